@@ -0,0 +1,279 @@
+#include "animation.h"
+#include "leds.h" //builds each step with the LED frame functions from leds.c/h
+#include "ball.h" //times each step from the kinematics in ball.c/h
+#include "game_logic.h" //raises the ball event where a segment ends, see game_logic.c/h
+/**
+**************************************************************************************************
+* @file animation.c
+* @brief Source file for the DMA ball animation
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* When the ball is served or hit, START_BALL_ANIMATION() works out its whole run up to the next
+* hitzone, and the one step after it into the MISS zone, in the main loop: for every step, the
+* BSRR word each LED port gets and the TIM2 reload up to the following step. TIM2 then paces
+* four DMA1 channels that store those words on every update, so the ball crosses the board
+* without a single interrupt. The CPU wakes when a segment's last step lands
+* (DMA1_Channel2_IRQHandler): once in the hitzone and once more in the MISS zone.
+*
+*	TIM2 request   DMA1 channel   stores to      priority
+*	CH3            1              GPIOA->BSRR    high
+*	CH1            5              GPIOB->BSRR    high
+*	CH2            7              GPIOC->BSRR    high
+*	UP             2              TIM2->ARR      low, so it finishes last and raises the interrupt
+* CCR1-3 are 0, so the compare requests come as CNT wraps, together with the update request.
+*
+* Every reload is a whole number of ticks, worked out from ball_phase and ball_velocity the way
+* BALL_TICK() would step them, so the ball steps on exactly the same ticks as it does with
+* BALL_ANIMATION_CPU. STOP_BALL_ANIMATION() puts TIM2 back to ticking on the same tick grid.
+* LEDcount only moves at the end of a segment, where the hitzone or MISS zone event is raised.
+*
+*	Note: Enabled with BALL_ANIMATION_DMA (main.h or the compiler command line). The winner's
+*	      circle still flashes from TIM2_IRQHandler.
+*************************************************************************************************/
+#if BALL_ANIMATION == BALL_ANIMATION_DMA
+
+#define TICK_COUNTS (cntclk / BALL_TICK_HZ) //TIM2 counts per tick
+#define TIM2_DMA_REQUESTS ((1 << 8) | (1 << 9) | (1 << 10) | (1 << 11)) //UDE, CC1DE, CC2DE, CC3DE
+#define DMA_CCR_EN (1 << 0)
+#define DMA_CCR_TCIE (1 << 1)
+#define DMA_CCR_WORDS_TO_PERIPHERAL ((1 << 4) | (1 << 7) | (2 << 8) | (2 << 10)) //DIR, MINC, 32-bit PSIZE and MSIZE
+#define DMA_CCR_PRIORITY_HIGH (2 << 12)
+#define DMA_CSELR_TIM2 4 //CxS value that routes the channel's TIM2 request
+#define DMA_CHANNEL_FLAGS(n) (0xF << (4 * ((n) - 1))) //GIF, TCIF, HTIF and TEIF of channel n
+
+struct Animation_Channel{
+	DMA_Channel_TypeDef *channel;
+	uint32_t number; //1 to 7, for DMA1_CSELR and DMA1->ISR
+};
+
+//in LED_PORT_CONFIG order
+static const struct Animation_Channel port_channels[LED_PORTS_used] = {
+		{DMA1_Channel1, 1}, //GPIOA on TIM2_CH3
+		{DMA1_Channel5, 5}, //GPIOB on TIM2_CH1
+		{DMA1_Channel7, 7} //GPIOC on TIM2_CH2
+};
+static const struct Animation_Channel arr_channel = {DMA1_Channel2, ANIMATION_ARR_CHANNEL}; //TIM2->ARR on TIM2_UP
+
+_Static_assert(LED_PORTS_used == 3, "animation.c: one DMA channel per LED port");
+
+struct Ball_Animation ball_animation;
+
+//================================================================================================
+// select_request()
+// @parm: *c = channel to route
+// @return: none
+//================================================================================================
+static void select_request(const struct Animation_Channel *c)
+{
+	uint32_t shift = 4 * (c->number - 1);
+	DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~(0xF << shift)) | (DMA_CSELR_TIM2 << shift);
+}
+//================================================================================================
+// configure_ball_animation()
+// @parm: none
+// @return: none
+// 		Routes the TIM2 requests to their DMA1 channels and points each channel at its register.
+// 		Nothing moves until START_BALL_ANIMATION() enables the requests. Called after configureTIM2().
+//================================================================================================
+void configure_ball_animation(void)
+{
+	RCC->AHB1ENR |= (1 << 0); //Enable DMA1 clock
+	for (uint32_t i = 0; i < LED_PORTS_used; i++){
+		port_channels[i].channel->CCR = 0;
+		port_channels[i].channel->CPAR = DMA_ADDRESS(&LED_PORT_CONFIG[i].port->BSRR);
+		select_request(&port_channels[i]);
+	}
+	arr_channel.channel->CCR = 0;
+	arr_channel.channel->CPAR = DMA_ADDRESS(&TIM2->ARR);
+	select_request(&arr_channel);
+	TIM2->CCR1 = 0; //compare requests on every wrap
+	TIM2->CCR2 = 0;
+	TIM2->CCR3 = 0;
+	NVIC_SetPriority(DMA1_Channel2_IRQn, 2); //same level as the TIM2 tick it stands in for
+	NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+//================================================================================================
+// ticks_to_step()
+// @parm: *phase = Q16.16 LEDs travelled since the last step, left at its value after the next one
+// @return: ticks until the next step, at least one
+// 		BALL_TICK() adds ball_velocity every tick and steps once the phase reaches one LED; this
+// 		works out on which tick that happens with one division instead of a loop
+//================================================================================================
+static uint32_t ticks_to_step(uint32_t *phase)
+{
+	uint32_t ticks = 1;
+	if (*phase + ball_velocity < Q16_ONE){
+		ticks = (Q16_ONE - *phase + ball_velocity - 1) / ball_velocity;
+	}
+	*phase = *phase + ticks * ball_velocity - Q16_ONE;
+	return ticks;
+}
+//================================================================================================
+// build_segment()
+// @parm: *seg = segment to fill
+//        from = LED the ball starts on, to = LED it ends on
+//        *board_lit = board LED state before the first step, left at its state after the last
+//        *phase = ball phase after the step before the first one, left at its value after the last
+// @return: none
+// 		Each step is what MOVE_BALL() would commit: toggle the board LED, turn off the LED the ball
+// 		leaves and light the one it reaches, GAMEBOARD LEDs only
+//================================================================================================
+static void build_segment(struct Ball_Segment *seg, uint32_t from, uint32_t to, uint32_t *board_lit, uint32_t *phase)
+{
+	uint32_t position = from;
+	seg->steps = 0;
+	while (position != to){
+		struct LED_Frame frame = {0};
+		uint32_t next = (to > from) ? position + 1 : position - 1;
+		if (*board_lit){
+			LED_FRAME_OFF(&frame, &BoardLED);
+		}
+		else{
+			LED_FRAME_ON(&frame, &BoardLED);
+		}
+		*board_lit = !*board_lit;
+		if (position > RIGHT_HITZONE_POS && position < LEFT_HITZONE_POS){ //if the led is in the GAMEZONE
+			LED_FRAME_OFF(&frame, &LEDS[position]);
+		}
+		if (next > RIGHT_HITZONE_POS && next < LEFT_HITZONE_POS){
+			LED_FRAME_ON(&frame, &LEDS[next]);
+		}
+		for (uint32_t i = 0; i < LED_PORTS_used; i++){
+			seg->bsrr[i][seg->steps] = frame.bsrr[i];
+		}
+		seg->arr[seg->steps] = ticks_to_step(phase) * TICK_COUNTS - 1; //time to the step after this one
+		seg->steps++;
+		position = next;
+	}
+	seg->end_position = to;
+}
+//================================================================================================
+// arm_channel()
+// @parm: *c = channel, *words = words to store, one per step, count = number of steps
+//        ccr = channel configuration, without DMA_CCR_EN
+// @return: none
+//================================================================================================
+static void arm_channel(const struct Animation_Channel *c, const uint32_t *words, uint32_t count, uint32_t ccr)
+{
+	c->channel->CCR = 0; //CMAR and CNDTR only take a write while the channel is disabled
+	c->channel->CMAR = DMA_ADDRESS(words);
+	c->channel->CNDTR = count;
+	c->channel->CCR = ccr | DMA_CCR_EN;
+}
+//================================================================================================
+// arm_segment()
+// @parm: s = index into ball_animation.segments
+// @return: none
+// 		Sets the channels up to play the segment from the next TIM2 update on. Interrupts masked
+// 		or in DMA1_Channel2_IRQHandler.
+//================================================================================================
+static void arm_segment(uint32_t s)
+{
+	struct Ball_Segment *seg = &ball_animation.segments[s];
+	for (uint32_t i = 0; i < LED_PORTS_used; i++){
+		arm_channel(&port_channels[i], seg->bsrr[i], seg->steps, DMA_CCR_WORDS_TO_PERIPHERAL | DMA_CCR_PRIORITY_HIGH);
+	}
+	arm_channel(&arr_channel, seg->arr, seg->steps, DMA_CCR_WORDS_TO_PERIPHERAL | DMA_CCR_TCIE);
+	ball_animation.playing = s;
+}
+//================================================================================================
+// START_BALL_ANIMATION()
+// @parm: none
+// @return: none
+// 		Entry action of MOVE_RIGHT and MOVE_LEFT, after the serve or hit has set the rate with
+// 		SET_STEP_RATE() and started TIM2. Takes TIM2 off its tick, builds the segments from
+// 		LEDcount in the current direction with interrupts enabled, then hands the steps to DMA.
+// 		Main loop only.
+//================================================================================================
+void START_BALL_ANIMATION(void)
+{
+	STOP_BALL_ANIMATION(); //TIM2 must be ticking, so CNT counts from a tick
+	uint32_t hitzone = (direction == RIGHT) ? RIGHT_HITZONE_POS : LEFT_HITZONE_POS;
+	uint32_t miss = (direction == RIGHT) ? RIGHT_MISS_ZONE : LEFT_MISS_ZONE;
+	uint32_t from = LEDcount;
+	if (from == miss || !ball_velocity){ //nothing to play, keep ticking
+		return;
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIM2->DIER &= ~(1 << 0); //no more tick interrupts...
+	TIM2->ARR = 0xFFFFFFFF; //...and no wrap while the segments are built
+	uint32_t phase = ball_phase;
+	if (TIM2->SR & (1 << 0)){ //a tick came due just now, it is folded into the animation
+		TIM2->SR &= ~(1 << 0);
+		NVIC_ClearPendingIRQ(TIM2_IRQn);
+		phase += ball_velocity;
+	}
+	__set_PRIMASK(primask);
+
+	uint32_t board_lit = (BoardLED.port->ODR & BoardLED.mask) != 0;
+	uint32_t first = ticks_to_step(&phase) * TICK_COUNTS - 1;
+	uint32_t s = 0;
+	if (from != hitzone){
+		build_segment(&ball_animation.segments[s++], from, hitzone, &board_lit, &phase);
+	}
+	build_segment(&ball_animation.segments[s++], hitzone, miss, &board_lit, &phase);
+	ball_animation.segment_count = s;
+
+	__disable_irq();
+	arm_segment(0);
+	if (TIM2->CNT >= first){ //the build took longer than the wait for the first step
+		first = TIM2->CNT + 1;
+	}
+	TIM2->ARR = first;
+	ball_animation.active = 1;
+	TIM2->DIER |= TIM2_DMA_REQUESTS;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// STOP_BALL_ANIMATION()
+// @parm: none
+// @return: none
+// 		Stops the DMA and puts TIM2 back to interrupting on every tick. Every reload was a whole
+// 		number of ticks, so the ticks carry on from where they would have been. Called by
+// 		SET_STEP_RATE(), since a new rate makes the built segments stale.
+//================================================================================================
+void STOP_BALL_ANIMATION(void)
+{
+	if (!ball_animation.active){
+		return;
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TIM2->DIER &= ~TIM2_DMA_REQUESTS;
+	for (uint32_t i = 0; i < LED_PORTS_used; i++){
+		port_channels[i].channel->CCR = 0;
+	}
+	arr_channel.channel->CCR = 0;
+	DMA1->IFCR = DMA_CHANNEL_FLAGS(ANIMATION_ARR_CHANNEL); //drop an end of segment the ISR has not taken
+	NVIC_ClearPendingIRQ(DMA1_Channel2_IRQn);
+	TIM2->CNT %= TICK_COUNTS; //counts since the last tick
+	TIM2->ARR = TICK_COUNTS - 1;
+	TIM2->SR &= ~(1 << 0);
+	TIM2->DIER |= (1 << 0);
+	ball_animation.active = 0;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// BALL_SEGMENT_DONE()
+// @parm: none
+// @return: steps the segment moved the ball
+// 		Called from DMA1_Channel2_IRQHandler once the last step of a segment is out. Moves
+// 		LEDcount to where the ball now is, raises its hitzone or MISS zone event and sets up the
+// 		next segment, which is at least a tick away.
+//================================================================================================
+uint32_t BALL_SEGMENT_DONE(void)
+{
+	const struct Ball_Segment *seg = &ball_animation.segments[ball_animation.playing];
+	LEDcount = seg->end_position;
+	balls.step_us = usTimer; //stamped by BALL_ARRIVED() and logged by RECORD_SEGMENT()
+	BALL_ARRIVED(0); //see game_logic.c/h
+	ball_animation.segments_played++;
+	if (ball_animation.playing + 1 < ball_animation.segment_count){
+		arm_segment(ball_animation.playing + 1);
+	}
+	return seg->steps;
+}
+
+#endif /* BALL_ANIMATION */
@@ -0,0 +1,52 @@
+/**
+**************************************************************************************************
+* @file animation.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for animation.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the DMA animation engine that moves the ball between the hitzones without the CPU.
+* With BALL_ANIMATION_CPU the functions expand to nothing and animation.c is empty.
+**************************************************************************************************
+*/
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include "main.h"
+
+#define ANIMATION_STEPS (LEFT_HITZONE_POS - RIGHT_HITZONE_POS) //longest segment, one hitzone to the other
+#define ANIMATION_SEGMENTS 2 //up to the hitzone, then on into the MISS zone
+#define ANIMATION_ARR_CHANNEL 2 //DMA1 channel on TIM2_UP, raises DMA1_Channel2_IRQn at the end of a segment
+
+//One precomputed run of the ball, step by step. The BSRR words are kept one array per port
+//because each DMA channel walks one of them.
+struct Ball_Segment{
+	uint32_t bsrr[LED_PORTS_used][ANIMATION_STEPS]; //word stored to each LED port's BSRR at each step
+	uint32_t arr[ANIMATION_STEPS]; //word stored to TIM2->ARR at each step: counts to the next step, less one
+	uint32_t steps; //steps in the segment, 1 to ANIMATION_STEPS
+	uint32_t end_position; //LEDcount after the last step
+};
+
+struct Ball_Animation{
+	struct Ball_Segment segments[ANIMATION_SEGMENTS];
+	uint32_t segment_count; //segments built by START_BALL_ANIMATION()
+	volatile uint32_t playing; //segment the DMA channels are set up for
+	volatile uint32_t active; //1 while TIM2 paces the DMA instead of interrupting on every tick
+	uint32_t segments_played; //segments that ran to their last step
+};
+
+extern struct Ball_Animation ball_animation;
+
+#if BALL_ANIMATION == BALL_ANIMATION_DMA
+void configure_ball_animation(void);
+void START_BALL_ANIMATION(void);
+void STOP_BALL_ANIMATION(void);
+uint32_t BALL_SEGMENT_DONE(void);
+#else
+#define configure_ball_animation() ((void)0)
+#define START_BALL_ANIMATION() ((void)0)
+#define STOP_BALL_ANIMATION() ((void)0)
+#endif
+
+#endif /* ANIMATION_H_ */
@@ -0,0 +1,182 @@
+#include "ball.h"
+#include "game_logic.h" //steps the ball with HANDLE_GAME_LED_MOVEMENT from game_logic.c/h
+#include "animation.h" //a new rate stops the DMA animation, see animation.c/h
+/**
+**************************************************************************************************
+* @file ball.c
+* @brief Source file for the balls' fixed-point kinematics
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* TIM2 ticks at BALL_TICK_HZ whatever the speed. Every tick adds each ball's velocity (Q16.16
+* LEDs per tick) to its phase, and the ball steps to the next LED when the phase passes one, so
+* any speed up to BALL_TICK_HZ LEDs per second is exact on average and the ISR never divides.
+* The balls are kept as one array per property (struct Ball_Pool, main.h), so a tick is a single
+* branch-free pass down the phase and velocity arrays however many balls there are, and all of
+* the steps are drawn in one LED frame.
+*
+* How much faster each hit makes the ball comes from speed_curve[], a const table computed by the
+* preprocessor for the SPEED_CURVE chosen at build time. Entry n is how many PACE_STEPs the n-th
+* speed level adds to DEFAULT_SPEED, in Q16.16:
+*	SPEED_CURVE_LINEAR       n
+*	SPEED_CURVE_EXPONENTIAL  1 + g + g^2 + ... + g^(n-1), g = SPEED_CURVE_GROWTH
+*	SPEED_CURVE_CAPPED       n, up to SPEED_CURVE_CAP
+* The result is limited to MAX_SPEED, and pace stops at the last entry, so no number of hits can
+* overflow anything.
+**************************************************************************************************
+*/
+//--speed curve, all constant expressions---------------------------------------------------------
+#define Q16_MUL(a, b) (((uint64_t)(a) * (uint64_t)(b)) >> 16)
+#define GROWTH_1 ((uint64_t)SPEED_CURVE_GROWTH)
+#define GROWTH_2 Q16_MUL(GROWTH_1, GROWTH_1)
+#define GROWTH_4 Q16_MUL(GROWTH_2, GROWTH_2)
+#define GROWTH_8 Q16_MUL(GROWTH_4, GROWTH_4)
+#define GROWTH_16 Q16_MUL(GROWTH_8, GROWTH_8)
+#define GROWTH_32 Q16_MUL(GROWTH_16, GROWTH_16)
+#define GROWTH_BIT(n, bit) (((n) & (bit)) ? GROWTH_##bit : (uint64_t)Q16_ONE)
+#define GROWTH_POW(n) Q16_MUL(Q16_MUL(Q16_MUL(Q16_MUL(Q16_MUL(GROWTH_BIT(n, 1), GROWTH_BIT(n, 2)), \
+		GROWTH_BIT(n, 4)), GROWTH_BIT(n, 8)), GROWTH_BIT(n, 16)), GROWTH_BIT(n, 32)) //g^n, n < 64
+#define SHAPE_LIMIT ((uint64_t)BALL_TICK_HZ << 16) //past MAX_SPEED for any PACE_STEP, keeps entries in 32 bits
+
+#if SPEED_CURVE == SPEED_CURVE_EXPONENTIAL
+#define SPEED_SHAPE(n) (((GROWTH_POW(n) - Q16_ONE) << 16) / (GROWTH_1 - Q16_ONE))
+#elif SPEED_CURVE == SPEED_CURVE_CAPPED
+#define SPEED_SHAPE(n) ((uint64_t)((n) < SPEED_CURVE_CAP ? (n) : SPEED_CURVE_CAP) << 16)
+#else
+#define SPEED_SHAPE(n) ((uint64_t)(n) << 16)
+#endif
+
+#define SPEED_ENTRY(n) (uint32_t)(SPEED_SHAPE(n) < SHAPE_LIMIT ? SPEED_SHAPE(n) : SHAPE_LIMIT),
+#define SPEED_LEVELS_8(X, n) X(n) X(n + 1) X(n + 2) X(n + 3) X(n + 4) X(n + 5) X(n + 6) X(n + 7)
+static const uint32_t speed_curve[SPEED_LEVELS] = {
+		SPEED_LEVELS_8(SPEED_ENTRY, 0)  SPEED_LEVELS_8(SPEED_ENTRY, 8)
+		SPEED_LEVELS_8(SPEED_ENTRY, 16) SPEED_LEVELS_8(SPEED_ENTRY, 24)
+		SPEED_LEVELS_8(SPEED_ENTRY, 32) SPEED_LEVELS_8(SPEED_ENTRY, 40)
+		SPEED_LEVELS_8(SPEED_ENTRY, 48) SPEED_LEVELS_8(SPEED_ENTRY, 56)
+};
+
+_Static_assert(SPEED_LEVELS == 64, "ball.c: speed_curve[] and GROWTH_POW() are written out for 64 levels");
+_Static_assert(SPEED_CURVE != SPEED_CURVE_EXPONENTIAL || SPEED_CURVE_GROWTH > Q16_ONE,
+		"main.h: SPEED_CURVE_GROWTH must be above 1.0");
+_Static_assert(SPEED_CURVE != SPEED_CURVE_EXPONENTIAL || GROWTH_32 < ((uint64_t)1 << 40),
+		"main.h: SPEED_CURVE_GROWTH is too large for 64 speed levels");
+
+//================================================================================================
+// BALL_SPEED()
+// @parm: level = speed level, as counted by pace
+// @return: ball speed at that level, Q16.16 LEDs per second
+// 		DEFAULT_SPEED plus the curve's PACE_STEPs, limited to MAX_SPEED. Read from tuning, so
+// 		the sweep can change the constants at run time.
+//================================================================================================
+uint32_t BALL_SPEED(uint32_t level)
+{
+	if (level >= SPEED_LEVELS){
+		level = SPEED_LEVELS - 1;
+	}
+	uint64_t speed = ((uint64_t)tuning.default_speed << 16) + (uint64_t)tuning.pace_step * speed_curve[level];
+	uint64_t max = (uint64_t)tuning.max_speed << 16;
+	if (speed > max){
+		speed = max;
+	}
+	return (speed < BALL_RATE_LIMIT) ? (uint32_t)speed : BALL_RATE_LIMIT;
+}
+//================================================================================================
+// SET_STEP_RATE()
+// @parm: ball = ball to set, 0 for the served ball (or the winner's display)
+//        rate = steps per second, Q16.16, limited to BALL_RATE_LIMIT
+// @return: none
+// 		Sets how often BALL_TICK() steps the ball and restarts its count to the next step, so the
+// 		first step at the new rate comes one full interval later. Main loop only; the one
+// 		division happens here rather than in the ISR. Any DMA animation was built for the old
+// 		rate, so it is stopped and TIM2 ticks again until START_BALL_ANIMATION().
+//================================================================================================
+void SET_STEP_RATE(uint32_t ball, uint32_t rate)
+{
+	STOP_BALL_ANIMATION(); //see animation.c/h
+	if (rate > BALL_RATE_LIMIT){
+		rate = BALL_RATE_LIMIT;
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //TIM2 must not add the old velocity to the new phase
+	balls.velocity[ball] = rate / BALL_TICK_HZ;
+	balls.phase[ball] = 0;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// SET_BALL_STATE()
+// @parm: ball = ball to move, state = its new rally state
+// @return: none
+// 		Keeps balls.state[] and the per-state masks in step, so the balls in a state can be
+// 		found without looking at every ball. Main loop only.
+//================================================================================================
+void SET_BALL_STATE(uint32_t ball, enum game_states state)
+{
+	balls.in_state[balls.state[ball]] &= ~(0x1u << ball);
+	balls.state[ball] = (uint8_t)state;
+	balls.in_state[state] |= 0x1u << ball;
+}
+//================================================================================================
+// JOIN_BALL()
+// @parm: ball = ball out of play, position / heading = where it starts and which way it goes
+//        state = its rally state
+// @return: none
+// 		Puts the ball in play at the slowest speed level. Main loop only.
+//================================================================================================
+void JOIN_BALL(uint32_t ball, uint32_t position, enum directions heading, enum game_states state)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //TIM2 sees the whole ball or none of it
+	balls.position[ball] = position;
+	balls.heading[ball] = heading;
+	balls.level[ball] = 0;
+	SET_STEP_RATE(ball, BALL_SPEED(0));
+	SET_BALL_STATE(ball, state);
+	balls.in_play |= 0x1u << ball;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RESET_BALLS()
+// @parm: none
+// @return: none
+// 		Takes every ball but the served one out of play and puts every rally state back to
+// 		INITIAL_SERVE. Ball 0 keeps its position and speed. Main loop only.
+//================================================================================================
+void RESET_BALLS(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint32_t k = 1; k < BALL_COUNT; k++){
+		balls.velocity[k] = 0;
+		balls.phase[k] = 0;
+	}
+	for (uint32_t k = 0; k < BALL_COUNT; k++){
+		balls.state[k] = INITIAL_SERVE;
+	}
+	for (uint32_t s = 0; s < NUM_of_GAME_STATES; s++){
+		balls.in_state[s] = 0;
+	}
+	balls.in_state[INITIAL_SERVE] = ALL_BALLS;
+	balls.in_play = 0x1;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// BALL_TICK()
+// @parm: none
+// @return: balls that stepped, bit k = ball k, 0 if none did
+// 		Called from TIM2_IRQHandler on every tick. Velocities are below one LED per tick, so
+// 		each ball steps at most once per tick and the carry out of its phase is the step.
+//================================================================================================
+uint32_t BALL_TICK(void)
+{
+	uint32_t stepped = 0;
+	for (uint32_t k = 0; k < BALL_COUNT; k++){
+		uint32_t phase = balls.phase[k] + balls.velocity[k];
+		balls.phase[k] = phase & (Q16_ONE - 1);
+		stepped |= (phase >> 16) << k;
+	}
+	if (stepped){
+		balls.step_us = usTimer; //stamped by BALL_ARRIVED() and logged by RECORD_BALL()
+		HANDLE_GAME_LED_MOVEMENT(stepped); //see game_logic.c/h
+	}
+	return stepped;
+}
@@ -0,0 +1,43 @@
+/**
+**************************************************************************************************
+* @file ball.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for ball.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the balls' fixed-point kinematics and the speed curve used by ball.c
+**************************************************************************************************
+*/
+#ifndef BALL_H_
+#define BALL_H_
+
+#include "main.h"
+
+#define Q16_ONE (0x1u << 16) //1.0 in Q16.16
+#define SPEED_LEVELS 64 //entries in the speed curve, pace stops rising at the last one
+#define BALL_TICK_us (usclk / BALL_TICK_HZ) //usTimer counts per tick
+#define BALL_RATE_LIMIT ((BALL_TICK_HZ << 16) - 1) //Q16.16 steps per second, just under one per tick
+#define ALL_BALLS ((uint32_t)((0x1ull << BALL_COUNT) - 1)) //every bit of a ball mask
+#define LOWEST_BALL(mask) ((uint32_t)__builtin_ctz(mask)) //first ball in a non-empty mask, RBIT and CLZ on the M4
+
+_Static_assert(cntclk % BALL_TICK_HZ == 0 && cntclk / BALL_TICK_HZ > 1
+		&& usclk % BALL_TICK_HZ == 0,
+		"main.h: TIM2 cannot tick at BALL_TICK_HZ");
+_Static_assert(IDLE_CLK_FREQ / BALL_TICK_HZ >= 100, "main.h: TIM2 ticks too fast to be served at the idle clock");
+_Static_assert(MAX_SPEED > 0 && MAX_SPEED < BALL_TICK_HZ, "main.h: MAX_SPEED must stay below one LED per tick");
+_Static_assert(BALL_COUNT >= 1 && BALL_COUNT <= 32, "main.h: BALL_COUNT must fit a 32-bit ball mask");
+_Static_assert(BALL_COUNT == 1 || BALL_ANIMATION == BALL_ANIMATION_CPU, "main.h: BALL_ANIMATION_DMA plays a single ball");
+_Static_assert(SPEED_CURVE == SPEED_CURVE_LINEAR || SPEED_CURVE == SPEED_CURVE_EXPONENTIAL
+		|| SPEED_CURVE == SPEED_CURVE_CAPPED, "unknown SPEED_CURVE");
+
+#define ball_phase (balls.phase[0]) //the served ball's, see struct Ball_Pool in main.h
+#define ball_velocity (balls.velocity[0])
+
+uint32_t BALL_SPEED(uint32_t level);
+void SET_STEP_RATE(uint32_t ball, uint32_t rate);
+void SET_BALL_STATE(uint32_t ball, enum game_states state);
+void JOIN_BALL(uint32_t ball, uint32_t position, enum directions heading, enum game_states state);
+void RESET_BALLS(void);
+uint32_t BALL_TICK(void);
+#endif /* BALL_H_ */
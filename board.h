@@ -0,0 +1,124 @@
+/**
+**************************************************************************************************
+* @file board.h
+* @brief Board description (LED wiring)
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header included by main.h
+* ------------------------------------------------------------------------------------------------
+* The only place the LED wiring is written down. Each entry is X(name, port letter, pin). The list
+* is expanded at compile time into the LED enum, the const LEDS[] table (main.c) and the per-port
+* configuration masks used by configure_LEDS() (leds.c). Wiring mistakes fail the build.
+* With LED_OUTPUT_STRIP (main.h) the GAMEBOARD row is BOARD_LENGTH pixels of one WS2812 strip
+* on PA7 instead, and only the POINTS displays and the board LED are GPIO pins.
+**************************************************************************************************
+*/
+#ifndef BOARD_H
+#define BOARD_H
+
+//GAMEBOARD row, indexed right to left: right MISS/HITZONE LEDs, GAMEBOARD LEDs, left HITZONE/MISS
+#define BOARD_RIGHT_END_LEDS(X) \
+	X(P2_MISS,      C, 8)  X(P2_HITZONE,   C, 9)
+#define BOARD_GAMEBOARD_LEDS(X) \
+	                                              X(GAMEBOARD_2,  C, 6)  X(GAMEBOARD_3,  B, 8)  \
+	X(GAMEBOARD_4,  C, 5)  X(GAMEBOARD_5,  B, 9)  X(GAMEBOARD_6,  A, 12) X(GAMEBOARD_7,  A, 11) \
+	X(GAMEBOARD_8,  A, 6)  X(GAMEBOARD_9,  B, 12) X(GAMEBOARD_10, A, 7)  X(GAMEBOARD_11, B, 11) \
+	X(GAMEBOARD_12, B, 6)  X(GAMEBOARD_13, C, 7)  X(GAMEBOARD_14, B, 2)  X(GAMEBOARD_15, A, 9)  \
+	X(GAMEBOARD_16, B, 1)  X(GAMEBOARD_17, A, 8)  X(GAMEBOARD_18, B, 15) X(GAMEBOARD_19, B, 10) \
+	X(GAMEBOARD_20, B, 14) X(GAMEBOARD_21, B, 4)
+#define BOARD_LEFT_END_LEDS(X) \
+	X(P1_HITZONE,   B, 13) X(P1_MISS,      B, 5)
+#define BOARD_ROW_LEDS(X) BOARD_RIGHT_END_LEDS(X) BOARD_GAMEBOARD_LEDS(X) BOARD_LEFT_END_LEDS(X)
+
+//POINTS displays, first point first
+#define BOARD_POINTS_LEDS(X) \
+	X(P1_POINT_1, C, 0)  X(P1_POINT_2, C, 3)  X(P1_POINT_3, C, 2) \
+	X(P2_POINT_1, C, 12) X(P2_POINT_2, C, 10) X(P2_POINT_3, C, 11)
+
+//Built-in LED (LD2) on the NUCLEO board
+#define BOARD_STATUS_LEDS(X) \
+	X(BOARD_LED, A, 5)
+
+#define BOARD_LEDS(X) BOARD_ROW_LEDS(X) BOARD_POINTS_LEDS(X) BOARD_STATUS_LEDS(X)
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+#define BOARD_GPIO_LEDS(X) BOARD_POINTS_LEDS(X) BOARD_STATUS_LEDS(X) //LEDs on GPIO pins
+#define BOARD_GPIO_GAMEBOARD_LEDS(X)
+#else
+#define BOARD_GPIO_LEDS(X) BOARD_LEDS(X)
+#define BOARD_GPIO_GAMEBOARD_LEDS(X) BOARD_GAMEBOARD_LEDS(X)
+#endif
+
+//Port letter -> slot in the LED tables and bit in RCC->AHB2ENR
+#define BOARD_PORT_A 0
+#define BOARD_PORT_B 1
+#define BOARD_PORT_C 2
+
+//Button pins, kept here so they can be checked against the LED wiring
+#define BOARD_BUTTON_PINS_A ((0x1u << 1) | (0x1u << 4)) //PA1 right button, PA4 left button
+#define BOARD_BUTTON_PINS_B 0u
+#define BOARD_BUTTON_PINS_C (0x1u << 13) //PC13 board button
+#define BOARD_STRIP_PINS_A (0x1u << 7) //PA7 SPI1_MOSI, the strip's data line with LED_OUTPUT_STRIP
+#define BOARD_LINK_PINS_A ((0x1u << 2) | (0x1u << 3)) //PA2 USART2_TX, PA3 USART2_RX with LINK_UART
+#define BOARD_LINK_PINS_C (0x1u << 1) //PC1 side strap with LINK_UART
+
+#define BOARD_LED_ENUM(name, port, pin) LED_##name,
+#define BOARD_COUNT(name, port, pin) + 1
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+enum board_leds { LED_P2_MISS = RIGHT_MISS_ZONE, LED_P2_HITZONE = RIGHT_HITZONE_POS, //strip pixels, one per position
+	LED_P1_HITZONE = LEFT_HITZONE_POS, LED_P1_MISS = LEFT_MISS_ZONE,
+	BOARD_POINTS_LEDS(BOARD_LED_ENUM) BOARD_STATUS_LEDS(BOARD_LED_ENUM) NUM_of_BOARD_LEDS };
+#define NUM_of_GAMEBOARD_ROW BOARD_LENGTH
+#else
+enum board_leds { BOARD_LEDS(BOARD_LED_ENUM) NUM_of_BOARD_LEDS };
+#define NUM_of_GAMEBOARD_ROW (0 BOARD_ROW_LEDS(BOARD_COUNT)) //MISS + HITZONE + GAMEBOARD LEDs
+#endif
+#define NUM_of_LEDS (NUM_of_GAMEBOARD_ROW BOARD_POINTS_LEDS(BOARD_COUNT)) //external LEDs
+
+//--per-port masks, all constant expressions----------------------------------------------------
+#define BOARD_PIN_IF(target, port, pin, value) ((BOARD_PORT_##port == (target)) ? (value) : 0u)
+#define BOARD_PINS_A(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_A, port, pin, 0x1u << (pin))
+#define BOARD_PINS_B(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_B, port, pin, 0x1u << (pin))
+#define BOARD_PINS_C(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_C, port, pin, 0x1u << (pin))
+#define BOARD_FIELDS_A(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_A, port, pin, 0x3u << (2 * (pin)))
+#define BOARD_FIELDS_B(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_B, port, pin, 0x3u << (2 * (pin)))
+#define BOARD_FIELDS_C(name, port, pin) | BOARD_PIN_IF(BOARD_PORT_C, port, pin, 0x3u << (2 * (pin)))
+#define BOARD_SUM_A(name, port, pin) + BOARD_PIN_IF(BOARD_PORT_A, port, pin, 0x1u << (pin))
+#define BOARD_SUM_B(name, port, pin) + BOARD_PIN_IF(BOARD_PORT_B, port, pin, 0x1u << (pin))
+#define BOARD_SUM_C(name, port, pin) + BOARD_PIN_IF(BOARD_PORT_C, port, pin, 0x1u << (pin))
+#define BOARD_BAD_PIN(name, port, pin) | ((pin) < 0 || (pin) > 15)
+
+#define GPIOA_LED_PINS (0u BOARD_GPIO_LEDS(BOARD_PINS_A)) //one bit per LED pin
+#define GPIOB_LED_PINS (0u BOARD_GPIO_LEDS(BOARD_PINS_B))
+#define GPIOC_LED_PINS (0u BOARD_GPIO_LEDS(BOARD_PINS_C))
+#define GPIOA_GAMEBOARD_PINS (0u BOARD_GPIO_GAMEBOARD_LEDS(BOARD_PINS_A)) //GAMEBOARD LEDs only
+#define GPIOB_GAMEBOARD_PINS (0u BOARD_GPIO_GAMEBOARD_LEDS(BOARD_PINS_B))
+#define GPIOC_GAMEBOARD_PINS (0u BOARD_GPIO_GAMEBOARD_LEDS(BOARD_PINS_C))
+#define GPIOA_LED_FIELDS (0u BOARD_GPIO_LEDS(BOARD_FIELDS_A)) //two bits per LED pin (MODER/OSPEEDR/PUPDR)
+#define GPIOB_LED_FIELDS (0u BOARD_GPIO_LEDS(BOARD_FIELDS_B))
+#define GPIOC_LED_FIELDS (0u BOARD_GPIO_LEDS(BOARD_FIELDS_C))
+
+//--consistency checks--------------------------------------------------------------------------
+_Static_assert((0 BOARD_GPIO_LEDS(BOARD_BAD_PIN)) == 0, "board.h: LED pin number out of range");
+_Static_assert((0u BOARD_GPIO_LEDS(BOARD_SUM_A)) == GPIOA_LED_PINS, "board.h: two LEDs share a GPIOA pin");
+_Static_assert((0u BOARD_GPIO_LEDS(BOARD_SUM_B)) == GPIOB_LED_PINS, "board.h: two LEDs share a GPIOB pin");
+_Static_assert((0u BOARD_GPIO_LEDS(BOARD_SUM_C)) == GPIOC_LED_PINS, "board.h: two LEDs share a GPIOC pin");
+_Static_assert((GPIOA_LED_PINS & BOARD_BUTTON_PINS_A) == 0, "board.h: LED wired to a GPIOA button pin");
+_Static_assert((GPIOB_LED_PINS & BOARD_BUTTON_PINS_B) == 0, "board.h: LED wired to a GPIOB button pin");
+_Static_assert((GPIOC_LED_PINS & BOARD_BUTTON_PINS_C) == 0, "board.h: LED wired to a GPIOC button pin");
+_Static_assert((GPIOA_LED_PINS & BOARD_LINK_PINS_A) == 0 && (GPIOC_LED_PINS & BOARD_LINK_PINS_C) == 0, "board.h: LED wired to a link pin");
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+_Static_assert((GPIOA_LED_PINS & BOARD_STRIP_PINS_A) == 0, "board.h: LED wired to the strip's data pin");
+#else
+_Static_assert(BOARD_LENGTH == NUM_of_GAMEBOARD_ROW, "main.h: BOARD_LENGTH differs from the wired row, it needs LED_OUTPUT_STRIP");
+_Static_assert(LED_P2_MISS == RIGHT_MISS_ZONE && LED_P2_HITZONE == RIGHT_HITZONE_POS,
+		"board.h: right end of the GAMEBOARD row does not match main.h");
+_Static_assert(LED_P1_HITZONE == LEFT_HITZONE_POS && LED_P1_MISS == LEFT_MISS_ZONE,
+		"board.h: left end of the GAMEBOARD row does not match main.h");
+_Static_assert(NUM_of_GAMEBOARD_ROW == LEFT_MISS_ZONE + 1, "board.h: GAMEBOARD row length does not match main.h");
+_Static_assert(LED_GAMEBOARD_2 == RIGHT_HITZONE_POS + 1 && LED_GAMEBOARD_21 == LEFT_HITZONE_POS - 1,
+		"board.h: GAMEBOARD LEDs are not between the two HITZONE LEDs");
+#endif
+_Static_assert(DEFAULT_POSITION > RIGHT_HITZONE_POS && DEFAULT_POSITION < LEFT_HITZONE_POS,
+		"main.h: DEFAULT_POSITION is not on the GAMEBOARD");
+
+#endif /* BOARD_H */
@@ -0,0 +1,245 @@
+#include "clock.h"
+#include "strip.h" //SPI1's bit time is re-derived with the rest, see strip.c/h
+#include "link.h" //USART2 keeps its HSI16 kernel clock at every speed, see link.c/h
+/**
+**************************************************************************************************
+* @file clock.c
+* @brief Source file for the core clock and its speeds
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* The core runs at PLAY_CLK_FREQ from the PLL while the ball is in play, and drops to
+* IDLE_CLK_FREQ for the time out and the winner's circle, when all it does is wait on timers.
+* Each speed is one row of clock_settings[], which also gives the regulator voltage range and
+* the flash wait states it needs. Going faster, the range and the wait states are raised before
+* the switch; going slower, they are lowered after it, so the flash is never read too fast.
+*
+* SET_CORE_CLOCK() only asks for a speed. The switch is made by the next SysTick_Handler, on the
+* millisecond boundary, with interrupts masked, and every timebase is re-derived there from the
+* new frequency:
+*	SysTick   LOAD for 1 ms, and VAL cleared so the next millisecond starts at the switch
+*	TIM2      PSC for cntclk, CNT kept, so the ball's tick keeps its phase
+*	TIM5      PSC for usclk, CNT kept, so usTimer runs on
+*	SPI1      BR for STRIP_SPI_HZ (LED_OUTPUT_STRIP), once the frame going out has finished
+* TIM2 and TIM5 lose at most the one count their prescalers were part way through, and msTimer
+* the time between the tick and the handler clearing VAL.
+*
+*	Note: SWO is clocked from HCLK as well, and its prescaler is the debugger's. A capture has to
+*	      be set up for PLAY_CLK_FREQ and only reads the profile while the ball is in play.
+*************************************************************************************************/
+#define CLOCK_SOURCE_MSI 0 //RCC->CFGR SW and SWS values
+#define CLOCK_SOURCE_HSI 1
+#define CLOCK_SOURCE_PLL 3
+#define CLOCK_RANGE(hz) ((hz) > 26000000 ? 1 : 2) //PWR->CR1 VOS: range 2 saves power up to 26 MHz
+#define FLASH_WAIT_STATES(hz) (CLOCK_RANGE(hz) == 1 ? ((hz) - 1) / 16000000 \
+		: (((hz) - 1) / 6000000 < 3 ? ((hz) - 1) / 6000000 : 3)) //RM0351 flash read access latency
+#define PLL_VCO(m, n) (HSI_FREQ / (m) * (n))
+#define PLL_HZ(m, n, r) (PLL_VCO(m, n) / (r))
+#define PLL_CFGR(m, n, r) ((((r) / 2 - 1) << 25) | (1 << 24) | ((n) << 8) | (((m) - 1) << 4) | 2) //PLLR, PLLREN, PLLN, PLLM, HSI16 in
+#define PLL_SETTING(m, n, r) { PLL_HZ(m, n, r), CLOCK_SOURCE_PLL, 0, PLL_CFGR(m, n, r), \
+		CLOCK_RANGE(PLL_HZ(m, n, r)), FLASH_WAIT_STATES(PLL_HZ(m, n, r)) }
+#define PLL_VALID(m, n, r) (HSI_FREQ / (m) >= 4000000 && HSI_FREQ / (m) <= 16000000 && PLL_VCO(m, n) >= 64000000 \
+		&& PLL_VCO(m, n) <= (CLOCK_RANGE(PLL_HZ(m, n, r)) == 1 ? 344000000 : 128000000))
+#define PLL_APPLY(macro, pll) macro(pll) //pll is "m, n, r", spread over macro's arguments
+#define MSI_SETTING(range, hz) { hz, CLOCK_SOURCE_MSI, range, 0, CLOCK_RANGE(hz), FLASH_WAIT_STATES(hz) }
+
+#define PLAY_PLL 2, 20, 2 //16 MHz / 2 * 20 = 160 MHz VCO, / 2
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+#define IDLE_PLL 2, 10, 4 //80 MHz VCO, / 4
+#define IDLE_SETTING PLL_APPLY(PLL_SETTING, IDLE_PLL)
+_Static_assert(PLL_APPLY(PLL_HZ, IDLE_PLL) == IDLE_CLK_FREQ && PLL_APPLY(PLL_VALID, IDLE_PLL), "clock.c: no PLL setting for IDLE_CLK_FREQ");
+#else
+#define IDLE_MSI_RANGE 4
+#define IDLE_SETTING MSI_SETTING(IDLE_MSI_RANGE, IDLE_CLK_FREQ)
+_Static_assert(IDLE_CLK_FREQ == 1000000, "clock.c: IDLE_CLK_FREQ is not MSI range IDLE_MSI_RANGE");
+#endif
+_Static_assert(PLL_APPLY(PLL_HZ, PLAY_PLL) == PLAY_CLK_FREQ && PLL_APPLY(PLL_VALID, PLAY_PLL), "clock.c: no PLL setting for PLAY_CLK_FREQ");
+
+//Everything that makes up one speed
+struct Clock_Setting{
+	uint32_t hz; //core clock
+	uint32_t source; //RCC->CFGR SW
+	uint32_t msi_range; //RCC->CR MSIRANGE, MSI source only
+	uint32_t pllcfgr; //RCC->PLLCFGR, PLL source only
+	uint32_t range; //PWR->CR1 VOS
+	uint32_t wait_states; //FLASH->ACR LATENCY
+};
+
+static const struct Clock_Setting clock_settings[NUM_of_CLOCK_SPEEDS] = {
+		[CLOCK_PLAY] = PLL_APPLY(PLL_SETTING, PLAY_PLL),
+		[CLOCK_IDLE] = IDLE_SETTING
+};
+
+struct Core_Clock core_clock;
+
+//================================================================================================
+// set_range()
+// @parm: range = PWR->CR1 VOS, 1 or 2
+// @return: none
+//================================================================================================
+static void set_range(uint32_t range)
+{
+	PWR->CR1 = (PWR->CR1 & ~(0x3 << 9)) | (range << 9);
+	CLOCK_WAIT(!(PWR->SR2 & (1 << 10))); //VOSF, the regulator has reached the range
+}
+//================================================================================================
+// set_wait_states()
+// @parm: wait_states = FLASH->ACR LATENCY
+// @return: none
+//================================================================================================
+static void set_wait_states(uint32_t wait_states)
+{
+	FLASH->ACR = (FLASH->ACR & ~0x7) | wait_states;
+	CLOCK_WAIT((FLASH->ACR & 0x7) == wait_states); //read back, so the flash uses it before the clock changes
+}
+//================================================================================================
+// select_source()
+// @parm: source = RCC->CFGR SW, which must already be ready
+// @return: none
+//================================================================================================
+static void select_source(uint32_t source)
+{
+	RCC->CFGR = (RCC->CFGR & ~0x3) | source;
+	CLOCK_WAIT(((RCC->CFGR >> 2) & 0x3) == source); //SWS, the core runs from it
+}
+//================================================================================================
+// switch_clock()
+// @parm: *s = speed to run at
+// @return: none
+// 		Brings the source up and moves the core onto it, with the range and wait states changed
+// 		on the side that keeps the flash within its limits. The PLL cannot be set up while the
+// 		core runs from it, so a PLL to PLL switch goes through HSI16.
+//================================================================================================
+static void switch_clock(const struct Clock_Setting *s)
+{
+	uint32_t faster = s->hz > core_clock.hz;
+	if (faster){
+		set_range(s->range);
+		set_wait_states(s->wait_states);
+	}
+	if (s->source == CLOCK_SOURCE_PLL){
+		RCC->CR |= (1 << 8); //HSION, the PLL's input
+		CLOCK_WAIT(RCC->CR & (1 << 10)); //HSIRDY
+		if (((RCC->CFGR >> 2) & 0x3) == CLOCK_SOURCE_PLL){
+			select_source(CLOCK_SOURCE_HSI);
+		}
+		RCC->CR &= ~(1 << 24); //PLLON
+		CLOCK_WAIT(!(RCC->CR & (1 << 25))); //PLLRDY
+		RCC->PLLCFGR = s->pllcfgr;
+		RCC->CR |= (1 << 24);
+		CLOCK_WAIT(RCC->CR & (1 << 25));
+		select_source(CLOCK_SOURCE_PLL);
+	}
+	else{
+		CLOCK_WAIT(RCC->CR & (1 << 1)); //MSI may only change range while it is ready (MSIRDY)
+		RCC->CR = (RCC->CR & ~(0xF << 4)) | (s->msi_range << 4) | (1 << 3); //MSIRANGE, MSIRGSEL = range set here
+		CLOCK_WAIT(RCC->CR & (1 << 1));
+		select_source(CLOCK_SOURCE_MSI);
+		RCC->CR &= ~((1 << 24) | (LINK_KEEPS_HSI16 ? 0 : (1 << 8))); //PLL off, and HSI16 unless USART2 runs from it
+	}
+	if (!faster){
+		set_wait_states(s->wait_states);
+		set_range(s->range);
+	}
+	core_clock.hz = s->hz;
+}
+//================================================================================================
+// retime_timer()
+// @parm: *tim = TIM2 or TIM5
+//        count_hz = rate the timer counts at
+// @return: none
+// 		New prescaler for the new clock, loaded at once by an update event. URS is set, so the
+// 		event raises no interrupt or DMA request, and CNT is put back as it was.
+//================================================================================================
+static void retime_timer(TIM_TypeDef *tim, uint32_t count_hz)
+{
+	uint32_t count = tim->CNT;
+	tim->PSC = core_clock.hz / count_hz - 1;
+	TIM_UPDATE_EVENT(tim);
+	tim->CNT = count;
+}
+//================================================================================================
+// configure_core_clock()
+// @parm: none
+// @return: none
+// 		Moves the core from the reset MSI clock to CLOCK_PLAY. Called before anything is timed
+// 		from the clock; the configure functions take their rates from core_clock.hz.
+//================================================================================================
+void configure_core_clock(void)
+{
+	RCC->APB1ENR1 |= (1 << 28); //Enable PWR clock, for the voltage range
+	core_clock.hz = MSI_RESET_FREQ;
+	switch_clock(&clock_settings[CLOCK_PLAY]);
+	core_clock.speed = CLOCK_PLAY;
+	core_clock.wanted = CLOCK_PLAY;
+	core_clock.since_ms = msTimer;
+}
+//================================================================================================
+// SET_CORE_CLOCK()
+// @parm: speed = speed to run at
+// @return: none
+// 		Asks for the speed. CORE_CLOCK_TICK() makes the switch on the next millisecond, so a
+// 		state's entry and exit actions can call it without touching any timer themselves.
+//================================================================================================
+void SET_CORE_CLOCK(enum clock_speeds speed)
+{
+	core_clock.wanted = speed;
+}
+//================================================================================================
+// CORE_CLOCK_TICK()
+// @parm: none
+// @return: none
+// 		Called from SysTick_Handler, just after msTimer has moved on. Makes the switch asked for,
+// 		if any, and re-derives every timebase (see top of file). A strip frame still going out
+// 		keeps the old clock until the tick after it is done.
+//================================================================================================
+void CORE_CLOCK_TICK(void)
+{
+	enum clock_speeds wanted = core_clock.wanted;
+	if (wanted == core_clock.speed){
+		return;
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //no frame can start from a higher priority handler once this is checked
+	if (STRIP_BUSY()){
+		__set_PRIMASK(primask);
+		return;
+	}
+	uint32_t ms = msTimer - core_clock.since_ms;
+	core_clock.ms[core_clock.speed] += ms;
+	core_clock.past_cycles += (uint64_t)ms * (core_clock.hz / 1000);
+	core_clock.since_ms = msTimer;
+
+	switch_clock(&clock_settings[wanted]);
+	core_clock.speed = wanted;
+	core_clock.switches++;
+	SysTick->LOAD = core_clock.hz / 1000 - 1;
+	SysTick->VAL = 0; //the millisecond just ticked, the next one starts now at the new rate
+	retime_timer(TIM2, cntclk);
+	retime_timer(TIM5, usclk);
+	STRIP_RETIME();
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// CORE_CYCLES()
+// @parm: none
+// @return: core cycles since configure_core_clock(), to the millisecond, at whatever speeds
+// 		the core ran
+//================================================================================================
+uint64_t CORE_CYCLES(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint64_t cycles = core_clock.past_cycles + (uint64_t)(msTimer - core_clock.since_ms) * (core_clock.hz / 1000);
+	__set_PRIMASK(primask);
+	return cycles;
+}
+//================================================================================================
+// CORE_CLOCK_HZ()
+// @parm: speed = one of the speeds
+// @return: core clock frequency at that speed
+//================================================================================================
+uint32_t CORE_CLOCK_HZ(enum clock_speeds speed)
+{
+	return clock_settings[speed].hz;
+}
@@ -0,0 +1,48 @@
+/**
+**************************************************************************************************
+* @file clock.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for clock.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the core clock speeds and the switch between them. HCLK, PCLK1 and PCLK2 always run at
+* the core clock (AHB and APB prescalers at 1), so every timer counts from core_clock.hz.
+**************************************************************************************************
+*/
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "main.h"
+
+#define HSI_FREQ 16000000 //HSI16, the PLL's input
+#define MSI_RESET_FREQ 4000000 //MSI range 6, what the core runs from out of reset
+
+enum clock_speeds { CLOCK_PLAY, CLOCK_IDLE, NUM_of_CLOCK_SPEEDS };
+
+//Every timebase is re-derived from the clock, so each speed must divide down to all of them
+#define CLOCK_DIVIDES(hz) ((hz) % 1000 == 0 && (hz) % cntclk == 0 && (hz) % usclk == 0)
+_Static_assert(CLOCK_DIVIDES(PLAY_CLK_FREQ) && CLOCK_DIVIDES(IDLE_CLK_FREQ),
+		"main.h: SysTick, TIM2 and TIM5 must count whole periods of every core clock");
+_Static_assert(IDLE_CLK_FREQ <= PLAY_CLK_FREQ && PLAY_CLK_FREQ <= 80000000, "main.h: core clock out of range");
+
+//The core clock as it is now, and where the time went
+struct Core_Clock{
+	volatile enum clock_speeds speed; //speed the core runs at
+	volatile enum clock_speeds wanted; //speed asked for by SET_CORE_CLOCK(), taken on the next SysTick
+	volatile uint32_t hz; //core clock frequency
+	uint32_t switches; //speed changes made since configure_core_clock()
+	uint32_t since_ms; //msTimer when the current speed was set
+	uint32_t ms[NUM_of_CLOCK_SPEEDS]; //time spent at each speed, up to since_ms
+	uint64_t past_cycles; //core cycles up to since_ms
+};
+
+extern struct Core_Clock core_clock;
+
+void configure_core_clock(void);
+void SET_CORE_CLOCK(enum clock_speeds speed);
+void CORE_CLOCK_TICK(void);
+uint64_t CORE_CYCLES(void);
+uint32_t CORE_CLOCK_HZ(enum clock_speeds speed);
+
+#endif /* CLOCK_H_ */
@@ -0,0 +1,243 @@
+#include "difficulty.h"
+#include "ball.h" //speed levels from ball.c/h
+/**
+**************************************************************************************************
+* @file difficulty.c
+* @brief Source file for the adaptive difficulty
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Fits the ball's speed to the two players at the board. Every press that returns the ball gives
+* its offset, the time from the ball reaching the player's hitzone (balls.hitzone_us[], stamped
+* by BALL_ARRIVED()) to the press's button edge. A miss counts as an offset of the whole time the
+* ball spent there, the player was at least that slow. Each player keeps, in Player.timing:
+*	a Welford mean and variance, with the count stopped at DIFFICULTY_MEMORY so older presses
+*	fade out and the numbers follow a player who warms up or tires
+*	a frugal (Frugal-2U) estimate of the 90th percentile: one value nudged up or down by each
+*	press, with a step that grows while it keeps moving the same way
+* Both are integer only and constant time, a few multiplies and one divide per press, and take 16
+* bytes a player: the variance sum counts squares of DIFFICULTY_M2_UNIT_us and the p90 step is
+* kept within DIFFICULTY_P90_STEP_LIMIT_us.
+*
+* At every serve DIFFICULTY_MATCHUP() works out, from whichever player is slower:
+*	the serve level, the fastest at which one deviation above their mean press still fits in
+*	the first half of the window, so the rally opens comfortably for both
+*	the limit level, the fastest at which their p90 press still fits in the window
+*	the step, the speed levels a hit adds so a rally reaches the limit in about DIFFICULTY_RALLY
+*	hits, 1 to DIFFICULTY_MAX_STEP
+* Two quick players get a fast serve and a steep climb, a beginner a slow serve and the usual
+* one level a hit. Until both players have DIFFICULTY_MIN_PRESSES presses, and after a reset,
+* the game plays the speed curve as written: serve at level 0, one level a hit.
+*
+*	Note: Enabled with ADAPTIVE_DIFFICULTY 1 (main.h or the compiler command line), which is the
+*	      default except with LINK_UART, where each board only times its own player and both
+*	      boards must serve alike. Runs from the main loop only, in HANDLE_GAME().
+*************************************************************************************************/
+#if ADAPTIVE_DIFFICULTY
+
+_Static_assert(LINK != LINK_UART, "main.h: ADAPTIVE_DIFFICULTY needs both players on this board");
+
+#define P90_THRESHOLD 58982 //0.9 in Q0.16, chance a press above the estimate moves it up
+#define M2_SHIFT 22 //from squares of 1/16 us to squares of DIFFICULTY_M2_UNIT_us, 2 * log2(16 * 128)
+#define M2_ROUND (0x1ull << (M2_SHIFT - 1))
+_Static_assert(DIFFICULTY_M2_UNIT_us * 16 == 0x1u << (M2_SHIFT / 2), "difficulty.c: M2_SHIFT must match DIFFICULTY_M2_UNIT_us");
+_Static_assert((uint64_t)DIFFICULTY_MEMORY * DIFFICULTY_OFFSET_LIMIT_us / DIFFICULTY_M2_UNIT_us
+		* DIFFICULTY_OFFSET_LIMIT_us / DIFFICULTY_M2_UNIT_us <= 0xFFFFFFFFull, "difficulty.c: Press_Stats.m2 can overflow");
+_Static_assert(DIFFICULTY_MEMORY <= 0xFF, "difficulty.c: Press_Stats.count is a uint8_t");
+
+struct Difficulty difficulty = { .serve_level = 0, .step = 1, .limit_level = 0, .rng = 0x2545F491 };
+
+//================================================================================================
+// random_q16()
+// @parm: none
+// @return: pseudo random number from 0 to 65535, xorshift32
+//================================================================================================
+static uint32_t random_q16(void)
+{
+	uint32_t x = difficulty.rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	difficulty.rng = x;
+	return x >> 16;
+}
+//================================================================================================
+// square_root()
+// @parm: n = number
+// @return: floor of its square root, bit by bit
+//================================================================================================
+static uint32_t square_root(uint64_t n)
+{
+	uint64_t root = 0;
+	for (uint64_t bit = 0x1ull << 62; bit; bit >>= 2){
+		if (n >= root + bit){
+			n -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else{
+			root >>= 1;
+		}
+	}
+	return (uint32_t)root;
+}
+//================================================================================================
+// add_offset()
+// @parm: *s = player's statistics
+//        offset_us = one press offset
+// @return: none
+// 		Adds the offset to the Welford mean and variance and nudges the p90 estimate.
+//================================================================================================
+static void add_offset(struct Press_Stats *s, uint32_t offset_us)
+{
+	if (offset_us > DIFFICULTY_OFFSET_LIMIT_us){
+		offset_us = DIFFICULTY_OFFSET_LIMIT_us;
+	}
+	if (s->count == 0){
+		s->p90_us = offset_us;
+		s->p90_step_us = DIFFICULTY_NUDGE_us;
+		s->p90_sign = 1;
+	}
+	if (s->count < DIFFICULTY_MEMORY){
+		s->count++;
+	}
+	else{
+		s->m2 -= s->m2 / s->count; //one press's worth of the oldest fades out
+	}
+	int32_t x = (int32_t)(offset_us << 4);
+	int32_t delta = x - s->mean_q4;
+	s->mean_q4 += delta / (int32_t)s->count;
+	int64_t spread = (int64_t)delta * (x - s->mean_q4); //never negative but for rounding
+	if (spread > 0){
+		s->m2 += (uint32_t)(((uint64_t)spread + M2_ROUND) >> M2_SHIFT);
+	}
+
+	int32_t m = (int32_t)s->p90_us, sample = (int32_t)offset_us, step = s->p90_step_us;
+	if (sample > m && random_q16() < P90_THRESHOLD){
+		step += (s->p90_sign > 0) ? DIFFICULTY_NUDGE_us : -DIFFICULTY_NUDGE_us;
+		m += (step > 0) ? step : DIFFICULTY_NUDGE_us;
+		s->p90_sign = 1;
+		if (m > sample){
+			step += sample - m;
+			m = sample;
+		}
+	}
+	else if (sample < m && random_q16() >= P90_THRESHOLD){
+		step += (s->p90_sign < 0) ? DIFFICULTY_NUDGE_us : -DIFFICULTY_NUDGE_us;
+		m -= (step > 0) ? step : DIFFICULTY_NUDGE_us;
+		s->p90_sign = -1;
+		if (m < sample){
+			step += m - sample;
+			m = sample;
+		}
+	}
+	if ((m - sample) * s->p90_sign < 0 && step > DIFFICULTY_NUDGE_us){
+		step = DIFFICULTY_NUDGE_us;
+	}
+	s->p90_step_us = (int16_t)((step > DIFFICULTY_P90_STEP_LIMIT_us) ? DIFFICULTY_P90_STEP_LIMIT_us
+			: (step < -DIFFICULTY_P90_STEP_LIMIT_us) ? -DIFFICULTY_P90_STEP_LIMIT_us : step);
+	s->p90_us = (m > 0) ? (uint32_t)m : 0;
+}
+//================================================================================================
+// fastest_level()
+// @parm: window_us = time the ball must spend in a hitzone
+// @return: highest speed level whose ball stays on one LED at least that long, 0 if none does
+//================================================================================================
+static uint32_t fastest_level(uint32_t window_us)
+{
+	uint64_t top_speed = ((uint64_t)usclk << 16) / (window_us ? window_us : 1); //Q16.16 LEDs per second
+	uint32_t level = 0;
+	while (level + 1 < SPEED_LEVELS && BALL_SPEED(level + 1) <= top_speed){
+		level++;
+	}
+	return level;
+}
+//================================================================================================
+// DIFFICULTY_HIT()
+// @parm: *p = player who returned the ball
+//        k = ball returned
+//        pressTIME_us = usTimer value of the press's button edge
+// @return: none
+// 		Called by the P1_RETURNS and P2_RETURNS actions. An edge before the ball arrived
+// 		(DEBOUNCE_DEFERRED decides 20 ms later) counts as 0.
+//================================================================================================
+void DIFFICULTY_HIT(struct Player *p, uint32_t k, uint32_t pressTIME_us)
+{
+	int32_t offset = (int32_t)(pressTIME_us - balls.hitzone_us[k]);
+	add_offset(&p->timing, (offset > 0) ? (uint32_t)offset : 0);
+}
+//================================================================================================
+// DIFFICULTY_MISS()
+// @parm: *p = player who let the ball past
+//        k = ball missed, just reported at the MISS zone
+// @return: none
+// 		Called by the P1_MISSES and P2_MISSES actions. Counts the time the ball spent in the
+// 		hitzone, up to its step into the MISS zone, so it does not depend on when the main loop
+// 		gets to the miss. A press before the ball arrived is no sign of being slow and is not
+// 		counted.
+//================================================================================================
+void DIFFICULTY_MISS(struct Player *p, uint32_t k)
+{
+	add_offset(&p->timing, balls.miss_zone_us[k] - balls.hitzone_us[k]);
+}
+//================================================================================================
+// DIFFICULTY_MATCHUP()
+// @parm: none
+// @return: none
+// 		Called by the SERVE action, before the ball is served at DIFFICULTY_SERVE_LEVEL().
+// 		Fits the serve level and step to the slower player.
+//================================================================================================
+void DIFFICULTY_MATCHUP(void)
+{
+	const struct Press_Stats *one = &P1.timing, *two = &P2.timing;
+	difficulty.serve_level = 0;
+	difficulty.step = 1;
+	difficulty.limit_level = 0;
+	if (one->count < DIFFICULTY_MIN_PRESSES || two->count < DIFFICULTY_MIN_PRESSES){
+		return;
+	}
+	uint32_t typical_one = PRESS_STATS_MEAN_us(one) + PRESS_STATS_DEVIATION_us(one);
+	uint32_t typical_two = PRESS_STATS_MEAN_us(two) + PRESS_STATS_DEVIATION_us(two);
+	uint32_t typical = (typical_one > typical_two) ? typical_one : typical_two;
+	uint32_t slow = (one->p90_us > two->p90_us) ? one->p90_us : two->p90_us;
+	uint32_t limit = fastest_level(slow);
+	uint32_t serve = fastest_level(2 * typical);
+	if (serve > limit){
+		serve = limit;
+	}
+	uint32_t step = (limit - serve + DIFFICULTY_RALLY - 1) / DIFFICULTY_RALLY;
+	difficulty.serve_level = serve;
+	difficulty.limit_level = limit;
+	difficulty.step = (step < 1) ? 1 : (step > DIFFICULTY_MAX_STEP) ? DIFFICULTY_MAX_STEP : step;
+}
+//================================================================================================
+// DIFFICULTY_RESET()
+// @parm: none
+// @return: none
+// 		Called by the RESET_GAME action: whoever plays next starts from the speed curve as
+// 		written.
+//================================================================================================
+void DIFFICULTY_RESET(void)
+{
+	P1.timing = (struct Press_Stats){0};
+	P2.timing = (struct Press_Stats){0};
+	DIFFICULTY_MATCHUP();
+}
+//================================================================================================
+// PRESS_STATS_MEAN_us()
+// @parm: *s = player's statistics
+// @return: mean press offset in us
+//================================================================================================
+uint32_t PRESS_STATS_MEAN_us(const struct Press_Stats *s)
+{
+	return (s->mean_q4 > 0) ? (uint32_t)(s->mean_q4 + 8) >> 4 : 0;
+}
+//================================================================================================
+// PRESS_STATS_DEVIATION_us()
+// @parm: *s = player's statistics
+// @return: standard deviation of the press offsets in us, 0 with fewer than two
+//================================================================================================
+uint32_t PRESS_STATS_DEVIATION_us(const struct Press_Stats *s)
+{
+	return (s->count < 2) ? 0 : square_root((uint64_t)s->m2 * DIFFICULTY_M2_UNIT_us * DIFFICULTY_M2_UNIT_us / (s->count - 1u));
+}
+#endif
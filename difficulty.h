@@ -0,0 +1,55 @@
+/**
+**************************************************************************************************
+* @file difficulty.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for difficulty.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the adaptive difficulty (ADAPTIVE_DIFFICULTY in main.h). With ADAPTIVE_DIFFICULTY 0 the
+* game serves at speed level 0 and every hit adds one level, as the speed curve was written for.
+**************************************************************************************************
+*/
+#ifndef DIFFICULTY_H_
+#define DIFFICULTY_H_
+
+#include "main.h"
+
+#define DIFFICULTY_MEMORY 32 //presses the statistics average over, older ones fade out
+#define DIFFICULTY_MIN_PRESSES 8 //presses each player needs before the game adapts to them
+#define DIFFICULTY_RALLY 8 //hits a rally should take to reach the slower player's limit
+#define DIFFICULTY_MAX_STEP 4 //most speed levels a hit may add
+#define DIFFICULTY_NUDGE_us 500 //step unit of the frugal p90 estimate
+#define DIFFICULTY_OFFSET_LIMIT_us 1000000 //longer offsets are counted as this
+#define DIFFICULTY_P90_STEP_LIMIT_us 32000 //largest step of the p90 estimate, either way, to fit an int16_t
+#define DIFFICULTY_M2_UNIT_us 128 //Press_Stats.m2 counts squares of this, so it fits 32 bits at any offset
+
+//Set at every serve from both players' statistics, see DIFFICULTY_MATCHUP()
+struct Difficulty{
+	uint32_t serve_level; //speed level the ball is served at
+	uint32_t step; //speed levels each successful hit adds
+	uint32_t limit_level; //level at which the slower player's p90 press fills the window
+	uint32_t rng; //xorshift32 state of the frugal estimators
+};
+
+#if ADAPTIVE_DIFFICULTY
+extern struct Difficulty difficulty;
+
+void DIFFICULTY_HIT(struct Player *p, uint32_t k, uint32_t pressTIME_us);
+void DIFFICULTY_MISS(struct Player *p, uint32_t k);
+void DIFFICULTY_MATCHUP(void);
+void DIFFICULTY_RESET(void);
+uint32_t PRESS_STATS_MEAN_us(const struct Press_Stats *s);
+uint32_t PRESS_STATS_DEVIATION_us(const struct Press_Stats *s);
+#define DIFFICULTY_SERVE_LEVEL() (difficulty.serve_level)
+#define DIFFICULTY_STEP() (difficulty.step)
+#else
+#define DIFFICULTY_HIT(p, k, pressTIME_us) ((void)0)
+#define DIFFICULTY_MISS(p, k) ((void)0)
+#define DIFFICULTY_MATCHUP() ((void)0)
+#define DIFFICULTY_RESET() ((void)0)
+#define DIFFICULTY_SERVE_LEVEL() 0
+#define DIFFICULTY_STEP() 1
+#endif
+
+#endif /* DIFFICULTY_H_ */
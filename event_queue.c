@@ -0,0 +1,53 @@
+#include "event_queue.h"
+/**
+**************************************************************************************************
+* @file event_queue.c
+* @brief Source file for the lock-free event queue
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Wait-free single-producer/single-consumer ring. The producer fills a slot before publishing it
+* by advancing head; the consumer copies a slot out before releasing it by advancing tail. The
+* data memory barriers keep those two steps in order.
+*************************************************************************************************/
+//================================================================================================
+// EVENT_QUEUE_PUSH()
+// @parm: *q = queue owned by the calling ISR
+//        type = event type
+//        timestamp = time of the event
+// @return: 1 if the event was queued, 0 if the queue was full (the event is counted in dropped)
+// 		Producer side. Never blocks, safe to call from exactly one ISR per queue.
+//================================================================================================
+uint32_t EVENT_QUEUE_PUSH(struct Event_Queue *q, uint32_t type, uint32_t timestamp)
+{
+	uint32_t head = q->head;
+	if (head - q->tail >= EVENT_QUEUE_SIZE){ //full
+		q->dropped++;
+		return 0;
+	}
+	struct Event *slot = &q->events[head & (EVENT_QUEUE_SIZE - 1)];
+	slot->type = type;
+	slot->timestamp = timestamp;
+	__DMB(); //slot contents must land before the new head
+	q->head = head + 1;
+	return 1;
+}
+//================================================================================================
+// EVENT_QUEUE_POP()
+// @parm: *q = queue to read
+//        *e = receives the oldest event
+// @return: 1 if an event was read, 0 if the queue was empty
+// 		Consumer side, called from the main loop only.
+//================================================================================================
+uint32_t EVENT_QUEUE_POP(struct Event_Queue *q, struct Event *e)
+{
+	uint32_t tail = q->tail;
+	if (tail == q->head){ //empty
+		return 0;
+	}
+	__DMB(); //read the slot only after seeing the head that published it
+	*e = q->events[tail & (EVENT_QUEUE_SIZE - 1)];
+	__DMB(); //finish reading before handing the slot back
+	q->tail = tail + 1;
+	return 1;
+}
@@ -0,0 +1,39 @@
+/**
+**************************************************************************************************
+* @file event_queue.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for event_queue.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the single-producer/single-consumer event ring used to pass events from an ISR to the
+* main loop without locks or disabling interrupts.
+**************************************************************************************************
+*/
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include "main.h"
+
+#define EVENT_QUEUE_SIZE 8 //slots per queue, must be a power of two
+
+_Static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "EVENT_QUEUE_SIZE must be a power of two");
+
+struct Event{
+	uint32_t type; //what happened (e.g. enum choices for button presses)
+	uint32_t timestamp; //when it happened
+};
+
+//One producer (a single ISR) and one consumer (the main loop). head is only written by the
+//producer and tail only by the consumer, so neither side ever waits for the other.
+struct Event_Queue{
+	struct Event events[EVENT_QUEUE_SIZE];
+	volatile uint32_t head; //next slot to write, free running
+	volatile uint32_t tail; //next slot to read, free running
+	volatile uint32_t dropped; //events refused because the queue was full
+};
+
+uint32_t EVENT_QUEUE_PUSH(struct Event_Queue *q, uint32_t type, uint32_t timestamp);
+uint32_t EVENT_QUEUE_POP(struct Event_Queue *q, struct Event *e);
+
+#endif /* EVENT_QUEUE_H_ */
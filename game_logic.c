@@ -1,166 +1,606 @@
 #include "game_logic.h"
 #include "leds.h" //uses LED related functions from leds.c/h
-#include "timers.h" //uses updateARR from timers.c/h
+#include "ball.h" //sets the ball speed with ball.c/h
+#include "animation.h" //hands the ball's run to DMA, see animation.c/h
+#include "power.h" //posts wake events from power.c/h
+#include "recorder.h" //logs timer expiries for replay, see recorder.c/h
+#include "clock.h" //slows the core while nothing moves, see clock.c/h
+#include "link.h" //shares the game with a second board, see link.c/h
+#include "stats_log.h" //counts hits and rounds for the lifetime statistics, see stats_log.c/h
+#include "latency.h" //files the press being timed as a return, see latency.c/h
+#include "difficulty.h" //fits the serve and speed-up to the players, see difficulty.c/h
+#include "shared_state.h" //publishes the state for the ISRs, see shared_state.c/h
 /**************************************************************************************************
 * @file game_logic.c
 * @brief  Source file for core game behavior and state transitions
 * @author: Justin Turner
 * @corresponding author: Jesse Garcia
 * ------------------------------------------------------------------------------------------------
-* Defines functions used for handling game logic and game related events
+* Defines functions used for handling game logic and game related events.
+*
+* game_state only changes in GAME_EVENT(), through the const game_transitions[][] table built
+* from GAME_TRANSITIONS below. Each state also has entry, exit and TIM2 step actions in
+* game_state_actions[]. Both tables are const and stay in flash. The consistency checks after
+* the tables fail the build on an unreachable state, a state with no way out, an event no state
+* handles or two rows for the same state and event.
+*
+* The table describes one ball. With BALL_COUNT above 1 every successful hit also serves another
+* ball, and each ball in play keeps its own rally state in balls.state[]: GAME_EVENT() works out
+* which ball an event is about, runs the table from that ball's state, and stores the result
+* back, so during a rally game_state is the state of the ball last handled. A miss by any ball
+* ends the round for all of them. A press goes to the ball in the player's hitzone or, failing
+* that, to one heading their way (an early press), picked from the per-state ball masks in
+* constant time however many balls there are.
+*
+* The ball events are raised where the ball moves, in TIM2_IRQHandler (MOVE_BALL()) or at the end
+* of a DMA segment (BALL_ARRIVED()), not found by looking at the positions from the main loop, so
+* however late the main loop runs and however fast the ball goes, every hitzone and MISS zone a
+* ball reaches is reported, in the order it reached them. A ball stops at the MISS zone at the
+* end of its run and waits there for HANDLE_GAME(), so it never leaves the board.
 **************************************************************************************************/
+struct Soft_Timer round_timer; //armed while a player is timed out or in the winner's circle
+static uint32_t ball; //ball the event being handled is about, set by GAME_EVENT()
+//Balls that reached an event's position and have not yet been offered to the game, one mask per
+//ball event, bit k = ball k. Set by TIM2_IRQHandler and DMA1_Channel2_IRQHandler, which share a
+//priority and so never interrupt each other, and taken by HANDLE_GAME().
+static volatile uint32_t arrivals[NUM_of_GAME_EVENTS];
+
+//================================================================================================
+// SPEED_UP()
+// @parm: none
+// @return: none
+//	Called on a successful hit. Moves the ball at its current pace from now on and raises its
+//	pace for the next hit by DIFFICULTY_STEP() levels of the speed curve (see ball.c), one
+//	without ADAPTIVE_DIFFICULTY.
+//================================================================================================
+static void SPEED_UP(void){
+	uint32_t level = balls.level[ball];
+	SET_STEP_RATE(ball, BALL_SPEED(level));
+	level += DIFFICULTY_STEP();
+	balls.level[ball] = (level < SPEED_LEVELS) ? level : SPEED_LEVELS - 1;
+}
+//================================================================================================
+// ADD_BALL()
+// @parm: heading - way the ball just hit is now going
+//        *frame - frame being built
+// @return: none
+//	Called on a successful hit. Serves a ball that is out of play, if any (never with
+//	BALL_COUNT 1), from DEFAULT_POSITION at the slowest pace, towards the same player.
+//================================================================================================
+static void ADD_BALL(enum directions heading, struct LED_Frame *frame){
+	uint32_t out = ~balls.in_play & ALL_BALLS;
+	if (out){
+		JOIN_BALL(LOWEST_BALL(out), DEFAULT_POSITION, heading, (heading == LEFT) ? MOVE_LEFT : MOVE_RIGHT);
+		LED_FRAME_ON(frame, &LEDS[DEFAULT_POSITION]);
+	}
+}
+
+//--transition actions----------------------------------------------------------------------------
+//Run by GAME_EVENT() before the state changes. arg is the event's argument. A nonzero return
+//takes the row's alt state instead of its next state.
+
+static uint32_t SERVE(uint32_t arg, struct LED_Frame *frame){
+	if (!LINK_SERVE(frame)){ //the other board is not ready yet, only with LINK_UART
+		return 1;
+	}
+	RESET_BALLS(); //only the served ball is in play
+	STATS_ROUND_START(); //see stats_log.c/h
+	LEDcount = current_saved_position;//Places the ball at the saved position
+	DIFFICULTY_MATCHUP(); //see difficulty.c/h
+	SET_STEP_RATE(0, BALL_SPEED(pace = DIFFICULTY_SERVE_LEVEL()));//reset speed, level 0 without ADAPTIVE_DIFFICULTY
+	startTIM2_MACRO;
+	HANDLE_HITZONE_LEDS(&P1, frame); //relight any HITZONE LED left off by a miss
+	HANDLE_HITZONE_LEDS(&P2, frame);
+	return 0;
+}
+static uint32_t P1_PRESSES(uint32_t arg, struct LED_Frame *frame){
+	PRESS_DETECTED(&P1, arg, frame);
+	return 0;
+}
+static uint32_t P2_PRESSES(uint32_t arg, struct LED_Frame *frame){
+	PRESS_DETECTED(&P2, arg, frame);
+	return 0;
+}
+static uint32_t P1_RETURNS(uint32_t arg, struct LED_Frame *frame){
+	PRESS_DETECTED(&P1, arg, frame);
+	if (balls.position[ball] != LEFT_HITZONE_POS){ //the ball has already left the HITZONE, not a hit
+		return 1;
+	}
+	STATS_HIT(ONE, ball, arg); //at the pace the ball came in at, before SPEED_UP()
+	LATENCY_RETURN(ONE); //see latency.c/h
+	DIFFICULTY_HIT(&P1, ball, arg); //see difficulty.c/h
+	SPEED_UP(); //increase speed
+	ADD_BALL(RIGHT, frame); //another ball, with BALL_COUNT above 1
+	return 0;
+}
+static uint32_t P2_RETURNS(uint32_t arg, struct LED_Frame *frame){
+	PRESS_DETECTED(&P2, arg, frame);
+	if (balls.position[ball] != RIGHT_HITZONE_POS){
+		return 1;
+	}
+	STATS_HIT(TWO, ball, arg);
+	LATENCY_RETURN(TWO);
+	DIFFICULTY_HIT(&P2, ball, arg);
+	SPEED_UP();
+	ADD_BALL(LEFT, frame);
+	return 0;
+}
+static uint32_t P1_MISSES(uint32_t arg, struct LED_Frame *frame){
+	DIFFICULTY_MISS(&P1, ball); //the whole window went by, see difficulty.c/h
+	return HANDLE_MISS(&P1, &P2, frame);
+}
+static uint32_t P2_MISSES(uint32_t arg, struct LED_Frame *frame){
+	DIFFICULTY_MISS(&P2, ball);
+	return HANDLE_MISS(&P2, &P1, frame);
+}
+static uint32_t P1_PRESSES_EARLY(uint32_t arg, struct LED_Frame *frame){ //pressed while the ball was still on its way
+	PRESS_DETECTED(&P1, arg, frame);
+	return HANDLE_MISS(&P1, &P2, frame);
+}
+static uint32_t P2_PRESSES_EARLY(uint32_t arg, struct LED_Frame *frame){ //you hit too early lose
+	PRESS_DETECTED(&P2, arg, frame);
+	return HANDLE_MISS(&P2, &P1, frame);
+}
+static uint32_t RESET_GAME(uint32_t arg, struct LED_Frame *frame){
+	LEDcount = (current_saved_position); //saves the LEDcount position from the MOVE_MODE - Will be used in the first round for the PLAY MODE
+	stopTIM2_MACRO; //stop the timer
+	RESET_BALLS(); //every ball but the served one leaves the board
+	CANCEL_TIMER(&round_timer); //abandon any time out or winner's circle
+	TURN_OFF_POINTS_DISPLAY(&P1, frame);
+	TURN_OFF_POINTS_DISPLAY(&P2, frame);
+	TURN_OFF_GAMEBOARD_LEDS(frame);
+	TURN_OFF_MISS_LEDS(&P1, &P2, frame);
+	LED_FRAME_ON(frame, P1.hitzoneLED); //force HITZONE LED on
+	LED_FRAME_ON(frame, P2.hitzoneLED);//force HITZONE LED on
+	P1.score = 0; //reset P1 score
+	P2.score = 0;//reset P2 score
+	DIFFICULTY_RESET(); //new players may be taking over, see difficulty.c/h
+	return 0;
+}
+
+//--entry, exit and TIM2 step actions-------------------------------------------------------------
+
+static void HEAD_RIGHT(struct LED_Frame *frame){
+	balls.heading[ball] = RIGHT;
+	START_BALL_ANIMATION(); //nothing with BALL_ANIMATION_CPU
+	LINK_LEG_START(); //a late press from the other board is replayed from here, only with LINK_UART
+}
+static void HEAD_LEFT(struct LED_Frame *frame){
+	balls.heading[ball] = LEFT;
+	START_BALL_ANIMATION();
+	LINK_LEG_START();
+}
+static void END_P1_TIME_OUT(struct LED_Frame *frame){
+	END_TIME_OUT(&P1, frame);
+}
+static void END_P2_TIME_OUT(struct LED_Frame *frame){
+	END_TIME_OUT(&P2, frame);
+}
+static void ENTER_P1_WINNERS_CIRCLE(struct LED_Frame *frame){
+	SET_UP_WINNERS_CIRCLE(&P1, frame);
+}
+static void ENTER_P2_WINNERS_CIRCLE(struct LED_Frame *frame){
+	SET_UP_WINNERS_CIRCLE(&P2, frame);
+}
+static void LEAVE_P1_WINNERS_CIRCLE(struct LED_Frame *frame){
+	LEAVE_WINNERS_CIRCLE(&P1, &P2, frame);
+}
+static void LEAVE_P2_WINNERS_CIRCLE(struct LED_Frame *frame){
+	LEAVE_WINNERS_CIRCLE(&P2, &P1, frame);
+}
+static void MOVE_BALL(uint32_t stepped, struct LED_Frame *frame){
+	LED_FRAME_TOGGLE(frame, &BoardLED);
+	for (uint32_t moving = stepped; moving; moving &= moving - 1){
+		uint32_t k = LOWEST_BALL(moving);
+		uint32_t position = balls.position[k];
+		if (position == ((balls.heading[k] == LEFT) ? LEFT_MISS_ZONE : RIGHT_MISS_ZONE)){ //the end of the board, wait there for HANDLE_GAME()
+			continue;
+		}
+		if (position > RIGHT_HITZONE_POS && position < LEFT_HITZONE_POS){ //if the led is in the GAMEZONE
+			LED_FRAME_OFF(frame, &LEDS[position]); //turn off current LED
+		}
+		switch(balls.heading[k]){ //increment or decrement the position based on the direction
+		case LEFT:
+			position++;//increment
+			break;
+		case RIGHT:
+			position--;//decrement
+			break;
+		}
+		balls.position[k] = position;
+		BALL_ARRIVED(k);
+	}
+	//turn on the new LEDs, and any that a ball just left while another ball is on it
+	for (uint32_t lit = balls.in_play; lit; lit &= lit - 1){
+		uint32_t position = balls.position[LOWEST_BALL(lit)];
+		if (position > RIGHT_HITZONE_POS && position < LEFT_HITZONE_POS){ //if the led is in the GAMEZONE
+			LED_FRAME_ON(frame, &LEDS[position]);
+		}
+	}
+}
+static void TOGGLE_P1_POINTS(uint32_t stepped, struct LED_Frame *frame){
+	TOGGLE_POINTS_DISPLAY(&P1, frame);
+}
+static void TOGGLE_P2_POINTS(uint32_t stepped, struct LED_Frame *frame){
+	TOGGLE_POINTS_DISPLAY(&P2, frame);
+}
+
+//--tables----------------------------------------------------------------------------------------
+//X(arg, state, event, action, next, alt): in state, event runs action (0 = none), then moves to
+//next, or to alt when the action returned nonzero. Moving to the state the game is already in
+//runs no exit or entry actions. Events a state does not list are ignored. arg is only passed
+//through for the consistency checks.
+#define GAME_TRANSITIONS(X, arg) \
+	X(arg, INITIAL_SERVE,     EV_PASS,                  SERVE,            MOVE_RIGHT,        INITIAL_SERVE)     \
+	X(arg, INITIAL_SERVE,     EV_P1_PRESS,              P1_PRESSES,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, INITIAL_SERVE,     EV_P2_PRESS,              P2_PRESSES,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, INITIAL_SERVE,     EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, MOVE_RIGHT,        EV_BALL_IN_RIGHT_HITZONE, 0,                RIGHT_HITZONE,     RIGHT_HITZONE)     \
+	X(arg, MOVE_RIGHT,        EV_P1_PRESS,              P1_PRESSES,       MOVE_RIGHT,        MOVE_RIGHT)        \
+	X(arg, MOVE_RIGHT,        EV_P2_PRESS,              P2_PRESSES_EARLY, P2_LOST,           P1_WINNERS_CIRCLE) \
+	X(arg, MOVE_RIGHT,        EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, RIGHT_HITZONE,     EV_BALL_PAST_RIGHT,       P2_MISSES,        P2_LOST,           P1_WINNERS_CIRCLE) \
+	X(arg, RIGHT_HITZONE,     EV_P1_PRESS,              P1_PRESSES,       RIGHT_HITZONE,     RIGHT_HITZONE)     \
+	X(arg, RIGHT_HITZONE,     EV_P2_PRESS,              P2_RETURNS,       MOVE_LEFT,         RIGHT_HITZONE)     \
+	X(arg, RIGHT_HITZONE,     EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, MOVE_LEFT,         EV_BALL_IN_LEFT_HITZONE,  0,                LEFT_HITZONE,      LEFT_HITZONE)      \
+	X(arg, MOVE_LEFT,         EV_P1_PRESS,              P1_PRESSES_EARLY, P1_LOST,           P2_WINNERS_CIRCLE) \
+	X(arg, MOVE_LEFT,         EV_P2_PRESS,              P2_PRESSES,       MOVE_LEFT,         MOVE_LEFT)         \
+	X(arg, MOVE_LEFT,         EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, LEFT_HITZONE,      EV_BALL_PAST_LEFT,        P1_MISSES,        P1_LOST,           P2_WINNERS_CIRCLE) \
+	X(arg, LEFT_HITZONE,      EV_P1_PRESS,              P1_RETURNS,       MOVE_RIGHT,        LEFT_HITZONE)      \
+	X(arg, LEFT_HITZONE,      EV_P2_PRESS,              P2_PRESSES,       LEFT_HITZONE,      LEFT_HITZONE)      \
+	X(arg, LEFT_HITZONE,      EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P1_LOST,           EV_ROUND_OVER,            0,                INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P1_LOST,           EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P2_LOST,           EV_ROUND_OVER,            0,                INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P2_LOST,           EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P1_WINNERS_CIRCLE, EV_ROUND_OVER,            0,                INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P1_WINNERS_CIRCLE, EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P2_WINNERS_CIRCLE, EV_ROUND_OVER,            0,                INITIAL_SERVE,     INITIAL_SERVE)     \
+	X(arg, P2_WINNERS_CIRCLE, EV_RESET,                 RESET_GAME,       INITIAL_SERVE,     INITIAL_SERVE)
+
+struct Game_Transition{
+	uint32_t (*action)(uint32_t arg, struct LED_Frame *frame); //0 = no action
+	uint8_t next; //enum game_states
+	uint8_t alt; //enum game_states, taken when action returns nonzero
+	uint8_t handled; //0 = the state ignores the event
+};
+
+struct Game_State_Actions{
+	void (*entry)(struct LED_Frame *frame); //0 = none
+	void (*exit)(struct LED_Frame *frame); //0 = none
+	void (*step)(uint32_t stepped, struct LED_Frame *frame); //called by HANDLE_GAME_LED_MOVEMENT() when balls step
+};
+
+#define GAME_TRANSITION_ENTRY(arg, state, event, action, next, alt) [state][event] = {action, next, alt, 1},
+static const struct Game_Transition game_transitions[NUM_of_GAME_STATES][NUM_of_GAME_EVENTS] = {
+	GAME_TRANSITIONS(GAME_TRANSITION_ENTRY, 0)
+};
+
+static const struct Game_State_Actions game_state_actions[NUM_of_GAME_STATES] = {
+	[INITIAL_SERVE]     = {0,                       0,                       MOVE_BALL},
+	[MOVE_RIGHT]        = {HEAD_RIGHT,              0,                       MOVE_BALL},
+	[RIGHT_HITZONE]     = {0,                       0,                       MOVE_BALL},
+	[MOVE_LEFT]         = {HEAD_LEFT,               0,                       MOVE_BALL},
+	[LEFT_HITZONE]      = {0,                       0,                       MOVE_BALL},
+	[P1_LOST]           = {TIME_OUT,                END_P1_TIME_OUT,         MOVE_BALL},
+	[P2_LOST]           = {TIME_OUT,                END_P2_TIME_OUT,         MOVE_BALL},
+	[P1_WINNERS_CIRCLE] = {ENTER_P1_WINNERS_CIRCLE, LEAVE_P1_WINNERS_CIRCLE, TOGGLE_P1_POINTS},
+	[P2_WINNERS_CIRCLE] = {ENTER_P2_WINNERS_CIRCLE, LEAVE_P2_WINNERS_CIRCLE, TOGGLE_P2_POINTS}
+};
+
+//What BALL_ARRIVED() raises for each GAMEBOARD position. Positions not listed are EV_PASS.
+static const uint8_t ball_events[NUM_of_GAMEBOARD_ROW] = {
+	[RIGHT_MISS_ZONE] = EV_BALL_PAST_RIGHT, [RIGHT_HITZONE_POS] = EV_BALL_IN_RIGHT_HITZONE,
+	[LEFT_HITZONE_POS] = EV_BALL_IN_LEFT_HITZONE, [LEFT_MISS_ZONE] = EV_BALL_PAST_LEFT
+};
+
+//The order HANDLE_GAME() offers the ball events in. A ball reaches its hitzone before the MISS
+//zone behind it, so a ball that has reached both is handled in the order it reached them.
+static const uint8_t ball_event_order[] = {
+	EV_BALL_IN_RIGHT_HITZONE, EV_BALL_IN_LEFT_HITZONE, EV_BALL_PAST_RIGHT, EV_BALL_PAST_LEFT
+};
+
+//--consistency checks, all constant expressions--------------------------------------------------
+#define ALL_GAME_STATES ((0x1u << NUM_of_GAME_STATES) - 1)
+#define ALL_GAME_EVENTS ((0x1u << NUM_of_GAME_EVENTS) - 1)
+//states reached in one more transition from the states in reached
+#define GAME_REACH(reached, state, event, action, next, alt) \
+	| ((((reached) >> (state)) & 0x1u) ? (0x1u << (next)) | (0x1u << (alt)) : 0u)
+#define GAME_REACH_STEP(reached) ((reached) GAME_TRANSITIONS(GAME_REACH, reached))
+#define GAME_LEAVES(unused, state, event, action, next, alt) \
+	| (((event) != EV_RESET && ((next) != (state) || (alt) != (state))) ? 0x1u << (state) : 0u)
+#define GAME_HANDLES(unused, state, event, action, next, alt) | (0x1u << (event))
+#define GAME_RESETS(unused, state, event, action, next, alt) \
+	| (((event) == EV_RESET && (next) == INITIAL_SERVE) ? 0x1u << (state) : 0u)
+#define GAME_ROW_OR(e, state, event, action, next, alt) | (((event) == (e)) ? 0x1u << (state) : 0u)
+#define GAME_ROW_SUM(e, state, event, action, next, alt) + (((event) == (e)) ? 0x1u << (state) : 0u)
+#define GAME_DUPLICATE_ROWS(event) \
+	| ((0u GAME_TRANSITIONS(GAME_ROW_SUM, event)) != (0u GAME_TRANSITIONS(GAME_ROW_OR, event)))
+
+enum game_reach { //one step per state is enough to reach every reachable state
+	GAME_REACH_0 = 0x1u << INITIAL_SERVE,
+	GAME_REACH_1 = GAME_REACH_STEP(GAME_REACH_0),
+	GAME_REACH_2 = GAME_REACH_STEP(GAME_REACH_1),
+	GAME_REACH_3 = GAME_REACH_STEP(GAME_REACH_2),
+	GAME_REACH_4 = GAME_REACH_STEP(GAME_REACH_3),
+	GAME_REACH_5 = GAME_REACH_STEP(GAME_REACH_4),
+	GAME_REACH_6 = GAME_REACH_STEP(GAME_REACH_5),
+	GAME_REACH_7 = GAME_REACH_STEP(GAME_REACH_6),
+	GAME_REACH_8 = GAME_REACH_STEP(GAME_REACH_7)
+};
+_Static_assert(NUM_of_GAME_STATES <= 9, "game_logic.c: add GAME_REACH steps for the new game states");
+_Static_assert(NUM_of_GAME_STATES <= 8 * sizeof(uint32_t) && NUM_of_GAME_EVENTS <= 8 * sizeof(uint32_t),
+		"game_logic.c: game states or events no longer fit the check masks");
+_Static_assert(EV_PASS == 0, "game_logic.h: ball_events[] relies on EV_PASS being 0");
+_Static_assert(GAME_REACH_8 == ALL_GAME_STATES, "game_logic.c: a game state cannot be reached from INITIAL_SERVE");
+_Static_assert((0u GAME_TRANSITIONS(GAME_LEAVES, 0)) == ALL_GAME_STATES, "game_logic.c: a game state has no way out other than EV_RESET");
+_Static_assert((0u GAME_TRANSITIONS(GAME_HANDLES, 0)) == ALL_GAME_EVENTS, "game_logic.c: no game state handles an event");
+_Static_assert((0u GAME_TRANSITIONS(GAME_RESETS, 0)) == ALL_GAME_STATES, "game_logic.c: EV_RESET does not reset every game state");
+_Static_assert((0 GAME_EVENTS(GAME_DUPLICATE_ROWS)) == 0, "game_logic.c: two GAME_TRANSITIONS rows for the same state and event");
+
+//================================================================================================
+// PRESSED_BALL()
+// @parm: hitzone - the player's hitzone state, heading - the state of a ball on its way to them
+// @return: ball a press by the player applies to
+//         The lowest ball in the player's hitzone, else the lowest on its way to them, else the
+//	   served ball, which is always in play. Two mask reads, whatever BALL_COUNT is.
+//================================================================================================
+static uint32_t PRESSED_BALL(enum game_states hitzone, enum game_states heading){
+	uint32_t candidates = balls.in_state[hitzone] ? balls.in_state[hitzone] : balls.in_state[heading];
+	return candidates ? LOWEST_BALL(candidates) : 0;
+}
+//================================================================================================
+// EVENT_BALL()
+// @parm: event, arg - as passed to GAME_EVENT()
+// @return: ball the event is about
+//================================================================================================
+static uint32_t EVENT_BALL(enum game_events event, uint32_t arg){
+	switch(event){
+	case EV_BALL_IN_RIGHT_HITZONE:
+	case EV_BALL_PAST_RIGHT:
+	case EV_BALL_IN_LEFT_HITZONE:
+	case EV_BALL_PAST_LEFT:
+		return arg;
+	case EV_P1_PRESS:
+		return PRESSED_BALL(LEFT_HITZONE, MOVE_LEFT);
+	case EV_P2_PRESS:
+		return PRESSED_BALL(RIGHT_HITZONE, MOVE_RIGHT);
+	default:
+		return 0;
+	}
+}
+//================================================================================================
+// GAME_EVENT()
+// @parm: event - what happened
+//        arg - event's argument (see enum game_events), 0 if it has none
+//        *frame - frame being built
+// @return: 1 if the current state handles the event, 0 if it ignores it
+//         The only place game_state changes. Looks up (game_state, event) in game_transitions[][],
+//	   runs the transition's action and, if the state changes, the old state's exit action and
+//	   the new state's entry action. During a rally game_state is first set to the state of the
+//	   ball the event is about, and the ball keeps the result. Publishes the new state for the
+//	   ISRs once the transition is complete (see shared_state.c). Main loop only.
+//================================================================================================
+uint32_t GAME_EVENT(enum game_events event, uint32_t arg, struct LED_Frame *frame){
+	ball = EVENT_BALL(event, arg);
+	if (IN_RALLY(game_state)){
+		game_state = (enum game_states)balls.state[ball]; //the rally as this ball sees it
+	}
+	const struct Game_Transition *t = &game_transitions[game_state][event];
+	if (!t->handled){
+		return 0;
+	}
+	enum game_states next = (enum game_states)((t->action && t->action(arg, frame)) ? t->alt : t->next);
+	if (next != game_state){
+		if (game_state_actions[game_state].exit){
+			game_state_actions[game_state].exit(frame);
+		}
+		game_state = next;
+		if (game_state_actions[next].entry){
+			game_state_actions[next].entry(frame);
+		}
+	}
+	if (IN_RALLY(game_state)){
+		SET_BALL_STATE(ball, game_state); //see ball.c/h
+	}
+	PUBLISH_GAME_STATE(); //the ISRs see the whole transition or none of it
+	return 1;
+}
+//================================================================================================
+// BALL_ARRIVED()
+// @parm: k - ball that has just moved onto balls.position[k]
+// @return: none
+//         Raises the position's ball event, if it has one, for HANDLE_GAME(), and notes when the
+//	   ball reached a hitzone, where reaction times and press offsets start, and a MISS zone,
+//	   where a missed ball's window ends (see stats_log.c and difficulty.c), at balls.step_us.
+//	   Called where the ball moves, which sets balls.step_us first:
+//	   TIM2_IRQHandler through MOVE_BALL(), and DMA1_Channel2_IRQHandler at the end of a segment
+//	   (see animation.c).
+//================================================================================================
+void BALL_ARRIVED(uint32_t k){
+	uint32_t position = balls.position[k];
+	if (position < NUM_of_GAMEBOARD_ROW && ball_events[position] != EV_PASS){
+		arrivals[ball_events[position]] |= 0x1u << k;
+	}
+	if (position == LEFT_HITZONE_POS || position == RIGHT_HITZONE_POS){
+		balls.hitzone_us[k] = balls.step_us;
+	}
+	else if (position == LEFT_MISS_ZONE || position == RIGHT_MISS_ZONE){
+		balls.miss_zone_us[k] = balls.step_us;
+	}
+}
 //================================================================================================
 // HANDLE_GAME()
 // @parm: none
 // @return: none
-//         Called when the system state is in PLAY_MODE. Handles majority of the game's
-//	   logic and systems
+//         Called when the system state is in PLAY_MODE. Offers the game the ball events raised
+//	   since the last pass, then, if none made a transition, the end of the round timer and then
+//	   a plain pass, stopping at the first of those the current state handles.
 //================================================================================================
 void HANDLE_GAME(void){
-	switch(game_state){
-	case INITIAL_SERVE:
-		LEDcount = current_saved_position;//Places the ball at the saved position
-		updateARR(pace = DEFAULT_SPEED);//reset speed
-		startTIM2_MACRO;
-		direction = RIGHT; //set direction right
-		game_state = MOVE_RIGHT;
-		break;
-	case MOVE_RIGHT://ball is moving right
-		if (LEDcount == RIGHT_HITZONE_POS ){ //if the ball has entered the right HITZONE
-			game_state =RIGHT_HITZONE; }//change gamestate to RIGHT_HITZONE
-		break;
-	case RIGHT_HITZONE: //ball is in right HITZONE
-		if (LEDcount == RIGHT_MISS_ZONE){ //the ball has left the HITZONE - right player "P2" missed
-			HANDLE_MISS(&P2, &P1, msTimer);}
-		break;
-	case MOVE_LEFT://ball is moving left
-		if (LEDcount == LEFT_HITZONE_POS){//if the ball has entered the left HITZONE
-			game_state = LEFT_HITZONE; }//change gamestate to LEFT_HITZONE
-		break;
-	case LEFT_HITZONE://ball is in left HITZONE
-		if (LEDcount == LEFT_MISS_ZONE){//the ball has left the HITZONE - left player "P1" missed
-			HANDLE_MISS(&P1, &P2, msTimer);}
-		break;
-	case P1_LOST://The left player "P1" missed has lost the round
-		TIME_OUT(&P1, msTimer); //enter timeout phase
-		break;
-	case P2_LOST://The right player "P2" missed has lost the round
-		TIME_OUT(&P2, msTimer); //enter timeout phase
-		break;
-	case P1_WINNERS_CIRCLE://The left player "P1" has won the game
-		IN_THE_WINNERS_CIRCLE(&P1, &P2, msTimer);
-		break;
-	case P2_WINNERS_CIRCLE://The right player "P2" has won the game
-		IN_THE_WINNERS_CIRCLE(&P2, &P1, msTimer);
-		break;
+	struct LED_Frame frame = {0}; //LED changes made by this pass, written out at the end
+	uint32_t handled = 0;
+	uint32_t taken[sizeof(ball_event_order)];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //an arrival raised meanwhile must not be cleared with the rest
+	for (uint32_t i = 0; i < sizeof(ball_event_order); i++){
+		taken[i] = arrivals[ball_event_order[i]];
+		arrivals[ball_event_order[i]] = 0;
 	}
+	__set_PRIMASK(primask);
+	for (uint32_t i = 0; i < sizeof(ball_event_order); i++){
+		enum game_events event = (enum game_events)ball_event_order[i];
+		if (LINK_REMOTE_EVENT(event)){ //the other board says when its player missed, see link.c
+			continue;
+		}
+		for (uint32_t arrived = taken[i] & balls.in_play; arrived; arrived &= arrived - 1){
+			if (GAME_EVENT(event, LOWEST_BALL(arrived), &frame)){
+				handled = 1;
+				LINK_REPORT(event); //tells the other board of a miss here, only with LINK_UART
+			}
+		}
+	}
+	const enum game_events offers[] = {
+		round_timer.armed ? EV_PASS : EV_ROUND_OVER,
+		EV_PASS
+	};
+	for (uint32_t i = 0; !handled && i < sizeof(offers) / sizeof(offers[0]); i++){
+		handled = GAME_EVENT(offers[i], 0, &frame);
+	}
+	COMMIT_LED_FRAME(&frame);
 }
 //================================================================================================
 // HANDLE_GAME_LED_MOVEMENT()
-// @parm: nonr
+// @parm: stepped - balls that moved on an LED, bit k = ball k
+// @return: none
+//         Called within TIM2, Handles the automated led movement/animation: moves the balls, or
+//	   flashes the winner's points display (the step action of the published state, see
+//	   shared_state.c).
+//================================================================================================
+void HANDLE_GAME_LED_MOVEMENT (uint32_t stepped){
+    struct LED_Frame frame = {0}; //every ball's step is written out with one commit
+    game_state_actions[GAME_STATE_SNAPSHOT()->game_state].step(stepped, &frame);
+    COMMIT_LED_FRAME(&frame);
+}
+//================================================================================================
+// HITZONE_TOGGLE_EXPIRED()
+// @parm: context - pointer to the Player struct whose hitzone_timer fired
+// @return: none
+//         Timer callback, runs in SysTick_Handler HITZONE_LED_TOGGLE_TIME after the player's last
+//	   press. Ends the toggle and turns the hitzone LED back on, going by the published state.
+//================================================================================================
+void HITZONE_TOGGLE_EXPIRED(void *context){
+	struct Player *p = context;
+	RECORD_TIMER(p->ID == ONE ? REC_P1_HITZONE_TIMER : REC_P2_HITZONE_TIMER);
+	p->pressTIME_STAMP = 0; //clear time stamp
+	p->pressedFLAG = 0; //clear press flag
+	if (GAME_STATE_SNAPSHOT()->system_state == PLAY_MODE){
+		struct LED_Frame frame = {0};
+		HANDLE_HITZONE_LEDS(p, &frame);
+		COMMIT_LED_FRAME(&frame);
+	}
+}
+//================================================================================================
+// ROUND_TIMER_EXPIRED()
+// @parm: context - unused
 // @return: none
-//         Called within TIM2, Handles the automated led movement/animation.
-//================================================================================================
-void HANDLE_GAME_LED_MOVEMENT (void){
-    switch(game_state){
-    	case P1_WINNERS_CIRCLE:
-    		TOGGLE_POINTS_DISPLAY(&P1);
-    		break;
-    	case P2_WINNERS_CIRCLE:
-    		TOGGLE_POINTS_DISPLAY(&P2);
-    		break;
-    	default: //game is not in a winner's state
-    		ToggleBoardLED_MACRO;
-    		if (LEDcount > 1 && LEDcount < 22){ //if the led is in the GAMEZONE
-     	    	   LEDS[LEDcount].port-> ODR &= ~(0x1 << LEDS[LEDcount].pin); //turn off current LED
-     	    }
-     	    switch(direction){ //increment or decrement the LEDcount based on the direction
-     	        case LEFT:
-     	        	LEDcount++;//increment
-     	        	break;
-     	        case RIGHT:
-     	        	LEDcount--;//decrement
-     	        	break;
-     	     }
-     	    if (LEDcount > 1 && LEDcount < 22){ //if the led is in the GAMEZONE
-     	       LEDS[LEDcount].port-> ODR |= (0x1 << LEDS[LEDcount].pin); //turn on the new LED
-     	    }
-     	    break;
-    }
+//         Timer callback for round_timer. Wakes the main loop so HANDLE_GAME() can report
+//	   EV_ROUND_OVER.
+//================================================================================================
+void ROUND_TIMER_EXPIRED(void *context){
+	(void)context;
+	RECORD_TIMER(REC_ROUND_TIMER);
+	POST_WAKE_EVENT(WAKE_TIMER);
 }
 //================================================================================================
 // PRESS_DETECTED()
 //
 // @parm: *p - pointer to the Player struct
-//        currentTIME_ms - current system time in milliseconds
+//        pressTIME_us - usTimer value of the press's button edge
+//        *frame - frame being built
 // @return: none
 //
 //         When a press is detected, this function sets the pressed flag, stores the press timestamp,
-//	   and turns off the player's hitzone LED to simulate a toggle behavior.
+//	   and turns off the player's hitzone LED to simulate a toggle behavior. The LED comes back
+//	   on HITZONE_LED_TOGGLE_TIME after the latest press (see HITZONE_TOGGLE_EXPIRED()).
 //================================================================================================
-void PRESS_DETECTED(struct Player *p, uint32_t currentTIME_ms){
+void PRESS_DETECTED(struct Player *p, uint32_t pressTIME_us, struct LED_Frame *frame){
 	p->pressedFLAG = 1;
-	p->pressTIME_STAMP = currentTIME_ms; //takes note current time
-	p->hitzoneLED.port-> ODR &= ~(0x1 <<   p->hitzoneLED.pin); //turn off hitzoneLED (simulate toggle behavior)
+	p->pressTIME_STAMP = pressTIME_us; //takes note of when the button went down
+	LED_FRAME_OFF(frame, p->hitzoneLED); //turn off hitzoneLED (simulate toggle behavior)
+	SCHEDULE_TIMER(&p->hitzone_timer, tuning.hitzone_toggle_ms, HITZONE_TOGGLE_EXPIRED, p);
 }
 //================================================================================================
 // UPDATE_SCORE()
 //
 // @parm: *p - pointer to the Player struct who lost the round
 //        *opp - pointer to the opposing Player struct
+//        *frame - frame being built
 // @return: none
 //
 //         Called when a player loses. Resets their score, updates the display, increments the
 //		   opponent's score, and sets the winner flag if needed.
 //================================================================================================
-void UPDATE_SCORE (struct Player *p, struct Player *opp){
+void UPDATE_SCORE (struct Player *p, struct Player *opp, struct LED_Frame *frame){
 	p->score=0;//take away the players points
-	TURN_OFF_POINTS_DISPLAY(p);//update player's points display
+	TURN_OFF_POINTS_DISPLAY(p, frame);//update player's points display
     opp->score++; //update opponents score
 	if(opp->score == 3){ //the opponent has reach 3 points they have won the game
 			opp->winnerFLAG=1;
 	}
-	UPDATE_POINTS_DISPLAY(opp); //update the opponent's points display
+	UPDATE_POINTS_DISPLAY(opp, frame); //update the opponent's points display
 }
 //================================================================================================
 // TIME_OUT()
 //
-// @parm: p* - pointer to the Player struct who timed out
-//        currentTIME_ms - current system time in milliseconds
+// @parm: *frame - frame being built
 // @return: none
 //
-//         Called when a player has lost a round. Temporarily turns off the GAMEBOARD LEDs and the
-//	   built-in board LED for a declared TIME_OUT_TIME. After the time out time has passed, resets the
-//	   player's miss flag, miss LED, and returns game state to INITIAL_SERVE.
+//         Entry action of P1_LOST and P2_LOST. Turns off the GAMEBOARD LEDs and the built-in board
+//	   LED, starts round_timer for TIME_OUT_TIME and drops the core to its idle clock.
 //================================================================================================
-void TIME_OUT (struct Player *p, uint32_t currentTIME_ms){
-	TURN_OFF_GAMEBOARD_LEDS();
-	TurnOffBoardLED_MACRO;
+void TIME_OUT (struct LED_Frame *frame){
+	SCHEDULE_TIMER(&round_timer, tuning.time_out_ms, ROUND_TIMER_EXPIRED, 0);
+	TURN_OFF_GAMEBOARD_LEDS(frame);
+	LED_FRAME_OFF(frame, &BoardLED);
 	stopTIM2_MACRO;
-	if (currentTIME_ms - p->missTIME_STAMP >= TIME_OUT_TIME){//if the time out time has passed
-		p->missFLAG = 0; //reset player miss flag
-		p->missTIME_STAMP = 0;	//clear miss timestamp
-		p->missLED.port-> ODR &= ~(0x1 <<   p->missLED.pin); //turn off miss LED
-		game_state = INITIAL_SERVE;
-	}
+	SET_CORE_CLOCK(CLOCK_IDLE);
+}
+//================================================================================================
+// END_TIME_OUT()
+//
+// @parm: *p - pointer to the Player struct who timed out
+//        *frame - frame being built
+// @return: none
+//
+//         Exit action of P1_LOST and P2_LOST. Resets the player's miss flag and miss LED, and
+//	   brings the core back up to its play clock.
+//================================================================================================
+void END_TIME_OUT (struct Player *p, struct LED_Frame *frame){
+	SET_CORE_CLOCK(CLOCK_PLAY);
+	p->missFLAG = 0; //reset player miss flag
+	LED_FRAME_OFF(frame, p->missLED); //turn off miss LED
 }
 //================================================================================================
 // SET_UP_WINNERS_CIRCLE()
 //
 // @parm: *p - pointer to the winning Player struct
-//        currentTIME_ms - current system time in milliseconds
+//        *frame - frame being built
 // @return: none
 //
-//         Prepares the system for the winner’s circle state by recording the timestamp of the win,
-//	   turning off LEDs, and reconfiguring TIM2 to display the animation of the points display
+//         Entry action of the winner's circle states. Arms the round timer for the win, turns off
+//	   LEDs, steps TIM2 at WINNERS_CIRCLE_FLASH_RATE to animate the points display and drops the
+//	   core to its idle clock
 //================================================================================================
-void SET_UP_WINNERS_CIRCLE(struct Player *p, uint32_t currentTIME_ms){
-	p->winnerTIME_STAMP = currentTIME_ms;//new
-	TURN_OFF_GAMEBOARD_LEDS();
-	stopTIM2_MACRO;
-	configureTIM2();
-	updateARR(8);
+void SET_UP_WINNERS_CIRCLE(struct Player *p, struct LED_Frame *frame){
+	SCHEDULE_TIMER(&round_timer, WINNERS_CIRCLE_TIME, ROUND_TIMER_EXPIRED, 0);
+	TURN_OFF_GAMEBOARD_LEDS(frame);
+	LED_FRAME_ON(frame, p->hitzoneLED); //force green HITZONE LED on
+	SET_STEP_RATE(0, WINNERS_CIRCLE_FLASH_RATE << 16);
 	startTIM2_MACRO;
+	SET_CORE_CLOCK(CLOCK_IDLE);
 }
 
 //================================================================================================
@@ -168,89 +608,39 @@ void SET_UP_WINNERS_CIRCLE(struct Player *p, uint32_t currentTIME_ms){
 //
 // @parm: *p - pointer to the Player struct who missed
 //        opp* - pointer to the opposing Player struct
-//        currentTIME_ms - current system time in milliseconds
-// @return: none
+//        *frame - frame being built
+// @return: 1 if the miss won the opponent the game, 0 otherwise
 //
-//         Called when a player misses. Updates miss timestamp and flag, turns on miss LED, calls
-//	   UPDATE_SCORE(), and changes game state. If the opponent has won, enters the winner's circle.
+//         Called when a player misses. Sets the miss flag, turns on miss LED and calls
+//	   UPDATE_SCORE(). The transition it is called from picks the lost or winner's circle state.
 //================================================================================================
-void HANDLE_MISS(struct Player *p, struct Player *opp, uint32_t currentTIME_ms){
-	p->hitzoneLED.port-> ODR &= ~(0x1 <<   p->hitzoneLED.pin); //force player HITZONE LED off
-	p->missTIME_STAMP = currentTIME_ms; //create timestamp for player miss, will be used to turn off the miss LED
+uint32_t HANDLE_MISS(struct Player *p, struct Player *opp, struct LED_Frame *frame){
+	LED_FRAME_OFF(frame, p->hitzoneLED); //force player HITZONE LED off
 	p->missFLAG = 1;
-	p->missLED.port-> ODR |= (0x1 <<   p->missLED.pin); //turn on player's miss LED
-	UPDATE_SCORE(p, opp);//reset the players score and display, and update opponent's score and display
+	LED_FRAME_ON(frame, p->missLED); //turn on player's miss LED
+	UPDATE_SCORE(p, opp, frame);//reset the players score and display, and update opponent's score and display
+	RESET_BALLS(); //the round is over for every ball
 	current_saved_position = DEFAULT_POSITION; //reset the ball position to the default.
-	if (opp->winnerFLAG == 1){ //if the opponets's winner flag was set in the UPDATE_SCORE function
-		SET_UP_WINNERS_CIRCLE(opp, currentTIME_ms); //setup the conditions for the winner's circle
-		if (opp->ID == TWO){//if the opponent is flagged as P2.....
-			game_state = P2_WINNERS_CIRCLE;
-			}
-		else{ //they are P1
-			game_state = P1_WINNERS_CIRCLE;
-		}
-	}
-	else{//the opponent has not reached 3 points yet
-		if (p->ID == TWO){//if the opponent is flagged as P2.....
-			game_state = P2_LOST;
-		}
-		else{//they are P1
-			game_state = P1_LOST;
-		}
-	}
+	STATS_ROUND_END(p->ID, opp->winnerFLAG); //log the round to flash, see stats_log.c/h
+	return opp->winnerFLAG; //set in the UPDATE_SCORE function if the opponent reached 3 points
 }
 //================================================================================================
-// IN_THE_WINNERS_CIRCLE()
+// LEAVE_WINNERS_CIRCLE()
 //
 // @parm: *p - pointer to the winning Player struct
 //        *opp - pointer to the opposing Player struct
-//        currentTIME_ms - current system time in milliseconds
+//        *frame - frame being built
 // @return: none
 //
-//         Waits 2.5 seconds after a player wins. Resets player score, LEDs, and sets game state
-//	   to INITIAL_SERVE to restart the game.
-//================================================================================================
-void IN_THE_WINNERS_CIRCLE(struct Player *p, struct Player *opp, uint32_t currentTIME_ms){
-	p->hitzoneLED.port-> ODR |= (0x1 <<   p->hitzoneLED.pin); //force green HITZONE LED on
-	if(currentTIME_ms - p->winnerTIME_STAMP >= WINNERS_CIRCLE_TIME){//Winner's circle time is up
-		stopTIM2_MACRO;
-		p->score = 0;//reset score back to 0
-		TURN_OFF_POINTS_DISPLAY(p); //turn off the winner's point's display
-		opp->missFLAG = 0; //reset opponent miss flag
-		opp->missLED.port-> ODR &= ~(0x1 <<   opp->missLED.pin); //turn off opponent miss LED
-		p->winnerTIME_STAMP = 0; //clear player win time stamp
-		p->winnerFLAG = 0;//clear player win flag stamp
-		game_state = INITIAL_SERVE;
-	}
+//         Exit action of the winner's circle states, run once WINNERS_CIRCLE_TIME is up. Resets
+//	   player score and LEDs, and the core's play clock, so the next game can start.
+//================================================================================================
+void LEAVE_WINNERS_CIRCLE(struct Player *p, struct Player *opp, struct LED_Frame *frame){
+	stopTIM2_MACRO;
+	SET_CORE_CLOCK(CLOCK_PLAY);
+	p->score = 0;//reset score back to 0
+	TURN_OFF_POINTS_DISPLAY(p, frame); //turn off the winner's point's display
+	opp->missFLAG = 0; //reset opponent miss flag
+	LED_FRAME_OFF(frame, opp->missLED); //turn off opponent miss LED
+	p->winnerFLAG = 0;//clear player win flag stamp
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -14,13 +14,41 @@
 
 #include "main.h"
 
+//Everything that can move the game from one state to another (see GAME_TRANSITIONS in
+//game_logic.c). EV_PASS must stay first: it is what a GAMEBOARD position with no event maps to.
+//The ball events' arg is the ball that moved, 0 for the served ball.
+#define GAME_EVENTS(X) \
+	X(EV_PASS)                  /* a main loop pass with nothing more specific to report */ \
+	X(EV_BALL_IN_RIGHT_HITZONE) /* a ball reached RIGHT_HITZONE_POS */ \
+	X(EV_BALL_PAST_RIGHT)       /* a ball reached RIGHT_MISS_ZONE */ \
+	X(EV_BALL_IN_LEFT_HITZONE)  /* a ball reached LEFT_HITZONE_POS */ \
+	X(EV_BALL_PAST_LEFT)        /* a ball reached LEFT_MISS_ZONE */ \
+	X(EV_ROUND_OVER)            /* round_timer is no longer armed */ \
+	X(EV_P1_PRESS)              /* left button press, arg = usTimer value of its edge */ \
+	X(EV_P2_PRESS)              /* right button press, arg = usTimer value of its edge */ \
+	X(EV_RESET)                 /* special button, back to INITIAL_SERVE from anywhere */
+
+#define GAME_EVENT_ENUM(name) name,
+enum game_events { GAME_EVENTS(GAME_EVENT_ENUM) NUM_of_GAME_EVENTS };
+
+//States in which the balls are on the board, each ball in one of them (see balls.state[])
+#define RALLY_STATES ((0x1u << MOVE_RIGHT) | (0x1u << RIGHT_HITZONE) | (0x1u << MOVE_LEFT) | (0x1u << LEFT_HITZONE))
+#define IN_RALLY(state) ((RALLY_STATES >> (state)) & 0x1u)
+
+extern struct Soft_Timer round_timer; //runs out TIME_OUT_TIME and WINNERS_CIRCLE_TIME
+
 //function prototypes
-void PRESS_DETECTED(struct Player *p, uint32_t currentTIME_ms);
-void UPDATE_SCORE(struct Player *p, struct Player *opp);
-void TIME_OUT(struct Player *p, uint32_t currentTIME_ms);
-void SET_UP_WINNERS_CIRCLE(struct Player *p, uint32_t currentTIME_ms);
-void HANDLE_MISS(struct Player *p, struct Player *opp, uint32_t currentTIME_ms);
-void IN_THE_WINNERS_CIRCLE(struct Player *p, struct Player *opp, uint32_t currentTIME_ms);
+void HITZONE_TOGGLE_EXPIRED(void *context);
+void ROUND_TIMER_EXPIRED(void *context);
+void PRESS_DETECTED(struct Player *p, uint32_t pressTIME_us, struct LED_Frame *frame);
+void UPDATE_SCORE(struct Player *p, struct Player *opp, struct LED_Frame *frame);
+void TIME_OUT(struct LED_Frame *frame);
+void END_TIME_OUT(struct Player *p, struct LED_Frame *frame);
+void SET_UP_WINNERS_CIRCLE(struct Player *p, struct LED_Frame *frame);
+uint32_t HANDLE_MISS(struct Player *p, struct Player *opp, struct LED_Frame *frame);
+void LEAVE_WINNERS_CIRCLE(struct Player *p, struct Player *opp, struct LED_Frame *frame);
+uint32_t GAME_EVENT(enum game_events event, uint32_t arg, struct LED_Frame *frame);
+void BALL_ARRIVED(uint32_t k);
 void HANDLE_GAME(void);
-void HANDLE_GAME_LED_MOVEMENT(void);
+void HANDLE_GAME_LED_MOVEMENT(uint32_t stepped);
 #endif /* GAME_LOGIC_H_ */
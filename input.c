@@ -1,7 +1,11 @@
 #include "input.h"
-#include "timers.h" //uses updateARR from timers.c/h
 #include "game_logic.h" //game related functions from game_logic.c/h
 #include "leds.h" //uses LED related functions from leds.c/h
+#include "power.h" //posts wake events from power.c/h
+#include "recorder.h" //logs presses for replay, see recorder.c/h
+#include "link.h" //a press also goes to the other board, see link.c/h
+#include "latency.h" //times presses to their LED commit, see latency.c/h
+#include "shared_state.h" //publishes the new mode for the ISRs, see shared_state.c/h
 /**************************************************************************************************
 * @file input.c
 * @brief Source file for button configuration, debouncing, and input handling logic
@@ -55,17 +59,81 @@ void configure_board_button (void){
 	NVIC_SetPriority(EXTI15_10_IRQn, 3);//pin 13 interrupt: priority level 2
 	NVIC_EnableIRQ(EXTI15_10_IRQn); //enable interrupt at pin 13
 }
+struct UserInput buttons[NUM_of_BUTTONS]; //Left, Right, Special
+struct Input_Latency input_latency;
+
 //================================================================================================
 // DEBOUNCE_PROTOCOL()
 // @parm: push_button = Pointer to the UserInput struct representing the button
-// 	  currentTIME_ms = Current system time in milliseconds.
+//        choice = Which button this is
+// 	  edgeTIME_us = usTimer value read in the EXTI handler
+// @return: none
+//	 Called from the button's EXTI handler. Never blocks.
+//	 - DEBOUNCE_DEFERRED: posts every edge and its timestamp to the button's queue; the main
+//	   loop starts the debounce from it.
+//	 - DEBOUNCE_LEADING_EDGE: the first edge is posted straight away as a press and the line is
+//	   locked. Edges are ignored until DEBOUNCE_SAMPLE() has seen the button released for
+//	   DEBOUNCE_DELAY samples in a row.
+//================================================================================================
+void DEBOUNCE_PROTOCOL(struct UserInput *push_button, enum choices choice, uint32_t edgeTIME_us){
+#if DEBOUNCE_MODE == DEBOUNCE_LEADING_EDGE
+	if (push_button->locked){ //still bouncing, or held down
+		push_button->bounces++;
+		return;
+	}
+	push_button->locked = 1;
+	push_button->history = DEBOUNCE_RELEASED_MASK; //count the release from the next sample on
+	SCHEDULE_TIMER(&push_button->debounce_timer, 1, DEBOUNCE_SAMPLE, push_button);
+#endif
+	LATENCY_EDGE(choice, edgeTIME_us); //only with LATENCY_STATS
+	EVENT_QUEUE_PUSH(&push_button->queue, choice, edgeTIME_us);
+	POST_WAKE_EVENT(WAKE_INPUT); //wake the main loop to drain the queue
+}
+//================================================================================================
+// DEBOUNCE_SAMPLE()
+// @parm: context - pointer to the UserInput struct of a locked button
 // @return: none
-//	 Flags the button press as pending and records the current time to track
-//       how long the button has been held.
+//	Timer callback, runs in SysTick_Handler every millisecond while a button is locked (leading
+//	edge mode only). Shifts the pin level into the button's history and unlocks the line once
+//	the last DEBOUNCE_DELAY samples all read released.
 //================================================================================================
-void DEBOUNCE_PROTOCOL(struct UserInput *push_button, uint32_t currentTIME_ms){
-	push_button->press_pending = 1; //flag that determines if a press is pending
-	push_button->debounce_counter = currentTIME_ms;//creates a timestamp for the debounce
+void DEBOUNCE_SAMPLE(void *context){
+	struct UserInput *push_button = context;
+	enum choices choice = (enum choices)(push_button - buttons + 1);
+	push_button->history = (push_button->history << 1) | BUTTON_IS_DOWN(choice);
+	if ((push_button->history & DEBOUNCE_RELEASED_MASK) == 0){ //released and stable
+		push_button->locked = 0;
+	}
+	else{
+		RESCHEDULE_TIMER(&push_button->debounce_timer, 1); //sample again next millisecond
+	}
+}
+//================================================================================================
+// BUTTON_IS_DOWN()
+// @parm: choice = button to read
+// @return: 1 if the button's pin currently reads pressed, 0 otherwise
+//================================================================================================
+uint32_t BUTTON_IS_DOWN(enum choices choice){
+	switch(choice){
+	case Left_Pushed:
+		return LeftButtonPressed;
+	case Right_Pushed:
+		return RightButtonPressed;
+	case Special_Pushed:
+		return SpecialButtonPressed;
+	}
+	return 0;
+}
+//================================================================================================
+// DEBOUNCE_EXPIRED()
+// @parm: context - unused
+// @return: none
+//	Timer callback (deferred mode), runs in SysTick_Handler once a button's debounce delay has
+//	passed. Wakes the main loop so HANDLE_DEBOUNCED_BUTTON() can process the press.
+//================================================================================================
+void DEBOUNCE_EXPIRED(void *context){
+	(void)context;
+	POST_WAKE_EVENT(WAKE_INPUT);
 }
 //================================================================================================
 // SPECIAL_BUTTON_ACTIONS()
@@ -74,18 +142,11 @@ void DEBOUNCE_PROTOCOL(struct UserInput *push_button, uint32_t currentTIME_ms){
 //	Used to switch game modes and cleanly reinitialize the game state.
 //================================================================================================
 void SPECIAL_BUTTON_ACTIONS(void){
-	LEDcount = (current_saved_position); //saves the LEDcount position from the MOVE_MODE - Will be used in the first round for the PLAY MODE
-	stopTIM2_MACRO; //stop the timer
-	TURN_OFF_POINTS_DISPLAY(&P1);
-	TURN_OFF_POINTS_DISPLAY(&P2);
-	TURN_OFF_GAMEBOARD_LEDS();
-	TURN_OFF_MISS_LEDS(&P1, &P2);
-	P1.hitzoneLED.port-> ODR |= (0x1 <<   P1.hitzoneLED.pin); //force HITZONE LED on
-	P2.hitzoneLED.port-> ODR |= (0x1 <<   P2.hitzoneLED.pin);//force HITZONE LED on
-	P1.score = 0; //reset P1 score
-	P2.score = 0;//reset P2 score
-	game_state = INITIAL_SERVE;
+	struct LED_Frame frame = {0}; //every LED reset is written out with one commit
+	GAME_EVENT(EV_RESET, 0, &frame); //back to INITIAL_SERVE from any game state, see game_logic.c
+	COMMIT_LED_FRAME(&frame);
 	system_state^=1; //toggle system state
+	PUBLISH_GAME_STATE(); //see shared_state.c/h
 }
 
 //================================================================================================
@@ -94,9 +155,69 @@ void SPECIAL_BUTTON_ACTIONS(void){
 // @parm: none
 // @return: none
 //
-//	Called when the button is finished deboucning. It determines which button was pressed
-//	(left, right, or special) and executes the appropriate behavior based on the current
-//	system state.
+//	Called when the main loop is woken by WAKE_INPUT. Drains each button's queue and processes
+//	every button whose debounce has finished, oldest first. In DEBOUNCE_DEFERRED mode a newer
+//	edge restarts that button's debounce timer; in DEBOUNCE_LEADING_EDGE mode a queued edge is
+//	already a press and is processed straight away. Each button is tracked separately, so
+//	presses by both players within the same DEBOUNCE_DELAY are both handled.
+//================================================================================================
+void HANDLE_DEBOUNCED_BUTTON(void){
+	struct Event edge;
+	for (uint32_t i = 0; i < NUM_of_BUTTONS; i++){
+		while (EVENT_QUEUE_POP(&buttons[i].queue, &edge)){
+			buttons[i].press_pending = 1; //flag that determines if a press is pending
+			buttons[i].debounce_counter = edge.timestamp;//creates a timestamp for the debounce
+#if DEBOUNCE_MODE == DEBOUNCE_DEFERRED
+			uint32_t elapsed = usTimer - edge.timestamp; //time the edge spent in the queue
+			uint32_t remaining_ms = (elapsed < DEBOUNCE_DELAY_us) ? (DEBOUNCE_DELAY_us - elapsed + 999) / 1000 : 0;
+			//one extra tick: the next SysTick may be only microseconds away
+			SCHEDULE_TIMER(&buttons[i].debounce_timer, remaining_ms + 1, DEBOUNCE_EXPIRED, 0);
+#endif
+		}
+	}
+	while (1){
+		int32_t oldest = -1;
+		for (uint32_t i = 0; i < NUM_of_BUTTONS; i++){
+			if (buttons[i].press_pending == 1 && (DEBOUNCE_MODE == DEBOUNCE_LEADING_EDGE
+					|| usTimer - buttons[i].debounce_counter >= DEBOUNCE_DELAY_us)){//if debouncing is finished...
+				if (oldest < 0 || buttons[i].debounce_counter - buttons[oldest].debounce_counter >= 0x80000000){
+					oldest = (int32_t)i; //earlier edge than the current pick
+				}
+			}
+		}
+		if (oldest < 0){
+			break;
+		}
+		buttons[oldest].press_pending = 0; // clear the pending flag
+#if DEBOUNCE_MODE == DEBOUNCE_DEFERRED
+		CANCEL_TIMER(&buttons[oldest].debounce_timer); //already handled, no need to wake again
+#endif
+		uint32_t latency = usTimer - buttons[oldest].debounce_counter; //edge to decision
+		input_latency.presses++;
+		input_latency.total_us += latency;
+		if (latency > input_latency.worst_us){
+			input_latency.worst_us = latency;
+		}
+		enum choices choice = (enum choices)(oldest + 1);
+		//(DOUBLE CHECKING) a deferred press must still be down. A leading edge is a press already,
+		//the contacts may be mid-bounce now and the line stays locked until it settles.
+		if (DEBOUNCE_MODE == DEBOUNCE_LEADING_EDGE || BUTTON_IS_DOWN(choice)){
+			RECORD_PRESS(choice, buttons[oldest].debounce_counter);
+			LATENCY_PRESS(choice, buttons[oldest].debounce_counter);
+			PROCESS_BUTTON_PRESS(choice, buttons[oldest].debounce_counter);
+		}
+	}
+}
+//================================================================================================
+// PROCESS_BUTTON_PRESS()
+//
+// @parm: choice = the button that finished debouncing
+//        pressTIME_us = usTimer value of the press's button edge
+// @return: none
+//
+//	Called when the button is finished deboucning (and, DEBOUNCE_DEFERRED, still reads pressed).
+//	It determines which button was pressed (left, right, or special) and executes the appropriate
+//	behavior based on the current system state. Does not read the pins, so a recording can be replayed through it.
 //	- In PLAY_MODE:
 //              Processes hit detection and scoring.
 //              Handles valid hits and missed hits
@@ -105,72 +226,48 @@ void SPECIAL_BUTTON_ACTIONS(void){
 //	- Special Button:
 //              Toggles game modes and handles resets.
 //================================================================================================
-void HANDLE_DEBOUNCED_BUTTON(void){
-	switch(button.choice){
+void PROCESS_BUTTON_PRESS(enum choices choice, uint32_t pressTIME_us){
+	struct LED_Frame frame = {0}; //LED changes caused by this press, written out at the end
+	switch(choice){
 	case Left_Pushed: //left button pressed
-		if (LeftButtonPressed){ //(DOUBLE CHECKING)if the left button is still pressed...
-			switch(system_state){
-			case PLAY_MODE: //if PLAY_MODE....
-				//--if the game is not in a winner's state.........
-				if(game_state!=P1_WINNERS_CIRCLE && game_state!=P2_WINNERS_CIRCLE && game_state!=P1_LOST && game_state!=P2_LOST){
-					PRESS_DETECTED(&P1, msTimer); //initial press actions
-				}
-				if (game_state == LEFT_HITZONE && LEDcount ==LEFT_HITZONE_POS){ //if valid hit detected....
-					updateARR(pace++); //increase speed
-					game_state = MOVE_RIGHT;
-					direction = RIGHT;
-				}
-				else if (game_state == MOVE_LEFT){ // if pressed while the ball was still moving towards HITZONE
-					HANDLE_MISS(&P1, &P2, msTimer);
-				}
-				break;
-			case MOVE_MODE: //if MOVE_MODE
-				LEDcount++; //move left/increment
-				if (LEDcount == 22){//if the LEDcount is 22
-					LEDcount = 2;//change it back to 2
-				}
-				//--calculate previous LED------------------------------------------------------------------------
-				//if LEDcount > 2, prevLED = LEDcount - 1, else the LEDcount is 2 the prevLED is 21
-				uint32_t prevLED = (LEDcount > 2)? LEDcount - 1: 21;
-				LEDS[prevLED].port-> ODR &= ~(0x1 << LEDS[prevLED].pin); //turn off the previous LED
-				break;
+		switch(system_state){
+		case PLAY_MODE: //if PLAY_MODE....
+			LINK_PRESS(EV_P1_PRESS, pressTIME_us, &frame); //hit, early press or just a toggle, see game_logic.c and link.c
+			break;
+		case MOVE_MODE: //if MOVE_MODE
+			LEDcount++; //move left/increment
+			if (LEDcount == LEFT_HITZONE_POS){//if the LEDcount reached the left HITZONE
+				LEDcount = RIGHT_HITZONE_POS + 1;//change it back to the first GAMEBOARD LED
 			}
+			//--calculate previous LED------------------------------------------------------------------------
+			//the LED to the right, or the last GAMEBOARD LED if the LEDcount wrapped round to the first
+			uint32_t prevLED = (LEDcount > RIGHT_HITZONE_POS + 1)? LEDcount - 1: LEFT_HITZONE_POS - 1;
+			LED_FRAME_OFF(&frame, &LEDS[prevLED]); //turn off the previous LED
+			break;
 		}
 		break;
 	case Right_Pushed: //right button pressed
-		if (RightButtonPressed){ //(DOUBLE CHECKING)if the left button is still pressed...
-			switch(system_state){
-			case PLAY_MODE:
-				if(game_state!=P1_WINNERS_CIRCLE && game_state!=P2_WINNERS_CIRCLE && game_state!=P1_LOST && game_state!=P2_LOST){
-					PRESS_DETECTED(&P2, msTimer); //initial press actions
-				}
-				if (game_state == RIGHT_HITZONE && LEDcount == RIGHT_HITZONE_POS){
-					updateARR(pace++);
-					game_state = MOVE_LEFT;
-					direction = LEFT;
-				}
-				else if (game_state == MOVE_RIGHT){ //you hit too early lose
-					HANDLE_MISS(&P2, &P1, msTimer);
-				}
-				break;
-			case MOVE_MODE:
-				LEDcount--;//move right/decrement
-				if (LEDcount == 1){//if the LEDcount is 1.....
-					LEDcount = 21;//change it back to 21
-				}
-				//--calculate previous LED------------------------------------------------------------------------
-				//if LEDcount < 21, prevLED = LEDcount + 1, else the LEDcount is 21 the prevLED is 2
-				uint32_t prevLED = (LEDcount < 21)? LEDcount + 1: 2;
-				LEDS[prevLED].port-> ODR &= ~(0x1 << LEDS[prevLED].pin); //turn off the previous LED
-				break;
-			}//end switch
-		}
+		switch(system_state){
+		case PLAY_MODE:
+			LINK_PRESS(EV_P2_PRESS, pressTIME_us, &frame);
+			break;
+		case MOVE_MODE:
+			LEDcount--;//move right/decrement
+			if (LEDcount == RIGHT_HITZONE_POS){//if the LEDcount reached the right HITZONE.....
+				LEDcount = LEFT_HITZONE_POS - 1;//change it back to the last GAMEBOARD LED
+			}
+			//--calculate previous LED------------------------------------------------------------------------
+			//the LED to the left, or the first GAMEBOARD LED if the LEDcount wrapped round to the last
+			uint32_t prevLED = (LEDcount < LEFT_HITZONE_POS - 1)? LEDcount + 1: RIGHT_HITZONE_POS + 1;
+			LED_FRAME_OFF(&frame, &LEDS[prevLED]); //turn off the previous LED
+			break;
+		}//end switch
 		break;
 	case Special_Pushed://board button pressed
-		if (SpecialButtonPressed){
-			SPECIAL_BUTTON_ACTIONS();
-		}
+		SPECIAL_BUTTON_ACTIONS();
+		LINK_SEND_RESET(); //the other board resets with this one, only with LINK_UART
 		break;
 	}
+	COMMIT_LED_FRAME(&frame);
+	LATENCY_COMMIT(); //the press has shown, see latency.c/h
 }
-
@@ -12,10 +12,43 @@
 #ifndef INPUT_H_
 #define INPUT_H_
 #include "main.h"
+#include "event_queue.h"
+
+#define DEBOUNCE_DELAY_us (tuning.debounce_ms * (usclk / 1000)) //debounce delay in usTimer counts
+#define DEBOUNCE_RELEASED_MASK ((0x1u << tuning.debounce_ms) - 1) //debounce delay's worth of samples
+
+_Static_assert(DEBOUNCE_MODE == DEBOUNCE_DEFERRED || DEBOUNCE_MODE == DEBOUNCE_LEADING_EDGE, "unknown DEBOUNCE_MODE");
+_Static_assert(DEBOUNCE_DELAY > 0 && DEBOUNCE_DELAY < 32, "DEBOUNCE_DELAY must fit the sample history");
+
+//One per button. Each EXTI handler is the only producer for its own queue, so presses on
+//different buttons never overwrite each other.
+struct UserInput{
+	struct Event_Queue queue; //edges posted by the button's EXTI handler
+	uint32_t debounce_counter; //time (us, from usTimer) of the newest edge seen by the main loop
+	uint32_t press_pending; //Flag for pending button press
+	struct Soft_Timer debounce_timer; //deferred: wakes the main loop, leading edge: samples the line
+	volatile uint32_t locked; //leading edge: a press was accepted and the line is not yet stable
+	uint32_t history; //leading edge: one pin sample per ms, newest in bit 0, 1 = pressed
+	volatile uint32_t bounces; //edges ignored while locked
+};
+
+//Time from a button edge to the main loop acting on it
+struct Input_Latency{
+	uint32_t presses; //presses handed to PROCESS_BUTTON_PRESS()
+	uint32_t worst_us; //longest edge-to-decision time
+	uint64_t total_us; //sum of edge-to-decision times, for the mean
+};
+
+extern struct UserInput buttons[NUM_of_BUTTONS]; //indexed by enum choices - 1
+extern struct Input_Latency input_latency;
 
 void configure_external_switches(void);
 void configure_board_button (void);
-void DEBOUNCE_PROTOCOL(struct UserInput *push_button, uint32_t currentTIME_ms);
+void DEBOUNCE_PROTOCOL(struct UserInput *push_button, enum choices choice, uint32_t edgeTIME_us);
+void DEBOUNCE_EXPIRED(void *context);
+void DEBOUNCE_SAMPLE(void *context);
+uint32_t BUTTON_IS_DOWN(enum choices choice);
 void SPECIAL_BUTTON_ACTIONS(void);
+void PROCESS_BUTTON_PRESS(enum choices choice, uint32_t pressTIME_us);
 void HANDLE_DEBOUNCED_BUTTON(void);
 #endif /* INPUT_H_ */
@@ -0,0 +1,167 @@
+#include "latency.h"
+#include "power.h" //idle_stats.sleeps, see power.c/h
+#include "clock.h" //core_clock.switches and .hz, see clock.c/h
+/**
+**************************************************************************************************
+* @file latency.c
+* @brief Source file for the press-to-feedback latency histograms
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Measures how long a press takes to show: from the button edge, stamped with DWT->CYCCNT in the
+* EXTI handler that queues it (LATENCY_EDGE()), to the LED commit at the end of
+* PROCESS_BUTTON_PRESS() (LATENCY_COMMIT()). Each press is filed under what it did, which the
+* main loop notes as it hands the press on (LATENCY_PRESS()) and the game upgrades on a hit
+* (LATENCY_RETURN()):
+*	LAT_HITZONE_OFF  a press in PLAY_MODE, the HITZONE LED turning off (PRESS_DETECTED())
+*	LAT_BALL_RETURN  the same for a press that returned the ball, which reverses with that commit
+*	LAT_MOVE_LED     a press in MOVE_MODE, the ball's LED moving
+*	LAT_MODE_SWITCH  the USER button, the LEDs reset by SPECIAL_BUTTON_ACTIONS()
+*
+* Every type keeps a log-linear histogram in ns (see latency.h), so LATENCY_PERCENTILE() gives the
+* p50 and p99 to within a bin, and the exact max and mean. The table stays in SRAM (latency) to be
+* read with the debugger after a session.
+*
+* DWT->CYCCNT stops while the core sleeps, and a cycle's length changes with the core clock. A
+* press during which the core slept (deferred debouncing always does) or changed speed is timed
+* from the usTimer edge timestamp instead, to the microsecond, and counted as coarse.
+*
+*	Note: Enabled with LATENCY_STATS 1 (main.h or the compiler command line). The edge stamp is
+*	      taken a few cycles after the edge, by the EXTI handler, so that much is left out.
+*************************************************************************************************/
+#if LATENCY_STATS
+
+struct Latency latency = { .pending_event = NUM_of_LATENCY_EVENTS };
+
+//================================================================================================
+// latency_bin()
+// @parm: ns = one latency
+// @return: histogram bin, see LATENCY_BINS
+//================================================================================================
+static uint32_t latency_bin(uint32_t ns)
+{
+	if (ns < (0x1u << (LATENCY_SUB_BITS + 1))){
+		return ns;
+	}
+	uint32_t shift = (32 - (uint32_t)__builtin_clz(ns)) - (LATENCY_SUB_BITS + 1);
+	return (shift << LATENCY_SUB_BITS) + (ns >> shift);
+}
+//================================================================================================
+// latency_bin_top()
+// @parm: bin = histogram bin
+// @return: largest ns the bin holds
+//================================================================================================
+static uint32_t latency_bin_top(uint32_t bin)
+{
+	if (bin < (0x1u << (LATENCY_SUB_BITS + 1))){
+		return bin;
+	}
+	uint32_t shift = (bin >> LATENCY_SUB_BITS) - 1;
+	uint64_t top = ((uint64_t)(bin - (shift << LATENCY_SUB_BITS) + 1) << shift) - 1;
+	return (top > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)top;
+}
+//================================================================================================
+// LATENCY_EDGE()
+// @parm: choice = button whose edge is being queued
+//        edgeTIME_us = usTimer value it is queued with
+// @return: none
+// 		Called from the button's EXTI handler, next to the EVENT_QUEUE_PUSH() of the edge.
+//================================================================================================
+void LATENCY_EDGE(enum choices choice, uint32_t edgeTIME_us)
+{
+	latency.edge[choice - 1] = (struct Latency_Edge){ DWT->CYCCNT, edgeTIME_us, idle_stats.sleeps, core_clock.switches };
+}
+//================================================================================================
+// LATENCY_PRESS()
+// @parm: choice = button whose press is about to be processed
+//        pressTIME_us = the press's timestamp, from the edge in the button's queue
+// @return: none
+// 		Main loop, just before PROCESS_BUTTON_PRESS(). Starts timing the press if the button's
+// 		stamp is still the press's own edge.
+//================================================================================================
+void LATENCY_PRESS(enum choices choice, uint32_t pressTIME_us)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //the EXTI handler may stamp a newer edge meanwhile
+	latency.pending = latency.edge[choice - 1];
+	__set_PRIMASK(primask);
+	if (latency.pending.us != pressTIME_us){
+		latency.unmatched++;
+		latency.pending_event = NUM_of_LATENCY_EVENTS;
+		return;
+	}
+	latency.pending_choice = choice;
+	latency.pending_event = (choice == Special_Pushed) ? LAT_MODE_SWITCH
+			: (system_state == MOVE_MODE) ? LAT_MOVE_LED : LAT_HITZONE_OFF;
+}
+//================================================================================================
+// LATENCY_RETURN()
+// @parm: id = player who returned the ball
+// @return: none
+// 		Called by the game on a successful hit. If it was the press being timed, that press
+// 		returned the ball. In linked play the other board's hits are played from HANDLE_GAME()
+// 		too, before this board's press.
+//================================================================================================
+void LATENCY_RETURN(enum identifications id)
+{
+	if (latency.pending_event == LAT_HITZONE_OFF && latency.pending_choice == ((id == ONE) ? Left_Pushed : Right_Pushed)){
+		latency.pending_event = LAT_BALL_RETURN;
+	}
+}
+//================================================================================================
+// LATENCY_COMMIT()
+// @parm: none
+// @return: none
+// 		Called straight after PROCESS_BUTTON_PRESS() commits its LED frame. Files the press
+// 		being timed, if any.
+//================================================================================================
+void LATENCY_COMMIT(void)
+{
+	uint32_t cycle = DWT->CYCCNT;
+	if (latency.pending_event == NUM_of_LATENCY_EVENTS){
+		return;
+	}
+	struct Latency_Stats *s = &latency.stats[latency.pending_event];
+	const struct Latency_Edge *edge = &latency.pending;
+	uint64_t ns;
+	if (edge->sleeps == idle_stats.sleeps && edge->switches == core_clock.switches){
+		ns = (uint64_t)(cycle - edge->cycle) * 1000 / (core_clock.hz / 1000000);
+	}
+	else{
+		ns = (uint64_t)(usTimer - edge->us) * 1000;
+		s->coarse++;
+	}
+	uint32_t t = (ns > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ns;
+	s->count++;
+	s->total_ns += t;
+	if (t > s->max_ns){
+		s->max_ns = t;
+	}
+	s->histogram[latency_bin(t)]++;
+	latency.pending_event = NUM_of_LATENCY_EVENTS;
+}
+//================================================================================================
+// LATENCY_PERCENTILE()
+// @parm: e = event type
+//        permille = 500 for the median, 990 for p99
+// @return: latency in ns that permille of the type's presses were within, to the top of its bin
+// 		and no more than the max. 0 with no presses.
+//================================================================================================
+uint32_t LATENCY_PERCENTILE(enum latency_events e, uint32_t permille)
+{
+	const struct Latency_Stats *s = &latency.stats[e];
+	uint32_t rank = (uint32_t)(((uint64_t)s->count * permille + 999) / 1000); //presses at or below it
+	uint32_t seen = 0;
+	if (rank == 0){
+		return 0;
+	}
+	for (uint32_t bin = 0; bin < LATENCY_BINS; bin++){
+		seen += s->histogram[bin];
+		if (seen >= rank){
+			uint32_t top = latency_bin_top(bin);
+			return (top < s->max_ns) ? top : s->max_ns;
+		}
+	}
+	return s->max_ns;
+}
+#endif
@@ -0,0 +1,66 @@
+/**
+**************************************************************************************************
+* @file latency.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for latency.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the opt-in press-to-feedback latency histograms (LATENCY_STATS in main.h). With
+* LATENCY_STATS 0 the LATENCY_* calls expand to nothing and latency.c is empty.
+**************************************************************************************************
+*/
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "main.h"
+
+//What a press was seen to do, see LATENCY_PRESS() and LATENCY_RETURN()
+enum latency_events { LAT_HITZONE_OFF, LAT_BALL_RETURN, LAT_MOVE_LED, LAT_MODE_SWITCH, NUM_of_LATENCY_EVENTS };
+
+//Log-linear bins in ns: every power of two is split into 2^LATENCY_SUB_BITS bins, so a bin is at
+//most 25% wide. Values below 2^(LATENCY_SUB_BITS + 1) get a bin each.
+#define LATENCY_SUB_BITS 2
+#define LATENCY_BINS ((33 - LATENCY_SUB_BITS) << LATENCY_SUB_BITS)
+
+struct Latency_Stats{
+	uint32_t count;
+	uint32_t max_ns;
+	uint64_t total_ns; //for the mean
+	uint32_t coarse; //of count, timed by usTimer because the core slept or changed speed meanwhile
+	uint32_t histogram[LATENCY_BINS];
+};
+
+//Stamp of a button edge, taken in its EXTI handler
+struct Latency_Edge{
+	uint32_t cycle; //DWT->CYCCNT
+	uint32_t us; //usTimer, the edge's timestamp in the button's queue
+	uint32_t sleeps; //idle_stats.sleeps, DWT->CYCCNT stops in WFI
+	uint32_t switches; //core_clock.switches, a cycle is only as long as the speed it ran at
+};
+
+struct Latency{
+	struct Latency_Stats stats[NUM_of_LATENCY_EVENTS];
+	struct Latency_Edge edge[NUM_of_BUTTONS]; //newest edge queued by each button, by enum choices - 1
+	struct Latency_Edge pending; //edge of the press being processed
+	enum latency_events pending_event; //NUM_of_LATENCY_EVENTS when no press is being timed
+	enum choices pending_choice; //its button
+	uint32_t unmatched; //presses whose edge stamp a newer edge had replaced, not timed
+};
+
+#if LATENCY_STATS
+extern struct Latency latency;
+
+void LATENCY_EDGE(enum choices choice, uint32_t edgeTIME_us);
+void LATENCY_PRESS(enum choices choice, uint32_t pressTIME_us);
+void LATENCY_RETURN(enum identifications id);
+void LATENCY_COMMIT(void);
+uint32_t LATENCY_PERCENTILE(enum latency_events e, uint32_t permille);
+#else
+#define LATENCY_EDGE(choice, edgeTIME_us) ((void)0)
+#define LATENCY_PRESS(choice, pressTIME_us) ((void)0)
+#define LATENCY_RETURN(id) ((void)0)
+#define LATENCY_COMMIT() ((void)0)
+#endif
+
+#endif /* LATENCY_H_ */
@@ -1,4 +1,6 @@
 #include "leds.h"
+#include "strip.h" //GAMEBOARD row pixels with LED_OUTPUT_STRIP, see strip.c/h
+#include "shared_state.h" //the game state as the ISRs see it, see shared_state.c/h
 /**
 **************************************************************************************************
 * @file leds.c
@@ -8,100 +10,188 @@
 * ------------------------------------------------------------------------------------------------
 * Defines functions used for LED control and configuration.
 *************************************************************************************************/
+const struct LED_Port_Config LED_PORT_CONFIG[LED_PORTS_used] = {
+		{GPIOA, BOARD_PORT_A, GPIOA_LED_PINS, GPIOA_LED_FIELDS, GPIOA_GAMEBOARD_PINS},
+		{GPIOB, BOARD_PORT_B, GPIOB_LED_PINS, GPIOB_LED_FIELDS, GPIOB_GAMEBOARD_PINS},
+		{GPIOC, BOARD_PORT_C, GPIOC_LED_PINS, GPIOC_LED_FIELDS, GPIOC_GAMEBOARD_PINS}
+};
 //================================================================================================
 // configure_LEDS()
-// @parm:   *port = GPIOx
-//			pins[] = Array containing the port pin numbers used
-//          number_of_pins = Number of port pins used
-//			port_clock_num = The number associated with the port clock "0 for port A"
+// @parm:   *config = port and pin masks to configure (see LED_PORT_CONFIG)
 // @return: none
-// 		Conveniently configures multiple LEDs at once. Also assists with board wire management.
+// 		Configures every LED on a port at once: push-pull outputs, low speed, no pull resistor.
+// 		Each register is written once using the masks precomputed from board.h.
 //================================================================================================
-void configure_LEDS (GPIO_TypeDef *port, uint32_t pins[], uint32_t number_of_pins, uint32_t port_clock_num)
+void configure_LEDS (const struct LED_Port_Config *config)
 {
-	RCC->AHB2ENR |= (0x1 << port_clock_num);
-	for (uint32_t i = 0; i < number_of_pins; i++){
-		port->MODER &= ~(0x3 << (2 * pins[i]));
-		port->MODER |= (0x1 << (2 * pins[i]));
-		port->OTYPER &= ~(0x1 << pins[i]);
-		port->OSPEEDR &= ~(0x3 << (2 * pins[i]));
-		port->PUPDR &= ~(0x3 << (2 * pins[i]));
+	GPIO_TypeDef *port = config->port;
+	uint32_t outputs = config->fields & 0x55555555; //01 in every LED field = output mode
+	RCC->AHB2ENR |= (0x1 << config->port_clock_num);
+	port->MODER = (port->MODER & ~config->fields) | outputs;
+	port->OTYPER &= ~config->pins;
+	port->OSPEEDR &= ~config->fields;
+	port->PUPDR &= ~config->fields;
+}
+//================================================================================================
+// LED_FRAME_ON()
+// @parm:   *frame = frame being built
+//          *led = LED to turn on
+// @return: none
+// 		Stages the LED to be turned on when the frame is committed. Cancels a staged turn off.
+//================================================================================================
+void LED_FRAME_ON (struct LED_Frame *frame, const struct Light_Emitting_Diode *led)
+{
+	uint32_t *word = &frame->bsrr[led->port_index];
+	*word = (*word & ~(led->mask << 16)) | led->mask;
+}
+//================================================================================================
+// LED_FRAME_OFF()
+// @parm:   *frame = frame being built
+//          *led = LED to turn off
+// @return: none
+// 		Stages the LED to be turned off when the frame is committed. Cancels a staged turn on.
+//================================================================================================
+void LED_FRAME_OFF (struct LED_Frame *frame, const struct Light_Emitting_Diode *led)
+{
+	uint32_t *word = &frame->bsrr[led->port_index];
+	*word = (*word & ~led->mask) | (led->mask << 16);
+}
+//================================================================================================
+// LED_FRAME_TOGGLE()
+// @parm:   *frame = frame being built
+//          *led = LED to toggle
+// @return: none
+// 		Stages the opposite of the LED's state, taking changes already in the frame into account
+//================================================================================================
+void LED_FRAME_TOGGLE (struct LED_Frame *frame, const struct Light_Emitting_Diode *led)
+{
+	uint32_t word = frame->bsrr[led->port_index];
+	uint32_t lit = LED_IS_LIT(led); //state the LED has now...
+	if (word & led->mask) lit = 1;  //...or will have once the frame is committed
+	if (word & (led->mask << 16)) lit = 0;
+	if (lit){
+		LED_FRAME_OFF(frame, led);
 	}
+	else{
+		LED_FRAME_ON(frame, led);
+	}
+}
+//================================================================================================
+// LED_IS_LIT()
+// @parm:   *led = LED to look at
+// @return: 1 if the LED is on now, frames not yet committed aside
+//================================================================================================
+uint32_t LED_IS_LIT (const struct Light_Emitting_Diode *led)
+{
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+	if (led->port_index >= LED_PORTS_used){ //strip pixel
+		return (strip.lit[led->port_index - LED_PORTS_used] & led->mask) != 0;
+	}
+#endif
+	return (led->port->ODR & led->mask) != 0;
+}
+//================================================================================================
+// COMMIT_LED_FRAME()
+// @parm:   *frame = frame to write out
+// @return: none
+// 		Writes the staged changes with one BSRR store per port that has any, then clears the frame.
+// 		BSRR stores are atomic, so ISRs and the main loop can commit frames without losing updates.
+// 		The strip's words go to STRIP_COMMIT(), which is just as safe.
+//================================================================================================
+void COMMIT_LED_FRAME (struct LED_Frame *frame)
+{
+	for (uint32_t i = 0; i < LED_PORTS_used; i++){
+		if (frame->bsrr[i]){
+			GPIO_BSRR_WRITE(LED_PORT_CONFIG[i].port, frame->bsrr[i]);
+			frame->bsrr[i] = 0;
+		}
+	}
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+	STRIP_COMMIT(&frame->bsrr[LED_PORTS_used]);
+#endif
 }
 //================================================================================================
 // TURN_OFF_GAMEBOARD_LEDS()
-// @parm: none
+// @parm: *frame = frame being built
 // @return: none
 // 		Turns off GAMEBOARD LEDS (EVERY LED except the two HITZONE and two MISS LEDs)
 //================================================================================================
-void TURN_OFF_GAMEBOARD_LEDS (void)
+void TURN_OFF_GAMEBOARD_LEDS (struct LED_Frame *frame)
 {
-	for (uint32_t i = 2; i<22;i++){
-		LEDS[i].port-> ODR &= ~(0x1 << LEDS[i].pin);
+	for (uint32_t i = 0; i < LED_FRAME_PORTS; i++){
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+		uint32_t pins = (i < LED_PORTS_used) ? LED_PORT_CONFIG[i].gameboard : strip.gameboard[i - LED_PORTS_used];
+#else
+		uint32_t pins = LED_PORT_CONFIG[i].gameboard;
+#endif
+		frame->bsrr[i] = (frame->bsrr[i] & ~pins) | (pins << 16);
 	}
 }
 //================================================================================================
 // TURN_OFF_POINTS_DISPLAY()
 // @parm: *p = pointer to the Player struct
+//        *frame = frame being built
 // @return: none
 // 		Turns off the Players points-display
 //================================================================================================
-void TURN_OFF_POINTS_DISPLAY (struct Player *p)
+void TURN_OFF_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame)
 {
 	for (uint32_t i = 0; i<3;i++){
-		p->points_display[i].port-> ODR &= ~(0x1 << p->points_display[i].pin);
+		LED_FRAME_OFF(frame, p->points_display[i]);
 	}
 }
 //================================================================================================
 // UPDATE_POINTS_DISPLAY()
 // @parm: *p = pointer to the Player struct
+//        *frame = frame being built
 // @return: none
 // 		Turns on the LEDs corresponding to the player's current score
 //================================================================================================
-void UPDATE_POINTS_DISPLAY (struct Player *p)
+void UPDATE_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame)
 {
 	for (uint32_t i = 0; i<p->score;i++){
-		p->points_display[i].port-> ODR |= (0x1 << p->points_display[i].pin);
+		LED_FRAME_ON(frame, p->points_display[i]);
 	}
 }
 //================================================================================================
 // TOGGLE_POINTS_DISPLAY()
 // @param:  *p = pointer to the Player struct
+//          *frame = frame being built
 // @return: None
 // 		Toggles all LEDs in the player's score display. Called within TIM2 to simulate blink effect
 //================================================================================================
-void TOGGLE_POINTS_DISPLAY (struct Player *p)
+void TOGGLE_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame)
 {
 	for (uint32_t i = 0; i<3;i++){
-		p->points_display[i].port-> ODR ^= (0x1 << p->points_display[i].pin);
+		LED_FRAME_TOGGLE(frame, p->points_display[i]);
 	}
 }
 //================================================================================================
 // TURN_OFF_MISS_LEDS()
 // @param:  *p = pointer to the Player struct
 //			*opp - pointer to the opposing Player struct
+//          *frame = frame being built
 // @return: None
 // 		Turns off the miss LEDs for both players.
 //================================================================================================
-void TURN_OFF_MISS_LEDS (struct Player *p, struct Player *opp )
+void TURN_OFF_MISS_LEDS (struct Player *p, struct Player *opp, struct LED_Frame *frame)
 {
-		p->missLED.port-> ODR &= ~(0x1 << p->missLED.pin);
-		opp->missLED.port-> ODR &= ~(0x1 << opp->missLED.pin);
+		LED_FRAME_OFF(frame, p->missLED);
+		LED_FRAME_OFF(frame, opp->missLED);
 }
 //================================================================================================
 // HANDLE_HITZONE_LEDS()
 // @param:  *p = pointer to the Player struct
-//			curentTIME_ms = current time in MS
+//          *frame = frame being built
 // @return: None
-// 		Called within the SysTick Handler. Ensures the HITZONE LEDs are always on and that they will
-// 		eventually come back on after being turned off.
+// 		Turns the HITZONE LED back on unless the player's press toggle is still running, the player
+// 		has missed, or the game is in a winner's state. Called when the toggle timer expires, in
+// 		SysTick_Handler, and on every serve, so the miss and the state are read from the
+// 		published snapshot (see shared_state.c) and are never half way through a change.
 //================================================================================================
-void HANDLE_HITZONE_LEDS (struct Player *p, uint32_t curentTIME_ms){
-	if(p->pressedFLAG == 0 && p->missFLAG == 0 && game_state != 7 && game_state !=8){ //if p2 button is not pressed and the player has not missed
-		p->hitzoneLED.port-> ODR |= (0x1 <<   p->hitzoneLED.pin); //turn on the p hitzone
-		}
-	else if ((curentTIME_ms - p->pressTIME_STAMP) >= HITZONE_LED_TOGGLE_TIME ){//if the toggle time has passed
-		p->pressTIME_STAMP = 0; //clear time stamp
-		p->pressedFLAG = 0; //clear press flag
+void HANDLE_HITZONE_LEDS (struct Player *p, struct LED_Frame *frame){
+	const struct Game_Snapshot *s = GAME_STATE_SNAPSHOT();
+	if(p->pressedFLAG == 0 && s->player[p->ID].missFLAG == 0 && s->game_state != P1_WINNERS_CIRCLE && s->game_state != P2_WINNERS_CIRCLE){ //if the button is not pressed and the player has not missed
+		LED_FRAME_ON(frame, p->hitzoneLED); //turn on the p hitzone
 	}
 }
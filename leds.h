@@ -14,13 +14,30 @@
 
 #include "main.h" //functions use external variables form main.h
 
-void configure_LEDS (GPIO_TypeDef *port, uint32_t pins[], uint32_t number_of_pins, uint32_t port_clock_num);
+//Output configuration for one LED port, generated from board.h
+struct LED_Port_Config{
+	GPIO_TypeDef *port; //GPIOx
+	uint32_t port_clock_num; //bit in RCC->AHB2ENR, "0 for port A"
+	uint32_t pins; //one bit per LED pin (OTYPER)
+	uint32_t fields; //two bits per LED pin (MODER, OSPEEDR, PUPDR)
+	uint32_t gameboard; //one bit per GAMEBOARD LED pin
+};
 
-void TURN_OFF_GAMEBOARD_LEDS (void);
-void TURN_OFF_POINTS_DISPLAY (struct Player *p);
-void TOGGLE_POINTS_DISPLAY (struct Player *p);
-void UPDATE_POINTS_DISPLAY (struct Player *p);
-void TURN_OFF_MISS_LEDS (struct Player *p, struct Player *opp );
-void HANDLE_HITZONE_LEDS (struct Player *p, uint32_t curentTIME_ms);
+extern const struct LED_Port_Config LED_PORT_CONFIG[LED_PORTS_used];
+
+void configure_LEDS (const struct LED_Port_Config *config);
+
+void LED_FRAME_ON (struct LED_Frame *frame, const struct Light_Emitting_Diode *led);
+void LED_FRAME_OFF (struct LED_Frame *frame, const struct Light_Emitting_Diode *led);
+void LED_FRAME_TOGGLE (struct LED_Frame *frame, const struct Light_Emitting_Diode *led);
+uint32_t LED_IS_LIT (const struct Light_Emitting_Diode *led);
+void COMMIT_LED_FRAME (struct LED_Frame *frame);
+
+void TURN_OFF_GAMEBOARD_LEDS (struct LED_Frame *frame);
+void TURN_OFF_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame);
+void TOGGLE_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame);
+void UPDATE_POINTS_DISPLAY (struct Player *p, struct LED_Frame *frame);
+void TURN_OFF_MISS_LEDS (struct Player *p, struct Player *opp, struct LED_Frame *frame);
+void HANDLE_HITZONE_LEDS (struct Player *p, struct LED_Frame *frame);
 
 #endif
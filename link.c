@@ -0,0 +1,734 @@
+#include "link.h"
+#include "ball.h" //replays the ball's steps with the fixed-point stepping of ball.c/h
+#include "leds.h" //uses LED related functions from leds.c/h
+#include "input.h" //the other board's special button acts as this one's, see input.c/h
+#include "power.h" //posts WAKE_LINK, see power.c/h
+#include "shared_state.h" //publishes the rolled back state, see shared_state.c/h
+/**
+**************************************************************************************************
+* @file link.c
+* @brief Source file for play between two linked boards
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Splits the game over two boards, one player each, joined by USART2 (see link.h for the pins and
+* the frame format). Both boards run the whole game and play the rally by the same clock,
+* board_link.tick, the TIM2 ticks since the serve. A board only sends what its own player did: a
+* press, with its tick, and a miss, once its game has seen the ball go past. The left board
+* serves once the right one says it is ready, and the serve carries the position and scores.
+*
+* A press from the other board arrives a few ticks late. The game here runs ahead regardless,
+* predicting that the other player did nothing, and the ball keeps heading for them, past their
+* hitzone if need be, until the press or miss arrives: it is never offered the other player's
+* MISS zone itself. Whatever the other player did can only matter while the ball is on its way
+* to them, so it is enough to keep the ball as it was when it last changed course (the leg,
+* LINK_LEG_START()) and the local presses since. A late input rolls the ball back to the leg,
+* steps it forward in closed form to the input's tick, applies the input, applies the local
+* presses again and steps on to the present, all with interrupts masked, which takes a few
+* microseconds a tick. A press from the future waits for its tick (board_link.due).
+*
+* Frames are numbered and kept until the other board acknowledges them; unacknowledged frames
+* go again every LINK_RESEND_MS (go-back-N). Every frame carries the acknowledgement of what
+* arrived, and a board that has nothing to send answers with MSG_ACK. The USART moves the bytes
+* through two rings from USART2_IRQHandler; the rest runs in the main loop (HANDLE_LINK()).
+*
+*	Note: Enabled with LINK_UART (main.h or the compiler command line), which needs BALL_COUNT 1
+*	      and BALL_ANIMATION_CPU. Each board plays the left or right side, set by PC1.
+*************************************************************************************************/
+#if LINK == LINK_UART
+
+#define USART_CR1_UE (1 << 0)
+#define USART_CR1_RE (1 << 2)
+#define USART_CR1_TE (1 << 3)
+#define USART_CR1_RXNEIE (1 << 5)
+#define USART_CR1_TXEIE (1 << 7)
+#define USART_ISR_ORE (1 << 3)
+#define USART_ISR_RXNE (1 << 5)
+#define USART_ISR_TXE (1 << 7)
+#define USART_ISR_ERRORS ((1 << 3) | (1 << 2) | (1 << 1)) //ORE, NF, FE, cleared by writing the same bits to ICR
+
+struct Link board_link;
+
+//================================================================================================
+// ring_put()
+// @parm: *r = ring to fill
+//        byte = byte to add
+// @return: 1 if the byte went in, 0 if the ring was full
+// 		Producer side, one per ring: the main loop for tx, USART2_IRQHandler for rx.
+//================================================================================================
+static uint32_t ring_put(struct Link_Ring *r, uint8_t byte)
+{
+	uint32_t head = r->head;
+	if (head - r->tail >= LINK_RING_BYTES){
+		return 0;
+	}
+	r->bytes[head & (LINK_RING_BYTES - 1)] = byte;
+	__DMB(); //the byte must land before the new head
+	r->head = head + 1;
+	return 1;
+}
+//================================================================================================
+// ring_get()
+// @parm: *r = ring to empty
+//        *byte = receives the oldest byte
+// @return: 1 if a byte was read, 0 if the ring was empty
+//================================================================================================
+static uint32_t ring_get(struct Link_Ring *r, uint8_t *byte)
+{
+	uint32_t tail = r->tail;
+	if (tail == r->head){
+		return 0;
+	}
+	__DMB(); //read the byte only after seeing the head that published it
+	*byte = r->bytes[tail & (LINK_RING_BYTES - 1)];
+	__DMB();
+	r->tail = tail + 1;
+	return 1;
+}
+//================================================================================================
+// crc8()
+// @parm: *bytes, n = bytes to check
+// @return: CRC-8, polynomial 0x07, initial value 0
+//================================================================================================
+static uint8_t crc8(const uint8_t *bytes, uint32_t n)
+{
+	uint32_t crc = 0;
+	for (uint32_t i = 0; i < n; i++){
+		crc ^= bytes[i];
+		for (uint32_t bit = 0; bit < 8; bit++){
+			crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF;
+		}
+	}
+	return (uint8_t)crc;
+}
+//================================================================================================
+// game_tick()
+// @parm: none
+// @return: tick the game is at, board_link.tick or, during a replay, the tick replayed
+//================================================================================================
+static uint32_t game_tick(void)
+{
+	return board_link.replaying ? board_link.game_tick : board_link.tick;
+}
+//================================================================================================
+// send_frame()
+// @parm: type = enum link_messages
+//        seq = sequence number, 0 for MSG_ACK
+//        value = 16-bit value
+// @return: none
+// 		Queues a frame for USART2, with the acknowledgement of everything received so far. A frame
+// 		that does not fit the ring is left out, and data frames go again on the resend timer.
+//================================================================================================
+static void send_frame(uint32_t type, uint32_t seq, uint32_t value)
+{
+	uint8_t frame[LINK_FRAME_BYTES] = { LINK_SYNC, (uint8_t)((type << 4) | seq), (uint8_t)(board_link.wanted_seq % LINK_SEQ_MOD),
+			(uint8_t)value, (uint8_t)(value >> 8), 0 };
+	frame[5] = crc8(&frame[1], 4);
+	if (LINK_RING_BYTES - (board_link.tx.head - board_link.tx.tail) < LINK_FRAME_BYTES){
+		board_link.window_full++;
+		return;
+	}
+	for (uint32_t i = 0; i < LINK_FRAME_BYTES; i++){
+		ring_put(&board_link.tx, frame[i]);
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //USART2_IRQHandler clears TXEIE once the ring runs dry
+	USART2->CR1 |= USART_CR1_TXEIE;
+	__set_PRIMASK(primask);
+	board_link.frames_sent++;
+	board_link.ack_owed = 0;
+}
+//================================================================================================
+// RESEND_EXPIRED()
+// @parm: context - unused
+// @return: none
+//         Timer callback for resend_timer, runs in SysTick_Handler. Leaves the resending to the
+//	   main loop.
+//================================================================================================
+static void RESEND_EXPIRED(void *context)
+{
+	(void)context;
+	board_link.resend_due = 1;
+	POST_WAKE_EVENT(WAKE_LINK);
+}
+//================================================================================================
+// send_message()
+// @parm: type = enum link_messages, not MSG_ACK
+//        value = 16-bit value
+// @return: none
+// 		Numbers the message, keeps it until acknowledged and sends it. With LINK_WINDOW messages
+// 		unacknowledged the message is dropped and counted; the window only fills with the other
+// 		board gone.
+//================================================================================================
+static void send_message(enum link_messages type, uint32_t value)
+{
+	if (board_link.next_seq - board_link.unacked_seq >= LINK_WINDOW){
+		board_link.window_full++;
+		return;
+	}
+	uint32_t seq = board_link.next_seq % LINK_SEQ_MOD;
+	board_link.sent[seq].type = (uint8_t)type;
+	board_link.sent[seq].value = (uint16_t)value;
+	board_link.next_seq++;
+	send_frame(type, seq, value);
+	if (!board_link.resend_timer.armed){
+		SCHEDULE_TIMER(&board_link.resend_timer, LINK_RESEND_MS, RESEND_EXPIRED, 0);
+	}
+}
+//================================================================================================
+// resend()
+// @parm: none
+// @return: none
+// 		Sends every unacknowledged message again, oldest first.
+//================================================================================================
+static void resend(void)
+{
+	board_link.resend_due = 0;
+	for (uint32_t n = board_link.unacked_seq; n != board_link.next_seq; n++){
+		uint32_t seq = n % LINK_SEQ_MOD;
+		send_frame(board_link.sent[seq].type, seq, board_link.sent[seq].value);
+		board_link.frames_resent++;
+	}
+	if (board_link.unacked_seq != board_link.next_seq){
+		SCHEDULE_TIMER(&board_link.resend_timer, LINK_RESEND_MS, RESEND_EXPIRED, 0);
+	}
+}
+//================================================================================================
+// take_ack()
+// @parm: wanted = next sequence number the other board wants, 4 bits
+// @return: none
+//================================================================================================
+static void take_ack(uint32_t wanted)
+{
+	uint32_t acked = (wanted - board_link.unacked_seq) % LINK_SEQ_MOD;
+	if (acked == 0 || acked > board_link.next_seq - board_link.unacked_seq){ //nothing new, or an old frame
+		return;
+	}
+	board_link.unacked_seq += acked;
+	if (board_link.unacked_seq == board_link.next_seq){
+		CANCEL_TIMER(&board_link.resend_timer);
+	}
+	else{
+		RESCHEDULE_TIMER(&board_link.resend_timer, LINK_RESEND_MS);
+	}
+}
+//================================================================================================
+// forget_round()
+// @parm: none
+// @return: none
+// 		Drops what the link knows of the round being played, on a reset from either board.
+//================================================================================================
+static void forget_round(void)
+{
+	board_link.peer_ready = 0;
+	board_link.ready_sent = 0;
+	board_link.serve_pending = 0;
+	board_link.history_count = 0;
+}
+//================================================================================================
+// take_message()
+// @parm: type = enum link_messages, not MSG_ACK
+//        value = the frame's value
+// @return: none
+// 		Queues a message from the other board for apply_inputs(), ticks widened to 32 bits.
+//================================================================================================
+static void take_message(uint32_t type, uint32_t value)
+{
+	if (board_link.input_head - board_link.input_tail >= LINK_INPUTS){
+		board_link.discarded++;
+		return;
+	}
+	if (type == MSG_PRESS || type == MSG_MISS){ //16 bits on the wire, within 32767 ticks of this board's
+		value = board_link.tick + (int16_t)(uint16_t)(value - board_link.tick);
+	}
+	board_link.inputs[board_link.input_head % LINK_INPUTS] = (struct Link_Input){ type, value };
+	board_link.input_head++;
+}
+//================================================================================================
+// take_frame()
+// @parm: none
+// @return: none
+// 		Handles board_link.frame[], its CRC checked. Only the next data frame in sequence is
+// 		taken; a frame sent again, or one after a lost frame, is dropped, and either way the
+// 		acknowledgement sent back says what is wanted.
+//================================================================================================
+static void take_frame(void)
+{
+	uint32_t type = board_link.frame[1] >> 4;
+	uint32_t seq = board_link.frame[1] & 0xF;
+	board_link.frames_received++;
+	take_ack(board_link.frame[2] & 0xF);
+	if (type == MSG_ACK){
+		return;
+	}
+	board_link.ack_owed = 1;
+	if (type >= NUM_of_LINK_MESSAGES || seq != board_link.wanted_seq % LINK_SEQ_MOD){
+		board_link.discarded++;
+		return;
+	}
+	board_link.wanted_seq++;
+	take_message(type, board_link.frame[3] | (board_link.frame[4] << 8));
+}
+//================================================================================================
+// take_byte()
+// @parm: byte = next byte from USART2
+// @return: none
+// 		Builds frames from the byte stream. A frame that fails its CRC is dropped up to the next
+// 		LINK_SYNC in it, so the stream falls back into step after a lost or damaged byte.
+//================================================================================================
+static void take_byte(uint8_t byte)
+{
+	if (board_link.framed == 0 && byte != LINK_SYNC){
+		return;
+	}
+	board_link.frame[board_link.framed++] = byte;
+	if (board_link.framed < LINK_FRAME_BYTES){
+		return;
+	}
+	board_link.framed = 0;
+	if (crc8(&board_link.frame[1], 4) == board_link.frame[5]){
+		take_frame();
+		return;
+	}
+	board_link.crc_errors++;
+	for (uint32_t i = 1; i < LINK_FRAME_BYTES; i++){
+		if (board_link.frame[i] == LINK_SYNC){
+			for (uint32_t j = i; j < LINK_FRAME_BYTES; j++){
+				board_link.frame[board_link.framed++] = board_link.frame[j];
+			}
+			break;
+		}
+	}
+}
+//================================================================================================
+// fast_forward()
+// @parm: ticks = TIM2 ticks to step the ball through
+// @return: none
+// 		Does what BALL_TICK() and MOVE_BALL() would do to ball 0 over that many ticks, jumping
+// 		from one step to the next in closed form and raising the ball events on the way, without
+// 		touching the LEDs. Interrupts masked.
+//================================================================================================
+static void fast_forward(uint32_t ticks)
+{
+	uint32_t velocity = ball_velocity;
+	balls.step_us = usTimer; //what BALL_ARRIVED() stamps
+	while (ticks && velocity){
+		if (LEDcount == ((direction == LEFT) ? LEFT_MISS_ZONE : RIGHT_MISS_ZONE)){ //waits there, only the phase moves
+			ball_phase = (uint32_t)((ball_phase + (uint64_t)ticks * velocity) & (Q16_ONE - 1));
+			return;
+		}
+		uint32_t to_step = (Q16_ONE - ball_phase + velocity - 1) / velocity; //ticks until the phase carries
+		if (to_step > ticks){
+			ball_phase += ticks * velocity;
+			return;
+		}
+		ticks -= to_step;
+		ball_phase = ball_phase + to_step * velocity - Q16_ONE;
+		LEDcount = (direction == LEFT) ? LEDcount + 1 : LEDcount - 1;
+		BALL_ARRIVED(0);
+	}
+}
+//================================================================================================
+// play_to()
+// @parm: tick = tick to bring the replayed game up to
+// @return: none
+//================================================================================================
+static void play_to(uint32_t tick)
+{
+	if (IN_RALLY(game_state)){
+		fast_forward(tick - board_link.game_tick);
+	}
+	board_link.game_tick = tick;
+	HANDLE_GAME();
+}
+//================================================================================================
+// local_press()
+// @parm: tick = tick of the press
+//        pressTIME_us = usTimer value of its edge
+//        *frame - frame being built
+// @return: 1 if the game handled the press
+// 		Gives the game a press by this board's player and keeps it for a later replay, unless it
+// 		sent the ball back (then a replay starts after it).
+//================================================================================================
+static uint32_t local_press(uint32_t tick, uint32_t pressTIME_us, struct LED_Frame *frame)
+{
+	uint32_t serial = board_link.leg.serial;
+	uint32_t handled = GAME_EVENT((board_link.local == ONE) ? EV_P1_PRESS : EV_P2_PRESS, pressTIME_us, frame);
+	if (board_link.leg.serial == serial && IN_RALLY(game_state)){
+		if (board_link.history_count < LINK_HISTORY){
+			board_link.history[board_link.history_count] = tick;
+			board_link.history_stamp[board_link.history_count] = pressTIME_us;
+			board_link.history_count++;
+		}
+		else{
+			board_link.discarded++;
+		}
+	}
+	return handled;
+}
+//================================================================================================
+// replay_input()
+// @parm: event = the other player's press or miss, as this board's game sees it
+//        tick = tick it happened on
+//        *frame - frame being built
+// @return: none
+// 		Applies a due input from the other board. If the ball was on its way to the other player
+// 		at that tick, the game goes back to the leg and plays forward again with the input in
+// 		its place; before that the ball was coming here and a press could not matter.
+//================================================================================================
+static void replay_input(enum game_events event, uint32_t tick, struct LED_Frame *frame)
+{
+	enum directions away = (board_link.local == ONE) ? RIGHT : LEFT; //towards the other board
+	uint32_t press = (event == EV_P1_PRESS || event == EV_P2_PRESS);
+	uint32_t arg = press ? usTimer : 0; //the ball, for a miss
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //TIM2 must not step the ball while it is rolled back
+	HANDLE_GAME(); //every step up to now first
+	uint32_t now = board_link.tick;
+	if (!IN_RALLY(game_state) || direction != away){
+		if (press){ //at most a toggle, or an early press
+			GAME_EVENT(event, arg, frame);
+		}
+		__set_PRIMASK(primask);
+		return;
+	}
+	if ((int32_t)(tick - board_link.leg.tick) < 0){ //the ball was coming here then
+		if (press){
+			PRESS_DETECTED((event == EV_P1_PRESS) ? &P1 : &P2, arg, frame);
+		}
+		__set_PRIMASK(primask);
+		return;
+	}
+	//back to the leg, the ball's LED off where it is now
+	if (LEDcount > RIGHT_HITZONE_POS && LEDcount < LEFT_HITZONE_POS){
+		LED_FRAME_OFF(frame, &LEDS[LEDcount]);
+	}
+	LEDcount = board_link.leg.position;
+	ball_phase = board_link.leg.phase;
+	ball_velocity = board_link.leg.velocity;
+	pace = board_link.leg.level;
+	direction = board_link.leg.heading;
+	game_state = board_link.leg.state;
+	SET_BALL_STATE(0, game_state);
+	PUBLISH_GAME_STATE(); //see shared_state.c/h
+	uint32_t pending = 0; //local presses at or after tick, replayed after the input
+	uint32_t pending_tick[LINK_HISTORY], pending_stamp[LINK_HISTORY];
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < board_link.history_count; i++){
+		if ((int32_t)(board_link.history[i] - tick) >= 0){
+			pending_tick[pending] = board_link.history[i];
+			pending_stamp[pending++] = board_link.history_stamp[i];
+		}
+		else{
+			kept++;
+		}
+	}
+	board_link.history_count = kept;
+	board_link.replaying = 1;
+	board_link.game_tick = board_link.leg.tick;
+	play_to(tick);
+	GAME_EVENT(event, arg, frame);
+	for (uint32_t i = 0; i < pending; i++){
+		play_to(pending_tick[i]);
+		local_press(pending_tick[i], pending_stamp[i], frame);
+	}
+	play_to(now);
+	board_link.replaying = 0;
+	if (IN_RALLY(game_state) && LEDcount > RIGHT_HITZONE_POS && LEDcount < LEFT_HITZONE_POS){
+		LED_FRAME_ON(frame, &LEDS[LEDcount]);
+	}
+	if (now != tick){
+		board_link.rollbacks++;
+		board_link.rollback_ticks += now - tick;
+		if (now - tick > board_link.worst_rollback){
+			board_link.worst_rollback = now - tick;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// apply_input()
+// @parm: *in = message from the other board, taken off the queue
+// @return: none
+//================================================================================================
+static void apply_input(const struct Link_Input *in)
+{
+	struct LED_Frame frame = {0};
+	enum identifications remote = (board_link.local == ONE) ? TWO : ONE;
+	switch (in->type){
+	case MSG_READY:
+		board_link.peer_ready = 1; //HANDLE_GAME() serves on this pass, if the round is over here
+		break;
+	case MSG_SERVE:
+		board_link.serve_pending = 1;
+		board_link.serve_word = in->value;
+		if (system_state == PLAY_MODE){
+			GAME_EVENT(EV_PASS, 0, &frame); //serves from INITIAL_SERVE, see LINK_SERVE()
+		}
+		break;
+	case MSG_PRESS:
+		if (system_state == PLAY_MODE){
+			replay_input((remote == ONE) ? EV_P1_PRESS : EV_P2_PRESS, in->value, &frame);
+		}
+		break;
+	case MSG_MISS:
+		if (system_state == PLAY_MODE){
+			replay_input((remote == ONE) ? EV_BALL_PAST_LEFT : EV_BALL_PAST_RIGHT, in->value, &frame);
+		}
+		break;
+	case MSG_RESET:
+		forget_round();
+		SPECIAL_BUTTON_ACTIONS(); //as if pressed here, see input.c
+		break;
+	}
+	COMMIT_LED_FRAME(&frame);
+}
+//================================================================================================
+// apply_inputs()
+// @parm: none
+// @return: none
+// 		Applies the queued messages in order. During a rally a press or miss waits for its tick,
+// 		and LINK_TICK() wakes the main loop when it comes; anything after a serve this board has
+// 		not yet made waits for it.
+//================================================================================================
+static void apply_inputs(void)
+{
+	while (board_link.input_tail != board_link.input_head){
+		struct Link_Input in = board_link.inputs[board_link.input_tail % LINK_INPUTS];
+		if (board_link.serve_pending && in.type != MSG_RESET){
+			return;
+		}
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq(); //LINK_TICK() must see due, or the tick must already be past it
+		if ((in.type == MSG_PRESS || in.type == MSG_MISS) && IN_RALLY(game_state)
+				&& (int32_t)(in.value - board_link.tick) > 0){
+			if (board_link.due != in.value){
+				board_link.due = in.value;
+				board_link.waited++;
+			}
+			__set_PRIMASK(primask);
+			return;
+		}
+		board_link.due = 0;
+		__set_PRIMASK(primask);
+		board_link.input_tail++;
+		apply_input(&in);
+	}
+}
+//================================================================================================
+// configure_link()
+// @parm: none
+// @return: none
+// 		Reads the side from PC1, sets up PA2 and PA3 as USART2_TX and USART2_RX, and USART2 at
+// 		LINK_BAUD, 8N1, from HSI16, receiving under interrupt.
+//================================================================================================
+void configure_link(void)
+{
+	RCC->AHB2ENR |= (1 << 0) | (1 << 2); //Enable GPIOA and GPIOC clocks
+	GPIOC->MODER &= ~(0x3 << (2 * LINK_SIDE_PIN)); //PC1 input
+	GPIOC->PUPDR = (GPIOC->PUPDR & ~(0x3 << (2 * LINK_SIDE_PIN))) | (0x1 << (2 * LINK_SIDE_PIN)); //pulled up
+	board_link.local = (GPIOC->IDR & (1 << LINK_SIDE_PIN)) ? ONE : TWO;
+
+	GPIOA->MODER = (GPIOA->MODER & ~(0xF << 4)) | (0xA << 4); //PA2 and PA3 alternate function
+	GPIOA->PUPDR = (GPIOA->PUPDR & ~(0x3 << 6)) | (0x1 << 6); //RX pulled up, idle with no cable
+	GPIOA->AFR[0] = (GPIOA->AFR[0] & ~(0xFF << 8)) | (0x77 << 8); //AF7 = USART2_TX, USART2_RX
+
+	RCC->CR |= (1 << 8); //HSI16 on, normally already on for the PLL
+	CLOCK_WAIT(RCC->CR & (1 << 10)); //HSIRDY
+	RCC->CCIPR = (RCC->CCIPR & ~(0x3 << 2)) | (0x2 << 2); //USART2SEL = HSI16
+	RCC->APB1ENR1 |= (1 << 17); //Enable USART2 clock
+	USART2->CR1 = 0;
+	USART2->BRR = LINK_BRR;
+	USART2->CR1 = USART_CR1_RXNEIE | USART_CR1_TE | USART_CR1_RE; //8 data bits, no parity, 16 times oversampling
+	USART2->CR1 |= USART_CR1_UE;
+	NVIC_SetPriority(USART2_IRQn, 1); //a byte must be read before the next one is in, 87 us at 115200
+	NVIC_EnableIRQ(USART2_IRQn);
+}
+//================================================================================================
+// LINK_SERVICE_USART()
+// @parm: none
+// @return: none
+// 		Called from USART2_IRQHandler. Moves a received byte to the rx ring and the next byte of
+// 		the tx ring to USART2, and clears the error flags.
+//================================================================================================
+void LINK_SERVICE_USART(void)
+{
+	uint32_t isr = USART2->ISR;
+	if (isr & USART_ISR_ERRORS){
+		USART2->ICR = isr & USART_ISR_ERRORS;
+		if (isr & USART_ISR_ORE){ //a byte came in before the last was read
+			board_link.overruns++;
+		}
+	}
+	if (isr & USART_ISR_RXNE){
+		if (!ring_put(&board_link.rx, (uint8_t)USART_READ_RDR(USART2))){
+			board_link.overruns++;
+		}
+		POST_WAKE_EVENT(WAKE_LINK);
+	}
+	if ((USART2->CR1 & USART_CR1_TXEIE) && (isr & USART_ISR_TXE)){
+		uint8_t byte;
+		if (ring_get(&board_link.tx, &byte)){
+			USART_WRITE_TDR(USART2, byte);
+		}
+		else{
+			USART2->CR1 &= ~USART_CR1_TXEIE; //nothing more to send
+		}
+	}
+}
+//================================================================================================
+// LINK_TICK()
+// @parm: none
+// @return: none
+// 		Called from TIM2_IRQHandler every tick, before the ball steps. Wakes the main loop when a
+// 		waiting input from the other board comes due.
+//================================================================================================
+void LINK_TICK(void)
+{
+	uint32_t tick = board_link.tick + 1;
+	board_link.tick = tick;
+	if (tick == board_link.due){
+		POST_WAKE_EVENT(WAKE_LINK);
+	}
+}
+//================================================================================================
+// HANDLE_LINK()
+// @parm: none
+// @return: none
+// 		Main loop, on WAKE_LINK: takes the frames received, resends if the timer ran out, applies
+// 		what is due and acknowledges what arrived if nothing else went out.
+//================================================================================================
+void HANDLE_LINK(void)
+{
+	uint8_t byte;
+	while (ring_get(&board_link.rx, &byte)){
+		take_byte(byte);
+	}
+	if (board_link.resend_due){
+		resend();
+	}
+	apply_inputs();
+	if (board_link.ack_owed){
+		send_frame(MSG_ACK, 0, 0);
+	}
+}
+//================================================================================================
+// LINK_PRESS()
+// @parm: event = EV_P1_PRESS or EV_P2_PRESS
+//        pressTIME_us = usTimer value of the press's edge
+//        *frame - frame being built
+// @return: 1 if the game handled the press
+// 		Takes the place of GAME_EVENT() for a button press in PLAY_MODE. Only this board's
+// 		player plays here; a press during a rally goes to the other board with its tick.
+//================================================================================================
+uint32_t LINK_PRESS(enum game_events event, uint32_t pressTIME_us, struct LED_Frame *frame)
+{
+	if (event != ((board_link.local == ONE) ? EV_P1_PRESS : EV_P2_PRESS)){ //the other player's button, on the other board
+		return 0;
+	}
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //the tick sent is the tick the game takes the press at
+	HANDLE_GAME(); //every step up to now first, as the other board replays them
+	uint32_t tick = board_link.tick;
+	uint32_t rally = IN_RALLY(game_state);
+	uint32_t handled = local_press(tick, pressTIME_us, frame);
+	if (rally){ //a press between rallies only toggles the hitzone LED
+		send_message(MSG_PRESS, tick);
+	}
+	__set_PRIMASK(primask);
+	return handled;
+}
+//================================================================================================
+// LINK_SERVE()
+// @parm: *frame - frame being built
+// @return: 1 to serve now, 0 to stay in INITIAL_SERVE
+// 		Called by the SERVE action. The left board serves once the right one is ready and tells
+// 		it the position and scores; the right board says it is ready and serves when told, taking
+// 		the scores it is sent if they differ from its own.
+//================================================================================================
+uint32_t LINK_SERVE(struct LED_Frame *frame)
+{
+	if (board_link.local == ONE){
+		if (!board_link.peer_ready){
+			return 0;
+		}
+		board_link.peer_ready = 0;
+		send_message(MSG_SERVE, LINK_SERVE_WORD(current_saved_position, P1.score, P2.score));
+	}
+	else{
+		if (!board_link.serve_pending){
+			if (!board_link.ready_sent){
+				send_message(MSG_READY, 0);
+				board_link.ready_sent = 1;
+			}
+			return 0;
+		}
+		board_link.serve_pending = 0;
+		board_link.ready_sent = 0;
+		uint32_t score[2] = { (board_link.serve_word >> 12) & 0x3, (board_link.serve_word >> 14) & 0x3 };
+		struct Player *p[2] = { &P1, &P2 };
+		for (uint32_t i = 0; i < 2; i++){
+			if (p[i]->score != score[i]){
+				TURN_OFF_POINTS_DISPLAY(p[i], frame);
+				p[i]->score = score[i];
+				UPDATE_POINTS_DISPLAY(p[i], frame);
+				board_link.resyncs++;
+			}
+		}
+		current_saved_position = board_link.serve_word & 0xFFF;
+	}
+	board_link.tick = 0;
+	board_link.due = 0;
+	board_link.history_count = 0;
+	return 1;
+}
+//================================================================================================
+// LINK_LEG_START()
+// @parm: none
+// @return: none
+// 		Entry action of MOVE_RIGHT and MOVE_LEFT, through HEAD_RIGHT() and HEAD_LEFT(): keeps the
+// 		ball as it is now, the start of the leg an input from the other board is replayed from.
+//================================================================================================
+void LINK_LEG_START(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	board_link.leg.tick = game_tick();
+	board_link.leg.position = LEDcount;
+	board_link.leg.phase = ball_phase;
+	board_link.leg.velocity = ball_velocity;
+	board_link.leg.level = pace;
+	board_link.leg.heading = direction;
+	board_link.leg.state = game_state;
+	board_link.leg.serial++;
+	board_link.history_count = 0;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// LINK_REPORT()
+// @parm: event = ball event HANDLE_GAME() just had the game handle
+// @return: none
+// 		Tells the other board when this board's player missed, with the tick the game saw it.
+//================================================================================================
+void LINK_REPORT(enum game_events event)
+{
+	if (event == ((board_link.local == ONE) ? EV_BALL_PAST_LEFT : EV_BALL_PAST_RIGHT)){
+		send_message(MSG_MISS, game_tick());
+	}
+}
+//================================================================================================
+// LINK_SEND_RESET()
+// @parm: none
+// @return: none
+// 		Called after SPECIAL_BUTTON_ACTIONS() for a press of this board's special button, so the
+// 		other board resets and changes mode with it.
+//================================================================================================
+void LINK_SEND_RESET(void)
+{
+	forget_round();
+	board_link.input_tail = board_link.input_head; //whatever the other board sent was for the game just reset
+	board_link.due = 0;
+	send_message(MSG_RESET, 0);
+}
+
+#endif /* LINK */
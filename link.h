@@ -0,0 +1,142 @@
+/**
+**************************************************************************************************
+* @file link.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for link.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the UART link between two boards, one player each, and its frame format. With
+* LINK_NONE the functions expand to nothing, or straight to the game, and link.c is empty.
+**************************************************************************************************
+*/
+#ifndef LINK_H_
+#define LINK_H_
+
+#include "main.h"
+#include "game_logic.h"
+
+//USART2 on PA2 (TX) and PA3 (RX), AF7, crossed over to the other board. On the NUCLEO the two
+//pins go to the ST-LINK virtual COM port until its solder bridges are opened (UM1724). PC1 picks
+//the side: left open (pulled up) the board is the left one, P1, and serves; tied to GND it is the
+//right one, P2. USART2 is clocked from HSI16 whatever the core runs at, so the baud rate never
+//changes with the clock (see clock.c).
+#define LINK_BAUD 115200
+#define LINK_KERNEL_HZ 16000000 //HSI16, USART2's kernel clock
+#define LINK_BRR ((LINK_KERNEL_HZ + LINK_BAUD / 2) / LINK_BAUD) //USART2->BRR, 16 times oversampling
+#define LINK_SIDE_PIN 1 //PC1, read once by configure_link()
+
+//Every frame is LINK_FRAME_BYTES long:
+//	0    LINK_SYNC
+//	1    message type in bits 4-7, sequence number in bits 0-3 (0 for MSG_ACK)
+//	2    next sequence number wanted from the other board, in bits 0-3
+//	3-4  value, low byte first: the tick of a press or miss, or the serve word
+//	5    CRC-8 (polynomial 0x07) of bytes 1 to 4
+#define LINK_SYNC 0xA5
+#define LINK_FRAME_BYTES 6
+#define LINK_SEQ_MOD 16 //sequence numbers are 4 bits
+#define LINK_WINDOW 8 //frames sent and not yet acknowledged, less than LINK_SEQ_MOD
+#define LINK_RESEND_MS 30 //unacknowledged frames go again after this long
+#define LINK_RING_BYTES 128 //each way, must be a power of two
+#define LINK_INPUTS 8 //messages from the other board waiting for their tick, must be a power of two
+#define LINK_HISTORY 8 //local presses kept since the ball last changed course
+#define LINK_SERVE_WORD(position, s1, s2) (((position) & 0xFFF) | (((s1) & 0x3) << 12) | (((s2) & 0x3) << 14))
+
+enum link_messages {
+	MSG_ACK,   //no payload, acknowledges and is not itself acknowledged
+	MSG_READY, //the right board waits in INITIAL_SERVE
+	MSG_SERVE, //the left board has served: LINK_SERVE_WORD(current_saved_position, P1.score, P2.score)
+	MSG_PRESS, //the sender's player pressed at tick value
+	MSG_MISS,  //the sender's player missed, by tick value
+	MSG_RESET, //the sender's special button was pressed
+	NUM_of_LINK_MESSAGES
+};
+
+_Static_assert(LINK_WINDOW < LINK_SEQ_MOD && (LINK_RING_BYTES & (LINK_RING_BYTES - 1)) == 0 && (LINK_INPUTS & (LINK_INPUTS - 1)) == 0,
+		"link.h: bad window, ring or input queue size");
+_Static_assert(LINK == LINK_NONE || LINK == LINK_UART, "unknown LINK");
+_Static_assert(LINK == LINK_NONE || (BALL_COUNT == 1 && BALL_ANIMATION == BALL_ANIMATION_CPU),
+		"main.h: linked play rolls back a single ball stepped by TIM2");
+_Static_assert(BOARD_LENGTH <= 0xFFF, "link.h: the serve word holds a 12-bit position");
+
+//Bytes one way, filled by one side and emptied by the other
+struct Link_Ring{
+	uint8_t bytes[LINK_RING_BYTES];
+	volatile uint32_t head; //next byte written
+	volatile uint32_t tail; //next byte read
+};
+
+//Where the served ball was when it last changed course. A remote input is replayed from here.
+struct Link_Leg{
+	uint32_t tick; //board_link.tick at the change
+	uint32_t position, phase, velocity, level;
+	enum directions heading;
+	enum game_states state;
+	uint32_t serial; //counts the changes, so a press can tell it caused one
+};
+
+//A message from the other board, kept until the game can take it
+struct Link_Input{
+	uint32_t type; //enum link_messages
+	uint32_t value; //tick of a press or miss, widened to 32 bits, or the serve word
+};
+
+struct Link{
+	enum identifications local; //player on this board, ONE on the left board
+	volatile uint32_t tick; //TIM2 ticks since the serve, the clock both boards play the rally by
+	volatile uint32_t due; //tick at which the oldest remote input is due, 0 if none waits
+	struct Link_Ring rx, tx; //USART2_IRQHandler fills rx and empties tx
+	uint8_t frame[LINK_FRAME_BYTES]; //frame being received
+	uint32_t framed; //bytes of it so far
+	struct { uint8_t type; uint16_t value; } sent[LINK_SEQ_MOD]; //by sequence number, kept until acknowledged
+	uint32_t next_seq; //sequence number of the next frame sent
+	uint32_t unacked_seq; //oldest sequence number not yet acknowledged
+	uint32_t wanted_seq; //next sequence number wanted from the other board
+	uint32_t ack_owed; //a frame arrived since the last one sent
+	struct Soft_Timer resend_timer;
+	volatile uint32_t resend_due; //set by the timer, frames go again from the main loop
+	struct Link_Leg leg;
+	struct Link_Input inputs[LINK_INPUTS]; //messages from the other board in arrival order
+	uint32_t input_head, input_tail;
+	uint32_t history[LINK_HISTORY]; //ticks of local presses since leg, oldest first
+	uint32_t history_stamp[LINK_HISTORY]; //their usTimer stamps
+	uint32_t history_count;
+	uint32_t peer_ready; //left board: MSG_READY arrived since the last serve
+	uint32_t ready_sent; //right board: MSG_READY sent since the last serve
+	uint32_t serve_pending; //right board: MSG_SERVE arrived, serve_word holds it
+	uint32_t serve_word;
+	uint32_t replaying; //1 while a remote input is replayed, game_tick is the tick replayed
+	uint32_t game_tick;
+	//counters
+	uint32_t frames_sent, frames_received, frames_resent, crc_errors, overruns, discarded, window_full; //discarded: frames out of order, inputs with no room
+	uint32_t rollbacks, rollback_ticks, worst_rollback, waited, resyncs;
+};
+
+extern struct Link board_link;
+
+#if LINK == LINK_UART
+void configure_link(void);
+void LINK_TICK(void);
+void LINK_SERVICE_USART(void);
+void HANDLE_LINK(void);
+uint32_t LINK_PRESS(enum game_events event, uint32_t pressTIME_us, struct LED_Frame *frame);
+uint32_t LINK_SERVE(struct LED_Frame *frame);
+void LINK_LEG_START(void);
+void LINK_REPORT(enum game_events event);
+void LINK_SEND_RESET(void);
+#define LINK_REMOTE_EVENT(event) ((event) == ((board_link.local == ONE) ? EV_BALL_PAST_RIGHT : EV_BALL_PAST_LEFT)) //the other board's to report
+#define LINK_KEEPS_HSI16 1
+#else
+#define configure_link() ((void)0)
+#define LINK_TICK() ((void)0)
+#define HANDLE_LINK() ((void)0)
+#define LINK_PRESS(event, pressTIME_us, frame) GAME_EVENT((event), (pressTIME_us), (frame))
+#define LINK_SERVE(frame) 1
+#define LINK_LEG_START() ((void)0)
+#define LINK_REPORT(event) ((void)0)
+#define LINK_SEND_RESET() ((void)0)
+#define LINK_REMOTE_EVENT(event) 0
+#define LINK_KEEPS_HSI16 0
+#endif
+
+#endif /* LINK_H_ */
@@ -4,7 +4,18 @@
 #include "leds.h"
 #include "game_logic.h"
 #include "timers.h"
+#include "clock.h"
+#include "ball.h"
+#include "animation.h"
+#include "strip.h"
 #include "input.h"
+#include "power.h"
+#include "recorder.h"
+#include "profile.h"
+#include "link.h"
+#include "stats_log.h"
+#include "shared_state.h"
+#include "scheduler.h"
 /**
 **************************************************************************************************
 * @file main.c
@@ -14,37 +25,57 @@
 * @version 2.0
 **************************************************************************************************
 */
-volatile uint32_t LEDcount;//Sets the first LED that will be turned on
-enum directions direction;
+struct Ball_Pool balls = { .in_play = 0x1, .in_state = { [INITIAL_SERVE] = ALL_BALLS } }; //LEDcount, direction and pace are ball 0's
 enum game_states game_state = INITIAL_SERVE;
 enum system_states system_state = PLAY_MODE;
-volatile uint32_t pace = DEFAULT_SPEED;
+struct Game_Tuning tuning = {
+		.default_speed = DEFAULT_SPEED,
+		.pace_step = PACE_STEP,
+		.max_speed = MAX_SPEED,
+		.time_out_ms = TIME_OUT_TIME,
+		.hitzone_toggle_ms = HITZONE_LED_TOGGLE_TIME,
+		.debounce_ms = DEBOUNCE_DELAY,
+};
 
-struct UserInput button = {0, 0, 0}; //Creates a button with choice, counter, pending values at 0;
 volatile uint32_t current_saved_position = DEFAULT_POSITION; //sets default "ball" position
 volatile uint32_t msTimer = 0;
+static uint32_t drawn_position = 0xFFFFFFFF; //LED lit by MOVE_MODE, none yet
+
+static enum task_results LINK_TASK(struct Task *t);
+static enum task_results GAME_TASK(struct Task *t);
+static enum task_results MOVE_MODE_TASK(struct Task *t);
+static enum task_results DEBOUNCE_TASK(struct Task *t);
+#define WAKE_ANY ((0x1u << NUM_of_WAKE_EVENTS) - 1)
+struct Task tasks[NUM_of_TASKS] = { //the main loop's work, see scheduler.c/h
+		[TASK_LINK]      = { LINK_TASK,      WAKE_MASK(WAKE_LINK),  0, BALL_TICK_us }, //remote inputs land on the next tick
+		[TASK_GAME]      = { GAME_TASK,      WAKE_ANY,              1, BALL_TICK_us }, //before the ball steps again
+		[TASK_MOVE_MODE] = { MOVE_MODE_TASK, WAKE_ANY,              1, 10000 }, //well below what the eye sees
+		[TASK_DEBOUNCE]  = { DEBOUNCE_TASK,  WAKE_MASK(WAKE_INPUT), 2, 1000 }, //a press shows within a millisecond
+};
 
-struct Light_Emitting_Diode LEDS[] = { //declaring the array of LEDS
-		 {GPIOC, 8}, {GPIOC, 9}, {GPIOC, 6}, {GPIOB, 8}, {GPIOC, 5}, {GPIOB, 9},
-		 {GPIOA, 12}, {GPIOA, 11}, {GPIOA, 6}, {GPIOB, 12}, {GPIOA, 7}, {GPIOB, 11},
-		 {GPIOB, 6}, {GPIOC, 7}, {GPIOB, 2}, {GPIOA, 9}, {GPIOB, 1}, {GPIOA, 8},
-		 {GPIOB, 15}, {GPIOB, 10}, {GPIOB, 14}, {GPIOB, 4}, {GPIOB, 13}, {GPIOB, 5}
+#define LEDS_ENTRY(name, port, pin) [LED_##name] = {GPIO##port, BOARD_PORT_##port, (0x1u << (pin))},
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+struct Light_Emitting_Diode LEDS[NUM_of_BOARD_LEDS] = { //LEDs on GPIO pins, configure_strip() adds the GAMEBOARD row
+		BOARD_GPIO_LEDS(LEDS_ENTRY)
 };
+#else
+const struct Light_Emitting_Diode LEDS[NUM_of_BOARD_LEDS] = { //every LED on the board, generated from board.h
+		BOARD_LEDS(LEDS_ENTRY)
+};
+#endif
 
 struct Player P1 = {//left player
 		.score =0,
 
 		.pressTIME_STAMP = 0,
-		.missTIME_STAMP = 0,
-		.winnerTIME_STAMP = 0,
 
 		.missFLAG = 0,
 		.pressedFLAG = 0,
 		.winnerFLAG =0,
 
-		.points_display = { {GPIOC, 0}, {GPIOC, 3},{GPIOC, 2} },
-		.hitzoneLED = {GPIOB, 13},
-		.missLED = {GPIOB, 5}
+		.points_display = { &LEDS[LED_P1_POINT_1], &LEDS[LED_P1_POINT_2], &LEDS[LED_P1_POINT_3] },
+		.hitzoneLED = &LEDS[LED_P1_HITZONE],
+		.missLED = &LEDS[LED_P1_MISS]
 };
 
 struct Player P2 = { //right player
@@ -52,65 +83,169 @@ struct Player P2 = { //right player
 		.score =0,
 
 		.pressTIME_STAMP = 0,
-		.missTIME_STAMP = 0,
-		.winnerTIME_STAMP =0,
 
 		.missFLAG = 0,
 		.pressedFLAG = 0,
 		.winnerFLAG =0,
 
-		.points_display = { {GPIOC, 12}, {GPIOC, 10}, {GPIOC, 11} },
-		.hitzoneLED = {GPIOC, 9},
-		.missLED = {GPIOC, 8}
+		.points_display = { &LEDS[LED_P2_POINT_1], &LEDS[LED_P2_POINT_2], &LEDS[LED_P2_POINT_3] },
+		.hitzoneLED = &LEDS[LED_P2_HITZONE],
+		.missLED = &LEDS[LED_P2_MISS]
 };
+//Player.timing lives in the room the three flags gave up as bytes, so a player is no bigger than
+//its eight words, five LED pointers and hitzone timer were before it
+_Static_assert(sizeof(struct Player) <= 8 * sizeof(uint32_t) + 5 * sizeof(void *) + sizeof(struct Soft_Timer),
+		"main.h: struct Player outgrew its budget");
 
 
 int main(void)
 {
-	//--initialize hardware------------------------------------------------------------------------
-	//LEDs connected to port A's pins
-	uint32_t GPIOA_pins[] = {6, 7, 8, 9, 11, 12,5};
-
-	//LEDs connected to port B's pins
-	uint32_t GPIOB_pins[] = {1, 2, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+	configure_system(); //initialize hardware
 
-	//LEDs connected to port C's pins
-	uint32_t GPIOC_pins[] = {5, 6, 7, 8, 9 ,10,11,12, 0,3,2};
+	//---------------------------------------------------------------------------------------------
+	// This main loop continuously monitors both system and game states. It responds to player
+	// input and updates gameplay accordingly, managing LED movement, scoring, and state changes
+	//---------------------------------------------------------------------------------------------
+	while (1)
+	{
+		HANDLE_MAIN_LOOP();
+	}//end while loop
+}//end main
 
-	configure_LEDS(GPIOA, GPIOA_pins, GPIOApins_used, 0);//configure port A's LEDs
-	configure_LEDS(GPIOB, GPIOB_pins, GPIOBpins_used, 1);//configure port B's LEDs
-	configure_LEDS(GPIOC, GPIOC_pins, GPIOCpins_used, 2);//configure port C's LEDs
+//================================================================================================
+// configure_system()
+//
+// @parm: none
+// @return: none
+//
+// 		 Configures every LED, button, and timer used by the game. Kept separate from main() so
+//       the host simulator (sim/) can bring the board up without entering the infinite loop.
+//================================================================================================
+void configure_system(void)
+{
+	configure_core_clock(); //PLAY_CLK_FREQ, before anything is timed from it, see clock.c/h
+	for (uint32_t i = 0; i < LED_PORTS_used; i++){
+		configure_LEDS(&LED_PORT_CONFIG[i]);//configure every LED on the port (see board.h)
+	}
+	configure_strip(); //GAMEBOARD row on a WS2812 strip, only with LED_OUTPUT_STRIP, see strip.c/h
 	configure_external_switches();//configure the switches and their dedicated interrupts
 	configure_board_button(); //configure the board button and its interrupt
 	configureSysTickInterrupt();
 	startSysTickTimer_MACRO;
 
 	configureTIM2(); //configure general purpose TIM2
+	configure_ball_animation(); //DMA1 channels that play the ball, only with BALL_ANIMATION_DMA, see animation.c/h
+	configureTIM5(); //free-running microsecond counter for button timestamps
+	configure_idle_stats(); //start counting active vs sleep cycles
+	configure_link(); //USART2 to the other board, only with LINK_UART, see link.c/h
+	configure_stats_log(); //lifetime statistics read back from flash, only with STATS_LOG, see stats_log.c/h
+	configure_scheduler(); //main loop tasks from the top, see scheduler.c/h
+	PROFILE_RESET(); //handler timing, only with PROFILING, see profile.c/h
+	RECORDER_START(); //log inputs and timer events for replay, see recorder.c/h
+	PUBLISH_GAME_STATE(); //the state the ISRs start from, see shared_state.c/h
+	POST_WAKE_EVENT(WAKE_STATE); //run the INITIAL_SERVE state straight away
+}
 
+//================================================================================================
+// HANDLE_MAIN_LOOP()
+//
+// @parm: none
+// @return: none
+//
+// 		 One pass of the main loop. Takes the wake events posted by the ISRs, handles them, then
+//       sleeps until the next event.
+//================================================================================================
+void HANDLE_MAIN_LOOP(void)
+{
+	HANDLE_WAKE_EVENTS(TAKE_WAKE_EVENTS()); //see power.c/h
+	PROFILE_STREAM(); //send a few words of the profile over ITM, only with PROFILING
+	SLEEP_UNTIL_EVENT();
+}
 
-	//---------------------------------------------------------------------------------------------
-	// This main loop continuously monitors both system and game states. It responds to player
-	// input and updates gameplay accordingly, managing LED movement, scoring, and state changes
-	//---------------------------------------------------------------------------------------------
-	while (1)
-	{
-		switch(system_state){
-		case PLAY_MODE:
-			HANDLE_GAME(); //see game_logic.c/h
-			break;
-		case MOVE_MODE:
-			TurnOnBoardLED_MACRO;//Turn on the board LED
-			LEDS[LEDcount].port-> ODR |= (0x1 << LEDS[LEDcount].pin); //turn on current LED
-			current_saved_position = LEDcount;//saves the current LED position for when the user switches modes
-			break;
-		}//end switch
-		if(button.press_pending == 1 && msTimer - button.debounce_counter >= DEBOUNCE_DELAY  ){//if debouncing is finished...
-			HANDLE_DEBOUNCED_BUTTON(); //see input.c/h
-			button.press_pending = 0; // clear the pending flag
-			button.debounce_counter = 0;//clear debounce counter;
-		}
-	}//end while loop
-}//end main
+//================================================================================================
+// HANDLE_WAKE_EVENTS()
+//
+// @parm: events = mask of wake events taken by TAKE_WAKE_EVENTS()
+// @return: none
+//
+// 		 Runs the tasks the wake events make ready (see scheduler.c/h): the link, the current
+//       system state and any button presses whose debounce time has elapsed. Nothing is re-run
+//       unless the ball, the state or an input has changed. Also called by REPLAY_RECORDING(),
+//       which supplies the events itself.
+//================================================================================================
+void HANDLE_WAKE_EVENTS(uint32_t events)
+{
+	enum game_states previous_game_state = game_state;
+	enum system_states previous_system_state = system_state;
+
+	SCHEDULER_POST(events);
+	SCHEDULER_RUN(); //logs the state changes, see scheduler.c/h
+	if (game_state != previous_game_state || system_state != previous_system_state
+			|| (system_state == MOVE_MODE && LEDcount != drawn_position)){
+		POST_WAKE_EVENT(WAKE_STATE); //let the new state run before going to sleep
+	}
+}
+//================================================================================================
+// LINK_TASK()
+// @parm: *t = its task
+// @return: enum task_results
+// 		On WAKE_LINK: bytes from the other board, a remote press due or frames to resend
+//================================================================================================
+static enum task_results LINK_TASK(struct Task *t)
+{
+	PT_BEGIN(t);
+	HANDLE_LINK(); //only with LINK_UART, see link.c/h
+	PT_END(t);
+}
+//================================================================================================
+// GAME_TASK()
+// @parm: *t = its task
+// @return: enum task_results
+// 		In PLAY_MODE, on any wake event: the ball moved, the state changed, an input arrived or a
+// 		timeout is due.
+//================================================================================================
+static enum task_results GAME_TASK(struct Task *t)
+{
+	PT_BEGIN(t);
+	PT_WAIT_UNTIL(t, system_state == PLAY_MODE);
+	PROFILE_ENTER(PROF_HANDLE_GAME);
+	HANDLE_GAME(); //see game_logic.c/h
+	PROFILE_EXIT(PROF_HANDLE_GAME);
+	drawn_position = 0xFFFFFFFF; //redraw when MOVE_MODE is entered
+	PT_END(t);
+}
+//================================================================================================
+// MOVE_MODE_TASK()
+// @parm: *t = its task
+// @return: enum task_results
+// 		In MOVE_MODE, on any wake event: lights the ball's LED where the buttons have moved it.
+//================================================================================================
+static enum task_results MOVE_MODE_TASK(struct Task *t)
+{
+	PT_BEGIN(t);
+	PT_WAIT_UNTIL(t, system_state == MOVE_MODE);
+	if (LEDcount != drawn_position){ //only touch the LEDs when the position has changed
+		struct LED_Frame frame = {0};
+		LED_FRAME_ON(&frame, &BoardLED);//Turn on the board LED
+		LED_FRAME_ON(&frame, &LEDS[LEDcount]); //turn on current LED
+		COMMIT_LED_FRAME(&frame);
+		drawn_position = LEDcount;
+	}
+	current_saved_position = LEDcount;//saves the current LED position for when the user switches modes
+	PT_END(t);
+}
+//================================================================================================
+// DEBOUNCE_TASK()
+// @parm: *t = its task
+// @return: enum task_results
+// 		On WAKE_INPUT: an edge arrived or a debounce timer ran out.
+//================================================================================================
+static enum task_results DEBOUNCE_TASK(struct Task *t)
+{
+	PT_BEGIN(t);
+	HANDLE_DEBOUNCED_BUTTON(); //handles presses whose debounce has finished, see input.c/h
+	PT_END(t);
+}
 
 
 //================================================================================================
@@ -120,15 +255,16 @@ int main(void)
 // @return: none
 //
 // 		 When triggered, it identifies the button as the LEFT button,
-//       stores the ID, and begins the debounce protocol.
+//       posts the press, stamped with usTimer, to that button's queue to begin the debounce protocol.
 //================================================================================================
 void EXTI4_IRQHandler(void)
 {
+	PROFILE_ENTER(PROF_EXTI4);
 	if (EXTI->PR1 & (0x1 << 4)) {//if the interrupt flag is set....
 		EXTI->PR1 |= (0x1 << 4);  // Clear interrupt flag
-		button.choice = Left_Pushed;//set button ID as "ONE"
-		DEBOUNCE_PROTOCOL(&button, msTimer);//Initiate debouncing
+		DEBOUNCE_PROTOCOL(&buttons[Left_Pushed - 1], Left_Pushed, usTimer);//Initiate debouncing
 	}
+	PROFILE_EXIT(PROF_EXTI4);
 }
 //================================================================================================
 // EXTI1_IRQHandler()
@@ -137,15 +273,16 @@ void EXTI4_IRQHandler(void)
 // @return: none
 //
 // 		 When triggered, it identifies the button as the RIGHT button,
-//       stores the ID, and begins the debounce protocol.
+//       posts the press, stamped with usTimer, to that button's queue to begin the debounce protocol.
 //================================================================================================
 void EXTI1_IRQHandler(void)
 {
+	PROFILE_ENTER(PROF_EXTI1);
 	if (EXTI->PR1 & (0x1 << 1)) { //if the interrupt flag is set....
 		  EXTI->PR1 |= (0x1 << 1);  // Clear interrupt flag
-		  button.choice = Right_Pushed;//set button ID as "TWO"
-		  DEBOUNCE_PROTOCOL(&button, msTimer); //Initiate debouncing
+		  DEBOUNCE_PROTOCOL(&buttons[Right_Pushed - 1], Right_Pushed, usTimer); //Initiate debouncing
 	}
+	PROFILE_EXIT(PROF_EXTI1);
 }
 
 
@@ -162,15 +299,16 @@ void EXTI1_IRQHandler(void)
 // @return: none
 //
 // 		 When triggered, it identifies the button as the SPECIAL button,
-//       stores the ID, and begins the debounce protocol.
+//       posts the press, stamped with usTimer, to that button's queue to begin the debounce protocol.
 //================================================================================================
 void EXTI15_10_IRQHandler(void)
 {
+	PROFILE_ENTER(PROF_EXTI15_10);
 	if (EXTI->PR1 & (0x1 << 13)) { //if the interrupt flag is set....
 		EXTI->PR1 |= (0x1 << 13);  // Clear interrupt flag
-		button.choice = Special_Pushed;//set button ID as "SPECIAL"
-	    DEBOUNCE_PROTOCOL(&button, msTimer);//Initiate debouncing
+	    DEBOUNCE_PROTOCOL(&buttons[Special_Pushed - 1], Special_Pushed, usTimer);//Initiate debouncing
 	}
+	PROFILE_EXIT(PROF_EXTI15_10);
 }
 //================================================================================================
 // SysTick_Handler()
@@ -178,16 +316,17 @@ void EXTI15_10_IRQHandler(void)
 // @parm: none
 // @return: none
 //
-// 		  Increments the global millisecond timer (msTimer). If the system is in PLAY_MODE, it
-//		  updates the hitzone LEDs for both players based on their input timing.
+// 		  Increments the global millisecond timer (msTimer), changes the core clock speed on
+//		  the millisecond boundary when asked to, and fires any software timer due this
+//		  millisecond (hitzone toggles, time outs, debounces, see soft_timer.c/h).
 //================================================================================================
 void SysTick_Handler(void)
 {
+	PROFILE_ENTER(PROF_SYSTICK);
 	msTimer++; //goes up every 1ms
-	if (system_state == PLAY_MODE){
-		HANDLE_HITZONE_LEDS(&P1, msTimer);
-		HANDLE_HITZONE_LEDS(&P2, msTimer);
-	}
+	CORE_CLOCK_TICK(); //switch to the speed the game asked for, if it changed, see clock.c/h
+	TIMER_WHEEL_TICK(msTimer);
+	PROFILE_EXIT(PROF_SYSTICK);
 }
 //================================================================================================
 // TIM2_IRQHandler()
@@ -195,16 +334,115 @@ void SysTick_Handler(void)
 // @parm: none
 // @return: none
 //
-// 		 If the game is in a winner's state, toggles the winner's point display. Otherwise, it is
-// 		 responsible for updating the LED position.
+// 		 Runs BALL_TICK_HZ times a second. Advances every ball (or the winner's point display) and, when
+// 		 any has moved on by a whole LED, records the step and wakes the main loop. A ball reaching
+// 		 a hitzone or MISS zone raises its event here, see BALL_ARRIVED() in game_logic.c.
 //================================================================================================
 void TIM2_IRQHandler(void)
 {
+	PROFILE_ENTER(PROF_TIM2);
 	if (TIM2->SR & (1 << 0)) {
         TIM2->SR &= ~(1 << 0);// Clear update flag
-        HANDLE_GAME_LED_MOVEMENT(); //see game_logic.c/h
+        LINK_TICK(); //the rally clock both linked boards play by, only with LINK_UART
+        uint32_t stepped = BALL_TICK(); //see ball.c/h
+        if (stepped){
+        	RECORD_BALL(stepped); //see recorder.c/h
+        	POST_WAKE_EVENT(WAKE_BALL); //a ball moved, let HANDLE_GAME handle what it reached
+        }
+	}
+	PROFILE_EXIT(PROF_TIM2);
+}
+#if LINK == LINK_UART
+//================================================================================================
+// USART2_IRQHandler()
+//
+// @parm: none
+// @return: none
+//
+// 		 Runs for every byte received from the other board and, while there is something to send,
+// 		 every byte USART2 can take. See LINK_SERVICE_USART() in link.c.
+//================================================================================================
+void USART2_IRQHandler(void)
+{
+	PROFILE_ENTER(PROF_USART2);
+	LINK_SERVICE_USART(); //see link.c/h
+	PROFILE_EXIT(PROF_USART2);
+}
+#endif
+#if BALL_ANIMATION == BALL_ANIMATION_DMA
+//================================================================================================
+// DMA1_Channel2_IRQHandler()
+//
+// @parm: none
+// @return: none
+//
+// 		 Runs when DMA has played the last step of a ball segment, in the hitzone or the MISS
+// 		 zone. Moves LEDcount there, raises its event, records the steps and wakes the main loop.
+//================================================================================================
+void DMA1_Channel2_IRQHandler(void)
+{
+	PROFILE_ENTER(PROF_DMA1_CH2);
+	if (DMA1->ISR & (1 << 5)) { //if the transfer complete flag is set....
+		DMA1->IFCR = (1 << 5); // Clear it
+		RECORD_SEGMENT(BALL_SEGMENT_DONE()); //see animation.c/h and recorder.c/h
+		POST_WAKE_EVENT(WAKE_BALL); //the ball reached a hitzone or MISS zone, let HANDLE_GAME handle it
+	}
+	PROFILE_EXIT(PROF_DMA1_CH2);
+}
+#endif
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+//================================================================================================
+// DMA1_Channel3_IRQHandler()
+//
+// @parm: none
+// @return: none
+//
+// 		Runs when DMA has handed SPI1 the last byte of a strip frame. Sends whatever the game has
+// 		changed on the strip since the frame was encoded.
+//================================================================================================
+void DMA1_Channel3_IRQHandler(void)
+{
+	PROFILE_ENTER(PROF_DMA1_CH3);
+	if (DMA1->ISR & (1 << 9)) { //if the transfer complete flag is set....
+		DMA1->IFCR = (1 << 9); // Clear it
+		STRIP_FRAME_SENT(); //see strip.c/h
+	}
+	PROFILE_EXIT(PROF_DMA1_CH3);
+}
+#endif
+#if STATS_LOG
+//================================================================================================
+// FLASH_IRQHandler()
+//
+// @parm: none
+// @return: none
+//
+// 		Runs at the end of every program or erase of the statistics log, and starts the next one.
+// 		See STATS_FLASH_DONE() in stats_log.c.
+//================================================================================================
+void FLASH_IRQHandler(void)
+{
+	PROFILE_ENTER(PROF_FLASH);
+	STATS_FLASH_DONE(); //see stats_log.c/h
+	PROFILE_EXIT(PROF_FLASH);
+}
+//================================================================================================
+// NMI_Handler()
+//
+// @parm: none
+// @return: none
+//
+// 		Runs for a double ECC error on a flash read. Only the statistics log reads flash as data,
+// 		when configure_stats_log() reads back a double-word a reset left half-programmed.
+//================================================================================================
+void NMI_Handler(void)
+{
+	if (FLASH->ECCR & (1u << 31)){ //ECCD
+		FLASH->ECCR = (1u << 31); //write 1 to clear
+		STATS_ECC_FAULT(); //see stats_log.c/h
 	}
 }
+#endif
 
 
 
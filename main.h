@@ -13,77 +13,252 @@
 #define MAIN_H
 #include <stdint.h>
 #include "stm32l476xx.h"
+#include "soft_timer.h"
+
+//Single store to a port's bit set/reset register. Low half sets pins, high half resets them.
+//The host simulator (sim/) supplies its own definition so the store also updates ODR.
+#ifndef GPIO_BSRR_WRITE
+#define GPIO_BSRR_WRITE(port, value) ((port)->BSRR = (value))
+#endif
+
+//Bus address of a buffer or register, as DMA CPAR/CMAR take it. The host simulator (sim/) keeps
+//host pointers there instead and supplies its own definition.
+#ifndef DMA_ADDRESS
+#define DMA_ADDRESS(pointer) ((uint32_t)(pointer))
+#endif
+
+//Single store to a USART's transmit data register, and single load of its receive data register,
+//which clears RXNE. The host simulator (sim/) supplies its own definitions so the byte goes out,
+//or RXNE clears, at the access, as here.
+#ifndef USART_WRITE_TDR
+#define USART_WRITE_TDR(usart, byte) ((usart)->TDR = (byte))
+#endif
+#ifndef USART_READ_RDR
+#define USART_READ_RDR(usart) ((usart)->RDR)
+#endif
+
+//Software update event (EGR UG): reloads a timer's prescaler and restarts its count. The host
+//simulator (sim/) supplies its own definition so the event happens at the store, as here.
+#ifndef TIM_UPDATE_EVENT
+#define TIM_UPDATE_EVENT(tim) ((tim)->EGR = (1 << 0))
+#endif
+
+//Spins until a clock, regulator or flash setting has taken effect. The host simulator (sim/)
+//supplies its own definition, which settles its RCC, PWR and FLASH model first.
+#ifndef CLOCK_WAIT
+#define CLOCK_WAIT(condition) while (!(condition))
+#endif
+
+//Flash access for the statistics log, at bus addresses. A double-word is programmed by two word
+//stores, the second of which starts the write, and a CR store with STRT starts an erase. The host
+//simulator (sim/) supplies its own definitions, which act on its flash model at the access.
+#ifndef FLASH_READ_DOUBLE
+#define FLASH_READ_DOUBLE(address) (*(volatile const uint64_t *)(address))
+#endif
+#ifndef FLASH_PROGRAM_DOUBLE
+#define FLASH_PROGRAM_DOUBLE(address, value) do { *(volatile uint32_t *)(address) = (uint32_t)(value); \
+		*(volatile uint32_t *)((address) + 4) = (uint32_t)((value) >> 32); } while (0)
+#endif
+#ifndef FLASH_CR_WRITE
+#define FLASH_CR_WRITE(value) (FLASH->CR = (value))
+#endif
 
 //macros
 #define startSysTickTimer_MACRO (SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk)
 #define startTIM2_MACRO (TIM2->CR1 |= (1 << 0)) //start timer
 #define stopTIM2_MACRO (TIM2->CR1 &= ~(1 << 0)) //stop timer
-#define ToggleBoardLED_MACRO (GPIOA->ODR ^= (0x1 << 5))
-#define TurnOnBoardLED_MACRO (GPIOA->ODR |= (0x1 << 5))
-#define TurnOffBoardLED_MACRO (GPIOA->ODR &= ~(0x1 << 5))
+#define usTimer (TIM5->CNT) //free-running microsecond count, see configureTIM5()
+#define TurnOnBoardLED_MACRO GPIO_BSRR_WRITE(GPIOA, (0x1 << 5))
+#define TurnOffBoardLED_MACRO GPIO_BSRR_WRITE(GPIOA, (0x1 << (5 + 16)))
 #define RightButtonPressed ((!(GPIOA->IDR & (0x1 << 1))))//macro
 #define LeftButtonPressed ((!(GPIOA->IDR & (0x1 << 4)))) //macro
 #define SpecialButtonPressed ((!(GPIOC->IDR & (0x1 << 13))))//macro
-#define NUM_of_LEDS 30
-#define GPIOApins_used 7 //number of GPIOA pins used for LEDs
-#define GPIOBpins_used 13 //number of GPIOB pins used for LEDs
-#define GPIOCpins_used 11 //number of GPIOC pins used for LEDs
-#define SYS_CLK_FREQ 4000000// default frequency of the device = 4 MHZ
-#define cntclk 1000
+#define LED_PORTS_used 3 //GPIOA, GPIOB and GPIOC drive LEDs (see board.h)
+#define LED_OUTPUT_GPIO 0 //one GPIO pin per LED, wired as in board.h
+#define LED_OUTPUT_STRIP 1 //GAMEBOARD row on one WS2812 strip, sent over SPI1 by DMA (see strip.c)
+#ifndef LED_OUTPUT //may be set on the compiler command line
+#define LED_OUTPUT LED_OUTPUT_GPIO
+#endif
+#ifndef BOARD_LENGTH //may be set on the compiler command line
+#define BOARD_LENGTH 24 //LEDs in the GAMEBOARD row, MISS and HITZONE LEDs included. 24 with LED_OUTPUT_GPIO
+#endif
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+#define STRIP_PORTS ((BOARD_LENGTH + 15) / 16) //LED_Frame words for the strip, 16 pixels each like the pins of a port
+#define IDLE_CLK_FREQ 20000000 //PLL, the slowest clock the strip's SPI bit time still divides from (see strip.h)
+#else
+#define STRIP_PORTS 0
+#define IDLE_CLK_FREQ 1000000 //MSI range 4, the slowest clock TIM5 can still count microseconds from
+#endif
+#define PLAY_CLK_FREQ 80000000 //PLL, the fastest the device runs. Set while the ball is in play (see clock.c)
+#define LED_FRAME_PORTS (LED_PORTS_used + STRIP_PORTS) //words in struct LED_Frame
+#define cntclk 100000 //TIM2 count frequency
+#ifndef BALL_TICK_HZ //may be set on the compiler command line
+#define BALL_TICK_HZ 1000 //TIM2 update rate, the ball is advanced on every update (see ball.c). 10000 for balls of several kHz
+#endif
+#define usclk 1000000 //TIM5 count frequency, 1 us per count
 #define DEBOUNCE_DELAY 20//20ms debounce delay
+#define DEBOUNCE_DEFERRED 0 //act DEBOUNCE_DELAY after the last edge if the button is still down
+#define DEBOUNCE_LEADING_EDGE 1 //act on the first edge, then ignore the line until released for DEBOUNCE_DELAY
+#ifndef DEBOUNCE_MODE //may be set on the compiler command line
+#define DEBOUNCE_MODE DEBOUNCE_LEADING_EDGE
+#endif
+#ifndef PROFILING //may be set on the compiler command line
+#define PROFILING 0 //1 = time every handler with DWT->CYCCNT and stream the table over ITM, see profile.c
+#endif
+#ifndef STATS_LOG //may be set on the compiler command line
+#define STATS_LOG 1 //1 = keep lifetime player statistics in a log at the top of flash bank 2, see stats_log.c
+#endif
+#ifndef LATENCY_STATS //may be set on the compiler command line
+#define LATENCY_STATS 0 //1 = histogram the time from each button edge to the LED commit it causes, see latency.c
+#endif
 #define TIME_OUT_TIME 1800//arbitrary value that felt the best (MS)
 #define HITZONE_LED_TOGGLE_TIME 150//arbitrary value that felt the best (MS)
 #define WINNERS_CIRCLE_TIME 2500//arbitrary value that felt the best (MS)
-#define DEFAULT_SPEED 5 //initial speed for LED movement, it felt the best
-#define DEFAULT_POSITION 12 //initial position of the "ball"
+#define DEFAULT_SPEED 5 //initial speed for LED movement (LEDs per second), it felt the best
+#define PACE_STEP 1 //speed (LEDs per second) added by each step of the speed curve
+#define MAX_SPEED (BALL_TICK_HZ / 2) //fastest LED movement, at most one LED every other tick
+#define SPEED_CURVE_LINEAR 0 //every successful hit adds PACE_STEP
+#define SPEED_CURVE_EXPONENTIAL 1 //every successful hit adds SPEED_CURVE_GROWTH times the previous increase
+#define SPEED_CURVE_CAPPED 2 //linear for SPEED_CURVE_CAP hits, then no faster
+#ifndef SPEED_CURVE //may be set on the compiler command line
+#define SPEED_CURVE SPEED_CURVE_LINEAR
+#endif
+#define SPEED_CURVE_GROWTH 72090 //1.1 in Q16.16
+#define SPEED_CURVE_CAP 12
+#define WINNERS_CIRCLE_FLASH_RATE 8 //POINTS display toggles per second in the winner's circle
+#ifndef BALL_COUNT //may be set on the compiler command line
+#define BALL_COUNT 1 //balls in play at once, up to 32. Above 1 every successful hit adds a ball (see game_logic.c)
+#endif
+#define LINK_NONE 0 //both players on this board
+#define LINK_UART 1 //one player per board, two boards linked over USART2 (see link.c)
+#ifndef LINK //may be set on the compiler command line
+#define LINK LINK_NONE
+#endif
+#ifndef ADAPTIVE_DIFFICULTY //may be set on the compiler command line
+#if LINK == LINK_UART
+#define ADAPTIVE_DIFFICULTY 0 //each board only times its own player, and both boards must serve alike
+#else
+#define ADAPTIVE_DIFFICULTY 1 //1 = serve speed and speed-up per hit follow the players' press timing, see difficulty.c
+#endif
+#endif
+#define BALL_ANIMATION_CPU 0 //TIM2 interrupts on every tick and the ISR steps the ball
+#define BALL_ANIMATION_DMA 1 //DMA plays precomputed LED frames, the CPU only wakes at the hitzones
+#ifndef BALL_ANIMATION //may be set on the compiler command line
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+#define BALL_ANIMATION BALL_ANIMATION_CPU //the strip is redrawn by strip.c, there are no BSRR words to play
+#elif BALL_COUNT > 1
+#define BALL_ANIMATION BALL_ANIMATION_CPU //DMA plays a single ball's run
+#elif LINK == LINK_UART
+#define BALL_ANIMATION BALL_ANIMATION_CPU //a late press from the other board is replayed tick by tick
+#else
+#define BALL_ANIMATION BALL_ANIMATION_DMA
+#endif
+#endif
+#define DEFAULT_POSITION (BOARD_LENGTH / 2) //initial position of the "ball"
 #define RIGHT_MISS_ZONE 0
-#define LEFT_MISS_ZONE 23
+#define LEFT_MISS_ZONE (BOARD_LENGTH - 1)
 #define RIGHT_HITZONE_POS 1
-#define LEFT_HITZONE_POS 22
+#define LEFT_HITZONE_POS (BOARD_LENGTH - 2)
+
+#include "board.h" //LED wiring, checked against the constants above
 
 //enums
 enum choices { Left_Pushed = 1, Right_Pushed, Special_Pushed };
+#define NUM_of_BUTTONS 3 //one per enum choices value
 enum game_states { INITIAL_SERVE, MOVE_RIGHT, RIGHT_HITZONE, MOVE_LEFT,
-	LEFT_HITZONE, P1_LOST, P2_LOST, P1_WINNERS_CIRCLE, P2_WINNERS_CIRCLE };
+	LEFT_HITZONE, P1_LOST, P2_LOST, P1_WINNERS_CIRCLE, P2_WINNERS_CIRCLE, NUM_of_GAME_STATES };
 enum directions {LEFT, RIGHT};
 enum identifications{ONE, TWO};
 enum system_states {PLAY_MODE, MOVE_MODE};
 
 //Structures
-struct UserInput{
-	volatile uint32_t choice; //Determines which button was pressed
-	volatile uint32_t debounce_counter; //Counter for debouncing
-	volatile uint32_t press_pending; //Flag for pending button press
+struct Light_Emitting_Diode{
+	GPIO_TypeDef *port; //GPIOx, 0 for a strip pixel
+	uint32_t port_index; //slot in struct LED_Frame (BOARD_PORT_x, or LED_PORTS_used + pixel / 16)
+	uint32_t mask; //pin bitmask (0x1 << pin) precomputed from board.h, or 0x1 << (pixel % 16)
 };
 
-struct Light_Emitting_Diode{
-	GPIO_TypeDef *port; //GPIOx
-	uint32_t pin; //Pin number
+//Pending LED changes, one BSRR word per port. Built up by the LED functions and written out by
+//COMMIT_LED_FRAME() with at most one store per port, so no LED update is a read-modify-write.
+//With LED_OUTPUT_STRIP the strip follows the ports, 16 pixels to a word in the same format.
+struct LED_Frame{
+	uint32_t bsrr[LED_FRAME_PORTS]; //set mask in bits 0-15, reset mask in bits 16-31
+};
+
+//Streaming statistics of a player's press offsets, the time from the ball reaching their hitzone
+//to the press that returned it, a miss counting as the whole window. O(1) and integer only for
+//each press (see difficulty.c).
+struct Press_Stats{
+	uint8_t count; //presses so far, stops at DIFFICULTY_MEMORY and older presses fade out
+	int8_t p90_sign; //direction of the p90 estimate's last move, 1 up, -1 down
+	int16_t p90_step_us; //its current step size, kept within DIFFICULTY_P90_STEP_LIMIT_us
+	int32_t mean_q4; //Welford mean, 1/16 us
+	uint32_t m2; //Welford sum of squared differences from the mean, in DIFFICULTY_M2_UNIT_us squared
+	uint32_t p90_us; //frugal estimate of the 90th percentile
 };
 
 struct Player{
 	enum identifications ID; //The player has a unique identifier, either one or two
 	uint32_t score; //Controls the player's score
-	volatile uint32_t pressTIME_STAMP;//Time stamp created when the player presses their button
-	volatile uint32_t missTIME_STAMP;//Time stamp created when the player loses a round
-    uint32_t winnerTIME_STAMP;//Time stamp created when the player wins the game
-	volatile uint32_t missFLAG;//Flag that is set when the player loses a round
-	volatile uint32_t pressedFLAG;//Flag that is set when the player presses their button
-    uint32_t winnerFLAG;//Flag that is set when the player wins the game
-	struct  Light_Emitting_Diode points_display[3];//LEDs that denote a player's score
-	struct  Light_Emitting_Diode hitzoneLED;//Dedicated hitzone LED that is always lit. Toggles when the player presses their button
-	struct  Light_Emitting_Diode missLED;//Dedicated miss LED, that lights up when the player loses
+	volatile uint32_t pressTIME_STAMP;//Time stamp (us, from usTimer) of the button edge of the player's last press
+	volatile uint8_t missFLAG;//Flag that is set when the player loses a round
+	volatile uint8_t pressedFLAG;//Flag that is set when the player presses their button
+	uint8_t winnerFLAG;//Flag that is set when the player wins the game. The flags are bytes so Press_Stats fits, see main.c
+	const struct Light_Emitting_Diode *points_display[3];//LEDs that denote a player's score
+	const struct Light_Emitting_Diode *hitzoneLED;//Dedicated hitzone LED that is always lit. Toggles when the player presses their button
+	const struct Light_Emitting_Diode *missLED;//Dedicated miss LED, that lights up when the player loses
+	struct Soft_Timer hitzone_timer;//Turns the hitzone LED back on HITZONE_LED_TOGGLE_TIME after a press
+	struct Press_Stats timing;//How soon the player presses once the ball is in their hitzone
+};
+
+//Every ball, one array per property, so BALL_TICK() (ball.c) steps them all in one pass down the
+//arrays. Ball 0 is the served ball and stays in play for the whole rally; the others join on
+//successful hits. A ball out of play has velocity 0 and never steps.
+struct Ball_Pool{
+	volatile uint32_t position[BALL_COUNT]; //GAMEBOARD position
+	volatile uint32_t phase[BALL_COUNT]; //Q16.16 LEDs travelled since the last step, below Q16_ONE
+	volatile uint32_t velocity[BALL_COUNT]; //Q16.16 LEDs per tick, below Q16_ONE
+	volatile uint32_t level[BALL_COUNT]; //speed level, index into the speed curve (see ball.c)
+	enum directions heading[BALL_COUNT];
+	uint8_t state[BALL_COUNT]; //enum game_states, the rally as this ball sees it
+	uint32_t in_play; //bit k set while ball k is on the board
+	uint32_t in_state[NUM_of_GAME_STATES]; //bit k set in the entry for ball k's state
+	uint32_t step_us; //usTimer when the balls last stepped, one reading for the whole step
+	uint32_t hitzone_us[BALL_COUNT]; //step_us when the ball last reached a hitzone, see BALL_ARRIVED()
+	uint32_t miss_zone_us[BALL_COUNT]; //step_us when the ball last reached a MISS zone
+};
+
+//Game timing read at run time, so it can be changed without rebuilding (see sim/sweep.c).
+//Starts out at the #define of the same name.
+struct Game_Tuning{
+	uint32_t default_speed; //DEFAULT_SPEED, LEDs per second
+	uint32_t pace_step; //PACE_STEP, LEDs per second
+	uint32_t max_speed; //MAX_SPEED, LEDs per second
+	uint32_t time_out_ms; //TIME_OUT_TIME
+	uint32_t hitzone_toggle_ms; //HITZONE_LED_TOGGLE_TIME
+	uint32_t debounce_ms; //DEBOUNCE_DELAY, 1 to 31
 };
 
 extern enum system_states system_state;
 extern enum game_states game_state;
 extern volatile uint32_t current_saved_position;
 extern volatile uint32_t msTimer;
-extern volatile uint32_t pace;
-extern volatile uint32_t LEDcount;
-extern  enum directions direction;
-extern struct UserInput button;
+extern struct Game_Tuning tuning;
+extern struct Ball_Pool balls;
+#define LEDcount (balls.position[0]) //position of the served ball
+#define direction (balls.heading[0])
+#define pace (balls.level[0]) //speed level of the served ball, raised by every successful hit
 extern struct Player P1, P2;
-extern struct Light_Emitting_Diode LEDS[];
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+extern struct Light_Emitting_Diode LEDS[NUM_of_BOARD_LEDS]; //GAMEBOARD row filled in by configure_strip()
+#else
+extern const struct Light_Emitting_Diode LEDS[NUM_of_BOARD_LEDS];
+#endif
+#define BoardLED (LEDS[LED_BOARD_LED])
+
+//function prototypes
+void configure_system(void);
+void HANDLE_MAIN_LOOP(void);
+void HANDLE_WAKE_EVENTS(uint32_t events);
 
 #endif /* MAIN_H */
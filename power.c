@@ -0,0 +1,112 @@
+#include "power.h"
+#include "clock.h" //elapsed cycles at whatever speeds the core ran, see clock.c/h
+/**
+**************************************************************************************************
+* @file power.c
+* @brief Source file for wake events and sleep handling
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* ISRs post wake events; the main loop takes them, does only the work they call for, and sleeps
+* in WFI when none are left. Active cycles are measured with the DWT cycle counter so the idle
+* time reclaimed from the old busy loop can be read out of idle_stats.
+*************************************************************************************************/
+static volatile uint32_t wake_flags[NUM_of_WAKE_EVENTS]; //set by ISRs, cleared by the main loop
+static uint32_t wake_cycle; //DWT->CYCCNT when the core last woke up
+
+struct Idle_Stats idle_stats;
+
+//================================================================================================
+// configure_idle_stats()
+// @parm: none
+// @return: none
+// 		Enables the DWT cycle counter and starts the active/sleep accounting
+//================================================================================================
+void configure_idle_stats(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; //enable the DWT unit
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; //start the cycle counter
+	idle_stats.active_cycles = 0;
+	idle_stats.sleeps = 0;
+	idle_stats.wakeups = 0;
+	idle_stats.start_cycles = CORE_CYCLES();
+	wake_cycle = DWT->CYCCNT;
+}
+//================================================================================================
+// POST_WAKE_EVENT()
+// @parm: e = reason the main loop should run
+// @return: none
+// 		Called from ISRs (and the main loop itself). A single store, so it never races.
+//================================================================================================
+void POST_WAKE_EVENT(enum wake_events e)
+{
+	wake_flags[e] = 1;
+}
+//================================================================================================
+// TAKE_WAKE_EVENTS()
+// @parm: none
+// @return: mask of the wake events posted since the last call (see WAKE_MASK)
+// 		Each flag is cleared before the work it asks for is done, so an event posted while that
+// 		work runs is kept for the next pass.
+//================================================================================================
+uint32_t TAKE_WAKE_EVENTS(void)
+{
+	uint32_t events = 0;
+	for (uint32_t i = 0; i < NUM_of_WAKE_EVENTS; i++){
+		if (wake_flags[i]){
+			wake_flags[i] = 0;
+			events |= WAKE_MASK(i);
+		}
+	}
+	if (events){
+		idle_stats.wakeups++;
+	}
+	return events;
+}
+//================================================================================================
+// WAKE_EVENTS_PENDING()
+// @parm: none
+// @return: 1 if a wake event has been posted and not yet taken by the main loop, 0 otherwise
+//================================================================================================
+uint32_t WAKE_EVENTS_PENDING(void)
+{
+	uint32_t pending = 0;
+	for (uint32_t i = 0; i < NUM_of_WAKE_EVENTS; i++){
+		pending |= wake_flags[i];
+	}
+	return pending;
+}
+//================================================================================================
+// SLEEP_UNTIL_EVENT()
+// @parm: none
+// @return: none
+// 		Enters WFI unless a wake event is already pending. Interrupts are masked around the check
+// 		so an event posted just before WFI still wakes the core; the ISR runs once they are
+// 		unmasked again. Returns after one wake-up, whatever its cause.
+//================================================================================================
+void SLEEP_UNTIL_EVENT(void)
+{
+	__disable_irq();
+	if (!WAKE_EVENTS_PENDING()){
+		uint32_t sleep_cycle = DWT->CYCCNT;
+		idle_stats.active_cycles += sleep_cycle - wake_cycle;
+		idle_stats.sleeps++;
+		__WFI();
+		wake_cycle = DWT->CYCCNT;
+	}
+	__enable_irq();
+}
+//================================================================================================
+// IDLE_SLEEP_CYCLES()
+// @parm: none
+// @return: cycles spent asleep since configure_idle_stats()
+// 		Elapsed cycles (from msTimer and the clock speeds, see CORE_CYCLES()) minus the measured
+// 		active cycles. DWT->CYCCNT stops while the core sleeps, so sleep time cannot be read from
+// 		it directly.
+//================================================================================================
+uint64_t IDLE_SLEEP_CYCLES(void)
+{
+	uint64_t elapsed = CORE_CYCLES() - idle_stats.start_cycles;
+	return (elapsed > idle_stats.active_cycles) ? elapsed - idle_stats.active_cycles : 0;
+}
@@ -0,0 +1,39 @@
+/**
+**************************************************************************************************
+* @file power.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for power.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the wake events posted by the ISRs and the sleep/idle accounting used by the main loop
+**************************************************************************************************
+*/
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "main.h"
+
+//Reasons for the main loop to run. Each is a separate flag so an ISR setting one can never be
+//lost to the main loop clearing another.
+enum wake_events { WAKE_INPUT, WAKE_BALL, WAKE_TIMER, WAKE_STATE, WAKE_LINK, NUM_of_WAKE_EVENTS };
+#define WAKE_MASK(e) (0x1 << (e))
+
+//Where the core's cycles went since configure_idle_stats()
+struct Idle_Stats{
+	uint64_t active_cycles; //cycles between a wake-up and the next WFI (DWT->CYCCNT)
+	uint64_t start_cycles; //CORE_CYCLES() when counting started
+	uint32_t sleeps; //number of times the core entered WFI
+	uint32_t wakeups; //number of main loop passes that found work to do
+};
+
+extern struct Idle_Stats idle_stats;
+
+void configure_idle_stats(void);
+void POST_WAKE_EVENT(enum wake_events e);
+uint32_t TAKE_WAKE_EVENTS(void);
+uint32_t WAKE_EVENTS_PENDING(void);
+void SLEEP_UNTIL_EVENT(void);
+uint64_t IDLE_SLEEP_CYCLES(void);
+
+#endif /* POWER_H_ */
@@ -0,0 +1,149 @@
+#include "profile.h"
+/**
+**************************************************************************************************
+* @file profile.c
+* @brief Source file for the handler profiler
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Times each handler (and HANDLE_GAME()) with DWT->CYCCNT, started by configure_idle_stats().
+* Entries push a frame and exits pop it. When a frame is popped, its entry-to-exit time is
+* added to the frame below it, which was preempted for that long. That gives every point its
+* own cycles, and shows which point preempted which and for how long.
+*
+* PROFILE_STREAM() sends the table out over ITM/SWO a few words at a time from the main loop.
+* It only writes while the stimulus FIFO has room, so it never waits on the probe. Each record
+* is a header word, PROFILE_RECORD_MAGIC | point << 16 | PROFILE_RECORD_WORDS, followed by the
+* point's struct Profile_Stats. Nothing is sent unless a debugger has enabled the ITM port.
+*
+*	Note: Enabled with PROFILING 1 (main.h or the compiler command line). Frames are pushed and
+*	      popped with interrupts masked for a few instructions.
+*************************************************************************************************/
+#if PROFILING
+
+struct Profile_Frame{
+	enum profile_points point;
+	uint32_t entry_cycle; //DWT->CYCCNT at entry
+	uint32_t preempted_cycles; //entry to exit time of the handlers that preempted this run
+};
+
+struct Profile_Stats profile_stats[NUM_of_PROFILE_POINTS];
+
+//each point can only be active once, so the stack never holds more than one frame per point
+static struct Profile_Frame frames[NUM_of_PROFILE_POINTS];
+static uint32_t depth;
+
+//streaming position, see PROFILE_STREAM()
+static struct Profile_Stats sending; //copy of the record being sent, so it stays consistent
+static uint32_t send_point;
+static uint32_t send_word; //0 = header next
+
+//================================================================================================
+// log2_bucket()
+// @parm: cycles = own cycles of one run
+// @return: histogram bin, the number of significant bits (capped to the last bin)
+//================================================================================================
+static uint32_t log2_bucket(uint32_t cycles)
+{
+	uint32_t bits = cycles ? 32 - (uint32_t)__builtin_clz(cycles) : 0;
+	return (bits < PROFILE_BUCKETS) ? bits : PROFILE_BUCKETS - 1;
+}
+//================================================================================================
+// PROFILE_RESET()
+// @parm: none
+// @return: none
+// 		Clears the table. Call with no profiled point active.
+//================================================================================================
+void PROFILE_RESET(void)
+{
+	for (uint32_t i = 0; i < NUM_of_PROFILE_POINTS; i++){
+		profile_stats[i] = (struct Profile_Stats){ .min_cycles = 0xFFFFFFFF };
+	}
+	depth = 0;
+	send_point = 0;
+	send_word = 0;
+}
+//================================================================================================
+// PROFILE_ENTER_POINT()
+// @parm: point = code being entered, first thing in the handler
+// @return: none
+//================================================================================================
+void PROFILE_ENTER_POINT(enum profile_points point)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (depth < NUM_of_PROFILE_POINTS){
+		frames[depth] = (struct Profile_Frame){ point, DWT->CYCCNT, 0 };
+	}
+	depth++;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// PROFILE_EXIT_POINT()
+// @parm: point = code being left, last thing in the handler
+// @return: none
+// 		Pops the point's frame, updates its stats and charges its run to the frame it preempted
+//================================================================================================
+void PROFILE_EXIT_POINT(enum profile_points point)
+{
+	PROFILE_MODEL_COST(point);
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t now = DWT->CYCCNT;
+	if (depth > 0 && --depth < NUM_of_PROFILE_POINTS && frames[depth].point == point){
+		const struct Profile_Frame *f = &frames[depth];
+		struct Profile_Stats *s = &profile_stats[point];
+		uint32_t elapsed = now - f->entry_cycle;
+		uint32_t own = elapsed - f->preempted_cycles;
+		s->count++;
+		s->total_cycles += own;
+		if (own < s->min_cycles) s->min_cycles = own;
+		if (own > s->max_cycles) s->max_cycles = own;
+		if (elapsed > s->max_elapsed) s->max_elapsed = elapsed;
+		if (f->preempted_cycles){
+			s->preempted++;
+			if (f->preempted_cycles > s->max_preempted_cycles) s->max_preempted_cycles = f->preempted_cycles;
+		}
+		s->histogram[log2_bucket(own)]++;
+		if (depth > 0){ //this run preempted the frame below
+			struct Profile_Frame *below = &frames[depth - 1];
+			struct Profile_Stats *victim = &profile_stats[below->point];
+			below->preempted_cycles += elapsed;
+			victim->preempted_by[point]++;
+			if (elapsed > victim->worst_by[point]) victim->worst_by[point] = elapsed;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// PROFILE_STREAM()
+// @parm: none
+// @return: none
+// 		Called once per main loop pass. Writes up to PROFILE_STREAM_WORDS words of the current
+// 		record while the ITM FIFO has room, then moves on to the next point's record.
+//================================================================================================
+void PROFILE_STREAM(void)
+{
+	if (!(ITM->TCR & ITM_TCR_ITMENA_Msk) || !(ITM->TER & (1UL << PROFILE_ITM_PORT))){
+		return; //no debugger listening
+	}
+	const uint32_t *words = (const uint32_t *)&sending;
+	for (uint32_t i = 0; i < PROFILE_STREAM_WORDS && ITM_PORT_READY(PROFILE_ITM_PORT); i++){
+		if (send_word == 0){
+			uint32_t primask = __get_PRIMASK();
+			__disable_irq();
+			sending = profile_stats[send_point];
+			__set_PRIMASK(primask);
+			ITM_WRITE_PORT(PROFILE_ITM_PORT, PROFILE_RECORD_MAGIC | (send_point << 16) | PROFILE_RECORD_WORDS);
+		}
+		else{
+			ITM_WRITE_PORT(PROFILE_ITM_PORT, words[send_word - 1]);
+		}
+		if (++send_word > PROFILE_RECORD_WORDS){
+			send_word = 0;
+			send_point = (send_point + 1) % NUM_of_PROFILE_POINTS;
+		}
+	}
+}
+
+#endif /* PROFILING */
@@ -0,0 +1,81 @@
+/**
+**************************************************************************************************
+* @file profile.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for profile.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the opt-in handler profiler (PROFILING in main.h). With PROFILING 0 the PROFILE_*
+* macros expand to nothing and profile.c is empty.
+**************************************************************************************************
+*/
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include "main.h"
+
+//Profiled code, in NVIC priority order (see configure_link(), configure_ball_animation(),
+//configureTIM2(), configure_external_switches(), configureSysTickInterrupt(), configure_strip() and
+//configure_stats_log()), then the main loop's work
+enum profile_points { PROF_USART2, PROF_DMA1_CH2, PROF_TIM2, PROF_EXTI15_10, PROF_EXTI1, PROF_EXTI4, PROF_SYSTICK,
+	PROF_DMA1_CH3, PROF_FLASH, PROF_HANDLE_GAME, NUM_of_PROFILE_POINTS };
+
+#define PROFILE_BUCKETS 32 //log2 bins, bin b counts runs of 2^(b-1) to 2^b - 1 cycles, bin 0 counts 0
+#define PROFILE_ITM_PORT 1 //ITM stimulus port the table is streamed on (port 0 is left for printf)
+#define PROFILE_STREAM_WORDS 4 //most words PROFILE_STREAM() writes per call
+#define PROFILE_RECORD_MAGIC 0xA5000000 //top byte of a record's header word
+
+//Timing of one profiled point. Every field is 32 bits wide after total_cycles, so the struct is
+//streamed over ITM as it is laid out in memory.
+struct Profile_Stats{
+	uint64_t total_cycles; //sum of own cycles, for the mean
+	uint32_t count; //completed runs
+	uint32_t min_cycles; //own cycles: entry to exit less the time spent in handlers that preempted it
+	uint32_t max_cycles;
+	uint32_t max_elapsed; //worst entry to exit time, preemption included
+	uint32_t preempted; //runs preempted at least once
+	uint32_t max_preempted_cycles; //most cycles lost to preemption in a single run
+	uint32_t preempted_by[NUM_of_PROFILE_POINTS]; //times each point preempted this one
+	uint32_t worst_by[NUM_of_PROFILE_POINTS]; //longest single preemption by each point
+	uint32_t histogram[PROFILE_BUCKETS]; //own cycles
+};
+#define PROFILE_RECORD_WORDS (sizeof(struct Profile_Stats) / 4) //words after the header word
+
+_Static_assert(sizeof(struct Profile_Stats) % 4 == 0, "Profile_Stats is streamed in 32-bit words");
+
+//The host simulator runs code in zero simulated time, so it supplies a PROFILE_MODEL_COST() that
+//charges a modelled cost for the point's body. Nothing to do on the device.
+#ifndef PROFILE_MODEL_COST
+#define PROFILE_MODEL_COST(point) ((void)0)
+#endif
+
+//Non-blocking access to an ITM stimulus port. Reading the port returns 1 while its FIFO has room.
+//The host simulator supplies its own definitions.
+#ifndef ITM_PORT_READY
+#define ITM_PORT_READY(port) (ITM->PORT[(port)].u32 != 0)
+#endif
+#ifndef ITM_WRITE_PORT
+#define ITM_WRITE_PORT(port, value) (ITM->PORT[(port)].u32 = (value))
+#endif
+
+#if PROFILING
+#define PROFILE_ENTER(point) PROFILE_ENTER_POINT(point)
+#define PROFILE_EXIT(point) PROFILE_EXIT_POINT(point)
+#else
+#define PROFILE_ENTER(point) ((void)0)
+#define PROFILE_EXIT(point) ((void)0)
+#define PROFILE_STREAM() ((void)0)
+#define PROFILE_RESET() ((void)0)
+#endif
+
+extern struct Profile_Stats profile_stats[NUM_of_PROFILE_POINTS];
+
+void PROFILE_ENTER_POINT(enum profile_points point);
+void PROFILE_EXIT_POINT(enum profile_points point);
+#if PROFILING
+void PROFILE_STREAM(void);
+void PROFILE_RESET(void);
+#endif
+
+#endif /* PROFILE_H_ */
@@ -0,0 +1,749 @@
+#include "recorder.h"
+#include "game_logic.h" //replays into the game functions from game_logic.c/h
+#include "input.h" //replays presses through PROCESS_BUTTON_PRESS
+#include "power.h" //posts wake events from power.c/h
+#include "ball.h" //ball steps land on TIM2 ticks, see ball.c/h
+#include "shared_state.h" //publishes a restored snapshot, see shared_state.c/h
+#include "difficulty.h" //snapshots the adaptive difficulty, see difficulty.c/h
+/**
+**************************************************************************************************
+* @file recorder.c
+* @brief Source file for the event recorder and replay engine
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Everything that makes one game differ from another enters through a few places: TIM2 or DMA
+* moving the ball, a debounced press reaching PROCESS_BUTTON_PRESS(), and the soft timers ending
+* a hitzone toggle or a time out. Each of those is logged here, along with every state change, so
+* a game can be re-run exactly from the log.
+*
+* Record layout: one header byte (type in bits 0-2, a small value in bits 3-7, 31 meaning the
+* value follows as a varint), then unsigned LEB128 varints.
+*	REC_SNAPSHOT  small 0       : us, ms, game_state|system_state<<4|direction<<5, LEDcount,
+*	                              pace, current_saved_position, P1 score, P1 flags, P2 score,
+*	                              P2 flags, round_timer armed; with ADAPTIVE_DIFFICULTY also
+*	                              serve level, step, limit level, rng, then for P1 and P2 the
+*	                              Press_Stats: count << 2 | zigzag(p90_sign), zigzag(p90_step_us),
+*	                              zigzag(mean_q4), m2, p90_us
+*	REC_BALL      small zigzag(change) << 2 | ticks << 1 | behind : no fields, change = interval -
+*	                              previous interval, in whole TIM2 ticks when ticks is set, else in us.
+*	                              With BALL_COUNT above 1, one field: the balls that stepped.
+*	REC_PRESS     small choice | behind << 2 : delta us, edge-to-decision us
+*	REC_TIMER     small timer | behind << 2 : delta us
+*	REC_STATE     small game_state : delta us, system_state|direction<<1, LEDcount, pace
+*	REC_SEGMENT   small steps << 1 | behind : delta us
+* 'behind' is set when an ISR logged its record while the main loop still had wake events to
+* handle, so replay applies it before that main loop work rather than after. A press is logged by
+* the main loop itself, but an ISR can post a wake event in the middle of a pass, before the task
+* that handles the press has run, so a press carries it too.
+* The ball steps on TIM2 ticks, so its interval changes by a whole tick or not at all and a ball
+* step is normally a single byte. With BALL_ANIMATION_DMA the CPU only sees the ball at the end
+* of a segment (animation.c), so one REC_SEGMENT stands for all of its steps. A snapshot is written
+* at start-up and at every serve; it carries absolute times, so replay can begin at any snapshot
+* still in the ring once older records have been overwritten. Only the served ball is in play at
+* a serve, so a snapshot needs no more than its position, direction and pace. The adaptive
+* difficulty's statistics and random state decide every later serve, so they are in it too.
+* A ball record carries balls.step_us, the time BALL_ARRIVED() stamps, and replay sets it and
+* usTimer to each record's time, so the replayed game stamps the times of the recording. That is
+* only safe on the host, so replay is left out of the firmware unless RECORDER_REPLAY is set.
+*************************************************************************************************/
+_Static_assert((RECORDER_SIZE & (RECORDER_SIZE - 1)) == 0, "RECORDER_SIZE must be a power of two");
+
+#define INLINE_ESCAPE 31 //header value meaning "the small value follows as a varint"
+#if ADAPTIVE_DIFFICULTY
+#define DIFFICULTY_FIELDS 14 //struct Difficulty and both players' Press_Stats, see difficulty.c/h
+#else
+#define DIFFICULTY_FIELDS 0
+#endif
+#define SNAPSHOT_FIELDS (11 + DIFFICULTY_FIELDS)
+#define MAX_RECORD_BYTES (2 + 5 * SNAPSHOT_FIELDS) //header, escaped value and fields at 5 bytes each
+#define REPLAY_MAX_PASSES 16 //main loop passes run after one replayed event
+#define REPLAY_CHECKS 8 //state changes the replayed game may run ahead of the recording
+
+//fields after the header of each record type, in the order listed above
+static const uint8_t RECORD_FIELDS[NUM_of_RECORD_TYPES] = { SNAPSHOT_FIELDS, BALL_COUNT > 1, 2, 1, 4, 1 };
+
+struct Recorder recorder;
+
+#if RECORDER_REPLAY
+//State changes made by the replayed game, waiting to be compared with the recording
+static struct{
+	uint32_t type[REPLAY_CHECKS]; //REC_STATE or REC_SNAPSHOT
+	uint32_t f[REPLAY_CHECKS][SNAPSHOT_FIELDS]; //snapshot_fields() at the time
+	uint32_t head, tail; //free running
+} replay_checks;
+#endif
+
+//================================================================================================
+// put_varint()
+// @parm: *out = where to write, value = number to encode
+// @return: bytes written (1 to 5)
+//================================================================================================
+static uint32_t put_varint(uint8_t *out, uint32_t value)
+{
+	uint32_t n = 0;
+	while (value >= 0x80){
+		out[n++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (uint8_t)value;
+	return n;
+}
+//================================================================================================
+// put_header()
+// @parm: *out = where to write, type = record type, small = value carried by the header
+// @return: bytes written
+//================================================================================================
+static uint32_t put_header(uint8_t *out, enum record_types type, uint32_t small)
+{
+	if (small < INLINE_ESCAPE){
+		out[0] = (uint8_t)(type | (small << 3));
+		return 1;
+	}
+	out[0] = (uint8_t)(type | (INLINE_ESCAPE << 3));
+	return 1 + put_varint(out + 1, small);
+}
+//================================================================================================
+// zigzag() / unzigzag()
+// 		Map signed values to unsigned ones so small negative numbers stay short as varints
+//================================================================================================
+static uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+#if RECORDER_REPLAY
+static int32_t unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+#endif
+//================================================================================================
+// player_flags()
+// @parm: *p = player
+// @return: missFLAG, pressedFLAG and winnerFLAG packed into bits 0-2
+//================================================================================================
+static uint32_t player_flags(const struct Player *p)
+{
+	return (p->missFLAG ? 1 : 0) | (p->pressedFLAG ? 2 : 0) | (p->winnerFLAG ? 4 : 0);
+}
+#if ADAPTIVE_DIFFICULTY
+//================================================================================================
+// stats_fields()
+// @parm: *f = 5 values to fill, *s = a player's statistics
+// @return: none
+//================================================================================================
+static void stats_fields(uint32_t *f, const struct Press_Stats *s)
+{
+	f[0] = ((uint32_t)s->count << 2) | zigzag(s->p90_sign);
+	f[1] = zigzag(s->p90_step_us);
+	f[2] = zigzag(s->mean_q4);
+	f[3] = s->m2;
+	f[4] = s->p90_us;
+}
+#if RECORDER_REPLAY
+//================================================================================================
+// restore_stats()
+// @parm: *s = a player's statistics, *f = values from stats_fields()
+// @return: none
+//================================================================================================
+static void restore_stats(struct Press_Stats *s, const uint32_t *f)
+{
+	s->count = (uint8_t)(f[0] >> 2);
+	s->p90_sign = (int8_t)unzigzag(f[0] & 0x3);
+	s->p90_step_us = (int16_t)unzigzag(f[1]);
+	s->mean_q4 = unzigzag(f[2]);
+	s->m2 = f[3];
+	s->p90_us = f[4];
+}
+#endif
+#endif
+//================================================================================================
+// snapshot_fields()
+// @parm: *f = SNAPSHOT_FIELDS values to fill, now_us = time of the snapshot
+// @return: none
+// 		The game state a snapshot records. Also used by replay to compare against a recording.
+//================================================================================================
+static void snapshot_fields(uint32_t *f, uint32_t now_us)
+{
+	f[0] = now_us;
+	f[1] = msTimer;
+	f[2] = game_state | (system_state << 4) | (direction << 5);
+	f[3] = LEDcount;
+	f[4] = pace;
+	f[5] = current_saved_position;
+	f[6] = P1.score;
+	f[7] = player_flags(&P1);
+	f[8] = P2.score;
+	f[9] = player_flags(&P2);
+	f[10] = round_timer.armed;
+#if ADAPTIVE_DIFFICULTY
+	f[11] = difficulty.serve_level;
+	f[12] = difficulty.step;
+	f[13] = difficulty.limit_level;
+	f[14] = difficulty.rng;
+	stats_fields(&f[15], &P1.timing);
+	stats_fields(&f[20], &P2.timing);
+#endif
+}
+//================================================================================================
+// drop_oldest()
+// @parm: none
+// @return: none
+// 		Frees the oldest record in the ring. Records are self-delimiting, so its length is found
+// 		by walking its header and varints.
+//================================================================================================
+static void drop_oldest(void)
+{
+	uint8_t header = recorder.data[recorder.tail++ & (RECORDER_SIZE - 1)];
+	uint32_t fields = RECORD_FIELDS[header & 0x7] + ((header >> 3) == INLINE_ESCAPE);
+	while (fields && recorder.tail != recorder.head){
+		if (!(recorder.data[recorder.tail++ & (RECORDER_SIZE - 1)] & 0x80)){
+			fields--; //last byte of a varint
+		}
+	}
+	recorder.dropped++;
+}
+//================================================================================================
+// write_record()
+// @parm: *rec = encoded record, length = its size in bytes
+// @return: none
+// 		Appends to the ring, dropping old records to make room. Caller holds interrupts masked.
+//================================================================================================
+static void write_record(const uint8_t *rec, uint32_t length)
+{
+	while (RECORDER_SIZE - (recorder.head - recorder.tail) < length){
+		drop_oldest();
+	}
+	for (uint32_t i = 0; i < length; i++){
+		recorder.data[recorder.head++ & (RECORDER_SIZE - 1)] = rec[i];
+	}
+	recorder.records++;
+}
+//================================================================================================
+// put_delta()
+// @parm: *out = where to write, now_us = time of the record being written
+// @return: bytes written
+// 		Encodes the time since the previous record. Caller holds interrupts masked.
+//================================================================================================
+static uint32_t put_delta(uint8_t *out, uint32_t now_us)
+{
+	uint32_t n = put_varint(out, now_us - recorder.last_us);
+	recorder.last_us = now_us;
+	return n;
+}
+#if RECORDER_REPLAY
+//================================================================================================
+// queue_check()
+// @parm: type = REC_STATE or REC_SNAPSHOT
+// @return: none
+// 		RECORDER_CHECKING: keeps the state the replayed game would have recorded, so
+// 		REPLAY_RECORDING() can compare it with the next state record of the recording.
+//================================================================================================
+static void queue_check(enum record_types type)
+{
+	if (replay_checks.head - replay_checks.tail == REPLAY_CHECKS){
+		replay_checks.tail++; //never compared, counted as a divergence when the recording moves on
+	}
+	uint32_t slot = replay_checks.head++ % REPLAY_CHECKS;
+	replay_checks.type[slot] = type;
+	snapshot_fields(replay_checks.f[slot], 0);
+}
+#endif
+//================================================================================================
+// RECORDER_START()
+// @parm: none
+// @return: none
+// 		Empties the ring, starts recording and writes the first snapshot
+//================================================================================================
+void RECORDER_START(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	recorder.head = 0;
+	recorder.tail = 0;
+	recorder.records = 0;
+	recorder.dropped = 0;
+	recorder.mode = RECORDER_RECORDING;
+	__set_PRIMASK(primask);
+	RECORD_SNAPSHOT();
+}
+//================================================================================================
+// RECORD_BALL()
+// @parm: stepped = balls that moved, bit k = ball k
+// @return: none
+// 		Called from TIM2_IRQHandler after a ball (or the winner's display) has moved
+//================================================================================================
+void RECORD_BALL(uint32_t stepped)
+{
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t now = balls.step_us; //as BALL_ARRIVED() stamped it, the LEDs may have taken a while since
+	uint32_t interval = now - recorder.last_ball_us;
+	int32_t change = (int32_t)(interval - recorder.last_ball_interval);
+	uint32_t ticks = (change % BALL_TICK_us) == 0;
+	uint32_t small = (zigzag(ticks ? change / BALL_TICK_us : change) << 2) | (ticks << 1) | WAKE_EVENTS_PENDING();
+	uint32_t n = put_header(rec, REC_BALL, small);
+	if (BALL_COUNT > 1){
+		n += put_varint(rec + n, stepped);
+	}
+	recorder.last_ball_interval = interval;
+	recorder.last_ball_us = now;
+	recorder.last_us = now;
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_SEGMENT()
+// @parm: steps = steps the ball took in the segment
+// @return: none
+// 		Called from DMA1_Channel2_IRQHandler after a DMA ball segment has played
+//================================================================================================
+void RECORD_SEGMENT(uint32_t steps)
+{
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t n = put_header(rec, REC_SEGMENT, (steps << 1) | WAKE_EVENTS_PENDING());
+	n += put_delta(rec + n, balls.step_us);
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_PRESS()
+// @parm: choice = button, pressTIME_us = usTimer value of the press's button edge
+// @return: none
+// 		Called just before a debounced press is handed to PROCESS_BUTTON_PRESS()
+//================================================================================================
+void RECORD_PRESS(enum choices choice, uint32_t pressTIME_us)
+{
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t now = usTimer;
+	uint32_t n = put_header(rec, REC_PRESS, choice | (WAKE_EVENTS_PENDING() << 2));
+	n += put_delta(rec + n, now);
+	n += put_varint(rec + n, now - pressTIME_us);
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_TIMER()
+// @parm: timer = soft timer that just fired
+// @return: none
+// 		Called from the timer's callback in SysTick_Handler
+//================================================================================================
+void RECORD_TIMER(enum recorded_timers timer)
+{
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t n = put_header(rec, REC_TIMER, timer | (WAKE_EVENTS_PENDING() << 2));
+	n += put_delta(rec + n, usTimer);
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_STATE()
+// @parm: none
+// @return: none
+// 		Called through RECORD_STATE_CHANGE() after a task that changed game_state or system_state
+//================================================================================================
+void RECORD_STATE(void)
+{
+#if RECORDER_REPLAY
+	if (recorder.mode == RECORDER_CHECKING){
+		queue_check(REC_STATE);
+	}
+#endif
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t n = put_header(rec, REC_STATE, game_state);
+	n += put_delta(rec + n, usTimer);
+	n += put_varint(rec + n, system_state | (direction << 1));
+	n += put_varint(rec + n, LEDcount);
+	n += put_varint(rec + n, pace);
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_SNAPSHOT()
+// @parm: none
+// @return: none
+// 		Records the whole game state with absolute times. Replay can start from any snapshot.
+//================================================================================================
+void RECORD_SNAPSHOT(void)
+{
+#if RECORDER_REPLAY
+	if (recorder.mode == RECORDER_CHECKING){
+		queue_check(REC_SNAPSHOT);
+	}
+#endif
+	if (recorder.mode != RECORDER_RECORDING){
+		return;
+	}
+	uint8_t rec[MAX_RECORD_BYTES];
+	uint32_t f[SNAPSHOT_FIELDS];
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t now = usTimer;
+	snapshot_fields(f, now);
+	uint32_t n = put_header(rec, REC_SNAPSHOT, 0);
+	for (uint32_t i = 0; i < SNAPSHOT_FIELDS; i++){
+		n += put_varint(rec + n, f[i]);
+	}
+	recorder.last_us = now;
+	recorder.last_ball_us = now; //ball intervals restart from here
+	recorder.last_ball_interval = 0;
+	write_record(rec, n);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RECORD_STATE_CHANGE()
+// @parm: previous_game_state / previous_system_state = states before the work just done
+// @return: none
+// 		Called by SCHEDULER_RUN() after each task. Leaving INITIAL_SERVE writes a snapshot, so a
+// 		replay can start from any serve; any other change writes a state record.
+//================================================================================================
+void RECORD_STATE_CHANGE(enum game_states previous_game_state, enum system_states previous_system_state)
+{
+	if (game_state == previous_game_state && system_state == previous_system_state){
+		return;
+	}
+	if (previous_game_state == INITIAL_SERVE){
+		RECORD_SNAPSHOT();
+	}
+	else{
+		RECORD_STATE();
+	}
+}
+//================================================================================================
+// RECORDER_DUMP()
+// @parm: *out = destination, size = bytes available (RECORDER_SIZE always fits)
+// @return: bytes copied
+// 		Copies the ring out oldest record first. On the board the same bytes can be read from
+// 		'recorder' with a debugger.
+//================================================================================================
+uint32_t RECORDER_DUMP(uint8_t *out, uint32_t size)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t length = recorder.head - recorder.tail;
+	if (length > size){
+		length = size;
+	}
+	for (uint32_t i = 0; i < length; i++){
+		out[i] = recorder.data[(recorder.tail + i) & (RECORDER_SIZE - 1)];
+	}
+	__set_PRIMASK(primask);
+	return length;
+}
+
+#if RECORDER_REPLAY
+//------------------------------------------------------------------------------------------------
+// Replay
+//------------------------------------------------------------------------------------------------
+struct Record_Reader{
+	const uint8_t *data;
+	uint32_t length;
+	uint32_t pos;
+};
+//================================================================================================
+// get_varint()
+// @parm: *r = reader, *value = decoded number
+// @return: 1 on success, 0 if the data ended first
+//================================================================================================
+static uint32_t get_varint(struct Record_Reader *r, uint32_t *value)
+{
+	uint32_t result = 0;
+	for (uint32_t shift = 0; shift < 35; shift += 7){
+		if (r->pos >= r->length){
+			return 0;
+		}
+		uint8_t byte = r->data[r->pos++];
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)){
+			*value = result;
+			return 1;
+		}
+	}
+	return 0;
+}
+//================================================================================================
+// read_record()
+// @parm: *r = reader, *type / *small = header, *f = the record's fields
+// @return: 1 on success, 0 if the data ended inside the record
+//================================================================================================
+static uint32_t read_record(struct Record_Reader *r, uint32_t *type, uint32_t *small, uint32_t *f)
+{
+	uint8_t header = r->data[r->pos++];
+	*type = header & 0x7;
+	*small = header >> 3;
+	if (*type >= NUM_of_RECORD_TYPES){
+		return 0;
+	}
+	if (*small == INLINE_ESCAPE && !get_varint(r, small)){
+		return 0;
+	}
+	for (uint32_t i = 0; i < RECORD_FIELDS[*type]; i++){
+		if (!get_varint(r, &f[i])){
+			return 0;
+		}
+	}
+	return 1;
+}
+//================================================================================================
+// restore_player()
+// @parm: *p = player, score / flags = values from a snapshot
+// @return: none
+//================================================================================================
+static void restore_player(struct Player *p, uint32_t score, uint32_t flags)
+{
+	p->score = score;
+	p->missFLAG = flags & 1;
+	p->pressedFLAG = (flags >> 1) & 1;
+	p->winnerFLAG = (flags >> 2) & 1;
+	//the wheel is not ticked during replay, only whether a timer is armed matters
+	if (p->pressedFLAG){
+		SCHEDULE_TIMER(&p->hitzone_timer, tuning.hitzone_toggle_ms, HITZONE_TOGGLE_EXPIRED, p);
+	}
+	else{
+		CANCEL_TIMER(&p->hitzone_timer);
+	}
+}
+//================================================================================================
+// restore_snapshot()
+// @parm: *f = fields of a REC_SNAPSHOT
+// @return: none
+//================================================================================================
+static void restore_snapshot(const uint32_t *f)
+{
+	msTimer = f[1];
+	game_state = (enum game_states)(f[2] & 0xF);
+	system_state = (enum system_states)((f[2] >> 4) & 1);
+	direction = (enum directions)((f[2] >> 5) & 1);
+	RESET_BALLS();
+	if (IN_RALLY(game_state)){
+		SET_BALL_STATE(0, game_state);
+	}
+	LEDcount = f[3];
+	pace = f[4];
+	current_saved_position = f[5];
+	restore_player(&P1, f[6], f[7]);
+	restore_player(&P2, f[8], f[9]);
+	if (f[10]){
+		SCHEDULE_TIMER(&round_timer, tuning.time_out_ms, ROUND_TIMER_EXPIRED, 0);
+	}
+	else{
+		CANCEL_TIMER(&round_timer);
+	}
+#if ADAPTIVE_DIFFICULTY
+	difficulty.serve_level = f[11];
+	difficulty.step = f[12];
+	difficulty.limit_level = f[13];
+	difficulty.rng = f[14];
+	restore_stats(&P1.timing, &f[15]);
+	restore_stats(&P2.timing, &f[20]);
+#endif
+	PUBLISH_GAME_STATE(); //see shared_state.c/h
+}
+//================================================================================================
+// fire_timer()
+// @parm: timer = recorded timer expiry
+// @return: none
+// 		Runs the timer's callback exactly where the recording says it fired
+//================================================================================================
+static void fire_timer(uint32_t timer)
+{
+	switch(timer){
+	case REC_P1_HITZONE_TIMER:
+		CANCEL_TIMER(&P1.hitzone_timer);
+		HITZONE_TOGGLE_EXPIRED(&P1);
+		break;
+	case REC_P2_HITZONE_TIMER:
+		CANCEL_TIMER(&P2.hitzone_timer);
+		HITZONE_TOGGLE_EXPIRED(&P2);
+		break;
+	case REC_ROUND_TIMER:
+		CANCEL_TIMER(&round_timer);
+		ROUND_TIMER_EXPIRED(0);
+		break;
+	}
+}
+//================================================================================================
+// check_state()
+// @parm: type / small / *f = a REC_STATE or REC_SNAPSHOT from the recording
+// @return: 1 if the replayed game made the same state change, 0 if not
+//================================================================================================
+static uint32_t check_state(uint32_t type, uint32_t small, const uint32_t *f)
+{
+	if (replay_checks.head == replay_checks.tail){ //the replayed game did not change state
+		return 0;
+	}
+	uint32_t slot = replay_checks.tail++ % REPLAY_CHECKS;
+	const uint32_t *c = replay_checks.f[slot];
+	if (replay_checks.type[slot] != type){
+		return 0;
+	}
+	if (type == REC_STATE){
+		return (c[2] & 0xF) == small && ((c[2] >> 4) & 0x3) == f[1] && c[3] == f[2] && c[4] == f[3];
+	}
+	for (uint32_t i = 2; i < SNAPSHOT_FIELDS; i++){ //times are not part of the game
+		if (c[i] != f[i]){
+			return 0;
+		}
+	}
+	return 1;
+}
+//================================================================================================
+// run_main_loop_passes()
+// @parm: to_state = 1 to stop at the first pass that changes state
+// @return: none
+// 		Does the work the main loop would do for the wake events now posted, without sleeping.
+// 		A state record only says the main loop got as far as that change: the passes after it
+// 		may have come after the next ISR record, so they are left for that record to run.
+//================================================================================================
+static void run_main_loop_passes(uint32_t to_state)
+{
+	uint32_t events;
+	for (uint32_t i = 0; i < REPLAY_MAX_PASSES; i++){
+		if ((to_state && replay_checks.head != replay_checks.tail) || !(events = TAKE_WAKE_EVENTS())){
+			break;
+		}
+		HANDLE_WAKE_EVENTS(events);
+	}
+}
+//================================================================================================
+// REPLAY_RECORDING()
+// @parm: *data / length = bytes from RECORDER_DUMP(), *result = what the replay found
+// @return: none
+// 		Host only, built with RECORDER_REPLAY: drives the game functions directly, sets usTimer
+// 		(TIM5->CNT on the board) and must not run alongside the real interrupts. Starts at the
+// 		first snapshot, then feeds every ball step, press and timer expiry back in order,
+// 		running the main loop's work between them. Every state change the replayed game makes
+// 		is compared, in order, with the state and snapshot records of the recording; any
+// 		difference is a divergence.
+// 		No time passes while replaying, so it runs as fast as the host can decode: usTimer is
+// 		only set to the time of each record as it is read.
+//================================================================================================
+void REPLAY_RECORDING(const uint8_t *data, uint32_t length, struct Replay_Result *result)
+{
+	struct Record_Reader r = { data, length, 0 };
+	enum recorder_modes was = recorder.mode;
+	uint32_t started = 0, now = 0, start_us = 0, ball_us = 0, ball_interval = 0;
+	*result = (struct Replay_Result){0};
+	recorder.mode = RECORDER_CHECKING; //the replayed game's state changes are compared, not recorded
+	replay_checks.head = replay_checks.tail = 0;
+	(void)TAKE_WAKE_EVENTS(); //start from a quiet main loop
+
+	while (r.pos < r.length){
+		uint32_t type, small, f[SNAPSHOT_FIELDS];
+		if (!read_record(&r, &type, &small, f)){
+			result->corrupt = 1;
+			break;
+		}
+		result->records++;
+		uint32_t behind = 0; //an ISR record that came before the main loop caught up
+		if (type == REC_BALL){
+			behind = small & 1;
+			small = (uint32_t)unzigzag(small >> 2) * (((small >> 1) & 1) ? BALL_TICK_us : 1); //interval change
+		}
+		else if (type == REC_TIMER || type == REC_PRESS){
+			behind = small >> 2;
+			small &= 0x3;
+		}
+		else if (type == REC_SEGMENT){
+			behind = small & 1;
+			small >>= 1; //steps
+		}
+		switch(type){ //time of this record
+		case REC_SNAPSHOT:
+			now = f[0];
+			ball_us = now;
+			ball_interval = 0;
+			break;
+		case REC_BALL:
+			ball_interval += small;
+			ball_us += ball_interval;
+			now = ball_us;
+			break;
+		default:
+			now += f[0];
+			break;
+		}
+		usTimer = now; //the replayed game reads the time of the recording
+		if (!started){
+			if (type != REC_SNAPSHOT){ //history before it was overwritten
+				result->skipped++;
+				continue;
+			}
+			started = 1;
+			start_us = now;
+			restore_snapshot(f);
+			POST_WAKE_EVENT(WAKE_STATE);
+			run_main_loop_passes(0);
+			continue;
+		}
+		if (!behind){
+			run_main_loop_passes(type == REC_STATE || type == REC_SNAPSHOT); //the main loop handled everything before this record
+		}
+		uint32_t diverged = 0;
+		switch(type){
+		case REC_SNAPSHOT:
+		case REC_STATE:
+			diverged = !check_state(type, small, f);
+			result->checked++;
+			break;
+		case REC_BALL:
+			balls.step_us = now;
+			HANDLE_GAME_LED_MOVEMENT((BALL_COUNT > 1) ? f[0] : 0x1);
+			POST_WAKE_EVENT(WAKE_BALL);
+			result->applied++;
+			break;
+		case REC_SEGMENT:
+			balls.step_us = now;
+			for (uint32_t i = 0; i < small; i++){
+				HANDLE_GAME_LED_MOVEMENT(0x1); //the served ball, the only one DMA plays
+			}
+			POST_WAKE_EVENT(WAKE_BALL);
+			result->applied++;
+			break;
+		case REC_PRESS:{
+			enum game_states previous_game_state = game_state;
+			enum system_states previous_system_state = system_state;
+			PROCESS_BUTTON_PRESS((enum choices)small, now - f[1]);
+			RECORD_STATE_CHANGE(previous_game_state, previous_system_state); //as the task that ran it did
+			POST_WAKE_EVENT(WAKE_INPUT);
+			result->applied++;
+			break;
+		}
+		case REC_TIMER:
+			fire_timer(small);
+			result->applied++;
+			break;
+		}
+		if (diverged && result->divergences++ == 0){
+			result->first_divergence = result->records;
+		}
+		result->span_us = now - start_us;
+	}
+	run_main_loop_passes(0);
+	recorder.mode = was;
+}
+#endif /* RECORDER_REPLAY */
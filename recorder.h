@@ -0,0 +1,74 @@
+/**
+**************************************************************************************************
+* @file recorder.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for recorder.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the input/timer event recorder and the replay engine that re-runs a recording
+* through the game logic.
+**************************************************************************************************
+*/
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include "main.h"
+
+#ifndef RECORDER_SIZE //may be set on the compiler command line
+#define RECORDER_SIZE 4096 //bytes of SRAM kept for the recording
+#endif
+#ifndef RECORDER_REPLAY //set to 1 by sim/Makefile
+#define RECORDER_REPLAY 0 //1 = build REPLAY_RECORDING(). Host only: it sets usTimer, which on the board is TIM5->CNT
+#endif
+
+//Record types, stored in the low 3 bits of each record's first byte
+enum record_types { REC_SNAPSHOT, REC_BALL, REC_PRESS, REC_TIMER, REC_STATE, REC_SEGMENT, NUM_of_RECORD_TYPES };
+
+//What RECORD_* does with a record
+enum recorder_modes { RECORDER_OFF, RECORDER_RECORDING, RECORDER_CHECKING };
+
+//Soft timers whose expiry changes the game, see RECORD_TIMER()
+enum recorded_timers { REC_P1_HITZONE_TIMER, REC_P2_HITZONE_TIMER, REC_ROUND_TIMER };
+
+//RAM ring of variable-length records. When full, whole records are dropped from the oldest end.
+struct Recorder{
+	uint8_t data[RECORDER_SIZE];
+	uint32_t head; //next byte to write, free running
+	uint32_t tail; //oldest byte kept, free running
+	enum recorder_modes mode; //RECORDER_CHECKING while a recording is replayed
+	uint32_t records; //records written since RECORDER_START()
+	uint32_t dropped; //records overwritten because the ring was full
+	uint32_t last_us; //usTimer of the previous record
+	uint32_t last_ball_us; //usTimer of the previous REC_BALL (or snapshot)
+	uint32_t last_ball_interval; //time between the two previous REC_BALLs
+};
+
+//What REPLAY_RECORDING() found
+struct Replay_Result{
+	uint32_t records; //records decoded
+	uint32_t skipped; //records before the first snapshot (their history was overwritten)
+	uint32_t applied; //ball steps, presses and timer expiries fed to the game
+	uint32_t checked; //state and snapshot records compared against the replayed game
+	uint32_t divergences; //checks that did not match
+	uint32_t first_divergence; //record number of the first mismatch
+	uint32_t span_us; //recorded time covered from the first snapshot to the last record
+	uint32_t corrupt; //1 if the data ended inside a record
+};
+
+extern struct Recorder recorder;
+
+void RECORDER_START(void);
+void RECORD_BALL(uint32_t stepped);
+void RECORD_SEGMENT(uint32_t steps);
+void RECORD_PRESS(enum choices choice, uint32_t pressTIME_us);
+void RECORD_TIMER(enum recorded_timers timer);
+void RECORD_STATE(void);
+void RECORD_SNAPSHOT(void);
+void RECORD_STATE_CHANGE(enum game_states previous_game_state, enum system_states previous_system_state);
+uint32_t RECORDER_DUMP(uint8_t *out, uint32_t size);
+#if RECORDER_REPLAY
+void REPLAY_RECORDING(const uint8_t *data, uint32_t length, struct Replay_Result *result);
+#endif
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,128 @@
+#include "scheduler.h"
+#include "recorder.h" //logs each task's state change, see recorder.c/h
+/**
+**************************************************************************************************
+* @file scheduler.c
+* @brief Source file for the main loop's cooperative scheduler
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* The main loop's work is a table of tasks (tasks[], filled in by main.c), each a stackless
+* protothread with a priority, a deadline and the wake events it runs on. HANDLE_WAKE_EVENTS()
+* hands the scheduler the wake events it took (SCHEDULER_POST()), which makes the tasks waiting
+* on them ready, then runs them (SCHEDULER_RUN()): always the ready task of the highest priority,
+* the earliest deadline between equals, until none is ready. A task runs until it waits, yields
+* or ends; one that yields goes back in line behind anything more urgent, so long background
+* work split with PT_YIELD() never holds up the game for more than one of its slices.
+*
+* Every task keeps its own figures: runs, the longest single run and the total in core cycles,
+* and, each time it waits or ends, the time since it was made ready, counted as a deadline miss
+* when it is over deadline_us. A task woken while blocked, that only finds its wait condition
+* still false, has made no progress: it goes back to waiting without counting as a run or being
+* checked against its deadline, so a task waiting out a mode does not fill its figures.
+* The table stays in SRAM (tasks) to be read with the debugger.
+*
+* A task that changes game_state or system_state is logged as it returns (RECORD_STATE_CHANGE()),
+* before any interrupt that comes in ahead of the next task can move the ball on.
+*
+*	Note: The deadline counts from when the main loop took the wake event, not from the ISR that
+*	      posted it. Run cycles include any ISR that interrupted the task.
+*************************************************************************************************/
+//================================================================================================
+// configure_scheduler()
+// @parm: none
+// @return: none
+// 		Puts every task back at its top, not ready, and clears the statistics
+//================================================================================================
+void configure_scheduler(void)
+{
+	for (uint32_t i = 0; i < NUM_of_TASKS; i++){
+		struct Task *t = &tasks[i];
+		t->lc = 0;
+		t->ready = 0;
+		t->runs = t->finished = t->misses = 0;
+		t->worst_response_us = t->worst_cycles = 0;
+		t->total_cycles = 0;
+	}
+}
+//================================================================================================
+// SCHEDULER_POST()
+// @parm: events = mask of wake events taken by the main loop
+// @return: none
+// 		Makes ready every task that runs on one of them. A task already ready keeps its
+// 		deadline.
+//================================================================================================
+void SCHEDULER_POST(uint32_t events)
+{
+	uint32_t now_us = usTimer;
+	for (uint32_t i = 0; i < NUM_of_TASKS; i++){
+		struct Task *t = &tasks[i];
+		if (!(events & t->wake_mask) || t->ready){
+			continue;
+		}
+		t->ready = 1;
+		t->ready_us = now_us;
+	}
+}
+//================================================================================================
+// next_task()
+// @parm: none
+// @return: the ready task to run next, 0 if none is ready
+//================================================================================================
+static struct Task *next_task(void)
+{
+	struct Task *best = 0;
+	for (uint32_t i = 0; i < NUM_of_TASKS; i++){
+		struct Task *t = &tasks[i];
+		if (!t->ready){
+			continue;
+		}
+		if (!best || t->priority < best->priority
+				|| (t->priority == best->priority
+				&& (int32_t)((t->ready_us + t->deadline_us) - (best->ready_us + best->deadline_us)) < 0)){
+			best = t;
+		}
+	}
+	return best;
+}
+//================================================================================================
+// SCHEDULER_RUN()
+// @parm: none
+// @return: none
+// 		Main loop only. Runs the ready tasks, most urgent first, until none is left ready.
+//================================================================================================
+void SCHEDULER_RUN(void)
+{
+	struct Task *t;
+	while ((t = next_task()) != 0){
+		enum game_states previous_game_state = game_state;
+		enum system_states previous_system_state = system_state;
+		uint32_t lc = t->lc;
+		uint32_t start = DWT->CYCCNT;
+		enum task_results result = t->run(t);
+		RECORD_STATE_CHANGE(previous_game_state, previous_system_state); //see recorder.c/h
+		if (result == TASK_WAITING && t->lc == lc){ //still blocked at the same wait, no progress
+			t->ready = 0;
+			continue;
+		}
+		TASK_MODEL_COST(t - tasks); //see scheduler.h
+		uint32_t cycles = DWT->CYCCNT - start;
+		t->runs++;
+		t->total_cycles += cycles;
+		if (cycles > t->worst_cycles){
+			t->worst_cycles = cycles;
+		}
+		if (result == TASK_YIELDED){
+			continue;
+		}
+		uint32_t response_us = usTimer - t->ready_us;
+		t->finished++;
+		if (response_us > t->deadline_us){
+			t->misses++;
+		}
+		if (response_us > t->worst_response_us){
+			t->worst_response_us = response_us;
+		}
+		t->ready = 0;
+	}
+}
@@ -0,0 +1,68 @@
+/**
+**************************************************************************************************
+* @file scheduler.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for scheduler.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the main loop's tasks, the cooperative scheduler that runs them and the protothread
+* macros a task is written with.
+**************************************************************************************************
+*/
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "main.h"
+
+//What a task's run function returns
+enum task_results {
+	TASK_WAITING, //blocked in PT_WAIT_UNTIL(), runs again once one of its wake events is posted
+	TASK_YIELDED, //still has work, runs again after any ready task of a higher priority
+	TASK_ENDED //done, starts from the top on its next wake event
+};
+
+//Stackless protothreads: a task is a function that keeps its place in its struct Task (lc) and
+//returns to the scheduler when it waits or yields. Nothing on the stack survives a return, so
+//anything a task needs across a wait or yield goes in a static or a global. PT_BEGIN() and
+//PT_END() bracket the whole function, and a wait or yield cannot sit inside a switch of its own.
+#define PT_BEGIN(t) switch ((t)->lc) { case 0:
+#define PT_WAIT_UNTIL(t, condition) do { (t)->lc = __LINE__; __attribute__((fallthrough)); case __LINE__: \
+		if (!(condition)) { return TASK_WAITING; } } while (0)
+#define PT_YIELD(t) do { (t)->lc = __LINE__; return TASK_YIELDED; case __LINE__:; } while (0)
+#define PT_END(t) } (t)->lc = 0; return TASK_ENDED
+
+//The host simulator runs code in zero simulated time, so it supplies a TASK_MODEL_COST() that
+//charges a modelled cost for the task's run. Nothing to do on the device.
+#ifndef TASK_MODEL_COST
+#define TASK_MODEL_COST(task) ((void)0)
+#endif
+
+//The main loop's work, in the order HANDLE_WAKE_EVENTS() used to run it (see main.c)
+enum main_tasks { TASK_LINK, TASK_GAME, TASK_MOVE_MODE, TASK_DEBOUNCE, NUM_of_TASKS };
+
+struct Task{
+	enum task_results (*run)(struct Task *t);
+	uint32_t wake_mask; //WAKE_MASK()s of the wake events that make it ready (see power.h)
+	uint32_t priority; //0 runs first, equal priorities go by the earlier deadline
+	uint32_t deadline_us; //to finish in once the main loop has taken its wake event
+	//state
+	uint32_t lc; //where the protothread resumes, 0 for the top
+	uint32_t ready; //1 from its wake event until it waits or ends
+	uint32_t ready_us; //usTimer when it was made ready
+	//statistics, since configure_scheduler()
+	uint32_t runs; //calls of run that made progress
+	uint32_t finished; //waits and ends after progress, each is checked against the deadline
+	uint32_t misses; //of which finished after the deadline
+	uint32_t worst_response_us; //longest from being made ready to finishing
+	uint32_t worst_cycles; //longest single run, DWT->CYCCNT
+	uint64_t total_cycles;
+};
+
+extern struct Task tasks[NUM_of_TASKS];
+
+void configure_scheduler(void);
+void SCHEDULER_POST(uint32_t events);
+void SCHEDULER_RUN(void);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,67 @@
+#include "shared_state.h"
+/**
+**************************************************************************************************
+* @file shared_state.c
+* @brief Source file for the game state shared with the interrupt handlers
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* The main loop changes the game state a field at a time: a miss sets missFLAG, the scores and
+* winnerFLAG in HANDLE_MISS() before GAME_EVENT() moves game_state on. A handler reading those
+* fields in between (SysTick_Handler through HITZONE_TOGGLE_EXPIRED(), TIM2_IRQHandler through
+* HANDLE_GAME_LED_MOVEMENT()) would see half of the change. Instead the handlers read a
+* struct Game_Snapshot that the main loop publishes once a change is whole (PUBLISH_GAME_STATE(),
+* at the end of every GAME_EVENT() and wherever else the state is set).
+*
+* Publishing goes through a latch, a sequence count with two copies of the snapshot:
+*	sequence odd   readers use copy[1] while copy[0] is rewritten
+*	sequence even  readers use copy[0] while copy[1] is rewritten
+* so there is always a whole copy to read. A handler never waits, never retries and never
+* disables interrupts, it just reads copy[sequence & 1] (GAME_STATE_SNAPSHOT()). The main loop
+* cannot run while a handler does, so that copy cannot change under it.
+*
+*	Note: Only the main loop publishes. The handlers' own fields (the ball's steps in balls, the
+*	      press toggle in pressedFLAG) are single words each written in one place.
+*************************************************************************************************/
+struct Shared_State shared_state = {
+	.copy = {
+		{ .system_state = PLAY_MODE, .game_state = INITIAL_SERVE, .position = DEFAULT_POSITION },
+		{ .system_state = PLAY_MODE, .game_state = INITIAL_SERVE, .position = DEFAULT_POSITION },
+	},
+};
+
+//================================================================================================
+// take_player()
+// @parm: *p = player
+// @return: the player's part of the snapshot
+//================================================================================================
+static struct Player_Snapshot take_player(const struct Player *p)
+{
+	return (struct Player_Snapshot){ .score = p->score, .missFLAG = p->missFLAG, .winnerFLAG = p->winnerFLAG };
+}
+//================================================================================================
+// PUBLISH_GAME_STATE()
+// @parm: none
+// @return: none
+// 		Main loop only. Takes a snapshot of the game state and makes it the one the handlers
+// 		read, both copies in turn.
+//================================================================================================
+void PUBLISH_GAME_STATE(void)
+{
+	struct Game_Snapshot now = {
+		.system_state = system_state,
+		.game_state = game_state,
+		.position = LEDcount,
+		.heading = direction,
+		.level = pace,
+		.player = { take_player(&P1), take_player(&P2) },
+	};
+	uint32_t sequence = shared_state.sequence;
+	shared_state.sequence = sequence + 1;
+	__DMB(); //readers are on copy[1] before copy[0] changes
+	shared_state.copy[0] = now;
+	__DMB(); //copy[0] is whole before readers go back to it
+	shared_state.sequence = sequence + 2;
+	__DMB();
+	shared_state.copy[1] = now;
+}
@@ -0,0 +1,51 @@
+/**
+**************************************************************************************************
+* @file shared_state.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for shared_state.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the snapshot of the game state that the main loop publishes for the interrupt
+* handlers, and the latch (a seqlock with two copies) it is published through.
+**************************************************************************************************
+*/
+#ifndef SHARED_STATE_H_
+#define SHARED_STATE_H_
+
+#include "main.h"
+
+//What the handlers may know of a player. pressedFLAG is not here: SysTick_Handler clears it
+//itself (HITZONE_TOGGLE_EXPIRED()) and reads it back in the same call, one word.
+struct Player_Snapshot{
+	uint32_t score;
+	uint32_t missFLAG;
+	uint32_t winnerFLAG;
+};
+
+//The game state as the main loop last left it, every field from the same moment
+struct Game_Snapshot{
+	enum system_states system_state;
+	enum game_states game_state;
+	uint32_t position; //LEDcount
+	enum directions heading; //direction
+	uint32_t level; //pace
+	struct Player_Snapshot player[2]; //by enum identifications
+};
+
+//Written by the main loop only. sequence is even between publishes; readers take
+//copy[sequence & 1], which is never the copy being written.
+struct Shared_State{
+	volatile uint32_t sequence; //goes up by two with every publish
+	struct Game_Snapshot copy[2];
+};
+
+extern struct Shared_State shared_state;
+
+//The last published snapshot. For interrupt handlers, which the main loop cannot interrupt, so
+//the copy stays whole until the handler returns. The main loop reads the state itself.
+#define GAME_STATE_SNAPSHOT() ((const struct Game_Snapshot *)&shared_state.copy[shared_state.sequence & 1])
+
+void PUBLISH_GAME_STATE(void);
+
+#endif /* SHARED_STATE_H_ */
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "sim_hw.h"
+#include "../main.h"
+#include "../ball.h"
+#include "../leds.h"
+#include "../input.h"
+#include "../game_logic.h"
+#include "../shared_state.h"
+/**
+**************************************************************************************************
+* @file bench.c
+* @brief Host microbenchmarks for the game's hot paths
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Calls the game's entry points, compiled unmodified and linked against the emulated register
+* blocks, in a tight loop from a set of representative game states and ball positions, and
+* reports the time and the instructions each call takes. The instructions come from the host's
+* instruction counter (perf_event_open) and are "-" where it has none, in a VM for instance.
+*
+* Each case has a prepare step that puts the state back before every call, so every call sees
+* the same input. The prepare step is timed on its own and taken off. Every case is run several
+* times and the fastest run kept, which leaves out most of what else the host was doing. The runs
+* go round all the cases in turn, so a slow stretch of the host's does not land on one case alone.
+*
+* The results are compared against the stored baseline, bench_baseline.txt by default. A case whose
+* instructions per call rose by more than -t percent is a regression. Where the baseline or the run
+* has no instruction count, the case is gated on its time per call instead, with the wider -T
+* tolerance, since times move from one run to the next. Times are compared after scaling by the
+* REFERENCE case, fixed work that does not touch the game, so a host that is slower as a whole
+* right now is not taken for a regression; a case still over the tolerance is run again up to
+* TIME_RETRIES more rounds before it counts. A regression makes the exit status 1, and
+* a missing baseline makes it 2. -u writes the results as the new baseline instead. Times are only
+* comparable on the same host and compiler, so a new host or compiler needs a new baseline.
+*
+*	usage: pong_bench [-b baseline] [-u] [-t instr_percent] [-T time_percent] [-n calls] [-r runs]
+**************************************************************************************************
+*/
+#define MAX_CASES 32
+#define TIME_RETRIES 3 //extra rounds of runs for a case over its time tolerance
+#define MIDBOARD ((RIGHT_HITZONE_POS + LEFT_HITZONE_POS) / 2)
+
+struct bench_case{
+	const char *name; //entry point/input, also the key in the baseline
+	void (*setup)(void); //once before the case, may be NULL
+	void (*prepare)(void); //before every call, may be NULL
+	void (*call)(void);
+};
+
+struct bench_result{
+	double ns; //per call
+	double instructions; //per call, negative if not counted
+};
+
+static struct LED_Frame frame; //for the entry points that stage into a caller's frame
+static uint32_t position; //ball position the prepare step puts back
+static enum game_states state; //game state the prepare step puts back
+static uint32_t scores[2]; //P1 and P2 scores the prepare step puts back
+static enum choices pressed; //button the prepare step queues an edge for
+static int perf_fd = -1;
+
+//================================================================================================
+// count_instructions()
+// @parm: none
+// @return: user mode instructions retired by this process so far, 0 without a counter
+//================================================================================================
+static uint64_t count_instructions(void)
+{
+	uint64_t count = 0;
+	if (perf_fd >= 0 && read(perf_fd, &count, sizeof count) != sizeof count){
+		count = 0;
+	}
+	return count;
+}
+//================================================================================================
+// now_ns()
+// @parm: none
+// @return: monotonic time in ns
+//================================================================================================
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+//--setup and prepare steps-----------------------------------------------------------------------
+static void ball_in_play(void)
+{
+	system_state = PLAY_MODE;
+	balls.in_play = 0x1;
+	balls.heading[0] = (state == MOVE_LEFT || state == LEFT_HITZONE) ? LEFT : RIGHT;
+}
+static void put_ball_back(void)
+{
+	game_state = state;
+	balls.position[0] = position;
+	PUBLISH_GAME_STATE(); //the step action is looked up in the published state
+}
+static void put_scores_back(void)
+{
+	P1.score = scores[0];
+	P2.score = scores[1];
+	P1.winnerFLAG = 0;
+	P2.winnerFLAG = 0;
+}
+static void queue_edge(void)
+{
+	struct UserInput *b = &buttons[pressed - 1];
+	b->queue.tail = b->queue.head; //drops the edge of a prepare step timed without its call
+	EVENT_QUEUE_PUSH(&b->queue, pressed, usTimer - DEBOUNCE_DELAY_us); //already debounced
+	balls.position[0] = position;
+}
+static void hold_left_button(void)
+{
+	GPIOA->IDR &= ~(0x1u << 4); //PA4 reads low, pressed
+}
+static void release_left_button(void)
+{
+	GPIOA->IDR |= (0x1u << 4);
+}
+
+//--cases, each sets the inputs above then runs the ones it needs---------------------------------
+static void move_serve(void) { state = MOVE_RIGHT; position = DEFAULT_POSITION; ball_in_play(); }
+static void move_mid(void) { state = MOVE_LEFT; position = MIDBOARD; ball_in_play(); }
+static void move_hitzone(void) { state = MOVE_RIGHT; position = RIGHT_HITZONE_POS + 1; ball_in_play(); }
+static void move_miss(void) { state = RIGHT_HITZONE; position = RIGHT_HITZONE_POS; ball_in_play(); }
+static void move_waiting(void) { state = RIGHT_HITZONE; position = RIGHT_MISS_ZONE; ball_in_play(); }
+static void move_winner(void) { state = P1_WINNERS_CIRCLE; position = RIGHT_MISS_ZONE; ball_in_play(); }
+static void step_ball(void) { HANDLE_GAME_LED_MOVEMENT(0x1); }
+
+static void hitzone_lit(void) { game_state = MOVE_RIGHT; P1.pressedFLAG = 0; P1.missFLAG = 0; PUBLISH_GAME_STATE(); }
+static void hitzone_pressed(void) { game_state = MOVE_RIGHT; P1.pressedFLAG = 1; P1.missFLAG = 0; PUBLISH_GAME_STATE(); }
+static void hitzone_leds(void) { HANDLE_HITZONE_LEDS(&P1, &frame); }
+
+static void button_idle(void) { system_state = PLAY_MODE; }
+static void button_bounce(void) { system_state = PLAY_MODE; pressed = Left_Pushed; position = LEDcount; release_left_button(); }
+static void button_move_mode(void) { system_state = MOVE_MODE; pressed = Left_Pushed; position = MIDBOARD; hold_left_button(); }
+static void button_press(void) { state = MOVE_RIGHT; position = MIDBOARD; ball_in_play(); put_ball_back(); pressed = Left_Pushed; hold_left_button(); }
+static void debounced_button(void) { HANDLE_DEBOUNCED_BUTTON(); }
+
+static void score_point(void) { scores[0] = 1; scores[1] = 0; }
+static void score_game(void) { scores[0] = 0; scores[1] = 2; }
+static void update_score(void) { UPDATE_SCORE(&P1, &P2, &frame); }
+
+static void points_none(void) { P2.score = 0; }
+static void points_full(void) { P2.score = 3; }
+static void points_display(void) { UPDATE_POINTS_DISPLAY(&P2, &frame); }
+
+static void gameboard_off(void) { TURN_OFF_GAMEBOARD_LEDS(&frame); }
+
+static void publish(void) { PUBLISH_GAME_STATE(); }
+
+static void reference_work(void)
+{
+	static volatile uint32_t seed = 1;
+	uint32_t x = seed;
+	for (uint32_t i = 0; i < 16; i++){ //xorshift32, a fixed amount of work whatever the game does
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	seed = x;
+}
+
+static const struct bench_case cases[] = {
+	{"HANDLE_GAME_LED_MOVEMENT/MOVE_RIGHT,serve",         move_serve,       put_ball_back,   step_ball},
+	{"HANDLE_GAME_LED_MOVEMENT/MOVE_LEFT,midboard",       move_mid,         put_ball_back,   step_ball},
+	{"HANDLE_GAME_LED_MOVEMENT/MOVE_RIGHT,into_hitzone",  move_hitzone,     put_ball_back,   step_ball},
+	{"HANDLE_GAME_LED_MOVEMENT/RIGHT_HITZONE,into_miss",  move_miss,        put_ball_back,   step_ball},
+	{"HANDLE_GAME_LED_MOVEMENT/RIGHT_HITZONE,waiting",    move_waiting,     put_ball_back,   step_ball},
+	{"HANDLE_GAME_LED_MOVEMENT/P1_WINNERS_CIRCLE",        move_winner,      put_ball_back,   step_ball},
+	{"HANDLE_HITZONE_LEDS/lit",                           hitzone_lit,      NULL,            hitzone_leds},
+	{"HANDLE_HITZONE_LEDS/pressed",                       hitzone_pressed,  NULL,            hitzone_leds},
+	{"HANDLE_DEBOUNCED_BUTTON/idle",                      button_idle,      NULL,            debounced_button},
+	{"HANDLE_DEBOUNCED_BUTTON/bounce",                    button_bounce,    queue_edge,      debounced_button},
+	{"HANDLE_DEBOUNCED_BUTTON/MOVE_MODE,press",           button_move_mode, queue_edge,      debounced_button},
+	{"HANDLE_DEBOUNCED_BUTTON/MOVE_RIGHT,press",          button_press,     queue_edge,      debounced_button},
+	{"UPDATE_SCORE/point",                                score_point,      put_scores_back, update_score},
+	{"UPDATE_SCORE/game_won",                             score_game,       put_scores_back, update_score},
+	{"UPDATE_POINTS_DISPLAY/score_0",                     points_none,      NULL,            points_display},
+	{"UPDATE_POINTS_DISPLAY/score_3",                     points_full,      NULL,            points_display},
+	{"TURN_OFF_GAMEBOARD_LEDS",                           NULL,             NULL,            gameboard_off},
+	{"PUBLISH_GAME_STATE",                                NULL,             NULL,            publish},
+	{"REFERENCE",                                         NULL,             NULL,            reference_work},
+};
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+#define REFERENCE_CASE (NUM_CASES - 1) //not gated, measures how fast the host is running
+_Static_assert(NUM_CASES <= MAX_CASES, "bench.c: raise MAX_CASES");
+
+//================================================================================================
+// run_case()
+// @parm: *c = case to run
+//        calls = calls to time
+//        *best_ns, *best_instructions = fastest run so far, [0] prepare and call, [1] prepare alone
+// @return: none
+// 		Boots the firmware afresh, sets the case up and times its calls, then its prepare steps
+// 		alone. Keeps whichever run is the fastest yet.
+//================================================================================================
+static void run_case(const struct bench_case *c, uint32_t calls, uint64_t *best_ns, uint64_t *best_instructions)
+{
+	sim_reset();
+	configure_system();
+	if (c->setup) c->setup();
+	if (c->prepare) c->prepare();
+	c->call(); //warm up
+	for (uint32_t pass = 0; pass < 2; pass++){ //0: prepare and call, 1: prepare alone
+		if (pass == 1 && !c->prepare){
+			best_ns[1] = best_instructions[1] = 0;
+			break;
+		}
+		uint64_t instructions = count_instructions();
+		uint64_t start = now_ns();
+		if (pass == 0){
+			for (uint32_t i = 0; i < calls; i++){
+				if (c->prepare) c->prepare();
+				c->call();
+			}
+		}
+		else{
+			for (uint32_t i = 0; i < calls; i++){
+				c->prepare();
+			}
+		}
+		uint64_t ns = now_ns() - start;
+		instructions = count_instructions() - instructions;
+		if (ns < best_ns[pass]) best_ns[pass] = ns;
+		if (instructions < best_instructions[pass]) best_instructions[pass] = instructions;
+	}
+	release_left_button();
+}
+//================================================================================================
+// per_call()
+// @parm: *best = fastest runs of a case, [0] prepare and call, [1] prepare alone
+//        calls = calls in each run
+// @return: the call's own share per call
+//================================================================================================
+static double per_call(const uint64_t *best, uint32_t calls)
+{
+	return (best[0] > best[1]) ? (double)(best[0] - best[1]) / calls : 0;
+}
+//================================================================================================
+// read_baseline()
+// @parm: *path = baseline file
+//        base = filled in per case, ns negative for a case the file does not have
+// @return: 1 if the file was read, 0 if it could not be opened
+//================================================================================================
+static uint32_t read_baseline(const char *path, struct bench_result *base)
+{
+	for (uint32_t i = 0; i < NUM_CASES; i++){
+		base[i].ns = base[i].instructions = -1;
+	}
+	FILE *f = fopen(path, "r");
+	if (!f){
+		return 0;
+	}
+	char line[256], name[128], instructions[32];
+	double ns;
+	while (fgets(line, sizeof line, f)){
+		if (line[0] == '#' || sscanf(line, "%127s %lf %31s", name, &ns, instructions) != 3){
+			continue;
+		}
+		for (uint32_t i = 0; i < NUM_CASES; i++){
+			if (!strcmp(name, cases[i].name)){
+				base[i].ns = ns;
+				base[i].instructions = (instructions[0] == '-') ? -1 : strtod(instructions, NULL);
+			}
+		}
+	}
+	fclose(f);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *baseline = "bench_baseline.txt";
+	uint32_t update = 0, calls = 200000, runs = 7;
+	double instr_limit = 10, time_limit = 50; //percent
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+		int bad = 0;
+		if (!strcmp(arg, "-b")) { baseline = val; i++; }
+		else if (!strcmp(arg, "-u")) { update = 1; }
+		else if (!strcmp(arg, "-t")) { instr_limit = strtod(val, NULL); i++; }
+		else if (!strcmp(arg, "-T")) { time_limit = strtod(val, NULL); i++; }
+		else if (!strcmp(arg, "-n")) { calls = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-r")) { runs = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else bad = 1;
+		if (bad){
+			fprintf(stderr, "usage: %s [-b baseline] [-u] [-t instr_percent] [-T time_percent] [-n calls] [-r runs]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (calls == 0) calls = 1;
+	if (runs == 0) runs = 1;
+
+	struct perf_event_attr attr = {0};
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof attr;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+	struct bench_result base[MAX_CASES], result[MAX_CASES];
+	uint32_t have_baseline = !update && read_baseline(baseline, base);
+	uint32_t regressions = 0, gated = 0, timed = 0;
+	printf("%-50s %9s %11s %9s %11s %8s\n", "case", "ns/call", "instr/call", "base ns", "base instr", "change");
+	uint64_t best_ns[MAX_CASES][2], best_instructions[MAX_CASES][2];
+	memset(best_ns, 0xFF, sizeof best_ns);
+	memset(best_instructions, 0xFF, sizeof best_instructions);
+	for (uint32_t r = 0; r < runs; r++){
+		for (uint32_t i = 0; i < NUM_CASES; i++){
+			run_case(&cases[i], calls, best_ns[i], best_instructions[i]);
+		}
+	}
+	//a case gated on time that is over its tolerance gets more runs before it counts, as a busy
+	//spell of the host's can outlast all of its first ones
+	double host = 1; //time the REFERENCE case takes now over its time in the baseline
+	for (uint32_t retry = 0; have_baseline; retry++){
+		double reference = per_call(best_ns[REFERENCE_CASE], calls);
+		host = (base[REFERENCE_CASE].ns > 0 && reference > 0) ? reference / base[REFERENCE_CASE].ns : 1;
+		if (retry == TIME_RETRIES){
+			break;
+		}
+		uint32_t slow = 0;
+		for (uint32_t i = 0; i < REFERENCE_CASE; i++){
+			if (base[i].ns < 0 || (base[i].instructions >= 0 && perf_fd >= 0)
+					|| per_call(best_ns[i], calls) <= host * base[i].ns * (1 + time_limit / 100)){
+				continue;
+			}
+			slow++;
+			for (uint32_t r = 0; r < runs; r++){
+				run_case(&cases[i], calls, best_ns[i], best_instructions[i]);
+				run_case(&cases[REFERENCE_CASE], calls, best_ns[REFERENCE_CASE], best_instructions[REFERENCE_CASE]);
+			}
+		}
+		if (!slow){
+			break;
+		}
+	}
+	for (uint32_t i = 0; i < NUM_CASES; i++){
+		uint64_t *ns = best_ns[i], *instructions = best_instructions[i];
+		result[i].ns = per_call(ns, calls);
+		result[i].instructions = (perf_fd < 0) ? -1 : per_call(instructions, calls);
+		char instruction_text[16] = "-", base_ns[16] = "-", base_instructions[16] = "-", change[16] = "";
+		const char *verdict = "";
+		if (result[i].instructions >= 0) snprintf(instruction_text, sizeof instruction_text, "%.1f", result[i].instructions);
+		if (i == REFERENCE_CASE){
+			if (have_baseline && base[i].ns >= 0) snprintf(base_ns, sizeof base_ns, "%.1f", base[i].ns);
+		}
+		else if (have_baseline && base[i].ns >= 0){
+			snprintf(base_ns, sizeof base_ns, "%.1f", base[i].ns);
+			//gate on instructions when both runs counted them, they hardly vary from run to run
+			double was = base[i].ns, is = result[i].ns / host, limit = time_limit;
+			if (base[i].instructions >= 0 && result[i].instructions >= 0){
+				snprintf(base_instructions, sizeof base_instructions, "%.1f", base[i].instructions);
+				was = base[i].instructions;
+				is = result[i].instructions;
+				limit = instr_limit;
+			}
+			else{
+				timed++;
+			}
+			gated++;
+			double percent = (was > 0) ? 100 * (is - was) / was : 0;
+			snprintf(change, sizeof change, "%+.0f%%", percent);
+			if (percent > limit){
+				verdict = "  REGRESSED";
+				regressions++;
+			}
+		}
+		else if (have_baseline){
+			verdict = "  (new)";
+		}
+		printf("%-50s %9.1f %11s %9s %11s %8s%s\n", cases[i].name, result[i].ns, instruction_text, base_ns,
+				base_instructions, change, verdict);
+	}
+
+	if (update){
+		FILE *f = fopen(baseline, "w");
+		if (!f){
+			perror(baseline);
+			return 2;
+		}
+		fprintf(f, "# pong_bench baseline: case, ns per call, instructions per call (- if not counted)\n");
+		for (uint32_t i = 0; i < NUM_CASES; i++){
+			if (result[i].instructions >= 0){
+				fprintf(f, "%s %.1f %.1f\n", cases[i].name, result[i].ns, result[i].instructions);
+			}
+			else{
+				fprintf(f, "%s %.1f -\n", cases[i].name, result[i].ns);
+			}
+		}
+		fclose(f);
+		printf("baseline written to %s\n", baseline);
+	}
+	else if (!have_baseline){
+		printf("no baseline in %s, run with -u (make bench-baseline) to make one\n", baseline);
+		return 2;
+	}
+	else{
+		printf("%u of %u cases regressed (instructions +%.0f%%, time +%.0f%% for the %u without instruction counts,\n"
+				"taken at a host speed of %.2fx the baseline's)\n", regressions, gated, instr_limit, time_limit, timed, 1 / host);
+	}
+	return regressions ? 1 : 0;
+}
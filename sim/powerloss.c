@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_hw.h"
+#include "../main.h"
+#include "../stats_log.h"
+/**
+**************************************************************************************************
+* @file powerloss.c
+* @brief Host test that cuts the power while the statistics log is being written
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Boots the unmodified firmware over and over against the same emulated flash bank 2. Each trial
+* queues a few rounds of random content with STATS_APPEND(), lets the writer run for a random
+* time and cuts the power (sim_flash_power_cut()), which may land in the middle of a program or
+* of the erase that starts a new page. The next boot reads the log back in configure_stats_log()
+* and its totals must be those of every round the writer finished, or of those and the round it
+* was writing when the power went. Anything else is a mismatch and the exit status is 1.
+*
+* The random cut points make sure every step of the writer gets cut, including the checkpoint
+* and header of a new page, and the pages are rotated through many times over.
+*
+*	usage: pong_powerloss [-n trials] [-s seed] [-r rounds]
+**************************************************************************************************
+*/
+#define CUT_WINDOW_US 30000 //cuts fall within this long after the rounds are queued, an erase and a few records
+
+static uint64_t rng = 1;
+
+#if STATS_LOG
+//================================================================================================
+// random_below()
+// @parm: n = bound, not 0
+// @return: pseudo random number from 0 to n - 1
+//================================================================================================
+static uint32_t random_below(uint32_t n)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+//================================================================================================
+// random_round()
+// @parm: *r = round to fill in
+// @return: none
+// 		Any content will do, the log does not look inside a record beyond its CRC
+//================================================================================================
+static void random_round(struct Stats_Round *r)
+{
+	*r = (struct Stats_Round){0};
+	r->loser = random_below(2) ? ONE : TWO;
+	r->game_won = (random_below(4) == 0);
+	r->max_pace = (uint8_t)(1 + random_below(16));
+	for (uint32_t i = 0; i < 2; i++){
+		r->hits[i] = (uint16_t)random_below(40);
+		r->timed_hits[i] = (uint16_t)random_below(r->hits[i] + 1u);
+		for (uint32_t h = 0; h < r->timed_hits[i]; h++){
+			uint32_t reaction_us = 20000 + random_below(200000);
+			r->reaction_sum_us[i] += reaction_us;
+			r->reaction_sum_sq_ms[i] += (reaction_us / 1000) * (reaction_us / 1000);
+			if (!r->best_reaction_us[i] || reaction_us < r->best_reaction_us[i]){
+				r->best_reaction_us[i] = reaction_us;
+			}
+		}
+	}
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	uint32_t trials = 2000, max_rounds = STATS_QUEUE;
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+		int bad = 0;
+		if (!strcmp(arg, "-n")) { trials = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-s")) { rng = strtoull(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-r")) { max_rounds = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else bad = 1;
+		if (bad){
+			fprintf(stderr, "usage: %s [-n trials] [-s seed] [-r rounds]\n", argv[0]);
+			return 2;
+		}
+	}
+#if STATS_LOG
+	if (rng == 0) rng = 1;
+	if (max_rounds == 0) max_rounds = 1;
+	if (max_rounds > STATS_QUEUE) max_rounds = STATS_QUEUE;
+
+	struct Stats_Totals model = {0}; //every round known to be written
+	struct Stats_Round pending[STATS_QUEUE];
+	uint32_t num_pending = 0, in_flight = 0; //in_flight: pending[0] may or may not have made it
+	uint32_t mismatches = 0, cuts = 0, written = 0, torn = 0, ecc_errors = 0, most_boot_words = 0;
+	sim_flash_erase_all();
+	for (uint32_t t = 0; t <= trials; t++){
+		sim_reset();
+		configure_system(); //reads the log back
+		if (stats_log.boot_words > most_boot_words) most_boot_words = stats_log.boot_words;
+		torn += stats_log.torn_rounds;
+		ecc_errors += stats_log.ecc_errors;
+		struct Stats_Totals with_flight = model;
+		if (in_flight){
+			STATS_ADD_ROUND(&with_flight, &pending[0]);
+		}
+		if (in_flight && !memcmp(&stats_log.totals, &with_flight, sizeof with_flight)){
+			model = with_flight;
+			written++;
+		}
+		else if (memcmp(&stats_log.totals, &model, sizeof model)){
+			if (mismatches++ < 10){
+				fprintf(stderr, "trial %u: read back %u rounds, expected %u%s\n", t, stats_log.totals.rounds,
+						model.rounds, in_flight ? " or one more" : "");
+			}
+			model = stats_log.totals; //carry on from what the firmware believes
+		}
+		if (t == trials){
+			break;
+		}
+
+		num_pending = 1 + random_below(max_rounds);
+		for (uint32_t i = 0; i < num_pending; i++){
+			random_round(&pending[i]);
+			STATS_APPEND(&pending[i]);
+		}
+		sim_advance((uint32_t)((uint64_t)random_below(CUT_WINDOW_US) * sim_core_clock_hz() / 1000000));
+
+		for (uint32_t i = 0; i < stats_log.appended; i++){
+			STATS_ADD_ROUND(&model, &pending[i]);
+		}
+		written += stats_log.appended;
+		num_pending -= stats_log.appended;
+		memmove(pending, &pending[stats_log.appended], num_pending * sizeof pending[0]);
+		in_flight = (stats_log.step == STATS_ROUND); //the writer was part way through pending[0]
+		cuts += sim_flash_power_cut();
+	}
+
+	printf("powerloss      %u trials, %u cut a program or erase short, %u mismatches\n", trials, cuts, mismatches);
+	printf("               %u rounds written, %u torn records skipped, %u ECC errors, at most %u double-words read at boot\n",
+			written, torn, ecc_errors, most_boot_words);
+	printf("               erases per page:");
+	for (uint32_t p = 0; p < STATS_PAGES; p++){
+		printf(" %u", sim_flash_page_erases(STATS_FLASH_BASE + p * STATS_PAGE_BYTES));
+	}
+	printf("\n");
+	return mismatches ? 1 : 0;
+#else
+	(void)trials;
+	(void)max_rounds;
+	fprintf(stderr, "%s needs a build with STATS_LOG 1\n", argv[0]);
+	return 2;
+#endif
+}
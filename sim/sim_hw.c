@@ -0,0 +1,1510 @@
+#include <string.h>
+#include <unistd.h>
+#include "sim_hw.h"
+/**
+**************************************************************************************************
+* @file sim_hw.c
+* @brief Source file for the host register-level simulator
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Emulates the GPIO, TIM2, TIM5, DMA1, SPI1, USART2, SysTick, EXTI, SYSCFG, RCC, PWR, FLASH,
+* NVIC, DWT and ITM blocks the game relies on. Time only moves when sim_advance() is called;
+* pending interrupts are taken by sim_dispatch_irqs() in NVIC priority order. Handlers run to
+* completion in zero simulated time.
+* A timer update serves the DMA requests TIM2 has enabled on the same cycle, highest channel
+* priority first: the update request and, for a compare register left at 0, the compare request.
+* SPI1 shifts one byte every 8 SPI clocks, back to back for as long as DMA1 channel 3 feeds it,
+* and hands each byte to sim_spi_hook with the cycle its first bit starts on.
+* USART2 sends and receives 10-bit frames at its BRR setting from HSI16 or PCLK, over a wire to
+* another simulator running the other board (sim_link_open()). Each side only runs ahead of the
+* other by the wire's delay, so neither can receive a byte in its past.
+* Flash bank 2 programs a double-word in 82 us and erases a page in 22 ms, ending each with EOP
+* and the FLASH interrupt, and keeps its contents over sim_reset(). A power cut part way through
+* (sim_flash_power_cut()) leaves double-words that read back with a double ECC error, which calls
+* NMI_Handler at the read.
+*
+*	Note: EXTI->PR1 and DMA1->IFCR are write-1-to-clear on the device. Plain host memory cannot
+*	      see the write, so the lines and flags owned by a vector are acknowledged once its
+*	      handler returns.
+*	Note: An emulated DMA channel moves CMAR along as it transfers instead of keeping a hidden
+*	      address. The firmware writes CMAR every time it enables a channel, so it cannot tell.
+*	Note: SPI1 has no TX FIFO here. DMA moves a byte as SPI1 starts shifting it, so the transfer
+*	      complete interrupt comes a byte before the last one is out rather than four.
+*	Note: USART2->ICR is write-1-to-clear as well, and the USART2 vector acknowledges ORE, NF and
+*	      FE the same way. So does the FLASH vector for EOP and the FLASH->SR errors, except
+*	      those raised again while it ran, and the simulator clears FLASH->ECCR ECCD once
+*	      NMI_Handler returns.
+*	Note: Bank 1, which holds the program, is not modelled; programming or erasing it fails.
+*	      FLASH->CR unlocks at the first store to it after KEYR was last written the second key.
+*	Note: sim_cycles counts at SIM_CLK_FREQ whatever the core runs at. SysTick, the timers and
+*	      SPI1 count core clock edges, which come hclk_cycles sim cycles apart. The clock only
+*	      changes when the firmware waits on RCC, PWR or FLASH (sim_clock_settle()); the
+*	      oscillators, the regulator and the switch all settle at once.
+**************************************************************************************************
+*/
+#define VECTOR(irqn) ((irqn) + 16) //CMSIS IRQ number -> vector table slot
+
+//register blocks
+GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC;
+TIM_TypeDef sim_TIM2, sim_TIM5;
+DMA_TypeDef sim_DMA1;
+DMA_Channel_TypeDef sim_DMA1_Channel[7];
+DMA_Request_TypeDef sim_DMA1_CSELR;
+SPI_TypeDef sim_SPI1;
+USART_TypeDef sim_USART2;
+SysTick_Type sim_SysTick;
+EXTI_TypeDef sim_EXTI;
+SYSCFG_TypeDef sim_SYSCFG;
+RCC_TypeDef sim_RCC;
+PWR_TypeDef sim_PWR;
+FLASH_TypeDef sim_FLASH;
+DWT_Type sim_DWT;
+CoreDebug_Type sim_CoreDebug;
+ITM_Type sim_ITM;
+
+volatile uint64_t sim_cycles;
+uint32_t sim_loop_cycles = SIM_DEFAULT_LOOP_CYCLES;
+struct sim_stats sim_stats;
+uint32_t sim_profile_cost[SIM_PROFILE_POINTS];
+uint32_t sim_itm_capture[SIM_ITM_CAPTURE];
+uint64_t sim_itm_words;
+void (*sim_timer_update_hook)(TIM_TypeDef *tim, uint64_t at_cycle);
+void (*sim_spi_hook)(uint8_t byte, uint64_t at_cycle);
+static uint64_t itm_free_at; //sim_cycles when the stimulus FIFO has room again
+static uint64_t spi_next_shift; //sim_cycles when SPI1 starts on its next byte, if DMA has one for it
+static uint32_t hclk_cycles; //sim cycles per core clock cycle
+static uint32_t hclk_phase; //sim cycles since the last core clock edge
+
+#define USART_ISR_RESET ((1 << 7) | (1 << 6)) //TXE, TC
+#define USART_ISR_ERRORS ((1 << 3) | (1 << 2) | (1 << 1)) //ORE, NF, FE
+static uint64_t usart_tx_end = UINT64_MAX; //sim_cycles when the byte in the shifter is out, UINT64_MAX with it empty
+static int32_t usart_tdr = -1; //byte waiting in TDR behind the shifter, -1 with TDR empty
+
+//the wire to the other board's simulator, see sim_link_open()
+struct sim_link_record {
+	uint64_t sent; //sender's sim_cycles: it sends nothing more that arrives before sent + delay,
+	               //UINT64_MAX once it has finished
+	uint64_t at; //receiver's sim_cycles at which the byte's stop bit is in, unused for a time record
+	int32_t byte; //-1 for a time record
+	uint32_t unused;
+};
+static int link_in = -1, link_out = -1;
+static uint64_t link_delay, link_jitter, link_rng;
+static uint64_t link_last_at; //arrival of the last byte sent, later bytes arrive after it
+static uint64_t link_horizon = UINT64_MAX; //sim_cycles the other board's bytes are known up to
+static struct { uint64_t at; uint8_t byte; } link_rx[SIM_LINK_BYTES]; //bytes on the wire to USART2, by arrival
+static uint32_t link_rx_head, link_rx_tail;
+
+//flash bank 2, see sim_flash_read_double()
+#define FLASH_BANK2_BASE 0x08080000
+#define FLASH_BANK2_BYTES 0x80000
+#define FLASH_PAGE_WORDS (2048 / 8)
+#define FLASH_PROGRAM_CYCLES (SIM_CLK_FREQ / 1000000 * 82) //double-word, 81.69 us typical (DS10198)
+#define FLASH_ERASE_CYCLES (SIM_CLK_FREQ / 1000 * 22) //page, 22.02 ms typical
+#define FLASH_KEY2 0xCDEF89AB //second word of the KEYR unlock sequence
+#define FLASH_CR_PG (1 << 0)
+#define FLASH_CR_PER (1 << 1)
+#define FLASH_CR_BKER (1 << 11)
+#define FLASH_CR_STRT (1 << 16)
+#define FLASH_CR_EOPIE (1 << 24)
+#define FLASH_CR_ERRIE (1 << 25)
+#define FLASH_CR_LOCK (1u << 31)
+#define FLASH_CR_RESET 0xC0000000 //LOCK, OPTLOCK
+#define FLASH_SR_EOP (1 << 0)
+#define FLASH_SR_OPERR (1 << 1)
+#define FLASH_SR_PROGERR (1 << 3)
+#define FLASH_SR_WRPERR (1 << 4)
+#define FLASH_SR_PGAERR (1 << 5)
+#define FLASH_SR_PGSERR (1 << 7)
+#define FLASH_SR_BSY (1 << 16)
+#define FLASH_SR_ERRORS 0xC3FA
+#define FLASH_ECCR_ECCD (1u << 31)
+static uint64_t flash_bank2[FLASH_BANK2_BYTES / 8]; //inverted, so it starts out erased
+static uint8_t flash_torn[FLASH_BANK2_BYTES / 8]; //1 where a cut program or erase left the ECC wrong
+static uint32_t flash_page_erases[FLASH_BANK2_BYTES / 8 / FLASH_PAGE_WORDS]; //erases started, kept like the contents
+static uint64_t flash_op_start, flash_op_end = UINT64_MAX; //program or erase in progress, UINT64_MAX with none
+static uint32_t flash_op_word, flash_op_words; //first double-word and count: 1 for a program, a page for an erase
+static uint64_t flash_op_value; //double-word being programmed
+static uint64_t flash_rng = 1; //what a power cut leaves behind
+static uint32_t flash_raised; //FLASH->SR flags set since the FLASH handler was entered, which it cannot have cleared
+
+//button level changes waiting for their time, see sim_schedule_button()
+struct sim_pin_change {
+	uint64_t at; //sim_cycles value at which the level changes
+	enum sim_buttons button;
+	uint32_t pressed;
+};
+static struct sim_pin_change pin_changes[SIM_PIN_CHANGES];
+static uint32_t num_pin_changes;
+static uint64_t next_pin_change = UINT64_MAX; //earliest 'at' in pin_changes
+
+//firmware handlers, weak so the vector stays empty if the firmware does not define one
+void SysTick_Handler(void) __attribute__((weak));
+void EXTI1_IRQHandler(void) __attribute__((weak));
+void EXTI4_IRQHandler(void) __attribute__((weak));
+void EXTI15_10_IRQHandler(void) __attribute__((weak));
+void TIM2_IRQHandler(void) __attribute__((weak));
+void DMA1_Channel2_IRQHandler(void) __attribute__((weak));
+void DMA1_Channel3_IRQHandler(void) __attribute__((weak));
+void USART2_IRQHandler(void) __attribute__((weak));
+void FLASH_IRQHandler(void) __attribute__((weak));
+void NMI_Handler(void) __attribute__((weak));
+
+struct sim_vector {
+	void (*handler)(void); //firmware ISR
+	uint32_t exti_lines; //EXTI lines acknowledged when the handler returns
+	uint32_t dma1_flags; //DMA1->ISR flags acknowledged when the handler returns
+	uint32_t usart_flags; //USART2->ISR flags acknowledged when the handler returns
+	uint32_t flash_flags; //FLASH->SR flags acknowledged when the handler returns
+};
+
+static struct sim_vector vectors[SIM_NUM_IRQS + 16];
+static uint8_t nvic_priority[SIM_NUM_IRQS + 16];
+static uint8_t nvic_enabled[SIM_NUM_IRQS + 16];
+static uint8_t nvic_pending[SIM_NUM_IRQS + 16];
+static uint32_t pending_count; //number of set entries in nvic_pending
+static uint32_t primask; //1 while the firmware has interrupts masked (__disable_irq)
+static uint32_t active_priority = 0x100; //priority of the running handler, 0x100 in thread mode
+
+//A timer's DMA request and the DMA1 channel it is wired to (RM0351 DMA1 request mapping)
+struct sim_dma_request{
+	uint32_t dier; //TIMx->DIER bit that enables the request
+	uint32_t channel; //DMA1 channel, 1 to 7
+	uint32_t select; //DMA1_CSELR value that routes it to the channel
+	volatile uint32_t *compare; //CCRx for a compare request, made on each wrap when it is 0; NULL for the update request
+};
+#define TIM_DMA_REQUEST_BITS (0x1F << 8) //UDE, CC1DE-CC4DE
+#define SPI1_TX_CHANNEL 3 //DMA1 channel SPI1_TX is wired to...
+#define SPI1_TX_SELECT 1 //...with this DMA1_CSELR value
+
+static const struct sim_dma_request tim2_requests[] = {
+	{ (1 << 8), 2, 4, NULL },            //TIM2_UP
+	{ (1 << 9), 5, 4, &sim_TIM2.CCR1 },  //TIM2_CH1
+	{ (1 << 10), 7, 4, &sim_TIM2.CCR2 }, //TIM2_CH2
+	{ (1 << 11), 1, 4, &sim_TIM2.CCR3 }, //TIM2_CH3
+	{ (1 << 12), 7, 4, &sim_TIM2.CCR4 }, //TIM2_CH4
+};
+
+//general purpose timers, all up-counting with the same register layout
+struct sim_timer{
+	TIM_TypeDef *tim;
+	IRQn_Type irq; //update interrupt
+	uint32_t prescale; //core clock edges accumulated towards the next count
+	const struct sim_dma_request *requests; //DMA requests the timer can make
+	uint32_t num_requests;
+};
+static struct sim_timer timers[] = {
+	{ &sim_TIM2, TIM2_IRQn, 0, tim2_requests, sizeof tim2_requests / sizeof tim2_requests[0] },
+	{ &sim_TIM5, TIM5_IRQn, 0, NULL, 0 },
+};
+#define SIM_NUM_TIMERS (sizeof timers / sizeof timers[0])
+
+struct sim_button_wiring {
+	GPIO_TypeDef *port;
+	uint32_t pin;
+	uint32_t port_index; //value written to SYSCFG->EXTICR for this port
+};
+
+static const struct sim_button_wiring buttons[SIM_NUM_BUTTONS] = {
+		{&sim_GPIOA, 4, 0}, //left button  PA4
+		{&sim_GPIOA, 1, 0}, //right button PA1
+		{&sim_GPIOC, 13, 2} //board button PC13
+};
+
+//================================================================================================
+// set_pending()
+// @parm: slot = vector table slot
+// @return: none
+// 		Latches an interrupt request, exactly like NVIC->ISPR
+//================================================================================================
+static void set_pending(uint32_t slot)
+{
+	if (!nvic_pending[slot]){
+		nvic_pending[slot] = 1;
+		pending_count++;
+	}
+}
+//================================================================================================
+// exti_vector()
+// @parm: line = EXTI line number (0-15)
+// @return: IRQ that services the line
+//================================================================================================
+static IRQn_Type exti_vector(uint32_t line)
+{
+	if (line <= 4) return (IRQn_Type)(EXTI0_IRQn + line);
+	if (line <= 9) return EXTI9_5_IRQn;
+	return EXTI15_10_IRQn;
+}
+//================================================================================================
+// drive_button()
+// @parm: b = button to drive
+//        pressed = 1 to press (pull the pin low), 0 to release
+// @return: none
+// 		Drives the pin and makes the EXTI interrupt pending if its edge detector and mask are
+// 		configured. The caller takes the interrupt.
+//================================================================================================
+static void drive_button(enum sim_buttons b, uint32_t pressed)
+{
+	const struct sim_button_wiring *w = &buttons[b];
+	uint32_t bit = 0x1 << w->pin;
+	uint32_t was_high = w->port->IDR & bit;
+	if (pressed){
+		w->port->IDR &= ~bit;
+	}
+	else{
+		w->port->IDR |= bit;
+	}
+	uint32_t falling = was_high && pressed;
+	uint32_t rising = !was_high && !pressed;
+	uint32_t source = (sim_SYSCFG.EXTICR[w->pin / 4] >> (4 * (w->pin % 4))) & 0xF;
+	if (source != w->port_index || !(sim_EXTI.IMR1 & bit)){ //line not routed to this pin
+		return;
+	}
+	if ((falling && (sim_EXTI.FTSR1 & bit)) || (rising && (sim_EXTI.RTSR1 & bit))){
+		sim_EXTI.PR1 |= bit;
+		set_pending(VECTOR(exti_vector(w->pin)));
+	}
+}
+//================================================================================================
+// sim_reset()
+// @parm: none
+// @return: none
+// 		Puts every emulated peripheral in its reset state. Buttons are released (pins read high).
+//================================================================================================
+void sim_reset(void)
+{
+	memset(&sim_GPIOA, 0, sizeof sim_GPIOA);
+	memset(&sim_GPIOB, 0, sizeof sim_GPIOB);
+	memset(&sim_GPIOC, 0, sizeof sim_GPIOC);
+	memset(&sim_TIM2, 0, sizeof sim_TIM2);
+	memset(&sim_TIM5, 0, sizeof sim_TIM5);
+	memset(&sim_DMA1, 0, sizeof sim_DMA1);
+	memset(sim_DMA1_Channel, 0, sizeof sim_DMA1_Channel);
+	memset(&sim_DMA1_CSELR, 0, sizeof sim_DMA1_CSELR);
+	memset(&sim_SPI1, 0, sizeof sim_SPI1);
+	memset(&sim_USART2, 0, sizeof sim_USART2);
+	sim_USART2.ISR = USART_ISR_RESET;
+	usart_tx_end = UINT64_MAX;
+	usart_tdr = -1;
+	memset(&sim_SysTick, 0, sizeof sim_SysTick);
+	memset(&sim_EXTI, 0, sizeof sim_EXTI);
+	memset(&sim_SYSCFG, 0, sizeof sim_SYSCFG);
+	memset(&sim_RCC, 0, sizeof sim_RCC);
+	sim_RCC.CR = 0x63; //MSI on and ready at range 6 (4 MHz)
+	memset(&sim_PWR, 0, sizeof sim_PWR);
+	sim_PWR.CR1 = (1 << 9); //voltage range 1
+	memset(&sim_FLASH, 0, sizeof sim_FLASH);
+	sim_FLASH.ACR = 0x600; //caches on, no wait states
+	sim_FLASH.CR = FLASH_CR_RESET;
+	flash_op_end = UINT64_MAX; //the contents stay, see sim_flash_power_cut()
+	hclk_cycles = SIM_CLK_FREQ / 4000000;
+	hclk_phase = 0;
+	memset(&sim_DWT, 0, sizeof sim_DWT);
+	memset(&sim_CoreDebug, 0, sizeof sim_CoreDebug);
+	memset(&sim_ITM, 0, sizeof sim_ITM); //no debugger: ITM off until sim_itm_attach()
+	sim_itm_words = 0;
+	itm_free_at = 0;
+	spi_next_shift = 0;
+	num_pin_changes = 0;
+	next_pin_change = UINT64_MAX;
+	memset(nvic_priority, 0, sizeof nvic_priority);
+	memset(nvic_enabled, 0, sizeof nvic_enabled);
+	memset(nvic_pending, 0, sizeof nvic_pending);
+	memset(&sim_stats, 0, sizeof sim_stats);
+	pending_count = 0;
+	primask = 0;
+	active_priority = 0x100;
+	sim_cycles = 0;
+	for (uint32_t t = 0; t < SIM_NUM_TIMERS; t++){
+		timers[t].prescale = 0;
+	}
+	sim_TIM2.ARR = 0xFFFFFFFF; //TIM2 and TIM5 are 32 bit, ARR resets to all ones
+	sim_TIM5.ARR = 0xFFFFFFFF;
+
+	memset(vectors, 0, sizeof vectors);
+	vectors[VECTOR(SysTick_IRQn)].handler = SysTick_Handler;
+	vectors[VECTOR(EXTI1_IRQn)] = (struct sim_vector){ EXTI1_IRQHandler, 0x1 << 1, 0, 0, 0 };
+	vectors[VECTOR(EXTI4_IRQn)] = (struct sim_vector){ EXTI4_IRQHandler, 0x1 << 4, 0, 0, 0 };
+	vectors[VECTOR(EXTI15_10_IRQn)] = (struct sim_vector){ EXTI15_10_IRQHandler, 0xFC00, 0, 0, 0 };
+	vectors[VECTOR(TIM2_IRQn)].handler = TIM2_IRQHandler;
+	vectors[VECTOR(DMA1_Channel2_IRQn)] = (struct sim_vector){ DMA1_Channel2_IRQHandler, 0, 0xF << 4, 0, 0 };
+	vectors[VECTOR(DMA1_Channel3_IRQn)] = (struct sim_vector){ DMA1_Channel3_IRQHandler, 0, 0xF << 8, 0, 0 };
+	vectors[VECTOR(USART2_IRQn)] = (struct sim_vector){ USART2_IRQHandler, 0, 0, USART_ISR_ERRORS, 0 };
+	vectors[VECTOR(FLASH_IRQn)] = (struct sim_vector){ FLASH_IRQHandler, 0, 0, 0, FLASH_SR_EOP | FLASH_SR_ERRORS };
+
+	for (uint32_t b = 0; b < SIM_NUM_BUTTONS; b++){
+		buttons[b].port->IDR |= (0x1 << buttons[b].pin); //released buttons are pulled high
+	}
+}
+//================================================================================================
+// NVIC_xxx()
+// 		CMSIS NVIC functions. SysTick (negative IRQn) shares the same tables, offset by 16.
+//================================================================================================
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority)
+{
+	nvic_priority[VECTOR(IRQn)] = (uint8_t)priority;
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	nvic_enabled[VECTOR(IRQn)] = 1;
+}
+
+void NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	nvic_enabled[VECTOR(IRQn)] = 0;
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type IRQn)
+{
+	set_pending(VECTOR(IRQn));
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn)
+{
+	if (nvic_pending[VECTOR(IRQn)]){
+		nvic_pending[VECTOR(IRQn)] = 0;
+		pending_count--;
+	}
+}
+//================================================================================================
+// advance_systick()
+// @parm: cycles = core clock edges to advance
+// @return: none
+// 		SysTick counts VAL down on the core clock and reloads from LOAD when it reaches zero
+//================================================================================================
+static void advance_systick(uint32_t cycles)
+{
+	if (!(sim_SysTick.CTRL & SysTick_CTRL_ENABLE_Msk)){
+		return;
+	}
+	uint32_t remaining = sim_SysTick.VAL ? sim_SysTick.VAL : sim_SysTick.LOAD + 1;
+	while (cycles >= remaining){
+		cycles -= remaining;
+		remaining = sim_SysTick.LOAD + 1;
+		sim_SysTick.CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+		if (sim_SysTick.CTRL & SysTick_CTRL_TICKINT_Msk){
+			set_pending(VECTOR(SysTick_IRQn));
+		}
+	}
+	sim_SysTick.VAL = remaining - cycles;
+}
+//================================================================================================
+// spi_byte_cycles()
+// @parm: none
+// @return: sim cycles SPI1 takes to shift one byte at its CR1 BR setting
+//================================================================================================
+static uint32_t spi_byte_cycles(void)
+{
+	return (8u << (((sim_SPI1.CR1 >> 3) & 0x7) + 1)) * hclk_cycles;
+}
+//================================================================================================
+// spi_shift()
+// @parm: byte = byte written to SPI1->DR
+// @return: none
+// 		Shifts the byte out straight after the one before it
+//================================================================================================
+static void spi_shift(uint8_t byte)
+{
+	if (sim_spi_hook){
+		sim_spi_hook(byte, spi_next_shift);
+	}
+	spi_next_shift += spi_byte_cycles();
+	sim_stats.spi_bytes++;
+}
+//================================================================================================
+// dma_load() / dma_store()
+// @parm: address = CMAR or CPAR of the channel, size = access size in bytes (1, 2 or 4)
+//        value = value to store
+// 		A store to a GPIO BSRR acts on ODR and one to SPI1->DR is shifted out, like CPU stores
+// 		would; anything else is plain memory
+//================================================================================================
+static uint32_t dma_load(uintptr_t address, uint32_t size)
+{
+	if (size == 1) return *(volatile uint8_t *)address;
+	if (size == 2) return *(volatile uint16_t *)address;
+	return *(volatile uint32_t *)address;
+}
+
+static void dma_store(uintptr_t address, uint32_t value, uint32_t size)
+{
+	GPIO_TypeDef *ports[] = { &sim_GPIOA, &sim_GPIOB, &sim_GPIOC };
+	for (uint32_t i = 0; i < 3; i++){
+		if (address == (uintptr_t)&ports[i]->BSRR){
+			sim_gpio_bsrr_write(ports[i], value);
+			return;
+		}
+	}
+	if (address == (uintptr_t)&sim_SPI1.DR){
+		spi_shift((uint8_t)value);
+		return;
+	}
+	if (size == 1) *(volatile uint8_t *)address = (uint8_t)value;
+	else if (size == 2) *(volatile uint16_t *)address = (uint16_t)value;
+	else *(volatile uint32_t *)address = value;
+}
+//================================================================================================
+// dma_transfer()
+// @parm: channel = DMA1 channel, 1 to 7
+// @return: none
+// 		One memory to peripheral item, of the sizes MSIZE and PSIZE give. The last one of the
+// 		block raises TCIF, and the channel's interrupt with TCIE.
+//================================================================================================
+static void dma_transfer(uint32_t channel)
+{
+	DMA_Channel_TypeDef *ch = &sim_DMA1_Channel[channel - 1];
+	if (!(ch->CCR & (1 << 0)) || ch->CNDTR == 0){ //disabled or done
+		return;
+	}
+	uint32_t msize = 1u << ((ch->CCR >> 10) & 0x3);
+	uint32_t psize = 1u << ((ch->CCR >> 8) & 0x3);
+	dma_store(ch->CPAR, dma_load(ch->CMAR, msize), psize);
+	if (ch->CCR & (1 << 7)) ch->CMAR += msize; //MINC, see note at top of file
+	if (ch->CCR & (1 << 6)) ch->CPAR += psize; //PINC
+	ch->CNDTR--;
+	sim_stats.dma_transfers++;
+	if (ch->CNDTR == 0){
+		uint32_t shift = 4 * (channel - 1);
+		sim_DMA1.ISR |= (0x3 << shift); //GIF and TCIF
+		if (ch->CCR & (1 << 1)){ //TCIE
+			set_pending(VECTOR(DMA1_Channel1_IRQn + (channel - 1)));
+		}
+	}
+}
+//================================================================================================
+// timer_dma_requests()
+// @parm: t = timer that just updated
+// @return: none
+// 		Serves every DMA request the update makes, highest channel priority (CCR PL) first and the
+// 		lowest channel number first within a priority, like the DMA arbiter
+//================================================================================================
+static void timer_dma_requests(struct sim_timer *t)
+{
+	uint32_t requested = 0; //bit n = channel n
+	for (uint32_t r = 0; r < t->num_requests; r++){
+		const struct sim_dma_request *req = &t->requests[r];
+		uint32_t selected = ((sim_DMA1_CSELR.CSELR >> (4 * (req->channel - 1))) & 0xF) == req->select;
+		if ((t->tim->DIER & req->dier) && selected && (!req->compare || *req->compare == 0)){
+			requested |= (1 << req->channel);
+		}
+	}
+	for (int32_t priority = 3; priority >= 0 && requested; priority--){
+		for (uint32_t channel = 1; channel <= 7; channel++){
+			if ((requested & (1 << channel)) && ((sim_DMA1_Channel[channel - 1].CCR >> 12) & 0x3) == (uint32_t)priority){
+				requested &= ~(1 << channel);
+				dma_transfer(channel);
+			}
+		}
+	}
+}
+//================================================================================================
+// advance_timer()
+// @parm: t = timer to advance
+//        cycles = core clock edges to advance
+// @return: none
+// 		Up-counting TIMx: CNT runs at core/(PSC+1) and raises UIF when it passes ARR. Each update
+// 		serves its DMA requests, which may write ARR before the next period is counted.
+//================================================================================================
+static void advance_timer(struct sim_timer *t, uint32_t cycles)
+{
+	TIM_TypeDef *tim = t->tim;
+	if (!(tim->CR1 & (1 << 0))){ //counter disabled
+		return;
+	}
+	uint32_t divider = tim->PSC + 1;
+	t->prescale += cycles;
+	if (t->prescale < divider){ //fast path, no counter tick yet
+		return;
+	}
+	uint64_t count = tim->CNT + (uint64_t)(t->prescale / divider);
+	t->prescale %= divider;
+	if (count > tim->ARR && !(tim->DIER & TIM_DMA_REQUEST_BITS)){ //update event, without DMA
+		count %= (uint64_t)tim->ARR + 1;
+		tim->SR |= (1 << 0);
+		if (tim->DIER & (1 << 0)){
+			set_pending(VECTOR(t->irq));
+		}
+	}
+	while (count > tim->ARR){ //update events one at a time, DMA may change ARR
+		count -= (uint64_t)tim->ARR + 1;
+		tim->SR |= (1 << 0);
+		if (tim->DIER & (1 << 0)){
+			set_pending(VECTOR(t->irq));
+		}
+		tim->CNT = 0;
+		timer_dma_requests(t);
+		if (sim_timer_update_hook){
+			sim_timer_update_hook(tim, sim_cycles - hclk_phase - (count * divider + t->prescale) * hclk_cycles); //the cycle it happened on
+		}
+	}
+	tim->CNT = (uint32_t)count;
+}
+//================================================================================================
+// spi_fed()
+// @parm: none
+// @return: 1 if SPI1 is on and DMA1 channel 3 has bytes for it
+//================================================================================================
+static uint32_t spi_fed(void)
+{
+	const DMA_Channel_TypeDef *ch = &sim_DMA1_Channel[SPI1_TX_CHANNEL - 1];
+	uint32_t selected = ((sim_DMA1_CSELR.CSELR >> (4 * (SPI1_TX_CHANNEL - 1))) & 0xF) == SPI1_TX_SELECT;
+	return (sim_SPI1.CR1 & (1 << 6)) && (sim_SPI1.CR2 & (1 << 1)) && selected && (ch->CCR & (1 << 0)) && ch->CNDTR;
+}
+//================================================================================================
+// advance_spi()
+// @parm: from = sim_cycles before the advance
+// @return: none
+// 		Takes from DMA every byte SPI1 has started on by now. With nothing to send the line
+// 		idles, and the next byte starts when DMA has one.
+//================================================================================================
+static void advance_spi(uint64_t from)
+{
+	if (!spi_fed()){
+		return;
+	}
+	if (spi_next_shift < from){ //idle until now
+		spi_next_shift = from;
+	}
+	while (spi_next_shift <= sim_cycles && spi_fed()){
+		dma_transfer(SPI1_TX_CHANNEL);
+	}
+}
+//================================================================================================
+// usart_byte_cycles()
+// @parm: none
+// @return: sim cycles USART2 takes to send or receive one byte: start, 8 data and stop bits of
+//          BRR kernel clocks each (16 times oversampling), the kernel clock HSI16 if CCIPR
+//          selects it and it is running, else PCLK1, which runs at the core clock here
+//================================================================================================
+static uint64_t usart_byte_cycles(void)
+{
+	uint64_t kernel = (((sim_RCC.CCIPR >> 2) & 0x3) == 2 && (sim_RCC.CR & (1 << 10))) ? SIM_CLK_FREQ / 16000000 : hclk_cycles;
+	return 10 * (uint64_t)(sim_USART2.BRR ? sim_USART2.BRR : 1) * kernel;
+}
+//================================================================================================
+// link_write()
+// @parm: at = arrival for a byte, unused for a time record
+//        byte = byte, -1 for a time record
+// @return: none
+//================================================================================================
+static void link_write(uint64_t at, int32_t byte)
+{
+	struct sim_link_record r = { sim_cycles, at, byte, 0 };
+	if (link_out >= 0 && write(link_out, &r, sizeof r) != (ssize_t)sizeof r){
+		close(link_out); //the other side has gone, nothing more to tell it
+		link_out = -1;
+	}
+}
+//================================================================================================
+// link_wait()
+// @parm: none
+// @return: none
+// 		Called when time has caught up with what is known of the other board. Tells it this
+// 		side's time, so it can go on too, and reads its records until its bytes are known past
+// 		now, or it has finished.
+//================================================================================================
+static void link_wait(void)
+{
+	static uint8_t buffer[256 * sizeof(struct sim_link_record)]; //records read, whole ones first
+	static size_t buffered;
+	link_write(0, -1);
+	sim_stats.link_waits++;
+	while (link_horizon <= sim_cycles){
+		ssize_t n = read(link_in, buffer + buffered, sizeof buffer - buffered); //all that has come, at least a byte
+		if (n <= 0){ //the other side has gone without saying so
+			link_horizon = UINT64_MAX;
+			return;
+		}
+		buffered += (size_t)n;
+		size_t used = 0;
+		for (; buffered - used >= sizeof(struct sim_link_record); used += sizeof(struct sim_link_record)){
+			struct sim_link_record r;
+			memcpy(&r, buffer + used, sizeof r);
+			if (r.byte >= 0 && link_rx_head - link_rx_tail < SIM_LINK_BYTES){
+				link_rx[link_rx_head % SIM_LINK_BYTES].at = r.at;
+				link_rx[link_rx_head % SIM_LINK_BYTES].byte = (uint8_t)r.byte;
+				link_rx_head++;
+			}
+			if (r.sent == UINT64_MAX){
+				link_horizon = UINT64_MAX;
+			}
+			else if (r.sent + link_delay > link_horizon){
+				link_horizon = r.sent + link_delay;
+			}
+		}
+		memmove(buffer, buffer + used, buffered - used);
+		buffered -= used;
+	}
+}
+//================================================================================================
+// usart_start()
+// @parm: byte = byte moved into the shifter
+//        at = sim_cycles its start bit begins on
+// @return: none
+// 		Puts the byte on the wire, arriving a byte time, the wire's delay and up to its jitter
+// 		later, never before the byte sent ahead of it
+//================================================================================================
+static void usart_start(uint8_t byte, uint64_t at)
+{
+	uint64_t cycles = usart_byte_cycles();
+	usart_tx_end = at + cycles;
+	sim_stats.usart_bytes++;
+	if (link_out < 0){
+		return;
+	}
+	uint64_t jitter = 0;
+	if (link_jitter){
+		link_rng ^= link_rng >> 12;
+		link_rng ^= link_rng << 25;
+		link_rng ^= link_rng >> 27;
+		jitter = ((link_rng * 0x2545F4914F6CDD1DULL) >> 32) % (link_jitter + 1);
+	}
+	uint64_t arrive = at + cycles + link_delay + jitter;
+	if (arrive < link_last_at + cycles){
+		arrive = link_last_at + cycles;
+	}
+	link_last_at = arrive;
+	link_write(arrive, byte);
+}
+//================================================================================================
+// usart_irq()
+// @parm: none
+// @return: 1 if USART2 requests its interrupt: RXNE or ORE with RXNEIE, TXE with TXEIE
+//================================================================================================
+static uint32_t usart_irq(void)
+{
+	uint32_t cr1 = sim_USART2.CR1;
+	uint32_t isr = sim_USART2.ISR;
+	return ((cr1 & (1 << 5)) && (isr & ((1 << 5) | (1 << 3)))) || ((cr1 & (1 << 7)) && (isr & (1 << 7)));
+}
+//================================================================================================
+// advance_usart()
+// @parm: none
+// @return: none
+// 		Finishes the bytes whose stop bit is out by now, moving TDR into the shifter behind each,
+// 		and receives the bytes that have arrived. USART2's interrupt is level triggered, so it
+// 		is made pending for as long as a flag enabled for it is set.
+//================================================================================================
+static void advance_usart(void)
+{
+	while (usart_tx_end <= sim_cycles){
+		uint64_t end = usart_tx_end;
+		usart_tx_end = UINT64_MAX;
+		if (usart_tdr >= 0){
+			uint8_t byte = (uint8_t)usart_tdr;
+			usart_tdr = -1;
+			usart_start(byte, end);
+		}
+	}
+	while (link_rx_tail != link_rx_head && link_rx[link_rx_tail % SIM_LINK_BYTES].at <= sim_cycles){
+		if ((sim_USART2.CR1 & 0x5) == 0x5){ //UE and RE
+			if (sim_USART2.ISR & (1 << 5)){ //RXNE: the byte before is still in RDR
+				sim_USART2.ISR |= (1 << 3); //ORE, the new byte is lost
+			}
+			else{
+				sim_USART2.RDR = link_rx[link_rx_tail % SIM_LINK_BYTES].byte;
+				sim_USART2.ISR |= (1 << 5);
+			}
+		}
+		link_rx_tail++;
+	}
+	sim_USART2.ISR = (sim_USART2.ISR & ~USART_ISR_RESET) | ((usart_tdr < 0) ? (1 << 7) : 0)
+			| ((usart_tdr < 0 && usart_tx_end == UINT64_MAX) ? (1 << 6) : 0);
+	if (usart_irq() && nvic_enabled[VECTOR(USART2_IRQn)]){
+		set_pending(VECTOR(USART2_IRQn));
+	}
+}
+//================================================================================================
+// usart_next_event()
+// @parm: none
+// @return: sim_cycles of USART2's next byte out or in, UINT64_MAX if none
+//================================================================================================
+static uint64_t usart_next_event(void)
+{
+	uint64_t next = usart_tx_end;
+	if (link_rx_tail != link_rx_head && link_rx[link_rx_tail % SIM_LINK_BYTES].at < next){
+		next = link_rx[link_rx_tail % SIM_LINK_BYTES].at;
+	}
+	return next;
+}
+//================================================================================================
+// flash_irq()
+// @parm: none
+// @return: 1 if the flash requests its interrupt: EOP with EOPIE, OPERR with ERRIE
+//================================================================================================
+static uint32_t flash_irq(void)
+{
+	return ((sim_FLASH.CR & FLASH_CR_EOPIE) && (sim_FLASH.SR & FLASH_SR_EOP))
+			|| ((sim_FLASH.CR & FLASH_CR_ERRIE) && (sim_FLASH.SR & FLASH_SR_OPERR));
+}
+//================================================================================================
+// flash_error()
+// @parm: flags = FLASH->SR error flags of an operation that did not start
+// @return: none
+//================================================================================================
+static void flash_error(uint32_t flags)
+{
+	flags |= (sim_FLASH.CR & FLASH_CR_ERRIE) ? FLASH_SR_OPERR : 0;
+	sim_FLASH.SR |= flags;
+	flash_raised |= flags;
+	if (flash_irq() && nvic_enabled[VECTOR(FLASH_IRQn)]){
+		set_pending(VECTOR(FLASH_IRQn));
+	}
+}
+//================================================================================================
+// advance_flash()
+// @parm: none
+// @return: none
+// 		Finishes the program or erase in progress once its time is up. The FLASH interrupt is
+// 		level triggered, like USART2's.
+//================================================================================================
+static void advance_flash(void)
+{
+	if (flash_op_end <= sim_cycles){
+		flash_op_end = UINT64_MAX;
+		if (flash_op_words == 1){
+			flash_bank2[flash_op_word] = ~flash_op_value;
+		}
+		else{
+			memset(&flash_bank2[flash_op_word], 0, flash_op_words * sizeof flash_bank2[0]);
+			memset(&flash_torn[flash_op_word], 0, flash_op_words);
+		}
+		uint32_t eop = (sim_FLASH.CR & FLASH_CR_EOPIE) ? FLASH_SR_EOP : 0;
+		sim_FLASH.SR = (sim_FLASH.SR & ~FLASH_SR_BSY) | eop;
+		flash_raised |= eop;
+	}
+	if (flash_irq() && nvic_enabled[VECTOR(FLASH_IRQn)]){
+		set_pending(VECTOR(FLASH_IRQn));
+	}
+}
+//================================================================================================
+// edges_to_cycles()
+// @parm: edges = core clock edges from now, at least 1
+// @return: sim cycles until the last of them
+//================================================================================================
+static uint64_t edges_to_cycles(uint64_t edges)
+{
+	return edges * hclk_cycles - hclk_phase;
+}
+//================================================================================================
+// cycles_to_next_irq()
+// @parm: none
+// @return: sim cycles until SysTick or a timer next requests an interrupt
+//================================================================================================
+static uint32_t cycles_to_next_irq(void)
+{
+	uint64_t next = SIM_CLK_FREQ / 1000; //nothing running: wake up after a millisecond anyway
+	if (next_pin_change < sim_cycles + next){ //a button edge may wake the core first
+		next = next_pin_change - sim_cycles;
+	}
+	if ((sim_SysTick.CTRL & SysTick_CTRL_ENABLE_Msk) && (sim_SysTick.CTRL & SysTick_CTRL_TICKINT_Msk)){
+		uint64_t systick = edges_to_cycles(sim_SysTick.VAL ? sim_SysTick.VAL : sim_SysTick.LOAD + 1);
+		if (systick < next) next = systick;
+	}
+	for (uint32_t t = 0; t < SIM_NUM_TIMERS; t++){
+		TIM_TypeDef *tim = timers[t].tim;
+		if ((tim->CR1 & (1 << 0)) && (tim->DIER & ((1 << 0) | TIM_DMA_REQUEST_BITS))){ //an update wakes the core or moves data
+			uint64_t counts = (uint64_t)tim->ARR - tim->CNT + 1;
+			uint64_t cycles = edges_to_cycles(counts * (tim->PSC + 1) - timers[t].prescale);
+			if (cycles < next) next = cycles;
+		}
+	}
+	if (usart_irq()){ //the firmware has just enabled an interrupt whose flag is already set
+		next = 1;
+	}
+	uint64_t usart = usart_next_event();
+	if (usart != UINT64_MAX && usart - sim_cycles < next){
+		next = usart - sim_cycles;
+	}
+	if (flash_irq()){
+		next = 1;
+	}
+	if (flash_op_end != UINT64_MAX && (sim_FLASH.CR & FLASH_CR_EOPIE) && flash_op_end - sim_cycles < next){
+		next = flash_op_end - sim_cycles;
+	}
+	if (spi_fed() && (sim_DMA1_Channel[SPI1_TX_CHANNEL - 1].CCR & (1 << 1))){ //transfer complete interrupt
+		uint64_t start = (spi_next_shift > sim_cycles) ? spi_next_shift : sim_cycles;
+		uint64_t cycles = start + (uint64_t)(sim_DMA1_Channel[SPI1_TX_CHANNEL - 1].CNDTR - 1) * spi_byte_cycles() - sim_cycles;
+		if (cycles < next) next = cycles;
+	}
+	return next ? (uint32_t)next : 1;
+}
+//================================================================================================
+// advance_clocks()
+// @parm: cycles = sim cycles to advance
+// @return: none
+// 		Moves every core clocked block on by the core clock edges that fall in the time
+//================================================================================================
+static void advance_clocks(uint32_t cycles)
+{
+	sim_cycles += cycles;
+	uint64_t elapsed = (uint64_t)hclk_phase + cycles;
+	uint32_t edges = (uint32_t)(elapsed / hclk_cycles);
+	hclk_phase = (uint32_t)(elapsed % hclk_cycles);
+	advance_systick(edges);
+	for (uint32_t t = 0; t < SIM_NUM_TIMERS; t++){
+		advance_timer(&timers[t], edges);
+	}
+	advance_spi(sim_cycles - cycles);
+	advance_usart();
+	advance_flash();
+}
+//================================================================================================
+// apply_pin_changes()
+// @parm: none
+// @return: none
+// 		Drives every scheduled button change that is due. Their interrupts are only made pending
+// 		here; the caller takes them.
+//================================================================================================
+static void apply_pin_changes(void)
+{
+	while (next_pin_change <= sim_cycles){
+		uint64_t next = UINT64_MAX;
+		for (uint32_t i = 0; i < num_pin_changes; ){
+			if (pin_changes[i].at <= sim_cycles){
+				drive_button(pin_changes[i].button, pin_changes[i].pressed);
+				pin_changes[i] = pin_changes[--num_pin_changes];
+				continue;
+			}
+			if (pin_changes[i].at < next) next = pin_changes[i].at;
+			i++;
+		}
+		next_pin_change = next;
+	}
+}
+//================================================================================================
+// advance_time()
+// @parm: cycles = sim cycles to advance
+// @return: none
+// 		Stops at each scheduled button change and each USART2 byte on the way, so an edge or a
+// 		byte lands on its own cycle and its handler runs there (unless PRIMASK or a higher
+// 		priority handler holds it off). Linked to another board, never runs past the time its
+// 		bytes are known up to, waiting for it there.
+//================================================================================================
+static void advance_time(uint32_t cycles)
+{
+	for (;;){
+		if (link_horizon <= sim_cycles){
+			link_wait();
+		}
+		uint64_t stop = usart_next_event();
+		if (next_pin_change < stop) stop = next_pin_change;
+		if (sim_cycles + cycles < stop && sim_cycles + cycles <= link_horizon){
+			break;
+		}
+		if (link_horizon < stop){ //only as far as the other board is known, then wait for it
+			uint32_t step = (uint32_t)(link_horizon - sim_cycles);
+			advance_clocks(step);
+			cycles -= step;
+			continue;
+		}
+		uint32_t step = (uint32_t)(stop - sim_cycles);
+		advance_clocks(step);
+		cycles -= step;
+		apply_pin_changes();
+		sim_dispatch_irqs();
+	}
+	advance_clocks(cycles);
+}
+//================================================================================================
+// sim_advance()
+// @parm: cycles = core cycles the firmware spent running
+// @return: none
+// 		Moves simulated time forward and takes every interrupt that became pending. The cycles
+// 		count as active, so DWT->CYCCNT advances with them, and take longer the slower the core.
+// 		Interrupts are taken as they come due rather than at the end, so a long stretch of work
+// 		is preempted the way it would be on the device and no tick is lost behind it.
+//================================================================================================
+void sim_advance(uint32_t cycles)
+{
+	if (sim_DWT.CTRL & DWT_CTRL_CYCCNTENA_Msk){
+		sim_DWT.CYCCNT += cycles;
+	}
+	while (cycles){
+		uint32_t step = cycles_to_next_irq() / hclk_cycles + 1; //core cycles, up to the next interrupt
+		if (step > cycles) step = cycles;
+		advance_time(step * hclk_cycles);
+		cycles -= step;
+		sim_dispatch_irqs();
+	}
+}
+//================================================================================================
+// sim_wfi()
+// @parm: none
+// @return: none
+// 		__WFI(): sleeps until an interrupt is requested, skipping straight to it. The request
+// 		wakes the core even with PRIMASK set; the handler then runs on __enable_irq(), exactly
+// 		like the device. DWT->CYCCNT does not count while asleep.
+//================================================================================================
+void sim_wfi(void)
+{
+	while (pending_count == 0){
+		if (link_horizon <= sim_cycles){
+			link_wait();
+		}
+		uint32_t cycles = cycles_to_next_irq();
+		if (link_horizon - sim_cycles < cycles){ //a byte from the other board may yet wake it before then
+			cycles = (uint32_t)(link_horizon - sim_cycles);
+		}
+		sim_stats.sleep_cycles += cycles;
+		advance_time(cycles);
+	}
+	if (!primask){
+		sim_dispatch_irqs();
+	}
+}
+//================================================================================================
+// sim_disable_irq() / sim_enable_irq()
+// 		__disable_irq() / __enable_irq(). Re-enabling takes anything that became pending meanwhile.
+//================================================================================================
+void sim_disable_irq(void)
+{
+	primask = 1;
+}
+
+void sim_enable_irq(void)
+{
+	primask = 0;
+	sim_dispatch_irqs();
+}
+//================================================================================================
+// sim_get_primask() / sim_set_primask()
+// 		__get_PRIMASK() / __set_PRIMASK(), used to save and restore the mask around a critical
+// 		section that may itself run with interrupts masked.
+//================================================================================================
+uint32_t sim_get_primask(void)
+{
+	return primask;
+}
+
+void sim_set_primask(uint32_t value)
+{
+	if (value){
+		sim_disable_irq();
+	}
+	else{
+		sim_enable_irq();
+	}
+}
+//================================================================================================
+// sim_dispatch_irqs()
+// @parm: none
+// @return: none
+// 		Runs pending, enabled handlers from the highest priority (lowest number) down. Ties go to
+// 		the lowest vector number, the same rule the NVIC uses. Called from inside a handler (via
+// 		__enable_irq()), only requests that would preempt that handler are taken.
+//================================================================================================
+void sim_dispatch_irqs(void)
+{
+	while (pending_count && !primask){
+		int32_t best = -1;
+		for (uint32_t slot = 0; slot < SIM_NUM_IRQS + 16; slot++){
+			if (!nvic_pending[slot]) continue;
+			if (slot >= 16 && !nvic_enabled[slot]) continue; //device IRQ still masked in the NVIC
+			if (nvic_priority[slot] >= active_priority) continue; //cannot preempt the running handler
+			if (best < 0 || nvic_priority[slot] < nvic_priority[best]){
+				best = (int32_t)slot;
+			}
+		}
+		if (best < 0){ //everything pending is masked or waits for the running handler
+			return;
+		}
+		nvic_pending[best] = 0;
+		pending_count--;
+		sim_stats.irq_count[best]++;
+		uint32_t preempted_priority = active_priority;
+		active_priority = nvic_priority[best];
+		if (vectors[best].flash_flags){
+			flash_raised = 0;
+		}
+		if (vectors[best].handler){
+			vectors[best].handler();
+		}
+		active_priority = preempted_priority;
+		sim_EXTI.PR1 &= ~vectors[best].exti_lines; //see note at top of file
+		sim_DMA1.ISR &= ~vectors[best].dma1_flags;
+		sim_USART2.ISR &= ~vectors[best].usart_flags;
+		sim_FLASH.SR &= ~(vectors[best].flash_flags & ~flash_raised);
+		if (usart_irq() && nvic_enabled[VECTOR(USART2_IRQn)]){ //level triggered, still requested
+			set_pending(VECTOR(USART2_IRQn));
+		}
+		if (flash_irq() && nvic_enabled[VECTOR(FLASH_IRQn)]){
+			set_pending(VECTOR(FLASH_IRQn));
+		}
+		else if (vectors[best].flash_flags && nvic_pending[best]){ //pended while EOP waited for the acknowledge above
+			nvic_pending[best] = 0;
+			pending_count--;
+		}
+	}
+}
+//================================================================================================
+// sim_set_button()
+// @parm: b = button to drive
+//        pressed = 1 to press (pull the pin low), 0 to release
+// @return: none
+// 		Drives the pin now and takes the EXTI interrupt it raises
+//================================================================================================
+void sim_set_button(enum sim_buttons b, uint32_t pressed)
+{
+	drive_button(b, pressed);
+	sim_dispatch_irqs();
+}
+//================================================================================================
+// sim_schedule_button()
+// @parm: b = button to drive
+//        pressed = 1 to press (pull the pin low), 0 to release
+//        at_cycle = sim_cycles value at which the level changes
+// @return: 1 if scheduled, 0 if SIM_PIN_CHANGES changes are already waiting
+// 		The edge lands on that exact cycle, inside a handler if one is running then, so it can
+// 		preempt it the way a real press would
+//================================================================================================
+uint32_t sim_schedule_button(enum sim_buttons b, uint32_t pressed, uint64_t at_cycle)
+{
+	if (num_pin_changes == SIM_PIN_CHANGES){
+		return 0;
+	}
+	pin_changes[num_pin_changes++] = (struct sim_pin_change){ at_cycle, b, pressed };
+	if (at_cycle < next_pin_change){
+		next_pin_change = at_cycle;
+	}
+	return 1;
+}
+//================================================================================================
+// sim_gpio_bsrr_write()
+// @parm: port = GPIOx
+//        value = BSRR word (set mask in bits 0-15, reset mask in bits 16-31)
+// @return: none
+// 		Applies a BSRR store to ODR. Set wins over reset for the same pin, as on the device.
+//================================================================================================
+void sim_gpio_bsrr_write(GPIO_TypeDef *port, uint32_t value)
+{
+	port->ODR = (port->ODR & ~(value >> 16)) | (value & 0xFFFF);
+	sim_stats.bsrr_writes++;
+}
+//================================================================================================
+// sim_tim_update_event()
+// @parm: tim = TIM2 or TIM5
+// @return: none
+// 		TIM_UPDATE_EVENT(): restarts the counter and prescaler, taking the new PSC. With URS clear
+// 		the event also raises UIF, and the update interrupt if it is enabled.
+//================================================================================================
+void sim_tim_update_event(TIM_TypeDef *tim)
+{
+	for (uint32_t t = 0; t < SIM_NUM_TIMERS; t++){
+		if (timers[t].tim == tim){
+			timers[t].prescale = 0;
+			tim->CNT = 0;
+			if (!(tim->CR1 & (1 << 2))){
+				tim->SR |= (1 << 0);
+				if (tim->DIER & (1 << 0)){
+					set_pending(VECTOR(timers[t].irq));
+				}
+			}
+		}
+	}
+}
+//================================================================================================
+// msi_hz()
+// @parm: none
+// @return: MSI frequency at the range RCC->CR selects
+//================================================================================================
+static uint32_t msi_hz(void)
+{
+	static const uint32_t range_hz[16] = { 100000, 200000, 400000, 800000, 1000000, 2000000, 4000000, 8000000,
+			16000000, 24000000, 32000000, 48000000 }; //MSIRANGE, 12 and up are reserved
+	return range_hz[(sim_RCC.CR & (1 << 3)) ? (sim_RCC.CR >> 4) & 0xF : 6]; //MSIRGSEL clear: still the reset range
+}
+//================================================================================================
+// pll_input_hz()
+// @parm: none
+// @return: PLL input after the PLLM divider, 0 with no source selected (or HSE, not fitted)
+//================================================================================================
+static uint32_t pll_input_hz(void)
+{
+	uint32_t source = sim_RCC.PLLCFGR & 0x3;
+	uint32_t in = (source == 1) ? msi_hz() : (source == 2) ? 16000000 : 0;
+	return in / (((sim_RCC.PLLCFGR >> 4) & 0x7) + 1);
+}
+//================================================================================================
+// sim_core_clock_hz()
+// @parm: none
+// @return: core clock frequency, from the source RCC->CFGR SWS says the core runs on
+//================================================================================================
+uint32_t sim_core_clock_hz(void)
+{
+	switch ((sim_RCC.CFGR >> 2) & 0x3){
+	case 1:
+		return 16000000;
+	case 3:
+		return pll_input_hz() * ((sim_RCC.PLLCFGR >> 8) & 0x7F) / ((((sim_RCC.PLLCFGR >> 25) & 0x3) + 1) * 2);
+	default:
+		return msi_hz(); //HSE is not fitted either
+	}
+}
+//================================================================================================
+// clock_fault()
+// @parm: hz = core clock just settled
+// @return: 1 if the device could not run like this: a clock source that is not ready, a clock
+// 		above the voltage range's limit or too fast for the flash wait states, or a PLL outside
+// 		its input and VCO ranges (RM0351)
+//================================================================================================
+static uint32_t clock_fault(uint32_t hz)
+{
+	uint32_t range = (sim_PWR.CR1 >> 9) & 0x3;
+	uint32_t wait_states = sim_FLASH.ACR & 0x7;
+	uint32_t source = (sim_RCC.CFGR >> 2) & 0x3;
+	const uint32_t ready[4] = { sim_RCC.CR & (1 << 1), sim_RCC.CR & (1 << 10), 0, sim_RCC.CR & (1 << 25) };
+	if (!ready[source] || hz == 0 || SIM_CLK_FREQ % hz){
+		return 1;
+	}
+	if (range == 1){
+		if (hz > 80000000 || wait_states < (hz - 1) / 16000000) return 1;
+	}
+	else if (range == 2){
+		uint32_t needed = (hz <= 6000000) ? 0 : (hz <= 12000000) ? 1 : (hz <= 18000000) ? 2 : 3;
+		if (hz > 26000000 || wait_states < needed) return 1;
+	}
+	else{
+		return 1;
+	}
+	if (source == 3){
+		uint32_t in = pll_input_hz();
+		uint64_t vco = (uint64_t)in * ((sim_RCC.PLLCFGR >> 8) & 0x7F);
+		if (in < 4000000 || in > 16000000 || vco < 64000000 || vco > ((range == 1) ? 344000000 : 128000000)){
+			return 1;
+		}
+	}
+	return 0;
+}
+//================================================================================================
+// sim_clock_settle()
+// @parm: none
+// @return: none
+// 		CLOCK_WAIT(): every oscillator that is on is ready, the core is on the source SW selects
+// 		if that is ready, and the regulator has reached its range. A new core clock starts on a
+// 		clock edge now.
+//================================================================================================
+void sim_clock_settle(void)
+{
+	uint32_t cr = sim_RCC.CR & ~((1 << 1) | (1 << 10) | (1 << 25));
+	cr |= (cr & (1 << 0)) << 1; //MSIRDY follows MSION
+	cr |= (cr & (1 << 8)) << 2; //HSIRDY follows HSION
+	cr |= (cr & (1 << 24)) << 1; //PLLRDY follows PLLON
+	sim_RCC.CR = cr;
+	uint32_t selected = sim_RCC.CFGR & 0x3;
+	const uint32_t ready[4] = { cr & (1 << 1), cr & (1 << 10), 0, cr & (1 << 25) };
+	if (ready[selected]){
+		sim_RCC.CFGR = (sim_RCC.CFGR & ~(0x3 << 2)) | (selected << 2);
+	}
+	sim_PWR.SR2 &= ~(1 << 10); //VOSF
+	uint32_t hz = sim_core_clock_hz();
+	if (clock_fault(hz)){
+		sim_stats.clock_faults++;
+	}
+	if (hz && SIM_CLK_FREQ % hz == 0 && SIM_CLK_FREQ / hz != hclk_cycles){
+		hclk_cycles = SIM_CLK_FREQ / hz;
+		hclk_phase = 0;
+	}
+}
+//================================================================================================
+// sim_button_pressed()
+// @parm: b = button to query
+// @return: 1 if the button is currently held down
+//================================================================================================
+uint32_t sim_button_pressed(enum sim_buttons b)
+{
+	return !(buttons[b].port->IDR & (0x1 << buttons[b].pin));
+}
+//================================================================================================
+// sim_time_ms()
+// @parm: none
+// @return: simulated time in milliseconds
+//================================================================================================
+uint64_t sim_time_ms(void)
+{
+	return sim_cycles / (SIM_CLK_FREQ / 1000);
+}
+//================================================================================================
+// sim_itm_attach()
+// @parm: ports = mask of stimulus ports to enable
+// @return: none
+// 		Does what a debugger does when it starts an SWO capture: enables the ITM and the ports
+//================================================================================================
+void sim_itm_attach(uint32_t ports)
+{
+	sim_ITM.TCR |= ITM_TCR_ITMENA_Msk;
+	sim_ITM.TER |= ports;
+}
+//================================================================================================
+// sim_itm_ready()
+// @parm: port = stimulus port
+// @return: 1 if the port can take a word now (ITM->PORT[port].u32 reads non-zero)
+//================================================================================================
+uint32_t sim_itm_ready(uint32_t port)
+{
+	return (sim_ITM.TCR & ITM_TCR_ITMENA_Msk) && (sim_ITM.TER & (1UL << port)) && sim_cycles >= itm_free_at;
+}
+//================================================================================================
+// sim_itm_write()
+// @parm: port = stimulus port
+//        value = word stored to ITM->PORT[port].u32
+// @return: none
+// 		Captures the word and keeps the FIFO busy until SWO has sent it
+//================================================================================================
+void sim_itm_write(uint32_t port, uint32_t value)
+{
+	(void)port;
+	sim_itm_capture[sim_itm_words++ & (SIM_ITM_CAPTURE - 1)] = value;
+	itm_free_at = sim_cycles + SIM_ITM_WORD_CYCLES;
+}
+//================================================================================================
+// sim_profile_model_cost()
+// @parm: point = profiled point about to read its exit time (enum profile_points)
+// @return: none
+// 		Charges the point's modelled cost as active time. Interrupts that come due meanwhile
+// 		preempt it if their priority allows, like they would on the device.
+//================================================================================================
+void sim_profile_model_cost(uint32_t point)
+{
+	if (point < SIM_PROFILE_POINTS && sim_profile_cost[point]){
+		sim_advance(sim_profile_cost[point]);
+	}
+}
+//================================================================================================
+// sim_task_model_cost()
+// @parm: task = task that just ran (enum main_tasks)
+// @return: none
+// 		Charges one main loop pass, sim_loop_cycles, as active time for the run. Interrupts that
+// 		come due meanwhile preempt it, like they would on the device.
+//================================================================================================
+void sim_task_model_cost(uint32_t task)
+{
+	(void)task;
+	sim_advance(sim_loop_cycles);
+}
+//================================================================================================
+// sim_usart_write_tdr()
+// @parm: usart = USART2, the only one modelled
+//        byte = value stored to TDR
+// @return: none
+// 		USART_WRITE_TDR(): the byte goes straight into the shifter if it is idle, else waits in
+// 		TDR, over anything already there. Needs UE and TE.
+//================================================================================================
+void sim_usart_write_tdr(USART_TypeDef *usart, uint32_t byte)
+{
+	(void)usart;
+	if ((sim_USART2.CR1 & 0x9) != 0x9){
+		return;
+	}
+	if (usart_tx_end == UINT64_MAX){
+		usart_start((uint8_t)byte, sim_cycles);
+	}
+	else{
+		usart_tdr = (uint8_t)byte;
+	}
+	advance_usart();
+}
+//================================================================================================
+// sim_usart_read_rdr()
+// @parm: usart = USART2, the only one modelled
+// @return: RDR, clearing RXNE
+//================================================================================================
+uint32_t sim_usart_read_rdr(USART_TypeDef *usart)
+{
+	(void)usart;
+	sim_USART2.ISR &= ~(1 << 5);
+	return sim_USART2.RDR;
+}
+//================================================================================================
+// sim_link_open()
+// @parm: in_fd = records from the other board's simulator, blocking reads
+//        out_fd = records to it
+//        delay_cycles = wire delay after a byte's stop bit, at least one sim cycle
+//        jitter_cycles = up to this much more, uniformly
+//        seed = jitter's random sequence, non-zero
+// @return: none
+// 		Crosses USART2 over to another simulator. Each byte is sent as a record with the cycle
+// 		it arrives at, and when a side would run past the other's time plus the delay it sends
+// 		its own time and waits. Call after sim_reset().
+//================================================================================================
+void sim_link_open(int in_fd, int out_fd, uint64_t delay_cycles, uint64_t jitter_cycles, uint64_t seed)
+{
+	link_in = in_fd;
+	link_out = out_fd;
+	link_delay = delay_cycles ? delay_cycles : 1;
+	link_jitter = jitter_cycles;
+	link_rng = seed ? seed : 1;
+	link_last_at = 0;
+	link_horizon = link_delay;
+	link_rx_head = link_rx_tail = 0;
+}
+//================================================================================================
+// sim_link_close()
+// @parm: none
+// @return: none
+// 		Tells the other side this one has finished, so it no longer waits for it
+//================================================================================================
+void sim_link_close(void)
+{
+	if (link_out >= 0){
+		struct sim_link_record r = { UINT64_MAX, 0, -1, 0 };
+		ssize_t n = write(link_out, &r, sizeof r);
+		(void)n; //the other side may have gone already
+		close(link_out);
+		link_out = -1;
+	}
+	link_horizon = UINT64_MAX;
+}
+//================================================================================================
+// sim_flash_read_double()
+// @parm: address = bus address of a double-word in bank 2
+// @return: FLASH_READ_DOUBLE(): its contents. One a power cut left torn reads back as it is,
+// 		with FLASH->ECCR ECCD set and NMI_Handler run, as the device raises the NMI.
+//================================================================================================
+uint64_t sim_flash_read_double(uint32_t address)
+{
+	if (address < FLASH_BANK2_BASE || address - FLASH_BANK2_BASE >= FLASH_BANK2_BYTES || (address & 7)){
+		return UINT64_MAX;
+	}
+	uint32_t word = (address - FLASH_BANK2_BASE) / 8;
+	if (flash_torn[word]){
+		sim_FLASH.ECCR = FLASH_ECCR_ECCD | (1 << 19) | ((address - FLASH_BANK2_BASE) & 0x7FFFF); //BK_ECC, ADDR_ECC
+		if (NMI_Handler){
+			NMI_Handler();
+		}
+		sim_FLASH.ECCR &= ~FLASH_ECCR_ECCD;
+	}
+	return ~flash_bank2[word];
+}
+//================================================================================================
+// sim_flash_program_double()
+// @parm: address = bus address of a double-word in bank 2
+//        value = what to program
+// @return: none
+// 		FLASH_PROGRAM_DOUBLE(): starts programming, which needs CR unlocked with PG set, no
+// 		operation in progress and the double-word erased.
+//================================================================================================
+void sim_flash_program_double(uint32_t address, uint64_t value)
+{
+	if (address < FLASH_BANK2_BASE || address - FLASH_BANK2_BASE >= FLASH_BANK2_BYTES || (address & 7)){
+		flash_error(FLASH_SR_PGAERR);
+		return;
+	}
+	if ((sim_FLASH.CR & (FLASH_CR_LOCK | FLASH_CR_PG)) != FLASH_CR_PG || flash_op_end != UINT64_MAX){
+		flash_error(FLASH_SR_PGSERR);
+		return;
+	}
+	uint32_t word = (address - FLASH_BANK2_BASE) / 8;
+	if (flash_bank2[word] || flash_torn[word]){
+		flash_error(FLASH_SR_PROGERR);
+		return;
+	}
+	flash_op_word = word;
+	flash_op_words = 1;
+	flash_op_value = value;
+	flash_op_start = sim_cycles;
+	flash_op_end = sim_cycles + FLASH_PROGRAM_CYCLES;
+	sim_FLASH.SR |= FLASH_SR_BSY;
+	sim_stats.flash_programs++;
+}
+//================================================================================================
+// sim_flash_cr_write()
+// @parm: value = value stored to FLASH->CR
+// @return: none
+// 		FLASH_CR_WRITE(): ignored while CR is locked, unless the second key was the last store to
+// 		KEYR. STRT with PER starts erasing page PNB of bank 2 (BKER).
+//================================================================================================
+void sim_flash_cr_write(uint32_t value)
+{
+	if ((sim_FLASH.CR & FLASH_CR_LOCK) && sim_FLASH.KEYR != FLASH_KEY2){
+		return;
+	}
+	sim_FLASH.KEYR = 0;
+	sim_FLASH.CR = value & ~FLASH_CR_STRT;
+	if (!(value & FLASH_CR_STRT) || (value & FLASH_CR_LOCK)){
+		return;
+	}
+	if ((value & (FLASH_CR_PER | FLASH_CR_PG)) != FLASH_CR_PER || flash_op_end != UINT64_MAX){
+		flash_error(FLASH_SR_PGSERR);
+		return;
+	}
+	if (!(value & FLASH_CR_BKER)){ //bank 1 holds the program
+		flash_error(FLASH_SR_WRPERR);
+		return;
+	}
+	flash_op_word = ((value >> 3) & 0xFF) * FLASH_PAGE_WORDS;
+	flash_op_words = FLASH_PAGE_WORDS;
+	flash_op_start = sim_cycles;
+	flash_op_end = sim_cycles + FLASH_ERASE_CYCLES;
+	sim_FLASH.SR |= FLASH_SR_BSY;
+	sim_stats.flash_erases++;
+	flash_page_erases[flash_op_word / FLASH_PAGE_WORDS]++;
+}
+//================================================================================================
+// sim_flash_power_cut()
+// @parm: none
+// @return: 1 if a program or erase was cut short
+// 		Call before sim_reset() to lose power now. A program cut in its first quarter leaves the
+// 		double-word erased and one cut in its last quarter leaves it programmed; in between, and
+// 		anywhere in an erase, the cells hold part of the charge and read back at random with a
+// 		double ECC error (torn). An erase cut in its last quarter leaves the page erased.
+//================================================================================================
+uint32_t sim_flash_power_cut(void)
+{
+	if (flash_op_end == UINT64_MAX){
+		return 0;
+	}
+	uint64_t quarter = (flash_op_end - flash_op_start) / 4;
+	uint64_t done = sim_cycles - flash_op_start;
+	if (done >= 3 * quarter){
+		flash_op_end = sim_cycles; //as good as finished
+		advance_flash();
+	}
+	else if (flash_op_words == 1 && done < quarter){
+		flash_op_end = UINT64_MAX;
+	}
+	else{
+		for (uint32_t i = 0; i < flash_op_words; i++){
+			flash_rng ^= flash_rng >> 12;
+			flash_rng ^= flash_rng << 25;
+			flash_rng ^= flash_rng >> 27;
+			uint64_t noise = flash_rng * 0x2545F4914F6CDD1DULL;
+			if (flash_op_words == 1){
+				flash_bank2[flash_op_word] = ~flash_op_value & noise; //some of the bits to program got there
+			}
+			else{
+				flash_bank2[flash_op_word + i] &= noise; //some of the bits got erased
+			}
+			flash_torn[flash_op_word + i] = 1;
+		}
+		flash_op_end = UINT64_MAX;
+	}
+	sim_FLASH.SR &= ~FLASH_SR_BSY;
+	return 1;
+}
+//================================================================================================
+// sim_flash_erase_all()
+// @parm: none
+// @return: none
+// 		Bank 2 as it leaves the factory, every double-word erased
+//================================================================================================
+void sim_flash_erase_all(void)
+{
+	memset(flash_bank2, 0, sizeof flash_bank2);
+	memset(flash_torn, 0, sizeof flash_torn);
+	memset(flash_page_erases, 0, sizeof flash_page_erases);
+	flash_op_end = UINT64_MAX;
+}
+//================================================================================================
+// sim_flash_page_erases()
+// @parm: address = any address in a bank 2 page
+// @return: times the page has been erased since sim_flash_erase_all(), cut erases included
+//================================================================================================
+uint32_t sim_flash_page_erases(uint32_t address)
+{
+	if (address < FLASH_BANK2_BASE || address - FLASH_BANK2_BASE >= FLASH_BANK2_BYTES){
+		return 0;
+	}
+	return flash_page_erases[(address - FLASH_BANK2_BASE) / 8 / FLASH_PAGE_WORDS];
+}
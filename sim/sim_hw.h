@@ -0,0 +1,70 @@
+/**
+**************************************************************************************************
+* @file sim_hw.h
+* @brief Header file for the host register-level simulator
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for sim_hw.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the emulated clock, NVIC and button interface used to drive the game on a Linux host
+**************************************************************************************************
+*/
+#ifndef SIM_HW_H
+#define SIM_HW_H
+
+#include <stdint.h>
+#include "stm32l476xx.h"
+#include "../main.h"
+
+#define SIM_CLK_FREQ 80000000 //rate sim_cycles counts at, the fastest core clock. Every clock the firmware selects must divide it.
+#define SIM_DEFAULT_LOOP_CYCLES 100 //core cycles charged for one pass of the main loop, and for each task run in it
+#define SIM_PROFILE_POINTS 10 //entries in sim_profile_cost, at least NUM_of_PROFILE_POINTS
+#define SIM_ITM_CAPTURE 65536 //stimulus port words kept, must be a power of two
+#define SIM_PIN_CHANGES 128 //button level changes that can be scheduled ahead
+#define SIM_LINK_BYTES 4096 //bytes on the wire from the other board, must be a power of two
+#define SIM_ITM_WORD_CYCLES (SIM_CLK_FREQ / 40000) //sim cycles SWO needs per word (32 bits plus framing at 2 Mbit/s)
+
+//Buttons wired to the board (all active low with pull-ups)
+enum sim_buttons { SIM_LEFT_BUTTON, SIM_RIGHT_BUTTON, SIM_SPECIAL_BUTTON, SIM_NUM_BUTTONS };
+
+//Counters kept by the simulator, useful for profiling the firmware on the host
+struct sim_stats {
+	uint64_t irq_count[SIM_NUM_IRQS + 16];//number of times each vector was taken
+	uint64_t loop_iterations;//number of passes through the firmware main loop
+	uint64_t bsrr_writes;//number of GPIO BSRR stores, by the CPU or DMA
+	uint64_t dma_transfers;//number of words, halfwords or bytes moved by DMA1
+	uint64_t spi_bytes;//number of bytes shifted out by SPI1
+	uint64_t sleep_cycles;//sim cycles spent in WFI
+	uint64_t clock_faults;//settled clocks faster than the voltage range, wait states or PLL limits allow
+	uint64_t usart_bytes;//number of bytes sent by USART2
+	uint64_t link_waits;//number of times the run waited for the other board's simulator
+	uint64_t flash_programs;//number of double-words programmed in flash bank 2
+	uint64_t flash_erases;//number of flash pages erased
+};
+
+extern volatile uint64_t sim_cycles;//time since sim_reset(), SIM_CLK_FREQ per second
+extern uint32_t sim_loop_cycles;//core cycles charged per main loop pass and per task run
+extern struct sim_stats sim_stats;
+extern uint32_t sim_profile_cost[SIM_PROFILE_POINTS];//modelled cycles per profiled point, see profile.h
+extern uint32_t sim_itm_capture[SIM_ITM_CAPTURE];//words written to the ITM stimulus ports, oldest overwritten
+extern uint64_t sim_itm_words;//words written since sim_reset()
+extern void (*sim_timer_update_hook)(TIM_TypeDef *tim, uint64_t at_cycle);//called after each timer update's DMA, may be NULL
+extern void (*sim_spi_hook)(uint8_t byte, uint64_t at_cycle);//called with each byte SPI1 shifts out, may be NULL
+
+void sim_reset(void);
+void sim_advance(uint32_t cycles);
+void sim_wfi(void);
+void sim_dispatch_irqs(void);
+void sim_set_button(enum sim_buttons b, uint32_t pressed);
+uint32_t sim_schedule_button(enum sim_buttons b, uint32_t pressed, uint64_t at_cycle);
+uint32_t sim_button_pressed(enum sim_buttons b);
+uint64_t sim_time_ms(void);
+uint32_t sim_core_clock_hz(void);
+void sim_itm_attach(uint32_t ports);
+void sim_link_open(int in_fd, int out_fd, uint64_t delay_cycles, uint64_t jitter_cycles, uint64_t seed);
+void sim_link_close(void);
+uint32_t sim_flash_power_cut(void);
+void sim_flash_erase_all(void);
+uint32_t sim_flash_page_erases(uint32_t address);
+
+#endif /* SIM_HW_H */
@@ -0,0 +1,729 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include "sim_hw.h"
+#include "sim_players.h"
+#include "../main.h"
+#include "../power.h"
+#include "../input.h"
+#include "../recorder.h"
+#include "../profile.h"
+#include "../ball.h"
+#include "../animation.h"
+#include "../leds.h"
+#include "../strip.h"
+#include "../clock.h"
+#include "../link.h"
+#include "../latency.h"
+#include "../difficulty.h"
+#include "../scheduler.h"
+#include "../stats_log.h"
+/**
+**************************************************************************************************
+* @file sim_main.c
+* @brief Host simulator entry point
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Brings the board up through configure_system(), then runs HANDLE_MAIN_LOOP() against the
+* emulated peripherals and the scripted players in sim_players.c. -m picks how reaction times
+* are drawn (uniform, gaussian or exgauss, see enum sim_reaction_models). With -b, every press
+* and release bounces that many extra times.
+* -R saves the firmware's recording (recorder.c/h) at the end of the run; -P replays a saved
+* recording through the game logic instead of playing.
+* -l sets the core cycles a main loop pass takes; every task the scheduler runs in a pass takes as
+* many again (TASK_MODEL_COST()), so a large -l shows up as late tasks in the "tasks" table. The
+* table's cycles per run are that modelled cost, not a measurement of the task's code.
+* Built with PROFILING 1, each handler is charged a modelled cost (profile_model_cycles) and the
+* profile table is printed at the end. With -I it is decoded from the ITM stream the firmware
+* sent instead of read from memory.
+* Built with BALL_ANIMATION_DMA, -A checks the ball segments instead of playing: the ball is
+* launched from every position in both directions at several speeds, and each step the emulated
+* DMA plays is compared with where, and on which cycle, BALL_TICK() would have put the ball.
+* -v serves the ball at that many LEDs per second, and every hit keeps it there. With -l as well,
+* it shows that a ball faster than the main loop still has its every hitzone and MISS zone
+* handled; a ball found off the board is counted on the "board" line. Built with BALL_TICK_HZ
+* 10000 it goes up to several thousand.
+* Built with LED_OUTPUT_STRIP, -W plays as usual but decodes the SPI1 stream the way a WS2812
+* does: every high and low time is checked against the data sheet, and every latched frame
+* against what the game drew.
+* Built with LINK_UART, each simulator runs one board: -L picks its side (PC1), and USART2 talks to
+* the other simulator through the pipes given with -i and -o (make link sets up two FIFOs). The
+* wire delays each byte by -D us plus up to -J us; the two runs keep within that delay of each
+* other, so both see every byte on the cycle it arrives. Only this board's player presses; the
+* other player's presses and misses come over the link.
+* Built with STATS_LOG, the run starts from a blank flash bank 2 and prints the lifetime statistics
+* logged by the end. pong_powerloss (powerloss.c) checks the log against power cuts.
+*
+*	usage: embedded_pong_sim [-t ms] [-l loop_cycles] [-m model] [-r reaction_ms] [-j jitter_ms]
+*	                         [-x tail_ms] [-h hold_ms] [-b bounces] [-s seed] [-v speed] [-R file] [-P file]
+*	                         [-I] [-A] [-W] [-q] [-L left|right -i in_path -o out_path [-D delay_us] [-J jitter_us]]
+**************************************************************************************************
+*/
+//================================================================================================
+// reaction_model()
+// @parm: name = model name given with -m
+// @return: matching enum sim_reaction_models value, SIM_NUM_REACTION_MODELS if unknown
+//================================================================================================
+static enum sim_reaction_models reaction_model(const char *name)
+{
+	for (uint32_t i = 0; i < SIM_NUM_REACTION_MODELS; i++){
+		if (!strcmp(name, sim_reaction_model_names[i])){
+			return (enum sim_reaction_models)i;
+		}
+	}
+	return SIM_NUM_REACTION_MODELS;
+}
+
+#if PROFILING
+//Rough cost of each profiled point at 4 MHz. The simulator runs code in zero time, so these stand
+//in for the cycles DWT->CYCCNT would measure on the board.
+static const uint32_t profile_model_cycles[NUM_of_PROFILE_POINTS] = {
+	[PROF_USART2] = 70, [PROF_DMA1_CH2] = 150, [PROF_TIM2] = 220, [PROF_EXTI15_10] = 90, [PROF_EXTI1] = 90, [PROF_EXTI4] = 90,
+	[PROF_SYSTICK] = 60, [PROF_DMA1_CH3] = 120, [PROF_FLASH] = 110, [PROF_HANDLE_GAME] = 300
+};
+static const char *const profile_names[NUM_of_PROFILE_POINTS] = {
+	"USART2", "DMA1_CH2", "TIM2", "EXTI15_10", "EXTI1", "EXTI4", "SysTick", "DMA1_CH3", "FLASH", "HANDLE_GAME"
+};
+
+//================================================================================================
+// decode_itm()
+// @parm: stats = filled with the newest record seen for each point
+// @return: number of complete records found in the capture
+//================================================================================================
+static uint32_t decode_itm(struct Profile_Stats *stats)
+{
+	uint32_t records = 0;
+	uint64_t first = sim_itm_words > SIM_ITM_CAPTURE ? sim_itm_words - SIM_ITM_CAPTURE : 0;
+	for (uint64_t i = first; i + PROFILE_RECORD_WORDS < sim_itm_words; i++){
+		uint32_t header = sim_itm_capture[i & (SIM_ITM_CAPTURE - 1)];
+		uint32_t point = (header >> 16) & 0xFF;
+		if ((header & 0xFF000000) != PROFILE_RECORD_MAGIC || (header & 0xFFFF) != PROFILE_RECORD_WORDS
+				|| point >= NUM_of_PROFILE_POINTS){
+			continue;
+		}
+		uint32_t *words = (uint32_t *)&stats[point];
+		for (uint32_t w = 0; w < PROFILE_RECORD_WORDS; w++){
+			words[w] = sim_itm_capture[(i + 1 + w) & (SIM_ITM_CAPTURE - 1)];
+		}
+		i += PROFILE_RECORD_WORDS;
+		records++;
+	}
+	return records;
+}
+//================================================================================================
+// print_profile()
+// @parm: from_itm = 1 to decode the table from the ITM capture, 0 to read profile_stats
+// @return: none
+//================================================================================================
+static void print_profile(uint32_t from_itm)
+{
+	static struct Profile_Stats stats[NUM_of_PROFILE_POINTS];
+	if (from_itm){
+		uint32_t records = decode_itm(stats);
+		printf("profile        decoded from %u ITM records (%llu words)\n", records, (unsigned long long)sim_itm_words);
+	}
+	else{
+		memcpy(stats, profile_stats, sizeof stats);
+		printf("profile        core cycles (modelled costs), own = less preemption\n");
+	}
+	printf("  point          runs    own min/mean/max   worst elapsed  preempted (worst)  log2 histogram\n");
+	for (uint32_t p = 0; p < NUM_of_PROFILE_POINTS; p++){
+		const struct Profile_Stats *s = &stats[p];
+		printf("  %-11s %7u %6u/%llu/%-6u %9u %10u (%u)   ", profile_names[p], s->count, s->count ? s->min_cycles : 0,
+				s->count ? (unsigned long long)(s->total_cycles / s->count) : 0ULL, s->max_cycles, s->max_elapsed,
+				s->preempted, s->max_preempted_cycles);
+		for (uint32_t b = 0; b < PROFILE_BUCKETS; b++){
+			if (s->histogram[b]) printf(" <2^%u:%u", b, s->histogram[b]);
+		}
+		printf("\n");
+	}
+	printf("  preemption     point <- preempted by: times (worst cycles)\n");
+	for (uint32_t p = 0; p < NUM_of_PROFILE_POINTS; p++){
+		uint32_t any = 0;
+		for (uint32_t by = 0; by < NUM_of_PROFILE_POINTS; by++){
+			if (!stats[p].preempted_by[by]) continue;
+			if (!any) printf("  %-11s <-", profile_names[p]);
+			printf("%s %s %u (%u)", any ? "," : "", profile_names[by], stats[p].preempted_by[by], stats[p].worst_by[by]);
+			any = 1;
+		}
+		if (any) printf("\n");
+	}
+}
+#endif
+
+//================================================================================================
+// replay_file()
+// @parm: path = recording saved with -R
+// @return: process exit status, 1 if the replay diverged or could not be read
+//================================================================================================
+static int replay_file(const char *path)
+{
+	static uint8_t data[RECORDER_SIZE];
+	FILE *f = fopen(path, "rb");
+	if (!f){
+		perror(path);
+		return 1;
+	}
+	uint32_t length = (uint32_t)fread(data, 1, sizeof data, f);
+	fclose(f);
+
+	sim_reset();
+	configure_system();
+	struct Replay_Result result;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	REPLAY_RECORDING(data, length, &result);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double wall = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("replayed       %u bytes, %u records (%u before the first snapshot skipped)%s\n",
+			length, result.records, result.skipped, result.corrupt ? ", data ends mid-record" : "");
+	printf("               %u events applied, %u states checked, %u divergences",
+			result.applied, result.checked, result.divergences);
+	if (result.divergences) printf(" (first at record %u)", result.first_divergence);
+	printf("\n               %.3f s of play in %.6f s wall (%.0fx real time)\n", (double)result.span_us / 1e6, wall,
+			wall > 0 ? (double)result.span_us / 1e6 / wall : 0.0);
+	printf("final state    game_state %u LEDcount %u pace %u score P1 %u P2 %u\n",
+			(unsigned)game_state, (unsigned)LEDcount, (unsigned)pace, (unsigned)P1.score, (unsigned)P2.score);
+	return (result.divergences || result.corrupt) ? 1 : 0;
+}
+
+#if BALL_ANIMATION == BALL_ANIMATION_DMA
+#define CHECK_MISMATCHES_SHOWN 8 //mismatches printed in full
+
+//Where the ball should be while check_animation() runs, stepped the way BALL_TICK() steps it
+static struct {
+	uint32_t position; //LED the ball is on
+	uint32_t board_lit; //board LED state
+	uint32_t phase; //Q16.16, as ball_phase
+	uint64_t step_cycle; //cycle of the last step, or of the launch
+	uint64_t transfers; //sim_stats.dma_transfers after the last step
+	uint32_t steps; //steps seen since the launch
+	uint32_t mismatches; //steps that went wrong, over all launches
+} expect;
+
+//================================================================================================
+// check_step()
+// @parm: tim = timer that updated, at_cycle = cycle of the update
+// @return: none
+// 		sim_timer_update_hook while checking. An update that made DMA transfers is a step: the
+// 		board must show the ball on the next LED, the board LED toggled, on the expected cycle.
+//================================================================================================
+static void check_step(TIM_TypeDef *tim, uint64_t at_cycle)
+{
+	if (tim != TIM2 || sim_stats.dma_transfers == expect.transfers){ //nothing played on this update
+		return;
+	}
+	expect.transfers = sim_stats.dma_transfers;
+	uint32_t ticks = 0;
+	do{
+		expect.phase += ball_velocity;
+		ticks++;
+	} while (expect.phase < Q16_ONE);
+	expect.phase -= Q16_ONE;
+	expect.step_cycle += (uint64_t)ticks * (SIM_CLK_FREQ / BALL_TICK_HZ);
+	expect.position = (direction == RIGHT) ? expect.position - 1 : expect.position + 1;
+	expect.board_lit = !expect.board_lit;
+	expect.steps++;
+
+	uint32_t wrong_leds = 0;
+	for (uint32_t i = RIGHT_HITZONE_POS + 1; i < LEFT_HITZONE_POS; i++){
+		uint32_t lit = LED_IS_LIT(&LEDS[i]);
+		wrong_leds += lit != (i == expect.position);
+	}
+	uint32_t board_lit = LED_IS_LIT(&BoardLED);
+	if (at_cycle != expect.step_cycle || board_lit != expect.board_lit || wrong_leds){
+		if (expect.mismatches++ < CHECK_MISMATCHES_SHOWN){
+			printf("  mismatch     step %u to LED %u: cycle %llu (expected %llu), board LED %u (expected %u), %u GAMEBOARD LEDs wrong\n",
+					expect.steps, expect.position, (unsigned long long)at_cycle, (unsigned long long)expect.step_cycle,
+					board_lit, expect.board_lit, wrong_leds);
+		}
+	}
+}
+//================================================================================================
+// check_animation()
+// @parm: none
+// @return: process exit status, 1 if any step or segment end was wrong
+// 		Launches the ball the way a serve or hit does, from every position it can start a run
+// 		from, and lets the emulated DMA play it into the MISS zone
+//================================================================================================
+static int check_animation(void)
+{
+	static const uint32_t speeds[] = { 1, DEFAULT_SPEED, 37, 250, MAX_SPEED - 1 }; //LEDs per second
+	uint32_t runs = 0, steps = 0, segments = 0, wrong_ends = 0;
+	sim_timer_update_hook = check_step;
+	for (uint32_t s = 0; s < sizeof speeds / sizeof speeds[0]; s++){
+		for (uint32_t d = LEFT; d <= RIGHT; d++){
+			uint32_t miss = (d == RIGHT) ? RIGHT_MISS_ZONE : LEFT_MISS_ZONE;
+			uint32_t first = (d == RIGHT) ? RIGHT_HITZONE_POS + 1 : RIGHT_HITZONE_POS; //up to the hitzone the ball is hit from
+			uint32_t last = (d == RIGHT) ? LEFT_HITZONE_POS : LEFT_HITZONE_POS - 1;
+			for (uint32_t start = first; start <= last; start++){
+				sim_reset();
+				configure_system();
+				tuning.default_speed = speeds[s];
+				LEDcount = start;
+				direction = (enum directions)d;
+				SET_STEP_RATE(0, BALL_SPEED(0)); //as SERVE() does
+				startTIM2_MACRO;
+				expect.position = start;
+				expect.board_lit = LED_IS_LIT(&BoardLED);
+				expect.phase = ball_phase;
+				expect.step_cycle = sim_cycles;
+				expect.transfers = sim_stats.dma_transfers;
+				expect.steps = 0;
+				uint32_t played = ball_animation.segments_played;
+				START_BALL_ANIMATION(); //as HEAD_RIGHT() and HEAD_LEFT() do
+
+				uint64_t limit = sim_cycles + 2 * (uint64_t)(LEFT_MISS_ZONE + 1) * SIM_CLK_FREQ; //one LED a second at the slowest, less what ball_velocity rounds off
+				while (LEDcount != miss && sim_cycles < limit){
+					sim_wfi();
+				}
+				uint32_t distance = (start > miss) ? start - miss : miss - start;
+				if (LEDcount != miss || expect.position != miss || expect.steps != distance){
+					if (wrong_ends++ < CHECK_MISMATCHES_SHOWN){
+						printf("  wrong end    %u LEDs/s from LED %u: LEDcount %u after %u steps, expected %u after %u\n",
+								speeds[s], start, (unsigned)LEDcount, expect.steps, miss, distance);
+					}
+				}
+				runs++;
+				steps += expect.steps;
+				segments += ball_animation.segments_played - played;
+			}
+		}
+	}
+	sim_timer_update_hook = NULL;
+	printf("animation      %u launches, %u segments, %u steps checked against the emulated DMA\n", runs, segments, steps);
+	printf("               %u steps wrong, %u segments ended in the wrong place\n", expect.mismatches, wrong_ends);
+	return (expect.mismatches || wrong_ends) ? 1 : 0;
+}
+#endif
+
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+#define WIRE_NS(cycles) ((uint64_t)(cycles) * 1000000000u / SIM_CLK_FREQ)
+#define WIRE_FRAME_BITS (24 * BOARD_LENGTH)
+enum wire_times { WIRE_T0H, WIRE_T1H, WIRE_T0L, WIRE_T1L, NUM_of_WIRE_TIMES };
+
+//The strip's data line as a WS2812 sees it: pulses, bits, and the frames the reset time latches
+static struct {
+	uint32_t level; //line level now
+	uint64_t edge; //cycle of the last level change
+	uint64_t high; //high time of the pulse waiting for its low time, 0 if none
+	uint64_t frame_start; //cycle of the first rising edge of the frame being received
+	uint32_t bits; //bits of the frame being received
+	uint8_t grb[BOARD_LENGTH][3]; //colours being received
+	uint8_t shown[BOARD_LENGTH]; //1 for each pixel lit by the last frame latched
+	uint32_t frames; //frames latched
+	uint32_t bad_frames; //frames of the wrong length or showing something the game could not have drawn
+	uint32_t bad_bits; //pulses with a high or low time out of range
+	uint64_t min_ns[NUM_of_WIRE_TIMES], max_ns[NUM_of_WIRE_TIMES];
+	uint64_t min_reset_ns; //shortest latch
+	uint64_t max_frame_ns; //longest frame, first rising edge to the start of the reset time
+} wire;
+
+//================================================================================================
+// wire_time()
+// @parm: which = time measured, ns = its length, min/max = data sheet range
+// @return: 1 if in range
+//================================================================================================
+static uint32_t wire_time(enum wire_times which, uint64_t ns, uint32_t min, uint32_t max)
+{
+	if (ns < wire.min_ns[which]) wire.min_ns[which] = ns;
+	if (ns > wire.max_ns[which]) wire.max_ns[which] = ns;
+	return ns >= min && ns <= max;
+}
+//================================================================================================
+// wire_latch()
+// @parm: none
+// @return: none
+// 		The reset time has passed: checks the frame and keeps what it shows
+//================================================================================================
+static void wire_latch(void)
+{
+	uint32_t bad = wire.bits != WIRE_FRAME_BITS;
+	uint32_t balls = 0;
+	for (uint32_t p = 0; p < BOARD_LENGTH; p++){
+		uint32_t colour = ((uint32_t)wire.grb[p][1] << 16) | ((uint32_t)wire.grb[p][0] << 8) | wire.grb[p][2];
+		bad |= colour != 0 && colour != STRIP_PIXEL_COLOUR(p);
+		wire.shown[p] = colour != 0;
+		balls += colour != 0 && p > RIGHT_HITZONE_POS && p < LEFT_HITZONE_POS;
+	}
+	bad |= balls > BALL_COUNT;
+	wire.bad_frames += bad;
+	wire.frames++;
+	wire.bits = 0;
+	memset(wire.grb, 0, sizeof wire.grb);
+}
+//================================================================================================
+// wire_pulse()
+// @parm: high = cycles the line was high, low = cycles it was low after that
+// @return: none
+// 		Reads a bit from the high time the way a WS2812 does, then checks both times for it
+//================================================================================================
+static void wire_pulse(uint64_t high, uint64_t low)
+{
+	uint64_t high_ns = WIRE_NS(high), low_ns = WIRE_NS(low);
+	uint32_t one = high_ns > (WS2812_T0H_MAX + WS2812_T1H_MIN) / 2;
+	uint32_t good = one ? wire_time(WIRE_T1H, high_ns, WS2812_T1H_MIN, WS2812_T1H_MAX)
+			: wire_time(WIRE_T0H, high_ns, WS2812_T0H_MIN, WS2812_T0H_MAX);
+	if (low_ns < WS2812_RESET_MIN){
+		good &= one ? wire_time(WIRE_T1L, low_ns, WS2812_T1L_MIN, WS2812_T1L_MAX)
+				: wire_time(WIRE_T0L, low_ns, WS2812_T0L_MIN, WS2812_T0L_MAX);
+	}
+	wire.bad_bits += !good;
+	if (wire.bits < WIRE_FRAME_BITS){
+		wire.grb[wire.bits / 24][(wire.bits % 24) / 8] |= (uint8_t)(one << (7 - wire.bits % 8));
+	}
+	wire.bits++;
+	if (low_ns >= WS2812_RESET_MIN){
+		if (low_ns < wire.min_reset_ns) wire.min_reset_ns = low_ns;
+		uint64_t frame_ns = WIRE_NS(wire.edge - wire.frame_start); //edge is the last falling one
+		if (frame_ns > wire.max_frame_ns) wire.max_frame_ns = frame_ns;
+		wire_latch();
+	}
+}
+//================================================================================================
+// wire_level()
+// @parm: level = line level from at_cycle on
+// @return: none
+//================================================================================================
+static void wire_level(uint32_t level, uint64_t at_cycle)
+{
+	if (level == wire.level){
+		return;
+	}
+	if (level){ //rising edge: the pulse before it is complete
+		if (wire.high){
+			wire_pulse(wire.high, at_cycle - wire.edge);
+		}
+		if (wire.bits == 0){
+			wire.frame_start = at_cycle;
+		}
+	}
+	else{
+		wire.high = at_cycle - wire.edge;
+	}
+	wire.level = level;
+	wire.edge = at_cycle;
+}
+//================================================================================================
+// wire_byte()
+// @parm: byte = byte SPI1 shifted out, at_cycle = cycle its first bit started on
+// @return: none
+// 		sim_spi_hook while checking. Between bytes the line keeps its level, as MOSI does.
+//================================================================================================
+static void wire_byte(uint8_t byte, uint64_t at_cycle)
+{
+	uint32_t bit_cycles = SIM_CLK_FREQ / STRIP_SPI_HZ;
+	for (uint32_t b = 0; b < 8; b++){
+		wire_level((byte >> (7 - b)) & 0x1, at_cycle + (uint64_t)b * bit_cycles);
+	}
+}
+//================================================================================================
+// check_strip()
+// @parm: run_ms = simulated time to play for
+// @return: process exit status, 1 if any pulse or frame was wrong
+// 		Plays like a normal run with the decoder on the data line, then stops the game's timers,
+// 		lets the last frame out and checks it against the pixels the game has lit
+//================================================================================================
+static int check_strip(uint64_t run_ms)
+{
+	memset(&wire, 0, sizeof wire);
+	for (uint32_t t = 0; t < NUM_of_WIRE_TIMES; t++){
+		wire.min_ns[t] = UINT64_MAX;
+	}
+	wire.min_reset_ns = UINT64_MAX;
+	sim_spi_hook = wire_byte;
+	sim_play(run_ms, NULL);
+
+	SysTick->CTRL = 0; //nothing more changes on the board...
+	stopTIM2_MACRO;
+	while (strip.busy){ //...once the frames still queued are out
+		sim_wfi();
+	}
+	sim_advance(STRIP_RESET_BYTES * 8 * (SIM_CLK_FREQ / STRIP_SPI_HZ)); //the last reset time
+	wire_level(1, sim_cycles); //the decoder only finishes a pulse on the next rising edge
+	sim_spi_hook = NULL;
+
+	uint32_t wrong = 0;
+	for (uint32_t p = 0; p < BOARD_LENGTH; p++){
+		wrong += wire.shown[p] != LED_IS_LIT(&LEDS[p]);
+	}
+	uint64_t bits_sent = (uint64_t)wire.frames * WIRE_FRAME_BITS;
+	printf("strip          %u pixels at %u kHz SPI, %u frames sent, %u latched, %.2f pixels encoded per frame\n",
+			BOARD_LENGTH, STRIP_SPI_HZ / 1000, strip.frames, wire.frames,
+			strip.frames ? (double)strip.pixels_encoded / strip.frames : 0.0);
+	printf("               T0H %llu-%llu ns, T1H %llu-%llu ns, T0L %llu-%llu ns, T1L %llu-%llu ns, reset at least %llu us\n",
+			(unsigned long long)wire.min_ns[WIRE_T0H], (unsigned long long)wire.max_ns[WIRE_T0H],
+			(unsigned long long)wire.min_ns[WIRE_T1H], (unsigned long long)wire.max_ns[WIRE_T1H],
+			(unsigned long long)wire.min_ns[WIRE_T0L], (unsigned long long)wire.max_ns[WIRE_T0L],
+			(unsigned long long)wire.min_ns[WIRE_T1L], (unsigned long long)wire.max_ns[WIRE_T1L],
+			(unsigned long long)(wire.min_reset_ns / 1000));
+	printf("               longest frame %llu us on the wire, %u of %llu bits out of range, %u bad frames, %u pixels differ from the game at the end\n",
+			(unsigned long long)(wire.max_frame_ns / 1000), wire.bad_bits, (unsigned long long)bits_sent,
+			wire.bad_frames, wrong);
+	return (wire.bad_bits || wire.bad_frames || wrong || wire.frames != strip.frames) ? 1 : 0;
+}
+#endif
+
+static uint32_t most_balls; //most balls in play at once
+static uint32_t off_board; //passes that found a ball in play off the GAMEBOARD row
+
+//================================================================================================
+// check_balls()
+// @parm: none
+// @return: 0, play goes on
+// 		sim_play() pass hook: counts the balls in play and checks every one is on the board
+//================================================================================================
+static uint32_t check_balls(void)
+{
+	uint32_t n = (uint32_t)__builtin_popcount(balls.in_play);
+	if (n > most_balls) most_balls = n;
+	for (uint32_t k = 0; k < BALL_COUNT; k++){
+		if (((balls.in_play >> k) & 1) && balls.position[k] >= NUM_of_GAMEBOARD_ROW){
+			off_board++;
+			break;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t run_ms = 600000; //10 minutes of play
+	uint32_t quiet = 0;
+	uint32_t itm = 0;
+	uint32_t seed = 1;
+	const char *record_path = NULL;
+	const char *replay_path = NULL;
+	uint32_t check = 0;
+	uint32_t check_wire = 0;
+	uint32_t speed = 0; //LEDs per second, 0 = DEFAULT_SPEED
+	const char *side = NULL;
+	const char *link_in_path = NULL;
+	const char *link_out_path = NULL;
+	uint32_t delay_us = 500;
+	uint32_t link_jitter_us = 0;
+
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+		if (!strcmp(arg, "-t")) { run_ms = strtoull(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-l")) { sim_loop_cycles = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-m")) { sim_left.model = sim_right.model = reaction_model(val); i++; }
+		else if (!strcmp(arg, "-r")) { sim_left.reaction_ms = sim_right.reaction_ms = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-j")) { sim_left.jitter_ms = sim_right.jitter_ms = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-x")) { sim_left.tail_ms = sim_right.tail_ms = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-h")) { sim_hold_ms = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-b")) { sim_bounces = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-R")) { record_path = val; i++; }
+		else if (!strcmp(arg, "-P")) { replay_path = val; i++; }
+		else if (!strcmp(arg, "-s")) { seed = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-v")) { speed = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-L")) { side = val; i++; }
+		else if (!strcmp(arg, "-i")) { link_in_path = val; i++; }
+		else if (!strcmp(arg, "-o")) { link_out_path = val; i++; }
+		else if (!strcmp(arg, "-D")) { delay_us = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-J")) { link_jitter_us = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-I")) { itm = 1; }
+		else if (!strcmp(arg, "-A")) { check = 1; }
+		else if (!strcmp(arg, "-W")) { check_wire = 1; }
+		else if (!strcmp(arg, "-q")) { quiet = 1; }
+		else {
+			fprintf(stderr, "usage: %s [-t ms] [-l loop_cycles] [-m uniform|gaussian|exgauss] [-r reaction_ms] [-j jitter_ms] [-x tail_ms] [-h hold_ms] [-b bounces] [-s seed] [-v speed] [-R file] [-P file] [-I] [-A] [-W] [-q] [-L left|right -i in_path -o out_path [-D delay_us] [-J jitter_us]]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (sim_loop_cycles == 0) sim_loop_cycles = 1;
+	if (itm && !PROFILING){
+		fprintf(stderr, "-I needs a build with PROFILING=1\n");
+		return 2;
+	}
+	if (check && BALL_ANIMATION != BALL_ANIMATION_DMA){
+		fprintf(stderr, "-A needs a build with BALL_ANIMATION=BALL_ANIMATION_DMA\n");
+		return 2;
+	}
+	if (check_wire && LED_OUTPUT != LED_OUTPUT_STRIP){
+		fprintf(stderr, "-W needs a build with LED_OUTPUT=LED_OUTPUT_STRIP\n");
+		return 2;
+	}
+	if ((LINK == LINK_UART) != (side != NULL) || (side && (!link_in_path || !link_out_path
+			|| (strcmp(side, "left") && strcmp(side, "right"))))){
+		fprintf(stderr, "a build with LINK=LINK_UART needs -L left|right, -i and -o, and others take none\n");
+		return 2;
+	}
+	if (sim_left.model == SIM_NUM_REACTION_MODELS){
+		fprintf(stderr, "unknown reaction model\n");
+		return 2;
+	}
+	if (replay_path){
+		return replay_file(replay_path);
+	}
+#if BALL_ANIMATION == BALL_ANIMATION_DMA
+	if (check){
+		return check_animation();
+	}
+#endif
+	sim_players_reset(seed);
+	sim_reset();
+	if (side){
+		//the way in is opened for writing as well: that never waits, so the two simulators cannot
+		//each wait for the other to open its way in, and it never reads end of file before the
+		//other has opened it. The other says when it has finished instead (sim_link_close()).
+		int in_fd = open(link_in_path, O_RDWR);
+		int out_fd = (in_fd < 0) ? -1 : open(link_out_path, O_WRONLY);
+		if (in_fd < 0 || out_fd < 0){
+			perror(in_fd < 0 ? link_in_path : link_out_path);
+			return 1;
+		}
+		signal(SIGPIPE, SIG_IGN); //the other side may finish first, see link_write()
+		uint32_t left = !strcmp(side, "left");
+		if (left) sim_GPIOC.IDR |= (1 << LINK_SIDE_PIN); //PC1 left open and pulled up
+		else sim_GPIOC.IDR &= ~(1 << LINK_SIDE_PIN); //tied to GND
+		sim_left.remote = !left;
+		sim_right.remote = left;
+		sim_link_open(in_fd, out_fd, (uint64_t)delay_us * (SIM_CLK_FREQ / 1000000),
+				(uint64_t)link_jitter_us * (SIM_CLK_FREQ / 1000000), seed + left);
+	}
+	configure_system();
+	if (speed){
+		tuning.default_speed = tuning.max_speed = (speed < BALL_TICK_HZ) ? speed : BALL_TICK_HZ - 1;
+	}
+#if PROFILING
+	memcpy(sim_profile_cost, profile_model_cycles, sizeof profile_model_cycles);
+	if (itm){
+		sim_itm_attach(1UL << PROFILE_ITM_PORT);
+	}
+#endif
+
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+	if (check_wire){
+		return check_strip(run_ms);
+	}
+#endif
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sim_play(run_ms, check_balls);
+	sim_link_close();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double wall = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (!quiet){
+		printf("simulated      %llu ms in %.3f s wall (%.1fx real time)\n",
+				(unsigned long long)run_ms, wall, wall > 0 ? (double)run_ms / 1000.0 / wall : 0.0);
+		printf("main loop      %llu iterations\n", (unsigned long long)sim_stats.loop_iterations);
+		printf("BSRR stores    %llu\n", (unsigned long long)sim_stats.bsrr_writes);
+		uint64_t sleep = IDLE_SLEEP_CYCLES();
+		uint64_t total = idle_stats.active_cycles + sleep;
+		printf("core           active %llu / sleep %llu cycles (%.2f%% idle), %u sleeps, %u wake-ups with work\n",
+				(unsigned long long)idle_stats.active_cycles, (unsigned long long)sleep,
+				total ? 100.0 * (double)sleep / (double)total : 0.0, idle_stats.sleeps, idle_stats.wakeups);
+		printf("clock          ");
+		for (uint32_t c = 0; c < NUM_of_CLOCK_SPEEDS; c++){
+			uint32_t ms = core_clock.ms[c] + ((core_clock.speed == c) ? msTimer - core_clock.since_ms : 0);
+			printf("%u MHz for %u ms, ", CORE_CLOCK_HZ(c) / 1000000, ms);
+		}
+		printf("%u switches, %llu faults\n", core_clock.switches, (unsigned long long)sim_stats.clock_faults);
+		printf("SysTick        %llu (%.0f ticks/s)\n", (unsigned long long)sim_stats.irq_count[SysTick_IRQn + 16],
+				wall > 0 ? (double)sim_stats.irq_count[SysTick_IRQn + 16] / wall : 0.0);
+		printf("TIM2           %llu\n", (unsigned long long)sim_stats.irq_count[TIM2_IRQn + 16]);
+		printf("DMA1           %llu transfers, %llu end of segment interrupts\n", (unsigned long long)sim_stats.dma_transfers,
+				(unsigned long long)sim_stats.irq_count[DMA1_Channel2_IRQn + 16]);
+#if BALL_COUNT > 1
+		printf("balls          up to %u in play at once, of %u\n", most_balls, BALL_COUNT);
+#endif
+		printf("board          %u passes found a ball off the GAMEBOARD row\n", off_board);
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+		printf("strip          %u pixels, %u frames, %u pixels encoded, %llu SPI bytes\n", BOARD_LENGTH, strip.frames,
+				strip.pixels_encoded, (unsigned long long)sim_stats.spi_bytes);
+#endif
+#if LINK == LINK_UART
+		printf("link           %s board, %llu bytes out, %u frames sent, %u received, %u resent, %u CRC errors, %u overruns, %u discarded, %u window full, %llu waits for the other side\n",
+				board_link.local == ONE ? "left" : "right", (unsigned long long)sim_stats.usart_bytes, board_link.frames_sent,
+				board_link.frames_received, board_link.frames_resent, board_link.crc_errors, board_link.overruns,
+				board_link.discarded, board_link.window_full, (unsigned long long)sim_stats.link_waits);
+		printf("rollback       %u rollbacks, mean %u worst %u ticks, %u inputs waited for their tick, %u score resyncs\n",
+				board_link.rollbacks, board_link.rollbacks ? board_link.rollback_ticks / board_link.rollbacks : 0,
+				board_link.worst_rollback, board_link.waited, board_link.resyncs);
+#endif
+		printf("EXTI1/4/15_10  %llu/%llu/%llu\n", (unsigned long long)sim_stats.irq_count[EXTI1_IRQn + 16],
+				(unsigned long long)sim_stats.irq_count[EXTI4_IRQn + 16], (unsigned long long)sim_stats.irq_count[EXTI15_10_IRQn + 16]);
+		printf("P1 (left)      presses %u misses %u wins %u\n", sim_left.presses, sim_left.misses, sim_left.wins);
+		printf("P2 (right)     presses %u misses %u wins %u\n", sim_right.presses, sim_right.misses, sim_right.wins);
+		printf("press stamps   worst error P1 %u us, P2 %u us\n", sim_left.stamp_error_us, sim_right.stamp_error_us);
+		printf("debounce       %s, edge to decision mean %llu us worst %u us over %u presses, %u/%u/%u bounces ignored\n",
+				DEBOUNCE_MODE == DEBOUNCE_LEADING_EDGE ? "leading edge" : "deferred",
+				input_latency.presses ? (unsigned long long)(input_latency.total_us / input_latency.presses) : 0ULL,
+				input_latency.worst_us, input_latency.presses,
+				buttons[0].bounces, buttons[1].bounces, buttons[2].bounces);
+		static const char *const task_names[NUM_of_TASKS] = { "link", "game", "move mode", "debounce" };
+		printf("tasks          priority, runs, modelled cycles per run mean and worst (-l), deadline misses, worst response\n");
+		for (uint32_t i = 0; i < NUM_of_TASKS; i++){
+			const struct Task *t = &tasks[i];
+			printf("  %-12s %u, %u runs, %llu / %u cycles, %u of %u late (%u us), worst %u us\n", task_names[i], t->priority,
+					t->runs, t->runs ? (unsigned long long)(t->total_cycles / t->runs) : 0ULL, t->worst_cycles,
+					t->misses, t->finished, t->deadline_us, t->worst_response_us);
+		}
+#if ADAPTIVE_DIFFICULTY
+		printf("difficulty     serve level %u, %u levels a hit, limit level %u\n",
+				difficulty.serve_level, difficulty.step, difficulty.limit_level);
+		for (uint32_t i = 0; i < 2; i++){
+			const struct Press_Stats *ps = i ? &P2.timing : &P1.timing;
+			printf("  P%u offset    mean %.1f ms sd %.1f ms p90 %.1f ms over the last %u presses\n", i + 1,
+					PRESS_STATS_MEAN_us(ps) / 1000.0, PRESS_STATS_DEVIATION_us(ps) / 1000.0, ps->p90_us / 1000.0, ps->count);
+		}
+#endif
+#if LATENCY_STATS
+		static const char *const latency_names[NUM_of_LATENCY_EVENTS] = { "hitzone off", "ball return", "move LED", "mode switch" };
+		printf("latency        button edge to LED commit, %u presses not timed\n", latency.unmatched);
+		for (uint32_t e = 0; e < NUM_of_LATENCY_EVENTS; e++){
+			const struct Latency_Stats *ls = &latency.stats[e];
+			if (ls->count){
+				printf("  %-12s %u presses, p50 %.2f us p99 %.2f us max %.2f us mean %.2f us, %u timed by usTimer\n",
+						latency_names[e], ls->count, LATENCY_PERCENTILE(e, 500) / 1000.0, LATENCY_PERCENTILE(e, 990) / 1000.0,
+						ls->max_ns / 1000.0, (double)ls->total_ns / ls->count / 1000.0, ls->coarse);
+			}
+		}
+#endif
+#if PROFILING
+		print_profile(itm);
+#endif
+		printf("recorder       %u of %u bytes, %u records, %u dropped, final state game_state %u LEDcount %u pace %u score P1 %u P2 %u\n",
+				recorder.head - recorder.tail, RECORDER_SIZE, recorder.records, recorder.dropped,
+				(unsigned)game_state, (unsigned)LEDcount, (unsigned)pace, (unsigned)P1.score, (unsigned)P2.score);
+	}
+#if STATS_LOG
+	if (!quiet){
+		printf("stats log      %u rounds written, %u dropped, %llu double-words programmed, %llu pages erased, %u errors, page %u next slot %u of %u\n",
+				stats_log.appended, stats_log.dropped, (unsigned long long)sim_stats.flash_programs,
+				(unsigned long long)sim_stats.flash_erases, stats_log.errors, stats_log.page, stats_log.slot, (unsigned)STATS_ROUNDS_PER_PAGE);
+		printf("lifetime       %u rounds, longest rally %u hits, max pace %u\n", stats_log.totals.rounds,
+				stats_log.totals.longest_rally, stats_log.totals.max_pace);
+		for (uint32_t i = 0; i < 2; i++){
+			const struct Player_Stats *ps = &stats_log.totals.player[i];
+			double mean_ms = ps->timed_hits ? (double)ps->reaction_sum_us / ps->timed_hits / 1000.0 : 0.0;
+			double var = ps->timed_hits ? (double)ps->reaction_sum_sq_ms / ps->timed_hits - mean_ms * mean_ms : 0.0;
+			printf("  P%u           %u games, %u rounds, %u hits, reaction mean %.1f ms sd %.1f ms best %.1f ms over %u timed hits\n",
+					i + 1, ps->games_won, ps->rounds_won, ps->hits, mean_ms, var > 0 ? sqrt(var) : 0.0,
+					ps->best_reaction_us / 1000.0, ps->timed_hits);
+		}
+	}
+#endif
+	if (record_path){
+		static uint8_t data[RECORDER_SIZE];
+		uint32_t length = RECORDER_DUMP(data, sizeof data);
+		FILE *f = fopen(record_path, "wb");
+		if (!f || fwrite(data, 1, length, f) != length){
+			perror(record_path);
+			return 1;
+		}
+		fclose(f);
+	}
+	return 0;
+}
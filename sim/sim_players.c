@@ -0,0 +1,190 @@
+#include <math.h>
+#include "sim_players.h"
+#include "../leds.h"
+/**
+**************************************************************************************************
+* @file sim_players.c
+* @brief Source file for the scripted players
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Two scripted players watch the GAMEBOARD LEDs and press their buttons a reaction time after
+* a ball leaves the last GAMEBOARD LED on their side for their hitzone, exactly like a person
+* looking at the board would. They tell a ball coming at them from one going away by where it
+* came from (the LED next to it going out as it lights), so this holds with several balls.
+* Reaction times come from their own generator, so a seed gives the same game no matter what
+* else the host process does. With sim_bounces set, every press and release bounces that many
+* extra times. Presses and releases are scheduled to the cycle with sim_schedule_button(), so
+* they can arrive in the middle of a handler.
+**************************************************************************************************
+*/
+#define GAMEZONE_FIRST (RIGHT_HITZONE_POS + 1) //first GAMEBOARD LED (right end)
+#define GAMEZONE_LAST (LEFT_HITZONE_POS - 1) //last GAMEBOARD LED (left end)
+
+struct sim_player sim_left = { .button = SIM_LEFT_BUTTON, .watch_led = GAMEZONE_LAST, .inward_led = GAMEZONE_LAST - 1,
+		.reaction_ms = 60, .jitter_ms = 40 };
+struct sim_player sim_right = { .button = SIM_RIGHT_BUTTON, .watch_led = GAMEZONE_FIRST, .inward_led = GAMEZONE_FIRST + 1,
+		.reaction_ms = 60, .jitter_ms = 40 };
+uint32_t sim_hold_ms = 60;
+uint32_t sim_bounces;
+const char *const sim_reaction_model_names[SIM_NUM_REACTION_MODELS] = { "uniform", "gaussian", "exgauss" };
+
+static uint64_t rng_state = 1; //xorshift64* state, never 0
+
+//================================================================================================
+// random_u32()
+// @parm: none
+// @return: next value of the players' xorshift64* generator
+//================================================================================================
+static uint32_t random_u32(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+//================================================================================================
+// random_unit()
+// @parm: none
+// @return: uniform value in (0, 1)
+//================================================================================================
+static double random_unit(void)
+{
+	return ((double)random_u32() + 0.5) / 4294967296.0;
+}
+//================================================================================================
+// reaction_time()
+// @parm: pl = scripted player
+// @return: core cycles from the ball entering the player's hitzone to the press, at least 1 ms
+//================================================================================================
+static uint64_t reaction_time(const struct sim_player *pl)
+{
+	double reaction = pl->reaction_ms;
+	switch (pl->model){
+	case SIM_REACTION_UNIFORM:
+		reaction += (2.0 * random_unit() - 1.0) * pl->jitter_ms;
+		break;
+	case SIM_REACTION_GAUSSIAN:
+	case SIM_REACTION_EXGAUSS: //Box-Muller, the second value is thrown away
+		reaction += pl->jitter_ms * sqrt(-2.0 * log(random_unit())) * cos(2.0 * M_PI * random_unit());
+		if (pl->model == SIM_REACTION_EXGAUSS){
+			reaction -= pl->tail_ms * log(random_unit());
+		}
+		break;
+	default:
+		break;
+	}
+	return (uint64_t)(((reaction > 1.0) ? reaction : 1.0) * (SIM_CLK_FREQ / 1000));
+}
+//================================================================================================
+// set_contact()
+// @parm: button = button to drive
+//        pressed = level the contact settles at
+//        at_cycle = when the contact first moves
+// @return: sim_cycles value at which the contact settles
+// 		Bounces the contact sim_bounces times before it settles
+//================================================================================================
+static uint64_t set_contact(enum sim_buttons button, uint32_t pressed, uint64_t at_cycle)
+{
+	for (uint32_t i = 0; i < sim_bounces; i++){
+		sim_schedule_button(button, pressed, at_cycle);
+		at_cycle += SIM_CLK_FREQ / 10000; //100 us between bounces
+		sim_schedule_button(button, !pressed, at_cycle);
+		at_cycle += SIM_CLK_FREQ / 10000;
+	}
+	sim_schedule_button(button, pressed, at_cycle);
+	return at_cycle;
+}
+//================================================================================================
+// update_player()
+// @parm: pl = scripted player
+//        p = firmware Player struct the scripted player controls
+// @return: none
+//================================================================================================
+static void update_player(struct sim_player *pl, struct Player *p)
+{
+	uint32_t lit = LED_IS_LIT(&LEDS[pl->watch_led]) | (LED_IS_LIT(&LEDS[pl->inward_led]) << 1);
+	uint32_t ball_left = 0;
+	if ((lit & 0x1) && !(pl->seen_lit & 0x1)){ //a ball came onto watch_led...
+		pl->incoming = (pl->seen_lit & 0x2) && !(lit & 0x2); //...from inward_led, so it is on its way in
+	}
+	else if (!(lit & 0x1) && (pl->seen_lit & 0x1)){ //it moved off
+		ball_left = pl->incoming;
+		pl->incoming = 0;
+	}
+	pl->seen_lit = lit;
+	if (ball_left && !pl->remote && sim_cycles >= pl->busy_until){
+		uint64_t press = sim_cycles + reaction_time(pl);
+		uint64_t release = set_contact(pl->button, 1, press) + (uint64_t)sim_hold_ms * (SIM_CLK_FREQ / 1000);
+		pl->busy_until = set_contact(pl->button, 0, release);
+		pl->pressed_us = (uint32_t)(press / (SIM_CLK_FREQ / 1000000));
+		pl->presses++;
+	}
+	if (!pl->remote && p->pressTIME_STAMP && p->pressTIME_STAMP != pl->seen_stamp){ //the firmware took a new press
+		uint32_t error = p->pressTIME_STAMP - pl->pressed_us;
+		if (error >= 0x80000000) error = -error;
+		if (error > pl->stamp_error_us) pl->stamp_error_us = error;
+	}
+	pl->seen_stamp = p->pressTIME_STAMP;
+	if (p->missFLAG && !pl->was_missed) pl->misses++;
+	if (p->winnerFLAG && !pl->was_winner) pl->wins++;
+	pl->was_missed = p->missFLAG;
+	pl->was_winner = p->winnerFLAG;
+}
+//================================================================================================
+// sim_players_reset()
+// @parm: seed = reaction time generator seed
+// @return: none
+// 		Clears both players' progress and counters, keeping their settings
+//================================================================================================
+void sim_players_reset(uint64_t seed)
+{
+	struct sim_player *players[] = { &sim_left, &sim_right };
+	for (uint32_t i = 0; i < 2; i++){
+		struct sim_player *pl = players[i];
+		struct sim_player settings = { .button = pl->button, .watch_led = pl->watch_led, .inward_led = pl->inward_led,
+				.model = pl->model, .reaction_ms = pl->reaction_ms, .jitter_ms = pl->jitter_ms, .tail_ms = pl->tail_ms,
+				.remote = pl->remote };
+		*pl = settings;
+	}
+	rng_state = seed * 0x9E3779B97F4A7C15ULL + 1; //spread small seeds, never 0
+	random_u32();
+}
+//================================================================================================
+// sim_players_tick()
+// @parm: none
+// @return: none
+// 		Lets both players look at the board. Called once per simulated millisecond.
+//================================================================================================
+void sim_players_tick(void)
+{
+	update_player(&sim_left, &P1);
+	update_player(&sim_right, &P2);
+}
+//================================================================================================
+// sim_play()
+// @parm: run_ms = simulated time to play until
+//        after_pass = called after every main loop pass, play stops when it returns non-zero.
+//                     May be NULL.
+// @return: simulated time (ms) when play stopped
+// 		Runs the firmware main loop against the scripted players. The board must already be up
+// 		(configure_system()).
+//================================================================================================
+uint64_t sim_play(uint64_t run_ms, uint32_t (*after_pass)(void))
+{
+	uint64_t now = sim_time_ms();
+	uint64_t end_cycles = run_ms * (SIM_CLK_FREQ / 1000);
+	while (sim_cycles < end_cycles){
+		HANDLE_MAIN_LOOP();
+		sim_stats.loop_iterations++;
+		if (after_pass && after_pass()){
+			break;
+		}
+		sim_advance(sim_loop_cycles);
+		if (sim_time_ms() != now){ //players look at the board once per millisecond
+			now = sim_time_ms();
+			sim_players_tick();
+		}
+	}
+	return sim_time_ms();
+}
@@ -0,0 +1,58 @@
+/**
+**************************************************************************************************
+* @file sim_players.h
+* @brief Header file for the scripted players
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for sim_players.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the scripted players that watch the GAMEBOARD LEDs and press the emulated buttons
+**************************************************************************************************
+*/
+#ifndef SIM_PLAYERS_H
+#define SIM_PLAYERS_H
+
+#include <stdint.h>
+#include "sim_hw.h"
+#include "../main.h"
+
+//How a scripted player's reaction time is drawn
+enum sim_reaction_models {
+	SIM_REACTION_UNIFORM, //reaction_ms +/- jitter_ms, flat
+	SIM_REACTION_GAUSSIAN, //normal, mean reaction_ms, standard deviation jitter_ms
+	SIM_REACTION_EXGAUSS, //normal plus an exponential tail of mean tail_ms, the usual fit for human reaction times
+	SIM_NUM_REACTION_MODELS
+};
+
+struct sim_player {
+	enum sim_buttons button; //button the player presses
+	uint32_t watch_led; //GAMEBOARD LED the ball leaves when it enters this player's hitzone
+	uint32_t inward_led; //GAMEBOARD LED next to watch_led, towards the middle
+	enum sim_reaction_models model;
+	uint32_t reaction_ms; //mean reaction time (of the normal part for SIM_REACTION_EXGAUSS)
+	uint32_t jitter_ms; //reaction time spread, see enum sim_reaction_models
+	uint32_t tail_ms; //mean of the exponential tail, SIM_REACTION_EXGAUSS only
+	uint32_t remote; //1 if the player is on the other linked board: never presses here, only counts
+	uint64_t busy_until; //sim_cycles value when the last scheduled press has been released
+	uint32_t presses;
+	uint32_t misses;
+	uint32_t wins;
+	uint32_t was_missed; //last seen missFLAG
+	uint32_t was_winner; //last seen winnerFLAG
+	uint32_t seen_lit; //watch_led in bit 0 and inward_led in bit 1, as last seen lit
+	uint32_t incoming; //1 if the ball on watch_led came from inward_led
+	uint32_t pressed_us; //simulated time of the last press, in usTimer counts
+	uint32_t seen_stamp; //last seen Player.pressTIME_STAMP
+	uint32_t stamp_error_us; //largest |pressTIME_STAMP - pressed_us| seen
+};
+
+extern struct sim_player sim_left, sim_right; //control P1 and P2
+extern uint32_t sim_hold_ms; //how long a press is held down
+extern uint32_t sim_bounces; //extra contact bounces on every press and release
+extern const char *const sim_reaction_model_names[SIM_NUM_REACTION_MODELS];
+
+void sim_players_reset(uint64_t seed);
+void sim_players_tick(void);
+uint64_t sim_play(uint64_t run_ms, uint32_t (*after_pass)(void));
+
+#endif /* SIM_PLAYERS_H */
@@ -0,0 +1,386 @@
+/**
+**************************************************************************************************
+* @file stm32l476xx.h
+* @brief Host stand-in for the CMSIS device header
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for the host simulator (sim/)
+* ------------------------------------------------------------------------------------------------
+* Provides the subset of the STM32L476xx register map used by the game. Every peripheral is a
+* plain struct living in host RAM (see sim_hw.c), so the unmodified game sources can be compiled
+* and run on Linux. Only fields and bit masks the firmware actually touches are guaranteed.
+**************************************************************************************************
+*/
+#ifndef SIM_STM32L476XX_H
+#define SIM_STM32L476XX_H
+
+#include <stdint.h>
+
+#define __IO volatile
+#define __I volatile const
+
+//IRQ numbers (matches the vector positions of the real device)
+typedef enum {
+	SysTick_IRQn = -1,
+	FLASH_IRQn = 4,
+	EXTI0_IRQn = 6,
+	EXTI1_IRQn = 7,
+	EXTI2_IRQn = 8,
+	EXTI3_IRQn = 9,
+	EXTI4_IRQn = 10,
+	DMA1_Channel1_IRQn = 11,
+	DMA1_Channel2_IRQn = 12,
+	DMA1_Channel3_IRQn = 13,
+	DMA1_Channel4_IRQn = 14,
+	DMA1_Channel5_IRQn = 15,
+	DMA1_Channel6_IRQn = 16,
+	DMA1_Channel7_IRQn = 17,
+	EXTI9_5_IRQn = 23,
+	TIM2_IRQn = 28,
+	USART2_IRQn = 38,
+	EXTI15_10_IRQn = 40,
+	TIM5_IRQn = 50
+} IRQn_Type;
+
+#define SIM_NUM_IRQS 82 //number of device interrupts on the STM32L476
+
+//Structures (register blocks)
+typedef struct {
+	__IO uint32_t MODER;
+	__IO uint32_t OTYPER;
+	__IO uint32_t OSPEEDR;
+	__IO uint32_t PUPDR;
+	__IO uint32_t IDR;
+	__IO uint32_t ODR;
+	__IO uint32_t BSRR;
+	__IO uint32_t LCKR;
+	__IO uint32_t AFR[2];
+	__IO uint32_t BRR;
+	__IO uint32_t ASCR;
+} GPIO_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SMCR;
+	__IO uint32_t DIER;
+	__IO uint32_t SR;
+	__IO uint32_t EGR;
+	__IO uint32_t CCMR1;
+	__IO uint32_t CCMR2;
+	__IO uint32_t CCER;
+	__IO uint32_t CNT;
+	__IO uint32_t PSC;
+	__IO uint32_t ARR;
+	__IO uint32_t RCR;
+	__IO uint32_t CCR1;
+	__IO uint32_t CCR2;
+	__IO uint32_t CCR3;
+	__IO uint32_t CCR4;
+	__IO uint32_t BDTR;
+	__IO uint32_t DCR;
+	__IO uint32_t DMAR;
+	__IO uint32_t OR1;
+	__IO uint32_t CCMR3;
+	__IO uint32_t CCR5;
+	__IO uint32_t CCR6;
+	__IO uint32_t OR2;
+	__IO uint32_t OR3;
+} TIM_TypeDef;
+
+typedef struct {
+	__IO uint32_t ISR;
+	__IO uint32_t IFCR;
+} DMA_TypeDef;
+
+//CPAR and CMAR hold bus addresses on the device. Here they hold host pointers, see DMA_ADDRESS.
+typedef struct {
+	__IO uint32_t CCR;
+	__IO uint32_t CNDTR;
+	__IO uintptr_t CPAR;
+	__IO uintptr_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	__IO uint32_t CSELR;
+} DMA_Request_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SR;
+	__IO uint32_t DR;
+	__IO uint32_t CRCPR;
+	__IO uint32_t RXCRCPR;
+	__IO uint32_t TXCRCPR;
+} SPI_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t CR3;
+	__IO uint32_t BRR;
+	__IO uint32_t GTPR;
+	__IO uint32_t RTOR;
+	__IO uint32_t RQR;
+	__IO uint32_t ISR;
+	__IO uint32_t ICR;
+	__IO uint32_t RDR;
+	__IO uint32_t TDR;
+} USART_TypeDef;
+
+typedef struct {
+	__IO uint32_t CTRL;
+	__IO uint32_t LOAD;
+	__IO uint32_t VAL;
+	__I uint32_t CALIB;
+} SysTick_Type;
+
+typedef struct {
+	__IO uint32_t IMR1;
+	__IO uint32_t EMR1;
+	__IO uint32_t RTSR1;
+	__IO uint32_t FTSR1;
+	__IO uint32_t SWIER1;
+	__IO uint32_t PR1;
+	uint32_t RESERVED1;
+	uint32_t RESERVED2;
+	__IO uint32_t IMR2;
+	__IO uint32_t EMR2;
+	__IO uint32_t RTSR2;
+	__IO uint32_t FTSR2;
+	__IO uint32_t SWIER2;
+	__IO uint32_t PR2;
+} EXTI_TypeDef;
+
+typedef struct {
+	__IO uint32_t MEMRMP;
+	__IO uint32_t CFGR1;
+	__IO uint32_t EXTICR[4];
+	__IO uint32_t SCSR;
+	__IO uint32_t CFGR2;
+	__IO uint32_t SWPR;
+	__IO uint32_t SKR;
+} SYSCFG_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR;
+	__IO uint32_t ICSCR;
+	__IO uint32_t CFGR;
+	__IO uint32_t PLLCFGR;
+	__IO uint32_t PLLSAI1CFGR;
+	__IO uint32_t PLLSAI2CFGR;
+	__IO uint32_t CIER;
+	__IO uint32_t CIFR;
+	__IO uint32_t CICR;
+	uint32_t RESERVED0;
+	__IO uint32_t AHB1RSTR;
+	__IO uint32_t AHB2RSTR;
+	__IO uint32_t AHB3RSTR;
+	uint32_t RESERVED1;
+	__IO uint32_t APB1RSTR1;
+	__IO uint32_t APB1RSTR2;
+	__IO uint32_t APB2RSTR;
+	uint32_t RESERVED2;
+	__IO uint32_t AHB1ENR;
+	__IO uint32_t AHB2ENR;
+	__IO uint32_t AHB3ENR;
+	uint32_t RESERVED3;
+	__IO uint32_t APB1ENR1;
+	__IO uint32_t APB1ENR2;
+	__IO uint32_t APB2ENR;
+	uint32_t RESERVED4;
+	__IO uint32_t AHB1SMENR;
+	__IO uint32_t AHB2SMENR;
+	__IO uint32_t AHB3SMENR;
+	uint32_t RESERVED5;
+	__IO uint32_t APB1SMENR1;
+	__IO uint32_t APB1SMENR2;
+	__IO uint32_t APB2SMENR;
+	uint32_t RESERVED6;
+	__IO uint32_t CCIPR;
+} RCC_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t CR3;
+	__IO uint32_t CR4;
+	__IO uint32_t SR1;
+	__IO uint32_t SR2;
+	__IO uint32_t SCR;
+} PWR_TypeDef;
+
+typedef struct {
+	__IO uint32_t ACR;
+	__IO uint32_t PDKEYR;
+	__IO uint32_t KEYR;
+	__IO uint32_t OPTKEYR;
+	__IO uint32_t SR;
+	__IO uint32_t CR;
+	__IO uint32_t ECCR;
+	uint32_t RESERVED1;
+	__IO uint32_t OPTR;
+} FLASH_TypeDef;
+
+typedef struct {
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT;
+	__IO uint32_t CPICNT;
+	__IO uint32_t EXCCNT;
+	__IO uint32_t SLEEPCNT;
+	__IO uint32_t LSUCNT;
+	__IO uint32_t FOLDCNT;
+	__I uint32_t PCSR;
+} DWT_Type;
+
+typedef struct {
+	__IO uint32_t DHCSR;
+	__IO uint32_t DCRSR;
+	__IO uint32_t DCRDR;
+	__IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+	__IO union {
+		__IO uint8_t u8;
+		__IO uint16_t u16;
+		__IO uint32_t u32;
+	} PORT[32];
+	uint32_t RESERVED0[864];
+	__IO uint32_t TER;
+	uint32_t RESERVED1[15];
+	__IO uint32_t TPR;
+	uint32_t RESERVED2[15];
+	__IO uint32_t TCR;
+} ITM_Type;
+
+#define ITM_TCR_ITMENA_Msk (1UL << 0)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+//SysTick bit masks
+#define SysTick_CTRL_ENABLE_Msk (1UL << 0)
+#define SysTick_CTRL_TICKINT_Msk (1UL << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk (1UL << 2)
+#define SysTick_CTRL_COUNTFLAG_Msk (1UL << 16)
+
+//Peripheral instances (see sim_hw.c)
+extern GPIO_TypeDef sim_GPIOA, sim_GPIOB, sim_GPIOC;
+extern TIM_TypeDef sim_TIM2, sim_TIM5;
+extern DMA_TypeDef sim_DMA1;
+extern DMA_Channel_TypeDef sim_DMA1_Channel[7];
+extern DMA_Request_TypeDef sim_DMA1_CSELR;
+extern SPI_TypeDef sim_SPI1;
+extern USART_TypeDef sim_USART2;
+extern SysTick_Type sim_SysTick;
+extern EXTI_TypeDef sim_EXTI;
+extern SYSCFG_TypeDef sim_SYSCFG;
+extern RCC_TypeDef sim_RCC;
+extern PWR_TypeDef sim_PWR;
+extern FLASH_TypeDef sim_FLASH;
+extern DWT_Type sim_DWT;
+extern CoreDebug_Type sim_CoreDebug;
+extern ITM_Type sim_ITM;
+
+#define GPIOA (&sim_GPIOA)
+#define GPIOB (&sim_GPIOB)
+#define GPIOC (&sim_GPIOC)
+#define TIM2 (&sim_TIM2)
+#define TIM5 (&sim_TIM5)
+#define DMA1 (&sim_DMA1)
+#define DMA1_Channel1 (&sim_DMA1_Channel[0])
+#define DMA1_Channel2 (&sim_DMA1_Channel[1])
+#define DMA1_Channel3 (&sim_DMA1_Channel[2])
+#define DMA1_Channel4 (&sim_DMA1_Channel[3])
+#define DMA1_Channel5 (&sim_DMA1_Channel[4])
+#define DMA1_Channel6 (&sim_DMA1_Channel[5])
+#define DMA1_Channel7 (&sim_DMA1_Channel[6])
+#define DMA1_CSELR (&sim_DMA1_CSELR)
+#define SPI1 (&sim_SPI1)
+#define USART2 (&sim_USART2)
+#define SysTick (&sim_SysTick)
+#define EXTI (&sim_EXTI)
+#define SYSCFG (&sim_SYSCFG)
+#define RCC (&sim_RCC)
+#define PWR (&sim_PWR)
+#define FLASH (&sim_FLASH)
+#define DWT (&sim_DWT)
+#define CoreDebug (&sim_CoreDebug)
+#define ITM (&sim_ITM)
+
+//BSRR is write-only on the device and acts on ODR. A plain struct field cannot, so GPIO_BSRR_WRITE
+//(see main.h) is routed to the simulator, which applies the store to ODR atomically.
+void sim_gpio_bsrr_write(GPIO_TypeDef *port, uint32_t value);
+#define GPIO_BSRR_WRITE(port, value) sim_gpio_bsrr_write((port), (value))
+
+//DMA channels are emulated by sim_hw.c, which follows the host pointers in CPAR and CMAR
+#define DMA_ADDRESS(pointer) ((uintptr_t)(pointer))
+
+//A timer's update event restarts its counter and prescaler on the store itself, so TIM_UPDATE_EVENT
+//(see main.h) is routed to the simulator rather than left in EGR until time next moves
+void sim_tim_update_event(TIM_TypeDef *tim);
+#define TIM_UPDATE_EVENT(tim) sim_tim_update_event(tim)
+
+//TDR and RDR are the two ends of USART2's shifters. A store to TDR starts the byte on its way and a
+//load of RDR clears RXNE, so USART_WRITE_TDR and USART_READ_RDR (see main.h) are routed to the
+//simulator, which moves the bytes to and from the other board (see sim_link_open() in sim_hw.h).
+void sim_usart_write_tdr(USART_TypeDef *usart, uint32_t byte);
+uint32_t sim_usart_read_rdr(USART_TypeDef *usart);
+#define USART_WRITE_TDR(usart, byte) sim_usart_write_tdr((usart), (byte))
+#define USART_READ_RDR(usart) sim_usart_read_rdr(usart)
+
+//Flash bank 2 is modelled by sim_hw.c: a program or erase takes its data sheet time and can be cut
+//short by a power cut (sim_flash_power_cut()). FLASH_READ_DOUBLE, FLASH_PROGRAM_DOUBLE and
+//FLASH_CR_WRITE (see main.h) are routed to it, so each acts at the access.
+uint64_t sim_flash_read_double(uint32_t address);
+void sim_flash_program_double(uint32_t address, uint64_t value);
+void sim_flash_cr_write(uint32_t value);
+#define FLASH_READ_DOUBLE(address) sim_flash_read_double(address)
+#define FLASH_PROGRAM_DOUBLE(address, value) sim_flash_program_double((address), (value))
+#define FLASH_CR_WRITE(value) sim_flash_cr_write(value)
+
+//Ready flags, SWS and VOSF only change when the firmware waits for them (CLOCK_WAIT, see main.h).
+//The simulator settles the clock tree at that point, and checks the new clock against the
+//voltage range and flash wait states.
+void sim_clock_settle(void);
+#define CLOCK_WAIT(condition) do { sim_clock_settle(); } while (!(condition))
+
+//Stimulus port stores are likewise routed to the simulator, which captures them and keeps the
+//port busy for as long as SWO takes to send a word. See profile.h.
+uint32_t sim_itm_ready(uint32_t port);
+void sim_itm_write(uint32_t port, uint32_t value);
+#define ITM_PORT_READY(port) sim_itm_ready(port)
+#define ITM_WRITE_PORT(port, value) sim_itm_write((port), (value))
+
+//Emulated code takes no simulated time. The profiler calls PROFILE_MODEL_COST() before reading
+//the exit time, and the simulator charges the cost it was given for that point (see profile.h).
+void sim_profile_model_cost(uint32_t point);
+#define PROFILE_MODEL_COST(point) sim_profile_model_cost(point)
+//The same for a task the scheduler has just run, so its response times and deadlines see time
+//pass (see scheduler.h).
+void sim_task_model_cost(uint32_t task);
+#define TASK_MODEL_COST(task) sim_task_model_cost(task)
+
+//CMSIS core intrinsics. PRIMASK and WFI are emulated: WFI fast-forwards simulated time to the
+//next interrupt request, which is how the host runs far faster than real time.
+void sim_disable_irq(void);
+void sim_enable_irq(void);
+void sim_wfi(void);
+uint32_t sim_get_primask(void);
+void sim_set_primask(uint32_t value);
+#define __DMB() __atomic_signal_fence(__ATOMIC_SEQ_CST) //the emulated interrupts run on the same thread
+#define __disable_irq() sim_disable_irq()
+#define __enable_irq() sim_enable_irq()
+#define __WFI() sim_wfi()
+#define __get_PRIMASK() sim_get_primask()
+#define __set_PRIMASK(value) sim_set_primask(value)
+
+//CMSIS NVIC functions, emulated by sim_hw.c
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+
+#endif /* SIM_STM32L476XX_H */
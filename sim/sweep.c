@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim_hw.h"
+#include "sim_players.h"
+#include "../main.h"
+#include "../ball.h"
+/**
+**************************************************************************************************
+* @file sweep.c
+* @brief Host batch simulator for sweeping the game's timing constants
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Plays many independent games of the unmodified firmware against the scripted players in
+* sim_players.c, one job per (parameter point, seed), and reports rally lengths, how rounds are
+* lost and throughput for every point of the sweep.
+*
+* The firmware keeps its state in globals, so every job runs in its own forked process started
+* from the untouched image. One worker per core takes jobs from its own slice of the job list
+* and, once that is empty, steals the back half of the fullest other slice. The slices live in
+* shared memory as packed {begin, end} words changed only by compare-and-swap.
+*
+* Each -p names one constant and the values it takes, either lo:hi[:step] or a,b,c. Every
+* combination of the given values is a point. Constants not named keep their defaults.
+*
+*	usage: pong_sweep [-p name=values]... [-n seeds] [-g games] [-t max_ms] [-w workers]
+*	                  [-m model] [-r reaction_ms] [-j jitter_ms] [-x tail_ms] [-b bounces] [-c]
+**************************************************************************************************
+*/
+#define MAX_PARAMS 8 //constants swept at once
+#define MAX_VALUES 64 //values per constant
+#define MAX_WORKERS 256
+#define RALLY_BUCKETS 32 //hits per round, the last bucket counts that many or more
+
+//Constants that can be swept. Game timing goes to struct Game_Tuning, the rest to the players.
+enum sweep_constants { SW_SPEED, SW_STEP, SW_MAX, SW_TIMEOUT, SW_TOGGLE, SW_DEBOUNCE,
+	SW_REACTION, SW_JITTER, SW_TAIL, NUM_of_SWEEP_CONSTANTS };
+
+static const char *const constant_names[NUM_of_SWEEP_CONSTANTS] = {
+	"speed", "step", "max", "timeout", "toggle", "debounce", "reaction", "jitter", "tail"
+};
+
+struct sweep_param{
+	enum sweep_constants constant;
+	uint32_t count; //number of values
+	uint32_t values[MAX_VALUES];
+};
+
+//What one job saw, written by the job's process into shared memory
+struct sweep_result{
+	uint32_t done; //1 once the job's process has finished
+	uint32_t games; //games won by either player
+	uint32_t rounds; //rounds lost by either player
+	uint32_t hits;
+	uint32_t early; //rounds lost by pressing before the ball reached the hitzone
+	uint32_t late; //rounds lost by letting the ball through the hitzone
+	uint32_t max_rally; //most hits in one round
+	uint32_t max_pace; //fastest pace reached, Q16.16 LEDs per second
+	uint64_t pace_at_miss; //sum of the pace at every lost round, for the mean, Q16.16 LEDs per second
+	uint64_t sim_ms; //simulated time played
+	uint32_t rally[RALLY_BUCKETS]; //rounds by number of hits
+};
+
+struct sweep_shared{
+	_Atomic uint64_t slices[MAX_WORKERS]; //begin in the low half, end in the high half
+	atomic_uint steals;
+	struct sweep_result results[]; //one per job
+};
+
+static struct sweep_param params[MAX_PARAMS];
+static uint32_t num_params;
+static uint32_t seeds = 4; //jobs per point
+static uint32_t games_per_job = 5;
+static uint64_t max_ms = 3600000; //a job gives up after an hour of simulated play
+static struct sweep_shared *shared;
+
+//state of the job running in this process, see observe_pass()
+static struct sweep_result *job;
+static enum game_states last_state;
+static uint32_t rally_hits;
+static uint32_t was_winner;
+
+//================================================================================================
+// apply_constant()
+// @parm: constant = what to set
+//        value = value to give it
+// @return: none
+//================================================================================================
+static void apply_constant(enum sweep_constants constant, uint32_t value)
+{
+	switch (constant){
+	case SW_SPEED: tuning.default_speed = value; break;
+	case SW_STEP: tuning.pace_step = value; break;
+	case SW_MAX: tuning.max_speed = value; break;
+	case SW_TIMEOUT: tuning.time_out_ms = value; break;
+	case SW_TOGGLE: tuning.hitzone_toggle_ms = value; break;
+	case SW_DEBOUNCE: tuning.debounce_ms = value; break;
+	case SW_REACTION: sim_left.reaction_ms = sim_right.reaction_ms = value; break;
+	case SW_JITTER: sim_left.jitter_ms = sim_right.jitter_ms = value; break;
+	case SW_TAIL: sim_left.tail_ms = sim_right.tail_ms = value; break;
+	default: break;
+	}
+}
+//================================================================================================
+// point_value()
+// @parm: point = index into the sweep's points
+//        param = index into params[]
+// @return: value params[param] takes at that point
+//================================================================================================
+static uint32_t point_value(uint32_t point, uint32_t param)
+{
+	for (uint32_t i = num_params - 1; i > param; i--){
+		point /= params[i].count;
+	}
+	return params[param].values[point % params[param].count];
+}
+//================================================================================================
+// parse_param()
+// @parm: arg = name=lo:hi[:step] or name=a,b,c
+// @return: 0 on success, -1 if arg is not understood
+//================================================================================================
+static int parse_param(const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	if (!eq || num_params == MAX_PARAMS){
+		return -1;
+	}
+	struct sweep_param *p = &params[num_params];
+	p->constant = NUM_of_SWEEP_CONSTANTS;
+	for (uint32_t i = 0; i < NUM_of_SWEEP_CONSTANTS; i++){
+		if (strlen(constant_names[i]) == (size_t)(eq - arg) && !strncmp(arg, constant_names[i], (size_t)(eq - arg))){
+			p->constant = (enum sweep_constants)i;
+		}
+	}
+	if (p->constant == NUM_of_SWEEP_CONSTANTS){
+		return -1;
+	}
+	char *end;
+	uint32_t first = (uint32_t)strtoul(eq + 1, &end, 0);
+	p->count = 0;
+	if (*end == ':'){
+		uint32_t last = (uint32_t)strtoul(end + 1, &end, 0);
+		uint32_t step = (*end == ':') ? (uint32_t)strtoul(end + 1, &end, 0) : 1;
+		if (*end || step == 0 || last < first){
+			return -1;
+		}
+		for (uint64_t v = first; v <= last && p->count < MAX_VALUES; v += step){
+			p->values[p->count++] = (uint32_t)v;
+		}
+	}
+	else{
+		p->values[p->count++] = first;
+		while (*end == ',' && p->count < MAX_VALUES){
+			p->values[p->count++] = (uint32_t)strtoul(end + 1, &end, 0);
+		}
+		if (*end){
+			return -1;
+		}
+	}
+	num_params++;
+	return 0;
+}
+//================================================================================================
+// observe_pass()
+// @parm: none
+// @return: 1 once the job has seen enough games, 0 to keep playing
+// 		Called after every main loop pass. Hits, misses and serves only happen in the main loop,
+// 		so comparing game_state with the previous pass sees each of them.
+//================================================================================================
+static uint32_t observe_pass(void)
+{
+	enum game_states state = game_state;
+	if (state != last_state){
+		switch (state){
+		case MOVE_RIGHT:
+		case MOVE_LEFT:
+			if (last_state != INITIAL_SERVE){ //the ball came back
+				rally_hits++;
+				job->hits++;
+				if (BALL_SPEED(pace) > job->max_pace) job->max_pace = BALL_SPEED(pace);
+			}
+			break;
+		case P1_LOST:
+		case P2_LOST:
+		case P1_WINNERS_CIRCLE:
+		case P2_WINNERS_CIRCLE:
+			if (last_state == MOVE_LEFT || last_state == MOVE_RIGHT){
+				job->early++;
+			}
+			else{
+				job->late++;
+			}
+			job->rounds++;
+			job->pace_at_miss += BALL_SPEED(pace);
+			job->rally[rally_hits < RALLY_BUCKETS ? rally_hits : RALLY_BUCKETS - 1]++;
+			if (rally_hits > job->max_rally) job->max_rally = rally_hits;
+			rally_hits = 0;
+			break;
+		default:
+			break;
+		}
+		last_state = state;
+	}
+	uint32_t winner = P1.winnerFLAG | P2.winnerFLAG;
+	if (winner && !was_winner){
+		job->games++;
+	}
+	was_winner = winner;
+	return job->games >= games_per_job;
+}
+//================================================================================================
+// run_job()
+// @parm: index = job number, point * seeds + seed
+// @return: none
+// 		Runs in a freshly forked process, so the firmware starts from its initial globals
+//================================================================================================
+static void run_job(uint32_t index)
+{
+	uint32_t point = index / seeds;
+	for (uint32_t i = 0; i < num_params; i++){
+		apply_constant(params[i].constant, point_value(point, i));
+	}
+	job = &shared->results[index];
+	last_state = game_state;
+	sim_players_reset(index % seeds + 1);
+	sim_reset();
+	configure_system();
+	job->sim_ms = sim_play(max_ms, observe_pass);
+	job->done = 1;
+}
+//================================================================================================
+// take_job()
+// @parm: worker = this worker's slice
+//        workers = number of slices
+// @return: next job number, -1 once every slice is empty
+//================================================================================================
+static int64_t take_job(uint32_t worker, uint32_t workers)
+{
+	while (1){
+		uint64_t mine = atomic_load(&shared->slices[worker]);
+		uint32_t begin = (uint32_t)mine, end = (uint32_t)(mine >> 32);
+		if (begin < end){
+			if (atomic_compare_exchange_weak(&shared->slices[worker], &mine, mine + 1)){
+				return begin;
+			}
+			continue; //a thief moved our end
+		}
+		//steal the back half of the fullest slice
+		uint32_t victim = workers, most = 0;
+		uint64_t seen = 0;
+		for (uint32_t i = 0; i < workers; i++){
+			uint64_t s = atomic_load(&shared->slices[i]);
+			uint32_t left = (uint32_t)(s >> 32) - (uint32_t)s;
+			if ((uint32_t)s < (uint32_t)(s >> 32) && left > most){
+				victim = i;
+				most = left;
+				seen = s;
+			}
+		}
+		if (victim == workers){
+			return -1;
+		}
+		uint32_t v_begin = (uint32_t)seen, v_end = (uint32_t)(seen >> 32);
+		uint32_t mid = v_end - (most + 1) / 2;
+		if (atomic_compare_exchange_strong(&shared->slices[victim], &seen, ((uint64_t)mid << 32) | v_begin)){
+			atomic_fetch_add(&shared->steals, 1);
+			//our slice is empty, so no thief will touch it before this store
+			atomic_store(&shared->slices[worker], ((uint64_t)v_end << 32) | (mid + 1));
+			return mid;
+		}
+	}
+}
+//================================================================================================
+// worker()
+// @parm: id = this worker's slice
+//        workers = number of slices
+// @return: none
+//================================================================================================
+static void worker(uint32_t id, uint32_t workers)
+{
+	int64_t index;
+	while ((index = take_job(id, workers)) >= 0){
+		pid_t pid = fork();
+		if (pid == 0){
+			run_job((uint32_t)index);
+			_exit(0);
+		}
+		if (pid > 0){
+			waitpid(pid, NULL, 0);
+		}
+	}
+}
+//================================================================================================
+// rally_percentile()
+// @parm: rally = rounds by number of hits
+//        rounds = total rounds
+//        fraction = 0.5 for the median and so on
+// @return: hits in the round at that fraction of the distribution
+//================================================================================================
+static uint32_t rally_percentile(const uint32_t *rally, uint32_t rounds, double fraction)
+{
+	uint64_t want = (uint64_t)(fraction * rounds + 0.5), seen = 0;
+	for (uint32_t i = 0; i < RALLY_BUCKETS; i++){
+		seen += rally[i];
+		if (seen >= want && seen){
+			return i;
+		}
+	}
+	return RALLY_BUCKETS - 1;
+}
+//================================================================================================
+// report()
+// @parm: points = number of points in the sweep
+//        csv = 1 for comma separated output
+// @return: number of jobs that did not finish
+//================================================================================================
+static uint32_t report(uint32_t points, uint32_t csv)
+{
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < num_params; i++){
+		printf(csv ? "%s," : "%8s ", constant_names[params[i].constant]);
+	}
+	printf(csv ? "games,rounds,rally_mean,rally_p50,rally_p90,rally_max,early_pct,late_pct,pace_at_miss,max_pace,games_per_hour\n"
+			: "   games  rounds   rally mean/p50/p90/max   early%%  late%%  pace@miss   max  games/h\n");
+	for (uint32_t point = 0; point < points; point++){
+		struct sweep_result sum = {0};
+		for (uint32_t s = 0; s < seeds; s++){
+			const struct sweep_result *r = &shared->results[point * seeds + s];
+			if (!r->done){
+				failed++;
+				continue;
+			}
+			sum.games += r->games;
+			sum.rounds += r->rounds;
+			sum.hits += r->hits;
+			sum.early += r->early;
+			sum.late += r->late;
+			sum.pace_at_miss += r->pace_at_miss;
+			sum.sim_ms += r->sim_ms;
+			if (r->max_rally > sum.max_rally) sum.max_rally = r->max_rally;
+			if (r->max_pace > sum.max_pace) sum.max_pace = r->max_pace;
+			for (uint32_t b = 0; b < RALLY_BUCKETS; b++){
+				sum.rally[b] += r->rally[b];
+			}
+		}
+		double rounds = sum.rounds ? (double)sum.rounds : 1.0;
+		for (uint32_t i = 0; i < num_params; i++){
+			printf(csv ? "%u," : "%8u ", point_value(point, i));
+		}
+		double mean_rally = sum.hits / rounds, early = 100.0 * sum.early / rounds, late = 100.0 * sum.late / rounds;
+		double pace_at_miss = sum.pace_at_miss / rounds / 65536.0, max_pace = sum.max_pace / 65536.0;
+		double per_hour = sum.sim_ms ? sum.games * 3600000.0 / (double)sum.sim_ms : 0.0;
+		uint32_t p50 = rally_percentile(sum.rally, sum.rounds, 0.5), p90 = rally_percentile(sum.rally, sum.rounds, 0.9);
+		if (csv){
+			printf("%u,%u,%.2f,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.1f\n", sum.games, sum.rounds, mean_rally, p50, p90,
+					sum.max_rally, early, late, pace_at_miss, max_pace, per_hour);
+		}
+		else{
+			printf("%8u %7u %8.2f/%u/%u/%-5u %7.1f %6.1f %9.1f %5.1f %8.1f\n", sum.games, sum.rounds, mean_rally, p50, p90,
+					sum.max_rally, early, late, pace_at_miss, max_pace, per_hour);
+		}
+	}
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t workers = cores > 0 ? (uint32_t)cores : 1;
+	uint32_t csv = 0;
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+		const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+		int bad = 0;
+		if (!strcmp(arg, "-p")) { bad = parse_param(val); i++; }
+		else if (!strcmp(arg, "-n")) { seeds = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-g")) { games_per_job = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-t")) { max_ms = strtoull(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-w")) { workers = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-m")) {
+			sim_left.model = SIM_NUM_REACTION_MODELS;
+			for (uint32_t m = 0; m < SIM_NUM_REACTION_MODELS; m++){
+				if (!strcmp(val, sim_reaction_model_names[m])) sim_left.model = (enum sim_reaction_models)m;
+			}
+			sim_right.model = sim_left.model;
+			bad = (sim_left.model == SIM_NUM_REACTION_MODELS);
+			i++;
+		}
+		else if (!strcmp(arg, "-r")) { apply_constant(SW_REACTION, (uint32_t)strtoul(val, NULL, 0)); i++; }
+		else if (!strcmp(arg, "-j")) { apply_constant(SW_JITTER, (uint32_t)strtoul(val, NULL, 0)); i++; }
+		else if (!strcmp(arg, "-x")) { apply_constant(SW_TAIL, (uint32_t)strtoul(val, NULL, 0)); i++; }
+		else if (!strcmp(arg, "-b")) { sim_bounces = (uint32_t)strtoul(val, NULL, 0); i++; }
+		else if (!strcmp(arg, "-c")) { csv = 1; }
+		else bad = 1;
+		if (bad){
+			fprintf(stderr, "usage: %s [-p name=lo:hi[:step]|name=a,b,c]... [-n seeds] [-g games] [-t max_ms] [-w workers]\n"
+					"       [-m uniform|gaussian|exgauss] [-r reaction_ms] [-j jitter_ms] [-x tail_ms] [-b bounces] [-c]\n"
+					"names: speed step max timeout toggle debounce reaction jitter tail\n", argv[0]);
+			return 2;
+		}
+	}
+	if (LINK != LINK_NONE){ //a linked board plays one player and needs the other board's simulator
+		fprintf(stderr, "%s cannot sweep a build with LINK=LINK_UART, use embedded_pong_sim -L\n", argv[0]);
+		return 2;
+	}
+	uint32_t points = 1;
+	for (uint32_t i = 0; i < num_params; i++){
+		points *= params[i].count;
+		for (uint32_t v = 0; v < params[i].count; v++){ //values the firmware cannot run with
+			uint32_t value = params[i].values[v];
+			if ((params[i].constant == SW_DEBOUNCE && (value == 0 || value > 31))
+					|| ((params[i].constant == SW_SPEED || params[i].constant == SW_MAX) && (value == 0 || value >= BALL_TICK_HZ))){
+				fprintf(stderr, "%s=%u is out of range\n", constant_names[params[i].constant], value);
+				return 2;
+			}
+		}
+	}
+	if (seeds == 0) seeds = 1;
+	if (workers == 0) workers = 1;
+	if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+	uint32_t jobs = points * seeds;
+	if (workers > jobs) workers = jobs;
+
+	size_t size = sizeof(struct sweep_shared) + (size_t)jobs * sizeof(struct sweep_result);
+	shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	for (uint32_t w = 0; w < workers; w++){ //contiguous slices, stealing evens them out
+		uint64_t begin = (uint64_t)jobs * w / workers, end = (uint64_t)jobs * (w + 1) / workers;
+		atomic_init(&shared->slices[w], (end << 32) | begin);
+	}
+	atomic_init(&shared->steals, 0);
+
+	struct timespec start, finish;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fflush(stdout);
+	for (uint32_t w = 0; w < workers; w++){
+		pid_t pid = fork();
+		if (pid == 0){
+			worker(w, workers);
+			_exit(0);
+		}
+		if (pid < 0){
+			perror("fork");
+			return 1;
+		}
+	}
+	while (wait(NULL) > 0){
+	}
+	clock_gettime(CLOCK_MONOTONIC, &finish);
+	double wall = (double)(finish.tv_sec - start.tv_sec) + (double)(finish.tv_nsec - start.tv_nsec) / 1e9;
+
+	uint32_t failed = report(points, csv);
+	uint64_t games = 0, sim_ms = 0;
+	for (uint32_t j = 0; j < jobs; j++){
+		games += shared->results[j].games;
+		sim_ms += shared->results[j].sim_ms;
+	}
+	fprintf(csv ? stderr : stdout, "%u points x %u seeds on %u workers (%u steals), %u failed: %llu games in %.3f s wall, "
+			"%.1f games/s, %.0fx real time\n", points, seeds, workers, atomic_load(&shared->steals), failed,
+			(unsigned long long)games, wall, wall > 0 ? games / wall : 0.0, wall > 0 ? sim_ms / 1000.0 / wall : 0.0);
+	return failed ? 1 : 0;
+}
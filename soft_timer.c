@@ -0,0 +1,144 @@
+#include "main.h"
+#include "soft_timer.h"
+/**
+**************************************************************************************************
+* @file soft_timer.c
+* @brief Source file for the software timer wheel
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Hashed timer wheel with 1 ms resolution. A timer lives in slot (deadline % TIMER_WHEEL_SLOTS).
+* Every SysTick looks at exactly one slot, so a tick with nothing due costs one pointer test.
+* Deadlines further away than one turn of the wheel stay in their slot and are skipped until
+* their turn comes round.
+*
+*	Note: SCHEDULE/RESCHEDULE/CANCEL may be called from the main loop or from any ISR. They mask
+*	      interrupts for a few instructions while they relink the slot lists.
+*************************************************************************************************/
+static struct Soft_Timer *wheel[TIMER_WHEEL_SLOTS];
+
+//================================================================================================
+// unlink_timer()
+// @parm: *t = armed timer
+// @return: none
+// 		Removes the timer from its slot. Caller holds interrupts masked.
+//================================================================================================
+static void unlink_timer(struct Soft_Timer *t)
+{
+	*t->link = t->next;
+	if (t->next){
+		t->next->link = t->link;
+	}
+	t->armed = 0;
+}
+//================================================================================================
+// link_timer()
+// @parm: *t = timer that is not armed
+//        delay_ms = milliseconds from now, 0 is treated as the next tick
+// @return: none
+// 		Adds the timer to the slot of its deadline. Caller holds interrupts masked.
+//================================================================================================
+static void link_timer(struct Soft_Timer *t, uint32_t delay_ms)
+{
+	t->deadline = msTimer + (delay_ms ? delay_ms : 1);
+	struct Soft_Timer **slot = &wheel[t->deadline & (TIMER_WHEEL_SLOTS - 1)];
+	t->next = *slot;
+	t->link = slot;
+	if (*slot){
+		(*slot)->link = &t->next;
+	}
+	*slot = t;
+	t->armed = 1;
+}
+//================================================================================================
+// SCHEDULE_TIMER()
+// @parm: *t = timer to arm (re-armed if it is already running)
+//        delay_ms = milliseconds until the callback runs
+//        callback = function to run from SysTick_Handler when the timer fires
+//        context = argument passed to the callback
+// @return: none
+//================================================================================================
+void SCHEDULE_TIMER(struct Soft_Timer *t, uint32_t delay_ms, void (*callback)(void *context), void *context)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (t->armed){
+		unlink_timer(t);
+	}
+	t->due = 0; //re-armed, a firing still waiting in TIMER_WHEEL_TICK() is dropped
+	t->callback = callback;
+	t->context = context;
+	link_timer(t, delay_ms);
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// RESCHEDULE_TIMER()
+// @parm: *t = timer previously passed to SCHEDULE_TIMER()
+//        delay_ms = new delay from now
+// @return: none
+// 		Moves the deadline, keeping the callback. Works whether or not the timer is armed.
+//================================================================================================
+void RESCHEDULE_TIMER(struct Soft_Timer *t, uint32_t delay_ms)
+{
+	SCHEDULE_TIMER(t, delay_ms, t->callback, t->context);
+}
+//================================================================================================
+// CANCEL_TIMER()
+// @parm: *t = timer to stop
+// @return: none
+// 		The callback will not run, even if the timer is already due in this tick. Safe to call on
+// 		a timer that is not armed.
+//================================================================================================
+void CANCEL_TIMER(struct Soft_Timer *t)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (t->armed){
+		unlink_timer(t);
+	}
+	t->due = 0;
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// TIMER_WHEEL_TICK()
+// @parm: currentTIME_ms = msTimer, just incremented by SysTick_Handler
+// @return: none
+// 		Fires every timer whose deadline is now. Due timers are unlinked first and chained through
+// 		due_next, not next, and their callbacks run afterwards, so a callback may schedule or
+// 		cancel any timer, itself included. A due timer that is scheduled or cancelled before its
+// 		turn does not fire.
+//================================================================================================
+void TIMER_WHEEL_TICK(uint32_t currentTIME_ms)
+{
+	struct Soft_Timer **slot = &wheel[currentTIME_ms & (TIMER_WHEEL_SLOTS - 1)];
+	if (*slot == 0){ //nothing in this slot, the common case
+		return;
+	}
+	struct Soft_Timer *due = 0;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	struct Soft_Timer *t = *slot;
+	while (t){
+		struct Soft_Timer *next = t->next;
+		if (t->deadline == currentTIME_ms){
+			unlink_timer(t);
+			t->due = 1;
+			t->due_next = due; //collect in a private list
+			due = t;
+		}
+		t = next;
+	}
+	__set_PRIMASK(primask);
+	while (due){
+		t = due;
+		due = due->due_next;
+		primask = __get_PRIMASK();
+		__disable_irq();
+		uint32_t fire = t->due; //an earlier callback may have scheduled or cancelled it
+		t->due = 0;
+		__set_PRIMASK(primask);
+		if (fire){
+			t->callback(t->context);
+		}
+	}
+}
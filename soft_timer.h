@@ -0,0 +1,36 @@
+/**
+**************************************************************************************************
+* @file soft_timer.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for soft_timer.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the millisecond software timers driven by SysTick. Included by main.h so that other
+* structures (Player, UserInput) can embed a timer.
+**************************************************************************************************
+*/
+#ifndef SOFT_TIMER_H_
+#define SOFT_TIMER_H_
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_SLOTS 256 //one slot per ms, must be a power of two
+
+struct Soft_Timer{
+	struct Soft_Timer *next; //next timer in the same wheel slot
+	struct Soft_Timer **link; //pointer that points at this timer, for O(1) cancel
+	uint32_t deadline; //msTimer value at which the timer fires
+	volatile uint32_t armed; //1 while scheduled, cleared when it falls due
+	struct Soft_Timer *due_next; //next timer due in the same tick, see TIMER_WHEEL_TICK()
+	volatile uint32_t due; //1 from falling due until its callback runs, cleared by a schedule or cancel
+	void (*callback)(void *context); //runs inside SysTick_Handler
+	void *context; //passed to the callback
+};
+
+void SCHEDULE_TIMER(struct Soft_Timer *t, uint32_t delay_ms, void (*callback)(void *context), void *context);
+void RESCHEDULE_TIMER(struct Soft_Timer *t, uint32_t delay_ms);
+void CANCEL_TIMER(struct Soft_Timer *t);
+void TIMER_WHEEL_TICK(uint32_t currentTIME_ms);
+
+#endif /* SOFT_TIMER_H_ */
@@ -0,0 +1,418 @@
+#include "stats_log.h"
+#include "link.h" //in linked play only this board's player is timed, see link.c/h
+/**
+**************************************************************************************************
+* @file stats_log.c
+* @brief Source file for the lifetime player statistics kept in flash
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Player.score only counts to 3 and is lost on reset. This module keeps lifetime totals for both
+* players (games and rounds won, hits, the longest rally, the fastest pace and reaction times)
+* in an append-only log at the top of flash bank 2, see stats_log.h for the region and layout.
+*
+* The game adds to stats_log.round as it plays (STATS_HIT()), and at the end of
+* every round STATS_ROUND_END() queues it. The flash writer runs from FLASH_IRQHandler: each end
+* of operation programs the next double-word, so a round (STATS_ROUND_WORDS double-words, about
+* 82 us each) is in well before the TIME_OUT that follows the miss is up, and nothing in the game
+* waits for it. When a page is full the writer moves on to the next one round-robin, the oldest,
+* so the pages wear evenly: it erases it (about 22 ms), programs the totals so far as the page's
+* checkpoint and only then the header that makes it the newest page. Until the header is in, the
+* page before is still the newest and holds the same totals, so a reset at any point loses at
+* most the round being written.
+*
+* At start-up configure_stats_log() reads the STATS_PAGES headers, takes the newest page whose
+* checkpoint passes its CRC, and adds every intact round after it. That is at most a few hundred
+* double-word reads. A double-word left half-programmed by a reset reads back with an ECC error,
+* which raises the NMI (see NMI_Handler() in main.c); the record it belongs to is skipped.
+*
+* A reaction time runs from the ball reaching the hitzone to the press's button edge. In linked
+* play (LINK_UART) each board only times its own player: the other player's presses arrive late.
+*
+*	Note: Enabled with STATS_LOG (main.h or the compiler command line). The CRCs are worked out in
+*	      software; the CRC unit is left free and the records are short.
+*************************************************************************************************/
+#if STATS_LOG
+
+#define STATS_KEY1 0x45670123 //FLASH->KEYR unlock sequence
+#define STATS_KEY2 0xCDEF89AB
+#define STATS_CR_PG (1 << 0) //FLASH->CR
+#define STATS_CR_PER (1 << 1)
+#define STATS_CR_PNB_Pos 3
+#define STATS_CR_BKER (1 << 11)
+#define STATS_CR_STRT (1 << 16)
+#define STATS_CR_EOPIE (1 << 24)
+#define STATS_CR_ERRIE (1 << 25)
+#define STATS_CR_LOCK (1u << 31)
+#define STATS_SR_EOP (1 << 0) //FLASH->SR, cleared by writing 1
+#define STATS_SR_ERRORS 0xC3FA //OPERR, PROGERR, WRPERR, PGAERR, SIZERR, PGSERR, MISERR, FASTERR, RDERR, OPTVERR
+#define STATS_ERASED 0xFFFFFFFFFFFFFFFFull
+#define PAGE_ADDRESS(page) (STATS_FLASH_BASE + (page) * STATS_PAGE_BYTES)
+#define ROUND_ADDRESS(page, slot) (PAGE_ADDRESS(page) + 8 * STATS_FIRST_ROUND_WORD + (slot) * sizeof(struct Stats_Round))
+
+_Static_assert(STATS_ROUNDS_PER_PAGE >= 1, "stats_log.h: a page must hold a round after its checkpoint");
+
+struct Stats_Log stats_log;
+
+//What a step programs, as double-words
+static union{
+	struct Stats_Checkpoint checkpoint;
+	struct Stats_Round round;
+	uint64_t header;
+	uint64_t words[STATS_CHECKPOINT_WORDS];
+} burst;
+
+//================================================================================================
+// crc32()
+// @parm: *data, n = bytes to check
+// @return: CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320)
+//================================================================================================
+static uint32_t crc32(const void *data, uint32_t n)
+{
+	const uint8_t *bytes = data;
+	uint32_t crc = 0xFFFFFFFF;
+	for (uint32_t i = 0; i < n; i++){
+		crc ^= bytes[i];
+		for (uint32_t bit = 0; bit < 8; bit++){
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+		}
+	}
+	return ~crc;
+}
+//================================================================================================
+// read_words()
+// @parm: address = first double-word, *out = where to put them, words = how many
+// @return: 1 if every double-word read back without an ECC error
+//================================================================================================
+static uint32_t read_words(uint32_t address, uint64_t *out, uint32_t words)
+{
+	uint32_t ok = 1;
+	for (uint32_t i = 0; i < words; i++){
+		stats_log.ecc_error = 0;
+		out[i] = FLASH_READ_DOUBLE(address + 8 * i);
+		stats_log.boot_words++;
+		if (stats_log.ecc_error){ //set by NMI_Handler during the read
+			stats_log.ecc_errors++;
+			ok = 0;
+		}
+	}
+	return ok;
+}
+//================================================================================================
+// read_rounds()
+// @parm: none
+// @return: none
+// 		Adds every intact round on stats_log.page to the totals, and leaves stats_log.slot at the
+// 		first blank record, where the next round goes.
+//================================================================================================
+static void read_rounds(void)
+{
+	uint32_t slot;
+	for (slot = 0; slot < STATS_ROUNDS_PER_PAGE; slot++){
+		uint32_t ok = read_words(ROUND_ADDRESS(stats_log.page, slot), burst.words, STATS_ROUND_WORDS);
+		uint32_t blank = ok;
+		for (uint32_t i = 0; i < STATS_ROUND_WORDS; i++){
+			blank &= (burst.words[i] == STATS_ERASED);
+		}
+		if (blank){
+			break;
+		}
+		const struct Stats_Round *r = &burst.round;
+		if (ok && r->crc == crc32(r, sizeof *r - sizeof r->crc) && r->round == stats_log.totals.rounds + 1){
+			STATS_ADD_ROUND(&stats_log.totals, r);
+			stats_log.recovered_rounds++;
+		}
+		else{ //cut short by a reset, it never counted
+			stats_log.torn_rounds++;
+		}
+	}
+	stats_log.slot = slot;
+}
+//================================================================================================
+// configure_stats_log()
+// @parm: none
+// @return: none
+// 		Reads the totals back from the newest intact page and enables the flash interrupt the
+// 		writer runs from. With no intact page the totals start at zero and the first round
+// 		starts page 0.
+//================================================================================================
+void configure_stats_log(void)
+{
+	uint32_t sequence[STATS_PAGES];
+	uint32_t valid = 0; //bit p set while page p may yet be the newest
+	stats_log = (struct Stats_Log){0};
+	stats_log.page = STATS_PAGES - 1;
+	stats_log.slot = STATS_ROUNDS_PER_PAGE; //full, so the first round starts the next page
+	for (uint32_t p = 0; p < STATS_PAGES; p++){
+		if (read_words(PAGE_ADDRESS(p), &burst.header, 1) && (uint32_t)(burst.header >> 32) == ((uint32_t)burst.header ^ STATS_MAGIC)){
+			sequence[p] = (uint32_t)burst.header;
+			valid |= 0x1u << p;
+			if (sequence[p] > stats_log.sequence){
+				stats_log.sequence = sequence[p]; //a new page must come after every one still readable
+			}
+		}
+	}
+	while (valid){ //newest first, an older page holds the same totals up to its last round
+		uint32_t newest = __builtin_ctz(valid);
+		for (uint32_t p = newest + 1; p < STATS_PAGES; p++){
+			if (((valid >> p) & 0x1) && sequence[p] > sequence[newest]){
+				newest = p;
+			}
+		}
+		valid &= ~(0x1u << newest);
+		const struct Stats_Checkpoint *c = &burst.checkpoint;
+		if (read_words(PAGE_ADDRESS(newest) + 8, burst.words, STATS_CHECKPOINT_WORDS)
+				&& c->crc == crc32(&c->totals, sizeof c->totals)){
+			stats_log.totals = c->totals;
+			stats_log.page = newest;
+			read_rounds();
+			break;
+		}
+	}
+	NVIC_SetPriority(FLASH_IRQn, 7); //the log can wait behind everything else
+	NVIC_EnableIRQ(FLASH_IRQn);
+}
+//================================================================================================
+// STATS_ADD_ROUND()
+// @parm: *t = totals to add to, *r = round played
+// @return: none
+//================================================================================================
+void STATS_ADD_ROUND(struct Stats_Totals *t, const struct Stats_Round *r)
+{
+	uint32_t winner = (r->loser == ONE) ? TWO : ONE;
+	t->rounds++;
+	t->player[winner].rounds_won++;
+	t->player[winner].games_won += r->game_won;
+	if ((uint32_t)r->hits[0] + r->hits[1] > t->longest_rally){
+		t->longest_rally = (uint32_t)r->hits[0] + r->hits[1];
+	}
+	if (r->max_pace > t->max_pace){
+		t->max_pace = r->max_pace;
+	}
+	for (uint32_t i = 0; i < 2; i++){
+		struct Player_Stats *p = &t->player[i];
+		p->hits += r->hits[i];
+		p->timed_hits += r->timed_hits[i];
+		p->reaction_sum_us += r->reaction_sum_us[i];
+		p->reaction_sum_sq_ms += r->reaction_sum_sq_ms[i];
+		if (r->best_reaction_us[i] && (!p->best_reaction_us || r->best_reaction_us[i] < p->best_reaction_us)){
+			p->best_reaction_us = r->best_reaction_us[i];
+		}
+	}
+}
+//================================================================================================
+// STATS_ROUND_START()
+// @parm: none
+// @return: none
+// 		Called by the SERVE action. Starts a new round, dropping whatever a reset cut short.
+//================================================================================================
+void STATS_ROUND_START(void)
+{
+	stats_log.round = (struct Stats_Round){0};
+}
+//================================================================================================
+// STATS_HIT()
+// @parm: id = player who returned the ball
+//        k = ball returned, still at the pace it arrived at
+//        pressTIME_us = usTimer value of the press's button edge
+// @return: none
+// 		Called by the P1_RETURNS and P2_RETURNS actions for a successful hit. An edge before the
+// 		ball arrived (DEBOUNCE_DEFERRED decides 20 ms later) counts as 1 us.
+//================================================================================================
+void STATS_HIT(enum identifications id, uint32_t k, uint32_t pressTIME_us)
+{
+	struct Stats_Round *r = &stats_log.round;
+	r->hits[id]++;
+	if (balls.level[k] > r->max_pace){
+		r->max_pace = (uint8_t)balls.level[k];
+	}
+#if LINK == LINK_UART
+	if (id != board_link.local){ //timed by the other board
+		return;
+	}
+#endif
+	int32_t reaction = (int32_t)(pressTIME_us - balls.hitzone_us[k]);
+	uint32_t us = (reaction > 0) ? (uint32_t)reaction : 1;
+	uint32_t ms = (us + 500) / 1000;
+	r->timed_hits[id]++;
+	r->reaction_sum_us[id] += us;
+	r->reaction_sum_sq_ms[id] += ms * ms;
+	if (!r->best_reaction_us[id] || us < r->best_reaction_us[id]){
+		r->best_reaction_us[id] = us;
+	}
+}
+//================================================================================================
+// STATS_ROUND_END()
+// @parm: loser = player who missed
+//        game_won = 1 if the miss won the other player the game
+// @return: none
+// 		Called by HANDLE_MISS(). Queues the round for the flash writer.
+//================================================================================================
+void STATS_ROUND_END(enum identifications loser, uint32_t game_won)
+{
+	stats_log.round.loser = (uint8_t)loser;
+	stats_log.round.game_won = (uint8_t)(game_won != 0);
+	STATS_APPEND(&stats_log.round);
+	STATS_ROUND_START();
+}
+//================================================================================================
+// program_word()
+// @parm: none
+// @return: none
+// 		Starts the next double-word of the current step. FLASH_IRQHandler runs when it is in.
+//================================================================================================
+static void program_word(void)
+{
+	uint32_t address;
+	switch (stats_log.step){
+	case STATS_CHECKPOINT:
+		address = PAGE_ADDRESS(stats_log.page) + 8;
+		break;
+	case STATS_HEADER:
+		address = PAGE_ADDRESS(stats_log.page);
+		break;
+	default:
+		address = ROUND_ADDRESS(stats_log.page, stats_log.slot);
+		break;
+	}
+	FLASH_CR_WRITE(STATS_CR_PG | STATS_CR_EOPIE | STATS_CR_ERRIE);
+	FLASH_PROGRAM_DOUBLE(address + 8 * stats_log.word, burst.words[stats_log.word]);
+	stats_log.word++;
+}
+//================================================================================================
+// begin_step()
+// @parm: step = step to begin, its double-words in burst
+// @return: none
+//================================================================================================
+static void begin_step(enum stats_steps step)
+{
+	stats_log.step = step;
+	stats_log.word = 0;
+	program_word();
+}
+//================================================================================================
+// next_step()
+// @parm: none
+// @return: none
+// 		Runs when the current step has finished, and in STATS_IDLE when a round is queued: starts
+// 		what comes after it, or locks the flash again once the queue is empty.
+//================================================================================================
+static void next_step(void)
+{
+	switch (stats_log.step){
+	case STATS_ERASING: //the page is blank, the totals so far go first
+		burst.checkpoint.totals = stats_log.totals;
+		burst.checkpoint.crc = crc32(&stats_log.totals, sizeof stats_log.totals);
+		burst.checkpoint.unused = 0;
+		begin_step(STATS_CHECKPOINT);
+		return;
+	case STATS_CHECKPOINT: //then the header, which makes it the newest page
+		burst.header = ((uint64_t)(stats_log.sequence ^ STATS_MAGIC) << 32) | stats_log.sequence;
+		begin_step(STATS_HEADER);
+		return;
+	case STATS_HEADER:
+		stats_log.slot = 0;
+		break;
+	case STATS_ROUND: //its CRC is in, the round counts
+		STATS_ADD_ROUND(&stats_log.totals, &stats_log.queue[stats_log.queue_tail & (STATS_QUEUE - 1)]);
+		stats_log.queue_tail++;
+		stats_log.appended++;
+		stats_log.slot++;
+		stats_log.error_run = 0;
+		break;
+	case STATS_IDLE:
+		break;
+	}
+	stats_log.step = STATS_IDLE;
+	if (stats_log.queue_tail == stats_log.queue_head){
+		FLASH_CR_WRITE(STATS_CR_LOCK);
+		return;
+	}
+	if (FLASH->CR & STATS_CR_LOCK){
+		FLASH->KEYR = STATS_KEY1;
+		FLASH->KEYR = STATS_KEY2;
+	}
+	if (stats_log.slot >= STATS_ROUNDS_PER_PAGE){ //full, erase the oldest page and carry on there
+		stats_log.page = (stats_log.page + 1) % STATS_PAGES;
+		stats_log.sequence++;
+		stats_log.step = STATS_ERASING;
+		stats_log.erases++;
+		uint32_t cr = STATS_CR_PER | STATS_CR_BKER | ((STATS_FIRST_PNB + stats_log.page) << STATS_CR_PNB_Pos)
+				| STATS_CR_EOPIE | STATS_CR_ERRIE;
+		FLASH_CR_WRITE(cr);
+		FLASH_CR_WRITE(cr | STATS_CR_STRT);
+		return;
+	}
+	burst.round = stats_log.queue[stats_log.queue_tail & (STATS_QUEUE - 1)];
+	burst.round.round = stats_log.totals.rounds + 1;
+	burst.round.crc = crc32(&burst.round, sizeof burst.round - sizeof burst.round.crc);
+	begin_step(STATS_ROUND);
+}
+//================================================================================================
+// STATS_APPEND()
+// @parm: *r = finished round
+// @return: 1 if it was queued, 0 if the queue was full or the writer has given up
+// 		Queues the round and starts the writer if it was idle. Main loop only.
+//================================================================================================
+uint32_t STATS_APPEND(const struct Stats_Round *r)
+{
+	uint32_t head = stats_log.queue_head;
+	if (stats_log.failed || head - stats_log.queue_tail >= STATS_QUEUE){
+		stats_log.dropped++;
+		return 0;
+	}
+	stats_log.queue[head & (STATS_QUEUE - 1)] = *r;
+	__DMB(); //the round must land before the new head
+	stats_log.queue_head = head + 1;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq(); //FLASH_IRQHandler must not start a step meanwhile
+	if (stats_log.step == STATS_IDLE){
+		next_step();
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
+//================================================================================================
+// STATS_FLASH_DONE()
+// @parm: none
+// @return: none
+// 		Called by FLASH_IRQHandler at the end of every program and erase. A failed operation
+// 		leaves the page to the next one. After STATS_PAGES - 1 failures in a row the next erase
+// 		would take the newest intact page, so the writer gives up and the totals stay in RAM.
+//================================================================================================
+void STATS_FLASH_DONE(void)
+{
+	uint32_t sr = FLASH->SR;
+	if (!(sr & (STATS_SR_EOP | STATS_SR_ERRORS))){
+		return;
+	}
+	FLASH->SR = sr & (STATS_SR_EOP | STATS_SR_ERRORS); //write 1 to clear
+	if (sr & STATS_SR_ERRORS){
+		stats_log.errors++;
+		stats_log.slot = STATS_ROUNDS_PER_PAGE;
+		stats_log.step = STATS_IDLE;
+		if (++stats_log.error_run >= STATS_PAGES - 1){
+			stats_log.failed = 1;
+			FLASH_CR_WRITE(STATS_CR_LOCK);
+			return;
+		}
+	}
+	else if ((stats_log.step == STATS_CHECKPOINT && stats_log.word < STATS_CHECKPOINT_WORDS)
+			|| (stats_log.step == STATS_ROUND && stats_log.word < STATS_ROUND_WORDS)){
+		program_word();
+		return;
+	}
+	next_step();
+}
+//================================================================================================
+// STATS_ECC_FAULT()
+// @parm: none
+// @return: none
+// 		Called by NMI_Handler for a double ECC error, which only the reads in configure_stats_log()
+// 		can meet.
+//================================================================================================
+void STATS_ECC_FAULT(void)
+{
+	stats_log.ecc_error = 1;
+}
+#endif
@@ -0,0 +1,134 @@
+/**
+**************************************************************************************************
+* @file stats_log.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for stats_log.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the lifetime player statistics and the log in internal flash that keeps them across
+* resets. With STATS_LOG 0 the functions expand to nothing and stats_log.c is empty.
+**************************************************************************************************
+*/
+#ifndef STATS_LOG_H_
+#define STATS_LOG_H_
+
+#include "main.h"
+
+//The log takes the last STATS_PAGES pages of flash bank 2, which the linker script must leave out
+//of its FLASH region. The program runs from bank 1, so the log is written while the core goes on
+//fetching from the other bank (read-while-write) and play never stalls on it.
+#define STATS_FLASH_END 0x08100000 //end of bank 2 on the 1 MB STM32L476RG
+#define STATS_PAGE_BYTES 2048
+#define STATS_PAGES 4 //pages written in turn, each is erased once every STATS_PAGES page fills
+#define STATS_FLASH_BASE (STATS_FLASH_END - STATS_PAGES * STATS_PAGE_BYTES)
+#define STATS_FIRST_PNB (256 - STATS_PAGES) //FLASH->CR PNB of the first page, with BKER (bank 2)
+#define STATS_MAGIC 0x57A75106 //the header's high word is its sequence number xor this
+#define STATS_QUEUE 4 //finished rounds waiting to be written, must be a power of two
+
+//Every page is laid out as:
+//	double-word 0   header, sequence number and check, programmed last: a page without a valid
+//	                header is never read
+//	1 to 13         checkpoint, the totals when the page was started
+//	14 onwards      one struct Stats_Round per round played since, STATS_ROUND_WORDS each
+//A round only counts once its last double-word, with the CRC, is in; a torn or half-written
+//record fails its CRC and is skipped.
+#define STATS_CHECKPOINT_WORDS (sizeof(struct Stats_Checkpoint) / 8)
+#define STATS_ROUND_WORDS (sizeof(struct Stats_Round) / 8)
+#define STATS_FIRST_ROUND_WORD (1 + STATS_CHECKPOINT_WORDS)
+#define STATS_ROUNDS_PER_PAGE ((STATS_PAGE_BYTES / 8 - STATS_FIRST_ROUND_WORD) / STATS_ROUND_WORDS)
+
+//One player's lifetime totals
+struct Player_Stats{
+	uint32_t games_won;
+	uint32_t rounds_won;
+	uint32_t hits; //successful returns
+	uint32_t timed_hits; //of which timed, see STATS_HIT()
+	uint64_t reaction_sum_us; //hitzone entry to press, over the timed hits
+	uint64_t reaction_sum_sq_ms; //squares of the same in ms, for the spread
+	uint32_t best_reaction_us; //0 until the first timed hit
+	uint32_t unused;
+};
+
+struct Stats_Totals{
+	struct Player_Stats player[2]; //P1, P2
+	uint32_t rounds;
+	uint32_t longest_rally; //hits in the longest round
+	uint32_t max_pace; //fastest speed level a ball has been returned at
+	uint32_t unused;
+};
+
+//Double-words 1 to STATS_CHECKPOINT_WORDS of a page
+struct Stats_Checkpoint{
+	struct Stats_Totals totals;
+	uint32_t crc; //CRC-32 of totals
+	uint32_t unused;
+};
+
+//One round, as logged
+struct Stats_Round{
+	uint32_t round; //totals.rounds before it, plus one
+	uint16_t hits[2]; //successful returns, P1 and P2
+	uint16_t timed_hits[2];
+	uint8_t loser; //enum identifications
+	uint8_t game_won; //1 if the round won the other player the game
+	uint8_t max_pace;
+	uint8_t unused;
+	uint32_t reaction_sum_us[2];
+	uint32_t reaction_sum_sq_ms[2];
+	uint32_t best_reaction_us[2]; //0 with no timed hit
+	uint32_t unused2;
+	uint32_t crc; //CRC-32 of everything before it
+};
+
+_Static_assert(sizeof(struct Stats_Checkpoint) % 8 == 0 && sizeof(struct Stats_Round) % 8 == 0,
+		"stats_log.h: flash is programmed a double-word at a time");
+_Static_assert((STATS_QUEUE & (STATS_QUEUE - 1)) == 0 && STATS_PAGES >= 2 && STATS_PAGES <= 32,
+		"stats_log.h: bad queue size or page count");
+
+//What the flash writer is doing, see stats_log.c
+enum stats_steps { STATS_IDLE, STATS_ERASING, STATS_CHECKPOINT, STATS_HEADER, STATS_ROUND };
+
+struct Stats_Log{
+	struct Stats_Totals totals; //as in flash: the page's checkpoint plus every round written since
+	struct Stats_Round round; //the round being played
+	struct Stats_Round queue[STATS_QUEUE]; //finished rounds, oldest first
+	volatile uint32_t queue_head, queue_tail; //free running
+	volatile enum stats_steps step;
+	uint32_t page; //page being filled, 0 to STATS_PAGES - 1
+	uint32_t slot; //next round record on it, STATS_ROUNDS_PER_PAGE when full
+	uint32_t sequence; //highest header in flash, the next page started gets the one after
+	uint32_t word; //double-words of the current step programmed
+	uint32_t error_run; //flash errors since the last round was written
+	uint32_t failed; //1 once the writer has given up, see STATS_FLASH_DONE()
+	volatile uint32_t ecc_error; //set by NMI_Handler for a double-word read back with a double ECC error
+	//counters
+	uint32_t appended; //rounds written since configure_stats_log()
+	uint32_t dropped; //rounds lost to a full queue
+	uint32_t erases; //pages erased
+	uint32_t errors; //programs and erases that failed (FLASH->SR)
+	uint32_t recovered_rounds; //rounds read back by configure_stats_log()
+	uint32_t torn_rounds; //records it skipped
+	uint32_t ecc_errors; //double-words it read back with an ECC error
+	uint32_t boot_words; //double-words it read
+};
+
+#if STATS_LOG
+extern struct Stats_Log stats_log;
+
+void configure_stats_log(void);
+void STATS_ROUND_START(void);
+void STATS_HIT(enum identifications id, uint32_t k, uint32_t pressTIME_us);
+void STATS_ROUND_END(enum identifications loser, uint32_t game_won);
+uint32_t STATS_APPEND(const struct Stats_Round *r);
+void STATS_ADD_ROUND(struct Stats_Totals *t, const struct Stats_Round *r);
+void STATS_FLASH_DONE(void);
+void STATS_ECC_FAULT(void);
+#else
+#define configure_stats_log() ((void)0)
+#define STATS_ROUND_START() ((void)0)
+#define STATS_HIT(id, k, pressTIME_us) ((void)0)
+#define STATS_ROUND_END(loser, game_won) ((void)0)
+#endif
+
+#endif /* STATS_LOG_H_ */
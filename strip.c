@@ -0,0 +1,225 @@
+#include "strip.h"
+#include "clock.h" //SPI1 divides its rate from core_clock.hz, see clock.c/h
+/**
+**************************************************************************************************
+* @file strip.c
+* @brief Source file for the WS2812 strip output
+* @author: Justin Turner
+* @corresponding author: Jesse Garcia
+* ------------------------------------------------------------------------------------------------
+* Drives the GAMEBOARD row as BOARD_LENGTH pixels of one WS2812 strip. The strip takes a single
+* data line with the bits timed by pulse width, so each bit is written out as a short run of SPI
+* bits (see strip.h) and SPI1 on PA7 sends the whole frame, clocked by DMA1 channel 3 with no
+* CPU involvement. The row positions are strip pixels in LEDS[], and the LED frame functions
+* (leds.c) treat the strip as further ports of 16 pins each. COMMIT_LED_FRAME() hands those words
+* to STRIP_COMMIT().
+*
+* Only the pixels that changed since the last frame are encoded again, with one table lookup per
+* colour byte, so a ball step costs two pixels however long the strip is. While a frame is going
+* out, further changes wait and are sent, all at once, as soon as it is done
+* (DMA1_Channel3_IRQHandler). A frame of n pixels takes 28.8n us on the wire plus the reset time,
+* so a long strip shows the newest position rather than every step of a fast ball.
+*
+*	Note: Enabled with LED_OUTPUT_STRIP (main.h or the compiler command line), which also keeps
+*	      the idle core clock on the PLL, as SPI1 has to divide STRIP_SPI_HZ from it (clock.c).
+*************************************************************************************************/
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+
+#define DMA_CCR_EN (1 << 0)
+#define DMA_CCR_TCIE (1 << 1)
+#define DMA_CCR_BYTES_TO_PERIPHERAL ((1 << 4) | (1 << 7)) //DIR, MINC, 8-bit PSIZE and MSIZE
+#define DMA_CSELR_SPI1_TX 1 //C3S value that routes SPI1_TX to channel 3
+
+struct LED_Strip strip;
+static uint8_t symbol_code[256][STRIP_SYMBOL_BITS]; //SPI bytes for each colour byte value
+
+//================================================================================================
+// build_symbol_code()
+// @parm: none
+// @return: none
+// 		Works out the SPI bytes for every colour byte once, most significant bit first as both
+// 		the WS2812 and SPI1 take it
+//================================================================================================
+static void build_symbol_code(void)
+{
+	for (uint32_t value = 0; value < 256; value++){
+		uint64_t code = 0;
+		for (int32_t bit = 7; bit >= 0; bit--){
+			uint32_t high = ((value >> bit) & 0x1) ? STRIP_ONE_HIGH_BITS : STRIP_ZERO_HIGH_BITS;
+			code = (code << STRIP_SYMBOL_BITS) | (((0x1u << high) - 1) << (STRIP_SYMBOL_BITS - high));
+		}
+		for (uint32_t i = 0; i < STRIP_SYMBOL_BITS; i++){
+			symbol_code[value][i] = (uint8_t)(code >> (8 * (STRIP_SYMBOL_BITS - 1 - i)));
+		}
+	}
+}
+//================================================================================================
+// STRIP_PIXEL_COLOUR()
+// @parm: pixel = position on the GAMEBOARD row
+// @return: colour the pixel shows when lit, 0xRRGGBB
+//================================================================================================
+uint32_t STRIP_PIXEL_COLOUR(uint32_t pixel)
+{
+	if (pixel == RIGHT_MISS_ZONE || pixel == LEFT_MISS_ZONE) return STRIP_MISS_COLOUR;
+	if (pixel == RIGHT_HITZONE_POS || pixel == LEFT_HITZONE_POS) return STRIP_HITZONE_COLOUR;
+	return STRIP_BALL_COLOUR;
+}
+//================================================================================================
+// encode_pixel()
+// @parm: pixel = position on the GAMEBOARD row
+//        colour = 0xRRGGBB, 0 for off
+// @return: none
+//================================================================================================
+static void encode_pixel(uint32_t pixel, uint32_t colour)
+{
+	uint8_t *out = &strip.spi[pixel * STRIP_PIXEL_BYTES];
+	const uint8_t grb[3] = { (uint8_t)(colour >> 8), (uint8_t)(colour >> 16), (uint8_t)colour }; //the order the strip takes
+	for (uint32_t c = 0; c < 3; c++){
+		const uint8_t *code = symbol_code[grb[c]];
+		for (uint32_t i = 0; i < STRIP_SYMBOL_BITS; i++){
+			*out++ = code[i];
+		}
+	}
+}
+//================================================================================================
+// start_frame()
+// @parm: none
+// @return: none
+// 		Has DMA send spi[] to SPI1. Interrupts masked.
+//================================================================================================
+static void start_frame(void)
+{
+	DMA1_Channel3->CCR = 0; //CMAR and CNDTR only take a write while the channel is disabled
+	DMA1_Channel3->CMAR = DMA_ADDRESS(strip.spi);
+	DMA1_Channel3->CNDTR = STRIP_SPI_BYTES;
+	DMA1_Channel3->CCR = DMA_CCR_BYTES_TO_PERIPHERAL | DMA_CCR_TCIE | DMA_CCR_EN;
+	strip.busy = 1;
+	strip.frames++;
+}
+//================================================================================================
+// send_changes()
+// @parm: none
+// @return: none
+// 		Encodes the pixels that differ from the last frame and sends the new one, or leaves that
+// 		for STRIP_FRAME_SENT() while a frame is still going out. Interrupts masked.
+//================================================================================================
+static void send_changes(void)
+{
+	if (strip.busy){
+		strip.stale = 1;
+		return;
+	}
+	uint32_t any = 0;
+	for (uint32_t k = 0; k < STRIP_PORTS; k++){
+		uint32_t changed = strip.lit[k] ^ strip.sent[k];
+		any |= changed;
+		for (uint32_t n = 0; changed; n++, changed >>= 1){
+			if (changed & 0x1){
+				uint32_t pixel = 16 * k + n;
+				encode_pixel(pixel, ((strip.lit[k] >> n) & 0x1) ? STRIP_PIXEL_COLOUR(pixel) : 0);
+				strip.pixels_encoded++;
+			}
+		}
+		strip.sent[k] = strip.lit[k];
+	}
+	if (any){
+		start_frame();
+	}
+}
+//================================================================================================
+// configure_strip()
+// @parm: none
+// @return: none
+// 		Fills in the GAMEBOARD row of LEDS[] as strip pixels, sets up PA7 as SPI1_MOSI, SPI1 as a
+// 		transmit-only master fed by DMA1 channel 3, and sends a frame with every pixel off
+//================================================================================================
+void configure_strip(void)
+{
+	for (uint32_t pixel = 0; pixel < BOARD_LENGTH; pixel++){
+		uint32_t mask = 0x1u << (pixel % 16);
+		LEDS[pixel] = (struct Light_Emitting_Diode){ 0, LED_PORTS_used + pixel / 16, mask };
+		if (pixel > RIGHT_HITZONE_POS && pixel < LEFT_HITZONE_POS){
+			strip.gameboard[pixel / 16] |= mask;
+		}
+	}
+	build_symbol_code();
+	for (uint32_t pixel = 0; pixel < BOARD_LENGTH; pixel++){
+		encode_pixel(pixel, 0);
+	}
+
+	RCC->AHB2ENR |= (1 << 0); //Enable GPIOA clock
+	GPIOA->MODER = (GPIOA->MODER & ~(0x3 << 14)) | (0x2 << 14); //PA7 alternate function
+	GPIOA->OSPEEDR = (GPIOA->OSPEEDR & ~(0x3 << 14)) | (0x1 << 14); //medium speed, the edges are 200 ns apart
+	GPIOA->AFR[0] = (GPIOA->AFR[0] & ~(0xF << 28)) | (5 << 28); //AF5 = SPI1_MOSI
+
+	RCC->APB2ENR |= (1 << 12); //Enable SPI1 clock
+	SPI1->CR1 = 0;
+	SPI1->CR2 = (7 << 8) | (1 << 1); //8-bit frames, TXDMAEN
+	SPI1->CR1 = (1 << 15) | (1 << 14) | (1 << 9) | (1 << 8) | (STRIP_SPI_BR(core_clock.hz) << 3) | (1 << 2); //transmit only, NSS held by software, BR, master
+	SPI1->CR1 |= (1 << 6); //SPE
+
+	RCC->AHB1ENR |= (1 << 0); //Enable DMA1 clock
+	DMA1_Channel3->CCR = 0;
+	DMA1_Channel3->CPAR = DMA_ADDRESS(&SPI1->DR);
+	DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~(0xF << 8)) | (DMA_CSELR_SPI1_TX << 8);
+	NVIC_SetPriority(DMA1_Channel3_IRQn, 7); //the display can wait behind everything else
+	NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	start_frame();
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// STRIP_COMMIT()
+// @parm: *bsrr = the strip's words of an LED frame, STRIP_PORTS of them, cleared here
+// @return: none
+// 		Applies the words to the lit pixels, set winning over reset as with a BSRR store, and
+// 		sends what changed. Called by COMMIT_LED_FRAME() from the main loop and from ISRs.
+//================================================================================================
+void STRIP_COMMIT(uint32_t *bsrr)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint32_t k = 0; k < STRIP_PORTS; k++){
+		if (bsrr[k]){
+			strip.lit[k] = (strip.lit[k] & ~(bsrr[k] >> 16)) | (bsrr[k] & 0xFFFF);
+			bsrr[k] = 0;
+		}
+	}
+	send_changes();
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// STRIP_FRAME_SENT()
+// @parm: none
+// @return: none
+// 		Called from DMA1_Channel3_IRQHandler once DMA has handed SPI1 the last byte of a frame.
+// 		SPI1 keeps shifting out the reset time, and anything that changed meanwhile follows it.
+//================================================================================================
+void STRIP_FRAME_SENT(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	strip.busy = 0;
+	if (strip.stale){
+		strip.stale = 0;
+		send_changes();
+	}
+	__set_PRIMASK(primask);
+}
+//================================================================================================
+// STRIP_RETIME()
+// @parm: none
+// @return: none
+// 		Called by CORE_CLOCK_TICK() after a clock switch, never while STRIP_BUSY(). Sets the
+// 		prescaler that gives STRIP_SPI_HZ at the new clock, so the encoded frame is unchanged.
+//================================================================================================
+void STRIP_RETIME(void)
+{
+	SPI1->CR1 &= ~(1 << 6); //BR only changes with SPE clear
+	SPI1->CR1 = (SPI1->CR1 & ~(0x7 << 3)) | (STRIP_SPI_BR(core_clock.hz) << 3);
+	SPI1->CR1 |= (1 << 6);
+}
+
+#endif /* LED_OUTPUT */
@@ -0,0 +1,93 @@
+/**
+**************************************************************************************************
+* @file strip.h
+* @brief Header file for program main
+* @author Justin Turner
+* @corresponding author: Jesse Garcia
+* @version Header for strip.c module
+* ------------------------------------------------------------------------------------------------
+* Declares the WS2812 strip output and its bit timing. With LED_OUTPUT_GPIO the functions expand
+* to nothing and strip.c is empty.
+**************************************************************************************************
+*/
+#ifndef STRIP_H_
+#define STRIP_H_
+
+#include "main.h"
+
+//SPI1 shifts at STRIP_SPI_HZ and every WS2812 bit goes out as STRIP_SYMBOL_BITS SPI bits: held
+//high for STRIP_ZERO_HIGH_BITS (a 0) or STRIP_ONE_HIGH_BITS (a 1), then low for the rest. The
+//rate is the same at every core clock, only the prescaler changes (see clock.c).
+#define STRIP_SPI_HZ 5000000
+#define STRIP_SPI_BR(hz) (__builtin_ctz((hz) / STRIP_SPI_HZ) - 1) //SPI1->CR1 BR, baud rate = hz / 2^(BR + 1)
+#define STRIP_SPI_DIVIDES(hz) ((hz) % STRIP_SPI_HZ == 0 && (hz) / STRIP_SPI_HZ >= 2 && (hz) / STRIP_SPI_HZ <= 256 \
+		&& (((hz) / STRIP_SPI_HZ) & ((hz) / STRIP_SPI_HZ - 1)) == 0) //a power of two SPI1 can divide by
+#define STRIP_BIT_ns (1000000000u / STRIP_SPI_HZ) //one SPI bit
+#define STRIP_SYMBOL_BITS 6 //SPI bits per WS2812 bit, 1.2 us at 5 MHz
+#define STRIP_ZERO_HIGH_BITS 2
+#define STRIP_ONE_HIGH_BITS 4
+#define STRIP_PIXEL_BYTES (24 * STRIP_SYMBOL_BITS / 8) //green, red, blue, 8 bits each
+#define STRIP_RESET_us 320 //line held low after the last pixel, so the strip latches the frame
+#define STRIP_RESET_BYTES (STRIP_RESET_us * (STRIP_SPI_HZ / 1000000) / 8)
+#define STRIP_SPI_BYTES (BOARD_LENGTH * STRIP_PIXEL_BYTES + STRIP_RESET_BYTES) //one frame, as DMA sends it
+
+//Pixel colours, 0xRRGGBB. Kept dim: a long strip at full white draws amps.
+#define STRIP_BALL_COLOUR 0x303030
+#define STRIP_HITZONE_COLOUR 0x000060
+#define STRIP_MISS_COLOUR 0x600000
+
+//WS2812B data sheet limits, ns. Checked against the symbols below and, by sim -W, against the
+//SPI stream itself.
+#define WS2812_T0H_MIN 250 //0 bit, high time
+#define WS2812_T0H_MAX 550
+#define WS2812_T1H_MIN 650 //1 bit, high time
+#define WS2812_T1H_MAX 950
+#define WS2812_T0L_MIN 700 //0 bit, low time
+#define WS2812_T0L_MAX 1000
+#define WS2812_T1L_MIN 300 //1 bit, low time
+#define WS2812_T1L_MAX 600
+#define WS2812_RESET_MIN 280000 //low time that latches the frame
+
+#if LED_OUTPUT == LED_OUTPUT_STRIP
+_Static_assert(STRIP_SPI_HZ % 1000000 == 0 && 1000000000u % STRIP_SPI_HZ == 0, "strip.h: SPI1 rate is not a whole number of MHz and ns");
+_Static_assert(STRIP_SPI_DIVIDES(PLAY_CLK_FREQ) && STRIP_SPI_DIVIDES(IDLE_CLK_FREQ), "strip.h: SPI1 cannot divide STRIP_SPI_HZ from every core clock");
+_Static_assert(STRIP_RESET_us * (STRIP_SPI_HZ / 1000000) % 8 == 0, "strip.h: reset time is not a whole number of SPI bytes");
+_Static_assert(STRIP_ZERO_HIGH_BITS * STRIP_BIT_ns >= WS2812_T0H_MIN && STRIP_ZERO_HIGH_BITS * STRIP_BIT_ns <= WS2812_T0H_MAX,
+		"strip.h: 0 bit high time out of range");
+_Static_assert(STRIP_ONE_HIGH_BITS * STRIP_BIT_ns >= WS2812_T1H_MIN && STRIP_ONE_HIGH_BITS * STRIP_BIT_ns <= WS2812_T1H_MAX,
+		"strip.h: 1 bit high time out of range");
+_Static_assert((STRIP_SYMBOL_BITS - STRIP_ZERO_HIGH_BITS) * STRIP_BIT_ns >= WS2812_T0L_MIN
+		&& (STRIP_SYMBOL_BITS - STRIP_ZERO_HIGH_BITS) * STRIP_BIT_ns <= WS2812_T0L_MAX, "strip.h: 0 bit low time out of range");
+_Static_assert((STRIP_SYMBOL_BITS - STRIP_ONE_HIGH_BITS) * STRIP_BIT_ns >= WS2812_T1L_MIN
+		&& (STRIP_SYMBOL_BITS - STRIP_ONE_HIGH_BITS) * STRIP_BIT_ns <= WS2812_T1L_MAX, "strip.h: 1 bit low time out of range");
+_Static_assert(STRIP_RESET_us * 1000 >= WS2812_RESET_MIN, "strip.h: reset time too short to latch");
+_Static_assert(STRIP_SYMBOL_BITS <= 8, "strip.h: a byte's symbols must fit the 64-bit code in build_symbol_code()");
+_Static_assert(STRIP_SPI_BYTES <= 0xFFFF, "strip.h: frame longer than one DMA block (CNDTR)");
+
+//The strip as the game sees it, and the frame DMA sends to it
+struct LED_Strip{
+	uint8_t spi[STRIP_SPI_BYTES]; //every pixel encoded, then STRIP_RESET_BYTES of zeros
+	uint32_t lit[STRIP_PORTS]; //pixels the game has turned on, bit n of word k is pixel 16k + n
+	uint32_t sent[STRIP_PORTS]; //pixels lit in spi[]
+	uint32_t gameboard[STRIP_PORTS]; //GAMEBOARD pixels, for TURN_OFF_GAMEBOARD_LEDS()
+	volatile uint32_t busy; //1 while DMA sends spi[], which must not change meanwhile
+	volatile uint32_t stale; //lit changed while busy, send again once done
+	uint32_t frames; //frames sent
+	uint32_t pixels_encoded; //pixels encoded into spi[], over all frames
+};
+
+extern struct LED_Strip strip;
+
+void configure_strip(void);
+void STRIP_COMMIT(uint32_t *bsrr);
+void STRIP_FRAME_SENT(void);
+void STRIP_RETIME(void);
+uint32_t STRIP_PIXEL_COLOUR(uint32_t pixel);
+#define STRIP_BUSY() (strip.busy || (SPI1->SR & (1 << 7))) //a frame is going out, or SPI1 is still shifting (BSY)
+#else
+#define configure_strip() ((void)0)
+#define STRIP_RETIME() ((void)0)
+#define STRIP_BUSY() 0
+#endif
+
+#endif /* STRIP_H_ */
@@ -1,4 +1,5 @@
 #include "timers.h"
+#include "clock.h" //every rate is divided from core_clock.hz, see clock.c/h
 /**
 **************************************************************************************************
 * @file timers.c
@@ -15,13 +16,14 @@
 // @parm: none
 // @return: none
 //
-// 		Configures the hardware so the SysTick timer will trigger every 1ms
+// 		Configures the hardware so the SysTick timer will trigger every 1ms. CORE_CLOCK_TICK()
+// 		sets LOAD again whenever the core clock changes.
 //================================================================================================
 void configureSysTickInterrupt(void)
 {
 	SysTick->CTRL = 0; //disable SysTick timer
 	NVIC_SetPriority(SysTick_IRQn, 7); //set priority level at 7
-	SysTick->LOAD = 3999; //set the counter reload value 1ms
+	SysTick->LOAD = core_clock.hz / 1000 - 1; //set the counter reload value 1ms
 	SysTick->VAL = 0; //reset SysTick timer value
 	SysTick->CTRL |= SysTick_CTRL_CLKSOURCE_Msk; //use system clock
 	SysTick->CTRL |= SysTick_CTRL_TICKINT_Msk; //enable SysTick interrupts
@@ -33,32 +35,41 @@ void configureSysTickInterrupt(void)
 // @parm: none
 // @return: none
 //
-// 	Configures TIM2 to for interrupt generation
+// 	Configures TIM2 to interrupt BALL_TICK_HZ times a second
 //
-//       Note: The counter reset and ARR value is handled by the updateARR function
-//	       The Timer does not start until the INITIAL_SERVE state.
+//       Note: The rate never changes; the ball's speed is set by SET_STEP_RATE() (ball.c).
+//	       The Timer does not start until the INITIAL_SERVE state. PSC follows the core
+//	       clock (see CORE_CLOCK_TICK()).
 //================================================================================================
 void configureTIM2 (void)
 {
 	  RCC->APB1ENR1 |= (1 << 0);  // Enable TIM2 clock
-	  TIM2->PSC = (SYS_CLK_FREQ/cntclk -1);
+	  TIM2->CR1 |= (1 << 2); //URS: only a wrap is an update, so reloading PSC moves no data
+	  TIM2->PSC = (core_clock.hz/cntclk -1);
+	  TIM2->ARR = (cntclk/BALL_TICK_HZ - 1); //one tick
+	  TIM_UPDATE_EVENT(TIM2); //load PSC now rather than at the first overflow
 	  TIM2->DIER |= (1 << 0);          // Enable update interrupt
 	  NVIC_SetPriority(TIM2_IRQn, 2); //set priority level at 2
 	  NVIC_EnableIRQ(TIM2_IRQn);       // Enable interrupt in NVIC
 }
 
 //================================================================================================
-// updateARR()
+// configureTIM5()
 //
-// @parm: speed = Desired update frequency (in HZ)
+// @parm: none
 // @return: none
 //
-// 	Recalculates and sets TIM2's ARR register based on the specified speed. This directly
-//	affects how often the timer overflows and triggers an interrupt. The timer counter (CNT)
-//	is also reset to ensure immediate effect.
+// 	Starts TIM5 as a free-running 32-bit microsecond counter, read through usTimer. Used to
+//	timestamp button edges inside the EXTI handlers, where msTimer can be stale because
+//	SysTick has the lowest priority. No interrupt; the count wraps every ~71 minutes, which
+//	unsigned subtraction handles.
 //================================================================================================
-void updateARR (uint32_t speed)
+void configureTIM5 (void)
 {
-	  TIM2->ARR = (cntclk/speed - 1); //update ARR value
-	  TIM2->CNT = 0; //reset timer counter
+	  RCC->APB1ENR1 |= (1 << 3);  // Enable TIM5 clock
+	  TIM5->CR1 |= (1 << 2); //URS, as TIM2
+	  TIM5->PSC = (core_clock.hz/usclk -1);
+	  TIM5->ARR = 0xFFFFFFFF; //count through all 32 bits
+	  TIM_UPDATE_EVENT(TIM5); //load PSC now rather than at the first overflow
+	  TIM5->CR1 |= (1 << 0); //start timer
 }
@@ -16,6 +16,6 @@
 
 void configureSysTickInterrupt(void);
 void configureTIM2 (void);
-void updateARR (uint32_t speed);
+void configureTIM5 (void);
 
 #endif /* TIMERS_H_ */